@@ -0,0 +1,917 @@
+//-----------------------------------------------------------------------------
+//
+// Zandronum Source
+// Copyright (C) 2015 Zandronum Development Team
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the Zandronum Development Team nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+// 4. Redistributions in any form must be accompanied by information on how to
+//    obtain complete source code for the software and any accompanying
+//    software that uses the software. The source code must either be included
+//    in the distribution or be available for no more than the cost of
+//    distribution plus a nominal fee, and must be freely redistributable
+//    under reasonable conditions. For an executable file, complete source
+//    code means the source code for all modules it contains. It does not
+//    include source code for modules or files that typically accompany the
+//    major components of the operating system on which the executable file
+//    runs.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Filename: main.cpp
+//
+// Description: Headless clients that connect to a server over the loopback
+// interface, send scripted movement every tic and measure the latency, the
+// packet loss and the traffic of each client. The clients don't load any WADs,
+// so the server has to be started with sv_allowloadtestclients.
+//
+// The clients only look at the packet headers. The latency is measured by
+// asking the server to resend the latest reliable packet a client received,
+// the server answers such requests right away.
+//
+//-----------------------------------------------------------------------------
+
+#include "../src/networkheaders.h"
+#include "../src/networkshared.h"
+#include "../src/network_protocol.h"
+#include "../src/version.h"
+#include "network.h"
+#include "main.h"
+#include <vector>
+
+// Needed for I_MSTime.
+#ifdef _MSC_VER
+#include <mmsystem.h>
+#endif
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+//*****************************************************************************
+//	VARIABLES
+
+// The emulated clients.
+static	LOADCLIENT_s					g_Clients[MAX_LOAD_CLIENTS];
+static	ULONG							g_ulNumClients = 8;
+
+// The server we are testing.
+static	NETADDRESS_s					g_ServerAddress;
+
+// Message buffer we write the commands of the clients to.
+static	NETBUFFER_s						g_MessageBuffer;
+
+// The movement every client repeats. The clients start at different steps.
+static	std::vector<LOADSCRIPTSTEP_s>	g_Script;
+
+// What we send when connecting.
+static	std::string						g_Password;
+static	int								g_iNetGameVersion;
+static	bool							g_bStartAsSpectator = false;
+
+// How long to wait between the connection attempts of two clients.
+static	ULONG							g_ulConnectInterval = 100;
+
+// Time in ms when the test started.
+static	ULONG							g_ulStartTime;
+
+//*****************************************************************************
+//	FUNCTIONS
+
+// Returns time in milliseconds
+ULONG I_MSTime( void )
+{
+#ifdef _MSC_VER
+	static DWORD  basetime;
+	DWORD         tm;
+
+	tm = timeGetTime();
+	if (!basetime)
+		basetime = tm;
+
+	return (tm-basetime);
+#else
+	struct timeval tv;
+	long long int thistimereply;
+	static long long int basetime;
+
+	gettimeofday(&tv, NULL);
+
+	thistimereply = tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+
+	if (!basetime)
+		basetime = thistimereply;
+
+	return static_cast<ULONG>(thistimereply - basetime);
+#endif
+}
+
+//*****************************************************************************
+//
+void LOADGEN_UseDefaultScript( void )
+{
+	// Run around, turn, strafe, jump and press use.
+	static const LOADSCRIPTSTEP_s	s_DefaultScript[] =
+	{
+		{ 70,	12800,	0,		0,		0 },
+		{ 35,	0,		0,		1280,	0 },
+		{ 70,	0,		10240,	0,		0 },
+		{ 35,	12800,	0,		-640,	4 },
+		{ 35,	-12800,	0,		0,		2 },
+	};
+
+	g_Script.assign( s_DefaultScript, s_DefaultScript + sizeof( s_DefaultScript ) / sizeof( s_DefaultScript[0] ));
+}
+
+//*****************************************************************************
+//
+// Every line of a script is "tics forwardmove sidemove yaw [buttons]" with the
+// values of a ticcmd. Lines starting with # are ignored.
+//
+bool LOADGEN_ParseScript( const char *pszFileName )
+{
+	FILE	*pFile;
+	char	szLine[256];
+	ULONG	ulLine = 0;
+
+	if (( pFile = fopen( pszFileName, "r" )) == NULL )
+	{
+		std::cerr << GenerateCouldNotOpenFileErrorString( "LOADGEN_ParseScript", pszFileName, errno );
+		return ( false );
+	}
+
+	g_Script.clear( );
+	while ( fgets( szLine, sizeof( szLine ), pFile ))
+	{
+		LOADSCRIPTSTEP_s	Step;
+		int					iTics;
+		int					iForwardMove;
+		int					iSideMove;
+		int					iYaw;
+		unsigned int		uButtons = 0;
+
+		ulLine++;
+
+		const char *pszLine = szLine;
+		while ( isspace( static_cast<unsigned char>( *pszLine )))
+			pszLine++;
+
+		if (( *pszLine == 0 ) || ( *pszLine == '#' ))
+			continue;
+
+		if (( sscanf( pszLine, "%d %d %d %d %u", &iTics, &iForwardMove, &iSideMove, &iYaw, &uButtons ) < 4 ) || ( iTics <= 0 ))
+		{
+			std::cerr << pszFileName << ":" << ulLine << ": Expected \"tics forwardmove sidemove yaw [buttons]\".\n";
+			fclose( pFile );
+			return ( false );
+		}
+
+		Step.ulTics = iTics;
+		Step.sForwardMove = static_cast<short>( iForwardMove );
+		Step.sSideMove = static_cast<short>( iSideMove );
+		Step.sYaw = static_cast<short>( iYaw );
+		Step.ulButtons = uButtons;
+		g_Script.push_back( Step );
+	}
+
+	fclose( pFile );
+
+	if ( g_Script.size( ) == 0 )
+	{
+		std::cerr << pszFileName << ": The script is empty.\n";
+		return ( false );
+	}
+
+	return ( true );
+}
+
+//*****************************************************************************
+//
+void LOADGEN_InitClient( LOADCLIENT_s &Client, ULONG ulIdx )
+{
+	Client.Socket = NETWORK_AllocateClientSocket( );
+	Client.State = ( Client.Socket == INVALID_SOCKET ) ? LCS_DISCONNECTED : LCS_CONNECTING;
+	Client.ErrorString = ( Client.Socket == INVALID_SOCKET ) ? "No socket" : "";
+
+	Client.ulLastRequestTime = 0;
+	Client.ulNumRequests = 0;
+	Client.lServerGametic = 0;
+	Client.ulServerGameticTime = 0;
+
+	// Spread the clients over the script, so that they don't all do the same at the same time.
+	Client.ulGametic = 0;
+	Client.ulScriptStep = ulIdx % g_Script.size( );
+	Client.ulScriptTic = 0;
+	Client.ulAngle = 0;
+
+	Client.lFirstSequence = -1;
+	Client.lHighestSequence = -1;
+	Client.ulReliablePackets = 0;
+	Client.ulOutOfOrderPackets = 0;
+	Client.ulUnreliablePackets = 0;
+
+	Client.lProbeSequence = -1;
+	Client.ulProbeTime = 0;
+	Client.ulNumProbes = 0;
+	Client.ulNumLostProbes = 0;
+	Client.ulNumLatencySamples = 0;
+	Client.ulLatencySum = 0;
+	Client.ulLatencyMin = 0;
+	Client.ulLatencyMax = 0;
+
+	Client.qwBytesSent = 0;
+	Client.qwBytesReceived = 0;
+	Client.qwDecodedBytesReceived = 0;
+}
+
+//*****************************************************************************
+//
+void LOADGEN_LaunchClientPacket( LOADCLIENT_s &Client )
+{
+	Client.qwBytesSent += NETWORK_LaunchPacket( Client.Socket, &g_MessageBuffer, g_ServerAddress );
+	NETWORK_ClearBuffer( &g_MessageBuffer );
+}
+
+//*****************************************************************************
+//
+void LOADGEN_Disconnect( LOADCLIENT_s &Client, const char *pszReason )
+{
+	Client.State = LCS_DISCONNECTED;
+	Client.ErrorString = pszReason;
+	std::cerr << "Client " << ( &Client - g_Clients ) << ": " << pszReason << std::endl;
+}
+
+//*****************************************************************************
+//
+void LOADGEN_SendConnectionRequest( LOADCLIENT_s &Client, ULONG ulTime )
+{
+	NETWORK_ClearBuffer( &g_MessageBuffer );
+
+	switch ( Client.State )
+	{
+	case LCS_CONNECTING:
+
+		NETWORK_WriteByte( &g_MessageBuffer.ByteStream, CLCC_ATTEMPTCONNECTION );
+		NETWORK_WriteString( &g_MessageBuffer.ByteStream, DOTVERSIONSTR );
+		NETWORK_WriteString( &g_MessageBuffer.ByteStream, g_Password.c_str( ));
+		// CCF_STARTASSPECTATOR
+		NETWORK_WriteByte( &g_MessageBuffer.ByteStream, g_bStartAsSpectator ? 1 : 0 );
+		NETWORK_WriteByte( &g_MessageBuffer.ByteStream, g_iNetGameVersion );
+		// We don't have the lumps, the server doesn't check this for us.
+		NETWORK_WriteString( &g_MessageBuffer.ByteStream, "" );
+		break;
+	case LCS_AUTHENTICATING:
+
+		// We don't have the map either. Pretend it's UDMF and send empty TEXTMAP and BEHAVIOR checksums.
+		NETWORK_WriteByte( &g_MessageBuffer.ByteStream, CLCC_ATTEMPTAUTHENTICATION );
+		NETWORK_WriteByte( &g_MessageBuffer.ByteStream, 1 );
+		NETWORK_WriteString( &g_MessageBuffer.ByteStream, "" );
+		NETWORK_WriteString( &g_MessageBuffer.ByteStream, "" );
+		break;
+	default:
+
+		return;
+	}
+
+	Client.ulLastRequestTime = ulTime;
+	Client.ulNumRequests++;
+	LOADGEN_LaunchClientPacket( Client );
+}
+
+//*****************************************************************************
+//
+void LOADGEN_RequestSnapshot( LOADCLIENT_s &Client )
+{
+	char	szName[32];
+
+	sprintf( szName, "LoadClient%d", static_cast<int>( &Client - g_Clients ));
+
+	// The server insists on the full userinfo (except the class).
+	NETWORK_ClearBuffer( &g_MessageBuffer );
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, CLCC_REQUESTSNAPSHOT );
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, CLC_USERINFO );
+	NETWORK_WriteShort( &g_MessageBuffer.ByteStream, USERINFO_ALL & ~USERINFO_PLAYERCLASS );
+	NETWORK_WriteString( &g_MessageBuffer.ByteStream, szName );
+	// Gender
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, 0 );
+	// Color
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, 0x40cf00 );
+	// Aim distance
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, 0 );
+	NETWORK_WriteString( &g_MessageBuffer.ByteStream, "base" );
+	// Rail color
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, 0 );
+	// Handicap
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, 0 );
+	// Tics per update
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, 1 );
+	// Connection type
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, 1 );
+	// Client flags
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, 0 );
+	// Rate, unlimited
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, 0 );
+	LOADGEN_LaunchClientPacket( Client );
+
+	// Only the packets of the game itself count.
+	Client.State = LCS_INGAME;
+	Client.lFirstSequence = -1;
+	Client.lHighestSequence = -1;
+	Client.ulReliablePackets = 0;
+	Client.ulOutOfOrderPackets = 0;
+}
+
+//*****************************************************************************
+//
+void LOADGEN_UpdateConnection( LOADCLIENT_s &Client, ULONG ulTime )
+{
+	const ULONG ulIdx = &Client - g_Clients;
+
+	if (( Client.State != LCS_CONNECTING ) && ( Client.State != LCS_AUTHENTICATING ))
+		return;
+
+	// The clients connect one after another.
+	if ( Client.ulNumRequests == 0 )
+	{
+		if ( ulTime - g_ulStartTime >= ulIdx * g_ulConnectInterval )
+			LOADGEN_SendConnectionRequest( Client, ulTime );
+		return;
+	}
+
+	if ( ulTime - Client.ulLastRequestTime < CONNECTION_RESEND_MS )
+		return;
+
+	if ( Client.ulNumRequests >= MAX_CONNECTION_ATTEMPTS )
+	{
+		LOADGEN_Disconnect( Client, ( Client.State == LCS_CONNECTING ) ? "The server didn't answer." : "The server didn't accept the level authentication. Is sv_allowloadtestclients on?" );
+		return;
+	}
+
+	LOADGEN_SendConnectionRequest( Client, ulTime );
+}
+
+//*****************************************************************************
+//
+void LOADGEN_SendClientMove( LOADCLIENT_s &Client, ULONG ulTime )
+{
+	const LOADSCRIPTSTEP_s	&Step = g_Script[Client.ulScriptStep];
+	ULONG					ulBits = 0;
+
+	if ( Step.sYaw )
+		ulBits |= CLIENT_UPDATE_YAW;
+	if ( Step.ulButtons )
+	{
+		ulBits |= CLIENT_UPDATE_BUTTONS;
+		if ( Step.ulButtons > 0xFF )
+			ulBits |= CLIENT_UPDATE_BUTTONS_LONG;
+	}
+	if ( Step.sForwardMove )
+		ulBits |= CLIENT_UPDATE_FORWARDMOVE;
+	if ( Step.sSideMove )
+		ulBits |= CLIENT_UPDATE_SIDEMOVE;
+
+	// The gametic the server told us when we connected plus the time since then.
+	// One tic less, the server ignores gametics it didn't reach yet.
+	const LONG lServerGametic = Client.lServerGametic + static_cast<LONG>(( ulTime - Client.ulServerGameticTime ) * LOADGEN_TICRATE / 1000 ) - 1;
+
+	Client.ulAngle += static_cast<ULONG>( Step.sYaw * 65536 );
+
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, CLC_CLIENTMOVE );
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, Client.ulGametic );
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, lServerGametic );
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, ulBits );
+	if ( ulBits & CLIENT_UPDATE_YAW )
+		NETWORK_WriteShort( &g_MessageBuffer.ByteStream, Step.sYaw );
+	if ( ulBits & CLIENT_UPDATE_BUTTONS )
+	{
+		if ( ulBits & CLIENT_UPDATE_BUTTONS_LONG )
+			NETWORK_WriteLong( &g_MessageBuffer.ByteStream, Step.ulButtons );
+		else
+			NETWORK_WriteByte( &g_MessageBuffer.ByteStream, Step.ulButtons );
+	}
+	if ( ulBits & CLIENT_UPDATE_FORWARDMOVE )
+		NETWORK_WriteShort( &g_MessageBuffer.ByteStream, Step.sForwardMove );
+	if ( ulBits & CLIENT_UPDATE_SIDEMOVE )
+		NETWORK_WriteShort( &g_MessageBuffer.ByteStream, Step.sSideMove );
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, Client.ulAngle );
+	// Pitch
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, 0 );
+	// The ticcmd checksum, the server only looks at it when built with LOG_SUSPICIOUS_CLIENTS.
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, 0 );
+	// BT_ATTACK needs the weapon we are firing, we don't know it.
+	if ( Step.ulButtons & 1 )
+		NETWORK_WriteShort( &g_MessageBuffer.ByteStream, 0 );
+	// We don't read the movement of the other players, so no keyframes are acknowledged.
+	NETWORK_WriteShort( &g_MessageBuffer.ByteStream, 0 );
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, 0 );
+
+	LOADGEN_LaunchClientPacket( Client );
+
+	Client.ulGametic++;
+	if ( ++Client.ulScriptTic >= Step.ulTics )
+	{
+		Client.ulScriptTic = 0;
+		Client.ulScriptStep = ( Client.ulScriptStep + 1 ) % g_Script.size( );
+	}
+}
+
+//*****************************************************************************
+//
+void LOADGEN_SendLatencyProbe( LOADCLIENT_s &Client, ULONG ulTime )
+{
+	// Give up on a probe after a while, so that the next one can be sent.
+	if ( Client.lProbeSequence != -1 )
+	{
+		if ( ulTime - Client.ulProbeTime < LATENCY_PROBE_TIMEOUT_MS )
+			return;
+
+		Client.ulNumLostProbes++;
+		Client.lProbeSequence = -1;
+	}
+
+	if (( Client.lHighestSequence < 0 ) || (( Client.ulNumProbes > 0 ) && ( ulTime - Client.ulProbeTime < LATENCY_PROBE_INTERVAL_MS )))
+		return;
+
+	// The latest packet we received is still stored on the server, so it can always be resent.
+	// This goes out together with the next movement.
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, CLC_MISSINGPACKET );
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, Client.lHighestSequence );
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, -1 );
+
+	Client.lProbeSequence = Client.lHighestSequence;
+	Client.ulProbeTime = ulTime;
+	Client.ulNumProbes++;
+}
+
+//*****************************************************************************
+//
+void LOADGEN_CountReliablePacket( LOADCLIENT_s &Client, LONG lSequence )
+{
+	if ( Client.lFirstSequence == -1 )
+	{
+		Client.lFirstSequence = Client.lHighestSequence = lSequence;
+		Client.ulReliablePackets = 1;
+		return;
+	}
+
+	// Part of the connection, we didn't count these.
+	if ( lSequence < Client.lFirstSequence )
+		return;
+
+	if ( lSequence > Client.lHighestSequence )
+		Client.lHighestSequence = lSequence;
+	else
+		Client.ulOutOfOrderPackets++;
+
+	Client.ulReliablePackets++;
+}
+
+//*****************************************************************************
+//
+ULONG LOADGEN_GetNumLostPackets( const LOADCLIENT_s &Client )
+{
+	if ( Client.lFirstSequence == -1 )
+		return ( 0 );
+
+	const ULONG ulExpected = Client.lHighestSequence - Client.lFirstSequence + 1;
+	return ( ulExpected > Client.ulReliablePackets ) ? ( ulExpected - Client.ulReliablePackets ) : 0;
+}
+
+//*****************************************************************************
+//
+const char *LOADGEN_GetErrorCodeString( int iErrorCode )
+{
+	switch ( iErrorCode )
+	{
+	case NETWORK_ERRORCODE_WRONGPASSWORD:				return "Incorrect password.";
+	case NETWORK_ERRORCODE_WRONGVERSION:				return "Incorrect version.";
+	case NETWORK_ERRORCODE_WRONGPROTOCOLVERSION:		return "Different network protocol version, see -netgameversion.";
+	case NETWORK_ERRORCODE_BANNED:						return "Banned.";
+	case NETWORK_ERRORCODE_SERVERISFULL:				return "Server is full.";
+	case NETWORK_ERRORCODE_AUTHENTICATIONFAILED:		return "Level authentication failed. Is sv_allowloadtestclients on?";
+	case NETWORK_ERRORCODE_FAILEDTOSENDUSERINFO:		return "Failed to send userinfo.";
+	case NETWORK_ERRORCODE_TOOMANYCONNECTIONSFROMIP:	return "Too many connections from this IP. Is sv_allowloadtestclients on?";
+	case NETWORK_ERRORCODE_PROTECTED_LUMP_AUTHENTICATIONFAILED:	return "Lump authentication failed. Is sv_allowloadtestclients on?";
+	case NETWORK_ERRORCODE_USERINFOREJECTED:			return "Userinfo rejected.";
+	default:											return "Unknown error.";
+	}
+}
+
+//*****************************************************************************
+//
+void LOADGEN_ParsePacket( LOADCLIENT_s &Client, BYTESTREAM_s *pByteStream, ULONG ulTime )
+{
+	const LONG	lHeader = NETWORK_ReadByte( pByteStream );
+
+	if ( lHeader == SVC_UNRELIABLEPACKET )
+	{
+		Client.ulUnreliablePackets++;
+
+		// Answer the server's ping, then its scoreboard shows the real latency. We don't know
+		// the other commands, so we only see the ping if it's the first one.
+		if (( pByteStream->pbStream < pByteStream->pbStreamEnd ) && ( *pByteStream->pbStream == SVC_PING ))
+		{
+			NETWORK_ReadByte( pByteStream );
+			const LONG lPingTime = NETWORK_ReadLong( pByteStream );
+
+			NETWORK_ClearBuffer( &g_MessageBuffer );
+			NETWORK_WriteByte( &g_MessageBuffer.ByteStream, CLC_PONG );
+			NETWORK_WriteLong( &g_MessageBuffer.ByteStream, lPingTime );
+			LOADGEN_LaunchClientPacket( Client );
+		}
+		return;
+	}
+
+	// The answer to our latency probe.
+	if ( lHeader == SVC_RETRANSMITTEDPACKETS )
+	{
+		while ( pByteStream->pbStream + 6 <= pByteStream->pbStreamEnd )
+		{
+			const LONG lSequence = NETWORK_ReadLong( pByteStream );
+			const LONG lSize = NETWORK_ReadShort( pByteStream ) & 0xFFFF;
+
+			if ( pByteStream->pbStream + lSize > pByteStream->pbStreamEnd )
+				break;
+			pByteStream->pbStream += lSize;
+
+			if (( Client.lProbeSequence != -1 ) && ( lSequence == Client.lProbeSequence ))
+			{
+				const ULONG ulLatency = ulTime - Client.ulProbeTime;
+
+				if (( Client.ulNumLatencySamples == 0 ) || ( ulLatency < Client.ulLatencyMin ))
+					Client.ulLatencyMin = ulLatency;
+				if ( ulLatency > Client.ulLatencyMax )
+					Client.ulLatencyMax = ulLatency;
+				Client.ulLatencySum += ulLatency;
+				Client.ulNumLatencySamples++;
+				Client.lProbeSequence = -1;
+			}
+		}
+		return;
+	}
+
+	if ( lHeader != SVC_HEADER )
+		return;
+
+	LOADGEN_CountReliablePacket( Client, NETWORK_ReadLong( pByteStream ));
+
+	// Once we are in the game, we don't look into the packets anymore.
+	if (( Client.State != LCS_CONNECTING ) && ( Client.State != LCS_AUTHENTICATING ))
+		return;
+
+	switch ( NETWORK_ReadByte( pByteStream ))
+	{
+	case SVCC_AUTHENTICATE:
+
+		// Map name
+		NETWORK_ReadString( pByteStream );
+		Client.lServerGametic = NETWORK_ReadLong( pByteStream );
+		Client.ulServerGameticTime = ulTime;
+		Client.State = LCS_AUTHENTICATING;
+		Client.ulNumRequests = 0;
+		LOADGEN_SendConnectionRequest( Client, ulTime );
+		break;
+	case SVCC_MAPLOAD:
+
+		// Game mode
+		NETWORK_ReadByte( pByteStream );
+		LOADGEN_RequestSnapshot( Client );
+		break;
+	case SVCC_ERROR:
+		{
+			const int iErrorCode = NETWORK_ReadByte( pByteStream );
+			std::string Reason = LOADGEN_GetErrorCodeString( iErrorCode );
+
+			if ( iErrorCode == NETWORK_ERRORCODE_WRONGVERSION )
+			{
+				Reason += " The server is ";
+				Reason += NETWORK_ReadString( pByteStream );
+				Reason += ".";
+			}
+			LOADGEN_Disconnect( Client, Reason.c_str( ));
+		}
+		break;
+	}
+}
+
+//*****************************************************************************
+//
+void LOADGEN_ReadPackets( ULONG ulTime )
+{
+	for ( ULONG ulIdx = 0; ulIdx < g_ulNumClients; ulIdx++ )
+	{
+		LOADCLIENT_s	&Client = g_Clients[ulIdx];
+
+		if ( Client.Socket == INVALID_SOCKET )
+			continue;
+
+		while ( NETWORK_GetPackets( Client.Socket ) > 0 )
+		{
+			if ( NETWORK_CompareAddress( NETWORK_GetFromAddress( ), g_ServerAddress, false ) == false )
+				continue;
+
+			Client.qwBytesReceived += NETWORK_GetLastPacketEncodedSize( );
+			Client.qwDecodedBytesReceived += NETWORK_GetNetworkMessageBuffer( )->ulCurrentSize;
+
+			if ( Client.State != LCS_DISCONNECTED )
+				LOADGEN_ParsePacket( Client, &NETWORK_GetNetworkMessageBuffer( )->ByteStream, ulTime );
+		}
+	}
+}
+
+//*****************************************************************************
+//
+void LOADGEN_RunTic( ULONG ulTime )
+{
+	for ( ULONG ulIdx = 0; ulIdx < g_ulNumClients; ulIdx++ )
+	{
+		LOADCLIENT_s	&Client = g_Clients[ulIdx];
+
+		if ( Client.State != LCS_INGAME )
+		{
+			LOADGEN_UpdateConnection( Client, ulTime );
+			continue;
+		}
+
+		NETWORK_ClearBuffer( &g_MessageBuffer );
+		LOADGEN_SendLatencyProbe( Client, ulTime );
+		LOADGEN_SendClientMove( Client, ulTime );
+	}
+}
+
+//*****************************************************************************
+//
+void LOADGEN_PrintStatus( ULONG ulTime )
+{
+	ULONG				ulNumInGame = 0;
+	ULONG				ulNumLost = 0;
+	ULONG				ulNumExpected = 0;
+	ULONG				ulLatencySum = 0;
+	ULONG				ulNumLatencySamples = 0;
+	unsigned long long	qwBytesSent = 0;
+	unsigned long long	qwBytesReceived = 0;
+
+	for ( ULONG ulIdx = 0; ulIdx < g_ulNumClients; ulIdx++ )
+	{
+		const LOADCLIENT_s	&Client = g_Clients[ulIdx];
+
+		if ( Client.State == LCS_INGAME )
+			ulNumInGame++;
+
+		ulNumLost += LOADGEN_GetNumLostPackets( Client );
+		ulNumExpected += LOADGEN_GetNumLostPackets( Client ) + Client.ulReliablePackets;
+		ulLatencySum += Client.ulLatencySum;
+		ulNumLatencySamples += Client.ulNumLatencySamples;
+		qwBytesSent += Client.qwBytesSent;
+		qwBytesReceived += Client.qwBytesReceived;
+	}
+
+	const double dSeconds = ( ulTime - g_ulStartTime ) / 1000.0;
+	printf( "%6.1fs: %u/%u in game, latency %.1f ms, loss %.2f%%, sent %.1f KB/s, received %.1f KB/s\n",
+		dSeconds,
+		static_cast<unsigned int>( ulNumInGame ),
+		static_cast<unsigned int>( g_ulNumClients ),
+		ulNumLatencySamples ? static_cast<double>( ulLatencySum ) / ulNumLatencySamples : 0.0,
+		ulNumExpected ? 100.0 * ulNumLost / ulNumExpected : 0.0,
+		dSeconds > 0 ? qwBytesSent / 1024.0 / dSeconds : 0.0,
+		dSeconds > 0 ? qwBytesReceived / 1024.0 / dSeconds : 0.0 );
+}
+
+//*****************************************************************************
+//
+void LOADGEN_WriteReport( FILE *pFile, ULONG ulTime, bool bCSV )
+{
+	static const char	*s_pszStateNames[] = { "connecting", "authenticating", "ingame", "disconnected" };
+	const double		dSeconds = ( ulTime - g_ulStartTime ) / 1000.0;
+
+	if ( bCSV )
+		fprintf( pFile, "client,state,sent,received,decoded,sentpersec,receivedpersec,reliable,unreliable,lost,outoforder,probes,lostprobes,latencymin,latencyavg,latencymax,error\n" );
+	else
+		fprintf( pFile, "\nClient  State           Sent/s  Recv/s  Reliable  Lost  Loss%%   RTT min/avg/max (ms)\n" );
+
+	for ( ULONG ulIdx = 0; ulIdx < g_ulNumClients; ulIdx++ )
+	{
+		const LOADCLIENT_s	&Client = g_Clients[ulIdx];
+		const ULONG			ulLost = LOADGEN_GetNumLostPackets( Client );
+		const double		dLatencyAvg = Client.ulNumLatencySamples ? static_cast<double>( Client.ulLatencySum ) / Client.ulNumLatencySamples : 0.0;
+		const double		dSentPerSec = dSeconds > 0 ? Client.qwBytesSent / dSeconds : 0.0;
+		const double		dReceivedPerSec = dSeconds > 0 ? Client.qwBytesReceived / dSeconds : 0.0;
+
+		if ( bCSV )
+		{
+			fprintf( pFile, "%u,%s,%llu,%llu,%llu,%.0f,%.0f,%u,%u,%u,%u,%u,%u,%u,%.1f,%u,\"%s\"\n",
+				static_cast<unsigned int>( ulIdx ),
+				s_pszStateNames[Client.State],
+				Client.qwBytesSent,
+				Client.qwBytesReceived,
+				Client.qwDecodedBytesReceived,
+				dSentPerSec,
+				dReceivedPerSec,
+				static_cast<unsigned int>( Client.ulReliablePackets ),
+				static_cast<unsigned int>( Client.ulUnreliablePackets ),
+				static_cast<unsigned int>( ulLost ),
+				static_cast<unsigned int>( Client.ulOutOfOrderPackets ),
+				static_cast<unsigned int>( Client.ulNumProbes ),
+				static_cast<unsigned int>( Client.ulNumLostProbes ),
+				static_cast<unsigned int>( Client.ulLatencyMin ),
+				dLatencyAvg,
+				static_cast<unsigned int>( Client.ulLatencyMax ),
+				Client.ErrorString.c_str( ));
+		}
+		else
+		{
+			fprintf( pFile, "%6u  %-14s %7.0f %7.0f  %8u %5u %6.2f   %u/%.1f/%u%s%s\n",
+				static_cast<unsigned int>( ulIdx ),
+				s_pszStateNames[Client.State],
+				dSentPerSec,
+				dReceivedPerSec,
+				static_cast<unsigned int>( Client.ulReliablePackets ),
+				static_cast<unsigned int>( ulLost ),
+				( Client.ulReliablePackets + ulLost ) ? 100.0 * ulLost / ( Client.ulReliablePackets + ulLost ) : 0.0,
+				static_cast<unsigned int>( Client.ulLatencyMin ),
+				dLatencyAvg,
+				static_cast<unsigned int>( Client.ulLatencyMax ),
+				Client.ErrorString.empty( ) ? "" : "  ",
+				Client.ErrorString.c_str( ));
+		}
+	}
+}
+
+//*****************************************************************************
+//
+void LOADGEN_PrintUsage( void )
+{
+	std::cerr << "Usage: loadgen [options]\n"
+		<< "  -host <address[:port]>    Server to test (default 127.0.0.1:" << DEFAULT_SERVER_PORT << ")\n"
+		<< "  -clients <n>              Number of clients (default 8, at most " << MAX_LOAD_CLIENTS << ")\n"
+		<< "  -duration <seconds>       How long to run (default 60)\n"
+		<< "  -script <file>            Movement script, lines of \"tics forwardmove sidemove yaw [buttons]\"\n"
+		<< "  -password <password>      Connect password\n"
+		<< "  -netgameversion <n>       Network protocol version (default " << g_iNetGameVersion << ")\n"
+		<< "  -connectinterval <ms>     Time between the connections of two clients (default 100)\n"
+		<< "  -spectate                 Connect as spectators\n"
+		<< "  -report <file>            Write the results of each client as CSV\n"
+		<< "The server needs sv_allowloadtestclients, it only accepts load test clients from the loopback interface.\n";
+}
+
+//*****************************************************************************
+//
+int main( int argc, char **argv )
+{
+	const char	*pszHost = "127.0.0.1";
+	const char	*pszScript = NULL;
+	const char	*pszReport = NULL;
+	ULONG		ulDuration = 60;
+
+	g_iNetGameVersion = NETGAMEVERSION;
+
+	std::cerr << "=== Zandronum Load Generator ===\n";
+	std::cerr << "Version: " DOTVERSIONSTR "\n";
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		const bool bHasValue = ( i + 1 < argc );
+
+		if (( stricmp( argv[i], "-host" ) == 0 ) && bHasValue )
+			pszHost = argv[++i];
+		else if (( stricmp( argv[i], "-clients" ) == 0 ) && bHasValue )
+			g_ulNumClients = atoi( argv[++i] );
+		else if (( stricmp( argv[i], "-duration" ) == 0 ) && bHasValue )
+			ulDuration = atoi( argv[++i] );
+		else if (( stricmp( argv[i], "-script" ) == 0 ) && bHasValue )
+			pszScript = argv[++i];
+		else if (( stricmp( argv[i], "-password" ) == 0 ) && bHasValue )
+			g_Password = argv[++i];
+		else if (( stricmp( argv[i], "-netgameversion" ) == 0 ) && bHasValue )
+			g_iNetGameVersion = atoi( argv[++i] );
+		else if (( stricmp( argv[i], "-connectinterval" ) == 0 ) && bHasValue )
+			g_ulConnectInterval = atoi( argv[++i] );
+		else if ( stricmp( argv[i], "-spectate" ) == 0 )
+			g_bStartAsSpectator = true;
+		else if (( stricmp( argv[i], "-report" ) == 0 ) && bHasValue )
+			pszReport = argv[++i];
+		else
+		{
+			LOADGEN_PrintUsage( );
+			return ( 1 );
+		}
+	}
+
+	if (( g_ulNumClients == 0 ) || ( g_ulNumClients > MAX_LOAD_CLIENTS ))
+	{
+		LOADGEN_PrintUsage( );
+		return ( 1 );
+	}
+
+	if ( pszScript )
+	{
+		if ( LOADGEN_ParseScript( pszScript ) == false )
+			return ( 1 );
+	}
+	else
+		LOADGEN_UseDefaultScript( );
+
+	NETWORK_Construct( );
+
+	if ( NETWORK_StringToAddress( pszHost, &g_ServerAddress ) == false )
+	{
+		std::cerr << "Couldn't resolve " << pszHost << ".\n";
+		return ( 1 );
+	}
+	if ( g_ServerAddress.usPort == 0 )
+		g_ServerAddress.usPort = htons( DEFAULT_SERVER_PORT );
+	if ( g_ServerAddress.abIP[0] != 127 )
+		std::cerr << "Warning: The server only accepts load test clients from the loopback interface.\n";
+
+	NETWORK_InitBuffer( &g_MessageBuffer, MAX_UDP_PACKET, BUFFERTYPE_WRITE );
+	NETWORK_ClearBuffer( &g_MessageBuffer );
+
+	SOCKET		aSockets[MAX_LOAD_CLIENTS];
+	for ( ULONG ulIdx = 0; ulIdx < g_ulNumClients; ulIdx++ )
+	{
+		LOADGEN_InitClient( g_Clients[ulIdx], ulIdx );
+		aSockets[ulIdx] = g_Clients[ulIdx].Socket;
+	}
+
+	std::cerr << "Testing " << NETWORK_AddressToString( g_ServerAddress ) << " with " << g_ulNumClients << " clients for " << ulDuration << " seconds.\n\n";
+
+	g_ulStartTime = I_MSTime( );
+	ULONG	ulTic = 0;
+	ULONG	ulNextTicTime = g_ulStartTime;
+	ULONG	ulNextStatusTime = g_ulStartTime + 5000;
+	ULONG	ulTime = g_ulStartTime;
+
+	while ( ulTime - g_ulStartTime < ulDuration * 1000 )
+	{
+		// Sleep until a packet arrives or the next tic is due.
+		if ( ulNextTicTime > ulTime )
+			NETWORK_WaitForPackets( aSockets, g_ulNumClients, ulNextTicTime - ulTime );
+
+		ulTime = I_MSTime( );
+		LOADGEN_ReadPackets( ulTime );
+
+		while ( ulTime >= ulNextTicTime )
+		{
+			LOADGEN_RunTic( ulTime );
+			ulTic++;
+			ulNextTicTime = g_ulStartTime + static_cast<ULONG>( ulTic * 1000ULL / LOADGEN_TICRATE );
+		}
+
+		if ( ulTime >= ulNextStatusTime )
+		{
+			LOADGEN_PrintStatus( ulTime );
+			ulNextStatusTime += 5000;
+		}
+	}
+
+	// Leave the server.
+	for ( ULONG ulIdx = 0; ulIdx < g_ulNumClients; ulIdx++ )
+	{
+		if ( g_Clients[ulIdx].State == LCS_INGAME )
+		{
+			NETWORK_ClearBuffer( &g_MessageBuffer );
+			NETWORK_WriteByte( &g_MessageBuffer.ByteStream, CLC_QUIT );
+			LOADGEN_LaunchClientPacket( g_Clients[ulIdx] );
+		}
+	}
+
+	LOADGEN_WriteReport( stdout, ulTime, false );
+	if ( pszReport )
+	{
+		FILE	*pFile = fopen( pszReport, "w" );
+		if ( pFile )
+		{
+			LOADGEN_WriteReport( pFile, ulTime, true );
+			fclose( pFile );
+		}
+		else
+			std::cerr << GenerateCouldNotOpenFileErrorString( "main", pszReport, errno );
+	}
+
+	for ( ULONG ulIdx = 0; ulIdx < g_ulNumClients; ulIdx++ )
+		NETWORK_FreeClientSocket( g_Clients[ulIdx].Socket );
+	NETWORK_FreeBuffer( &g_MessageBuffer );
+	NETWORK_Destruct( );
+
+	return ( 0 );
+}
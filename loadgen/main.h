@@ -0,0 +1,152 @@
+//-----------------------------------------------------------------------------
+//
+// Zandronum Source
+// Copyright (C) 2015 Zandronum Development Team
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the Zandronum Development Team nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+// 4. Redistributions in any form must be accompanied by information on how to
+//    obtain complete source code for the software and any accompanying
+//    software that uses the software. The source code must either be included
+//    in the distribution or be available for no more than the cost of
+//    distribution plus a nominal fee, and must be freely redistributable
+//    under reasonable conditions. For an executable file, complete source
+//    code means the source code for all modules it contains. It does not
+//    include source code for modules or files that typically accompany the
+//    major components of the operating system on which the executable file
+//    runs.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Filename: main.h
+//
+// Description: Headless clients that connect to a server over the loopback
+// interface, send scripted movement and measure what the server sends back.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef	__MAIN_H__
+#define	__MAIN_H__
+
+#include <string>
+
+//*****************************************************************************
+//	DEFINES
+
+// The server can't take more players anyway.
+#define	MAX_LOAD_CLIENTS				64
+
+// The server's tic rate.
+#define	LOADGEN_TICRATE					35
+
+// How long to wait for the server to answer a connection step before asking again.
+#define	CONNECTION_RESEND_MS			1000
+
+// How many times a connection step is sent before the client gives up.
+#define	MAX_CONNECTION_ATTEMPTS			10
+
+// How often each client measures the round trip time.
+#define	LATENCY_PROBE_INTERVAL_MS		1000
+
+// A probe that isn't answered in this time counts as lost.
+#define	LATENCY_PROBE_TIMEOUT_MS		2000
+
+//*****************************************************************************
+enum LOADCLIENTSTATE_e
+{
+	// Sent CLCC_ATTEMPTCONNECTION, waiting for SVCC_AUTHENTICATE.
+	LCS_CONNECTING,
+
+	// Sent CLCC_ATTEMPTAUTHENTICATION, waiting for SVCC_MAPLOAD.
+	LCS_AUTHENTICATING,
+
+	// Requested the snapshot and sends movement every tic.
+	LCS_INGAME,
+
+	// The server refused us or we gave up.
+	LCS_DISCONNECTED,
+};
+
+//*****************************************************************************
+//	STRUCTURES
+
+// One step of the movement script, repeated for ulTics tics.
+typedef struct
+{
+	ULONG			ulTics;
+	short			sForwardMove;
+	short			sSideMove;
+	short			sYaw;
+	ULONG			ulButtons;
+
+} LOADSCRIPTSTEP_s;
+
+typedef struct
+{
+	SOCKET			Socket;
+	LOADCLIENTSTATE_e	State;
+
+	// Why the client is disconnected.
+	std::string		ErrorString;
+
+	// When the current connection step was sent last, and how often.
+	ULONG			ulLastRequestTime;
+	ULONG			ulNumRequests;
+
+	// The server's gametic when it asked us to authenticate, and our time when that arrived.
+	// Together they give an estimate of the server's current gametic.
+	LONG			lServerGametic;
+	ULONG			ulServerGameticTime;
+
+	// Our own gametic and where we are in the script.
+	ULONG			ulGametic;
+	ULONG			ulScriptStep;
+	ULONG			ulScriptTic;
+	ULONG			ulAngle;
+
+	// Reliable packets by sequence number, to find the ones that never arrived.
+	LONG			lFirstSequence;
+	LONG			lHighestSequence;
+	ULONG			ulReliablePackets;
+	ULONG			ulOutOfOrderPackets;
+	ULONG			ulUnreliablePackets;
+
+	// The reliable packet we asked the server to resend to measure the round trip time, -1 if none.
+	LONG			lProbeSequence;
+	ULONG			ulProbeTime;
+	ULONG			ulNumProbes;
+	ULONG			ulNumLostProbes;
+	ULONG			ulNumLatencySamples;
+	ULONG			ulLatencySum;
+	ULONG			ulLatencyMin;
+	ULONG			ulLatencyMax;
+
+	// Traffic in both directions. Received bytes are counted as they came over the wire and after decoding.
+	unsigned long long	qwBytesSent;
+	unsigned long long	qwBytesReceived;
+	unsigned long long	qwDecodedBytesReceived;
+
+} LOADCLIENT_s;
+
+#endif	// __MAIN_H__
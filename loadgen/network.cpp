@@ -0,0 +1,275 @@
+//-----------------------------------------------------------------------------
+//
+// Zandronum Source
+// Copyright (C) 2015 Zandronum Development Team
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the Zandronum Development Team nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+// 4. Redistributions in any form must be accompanied by information on how to
+//    obtain complete source code for the software and any accompanying
+//    software that uses the software. The source code must either be included
+//    in the distribution or be available for no more than the cost of
+//    distribution plus a nominal fee, and must be freely redistributable
+//    under reasonable conditions. For an executable file, complete source
+//    code means the source code for all modules it contains. It does not
+//    include source code for modules or files that typically accompany the
+//    major components of the operating system on which the executable file
+//    runs.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Filename: network.cpp
+//
+// Description: Sockets of the emulated clients. Every client needs its own
+// socket, the server tells the clients apart by their address.
+//
+//-----------------------------------------------------------------------------
+
+#include "../src/networkheaders.h"
+#include "../src/networkshared.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "../src/huffman/huffman.h"
+#include "network.h"
+
+//*****************************************************************************
+//	VARIABLES
+
+// Buffer that holds the data from the most recently received packet.
+static	NETBUFFER_s		g_NetworkMessage;
+
+// Network address that the most recently received packet came from.
+static	NETADDRESS_s	g_AddressFrom;
+
+// Size of the most recently received packet before it was decoded.
+static	LONG			g_lLastPacketEncodedSize;
+
+// Buffer for the Huffman encoding.
+static	UCHAR			g_ucHuffmanBuffer[131072];
+
+//*****************************************************************************
+//	FUNCTIONS
+
+void NETWORK_Construct( void )
+{
+	// Initialize the Huffman buffer.
+	HUFFMAN_Construct( );
+
+#ifdef __WIN32__
+	// [BB] Linux doesn't know WSADATA, so this may not be moved outside the ifdef.
+	WSADATA			WSAData;
+	if ( WSAStartup( 0x0101, &WSAData ))
+	{
+		printf( "Winsock initialization failed!\n" );
+		exit( 1 );
+	}
+#endif
+
+	// Init our read buffer. Huffman decoding may blow up a packet to 8/3 of its size.
+	NETWORK_InitBuffer( &g_NetworkMessage, ((MAX_UDP_PACKET * 8) / 3 + 1), BUFFERTYPE_READ );
+	NETWORK_ClearBuffer( &g_NetworkMessage );
+}
+
+//*****************************************************************************
+//
+void NETWORK_Destruct( void )
+{
+	NETWORK_FreeBuffer( &g_NetworkMessage );
+
+#ifdef __WIN32__
+	WSACleanup( );
+#endif
+}
+
+//*****************************************************************************
+//
+SOCKET NETWORK_AllocateClientSocket( void )
+{
+	SOCKET				Socket;
+	struct sockaddr_in	Address;
+	ULONG				ulArg;
+
+	Socket = socket( PF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if ( Socket == INVALID_SOCKET )
+	{
+		printf( "NETWORK_AllocateClientSocket: Couldn't create socket!\n" );
+		return ( INVALID_SOCKET );
+	}
+
+	// Let the system pick the port.
+	memset( &Address, 0, sizeof( Address ));
+	Address.sin_family = AF_INET;
+	Address.sin_addr.s_addr = INADDR_ANY;
+	Address.sin_port = 0;
+	if ( bind( Socket, (sockaddr *)&Address, sizeof( Address )) == SOCKET_ERROR )
+	{
+		printf( "NETWORK_AllocateClientSocket: Couldn't bind socket: %s\n", strerror( errno ));
+		closesocket( Socket );
+		return ( INVALID_SOCKET );
+	}
+
+	ulArg = true;
+	if ( ioctlsocket( Socket, FIONBIO, &ulArg ) == -1 )
+		printf( "NETWORK_AllocateClientSocket: ioctl FIONBIO: %s\n", strerror( errno ));
+
+	return ( Socket );
+}
+
+//*****************************************************************************
+//
+void NETWORK_FreeClientSocket( SOCKET Socket )
+{
+	if ( Socket != INVALID_SOCKET )
+		closesocket( Socket );
+}
+
+//*****************************************************************************
+//
+int NETWORK_GetPackets( SOCKET Socket )
+{
+	LONG				lNumBytes;
+	INT					iDecodedNumBytes = sizeof(g_ucHuffmanBuffer);
+	struct sockaddr_in	SocketFrom;
+	INT					iSocketFromLength;
+
+	iSocketFromLength = sizeof( SocketFrom );
+
+#ifdef	WIN32
+	lNumBytes = recvfrom( Socket, (char *)g_ucHuffmanBuffer, sizeof( g_ucHuffmanBuffer ), 0, (struct sockaddr *)&SocketFrom, &iSocketFromLength );
+#else
+	lNumBytes = recvfrom( Socket, (char *)g_ucHuffmanBuffer, sizeof( g_ucHuffmanBuffer ), 0, (struct sockaddr *)&SocketFrom, (socklen_t *)&iSocketFromLength );
+#endif
+
+	// No packets or an error (usually "would block"), so don't process anything.
+	if ( lNumBytes <= 0 )
+		return ( 0 );
+
+	// If the number of bytes we're receiving exceeds our buffer size, ignore the packet.
+	if ( lNumBytes >= static_cast<LONG>( g_NetworkMessage.ulMaxSize ))
+		return ( 0 );
+
+	// Decode the huffman-encoded message we received.
+	HUFFMAN_Decode( g_ucHuffmanBuffer, (unsigned char *)g_NetworkMessage.pbData, lNumBytes, &iDecodedNumBytes );
+	g_NetworkMessage.ulCurrentSize = iDecodedNumBytes;
+	g_NetworkMessage.ByteStream.pbStream = g_NetworkMessage.pbData;
+	g_NetworkMessage.ByteStream.pbStreamEnd = g_NetworkMessage.ByteStream.pbStream + g_NetworkMessage.ulCurrentSize;
+	g_lLastPacketEncodedSize = lNumBytes;
+
+	// Store the IP address of the sender.
+	NETWORK_SocketAddressToNetAddress( &SocketFrom, &g_AddressFrom );
+
+	return ( g_NetworkMessage.ulCurrentSize );
+}
+
+//*****************************************************************************
+//
+LONG NETWORK_GetLastPacketEncodedSize( void )
+{
+	return ( g_lLastPacketEncodedSize );
+}
+
+//*****************************************************************************
+//
+NETADDRESS_s NETWORK_GetFromAddress( void )
+{
+	return ( g_AddressFrom );
+}
+
+//*****************************************************************************
+//
+NETBUFFER_s *NETWORK_GetNetworkMessageBuffer( void )
+{
+	return ( &g_NetworkMessage );
+}
+
+//*****************************************************************************
+//
+LONG NETWORK_LaunchPacket( SOCKET Socket, NETBUFFER_s *pBuffer, NETADDRESS_s Address )
+{
+	INT					iNumBytesOut = sizeof(g_ucHuffmanBuffer);
+	struct sockaddr_in	SocketAddress;
+
+	pBuffer->ulCurrentSize = NETWORK_CalcBufferSize( pBuffer );
+
+	// Nothing to do.
+	if ( pBuffer->ulCurrentSize == 0 )
+		return ( 0 );
+
+	// Convert the IP address to a socket address.
+	NETWORK_NetAddressToSocketAddress( Address, SocketAddress );
+
+	HUFFMAN_Encode( (unsigned char *)pBuffer->pbData, g_ucHuffmanBuffer, pBuffer->ulCurrentSize, &iNumBytesOut );
+
+	if ( sendto( Socket, (const char*)g_ucHuffmanBuffer, iNumBytesOut, 0, (struct sockaddr *)&SocketAddress, sizeof( SocketAddress )) == -1 )
+	{
+#ifdef __WIN32__
+		if ( WSAGetLastError( ) != WSAEWOULDBLOCK )
+			printf( "NETWORK_LaunchPacket: Error #%d\n", WSAGetLastError( ));
+#else
+		if (( errno != EWOULDBLOCK ) && ( errno != ECONNREFUSED ))
+			printf( "NETWORK_LaunchPacket: %s\n", strerror( errno ));
+#endif
+		return ( 0 );
+	}
+
+	return ( iNumBytesOut );
+}
+
+//*****************************************************************************
+//
+void NETWORK_WaitForPackets( const SOCKET *pSockets, ULONG ulNumSockets, ULONG ulMS )
+{
+	struct timeval	timeout;
+	fd_set			fdset;
+	SOCKET			MaxSocket = 0;
+
+	FD_ZERO( &fdset );
+	for ( ULONG ulIdx = 0; ulIdx < ulNumSockets; ulIdx++ )
+	{
+		if ( pSockets[ulIdx] == INVALID_SOCKET )
+			continue;
+
+		FD_SET( pSockets[ulIdx], &fdset );
+		if ( pSockets[ulIdx] > MaxSocket )
+			MaxSocket = pSockets[ulIdx];
+	}
+
+	timeout.tv_sec = ulMS / 1000;
+	timeout.tv_usec = ( ulMS % 1000 ) * 1000;
+	select( static_cast<int>( MaxSocket ) + 1, &fdset, NULL, NULL, &timeout );
+}
+
+//*****************************************************************************
+//
+char *NETWORK_AddressToString( NETADDRESS_s Address )
+{
+	static char	s_szAddress[64];
+
+	sprintf( s_szAddress, "%i.%i.%i.%i:%i", Address.abIP[0], Address.abIP[1], Address.abIP[2], Address.abIP[3], ntohs( Address.usPort ));
+
+	return ( s_szAddress );
+}
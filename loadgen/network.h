@@ -0,0 +1,71 @@
+//-----------------------------------------------------------------------------
+//
+// Zandronum Source
+// Copyright (C) 2015 Zandronum Development Team
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the Zandronum Development Team nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+// 4. Redistributions in any form must be accompanied by information on how to
+//    obtain complete source code for the software and any accompanying
+//    software that uses the software. The source code must either be included
+//    in the distribution or be available for no more than the cost of
+//    distribution plus a nominal fee, and must be freely redistributable
+//    under reasonable conditions. For an executable file, complete source
+//    code means the source code for all modules it contains. It does not
+//    include source code for modules or files that typically accompany the
+//    major components of the operating system on which the executable file
+//    runs.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Filename: network.h
+//
+// Description: Sockets of the emulated clients.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __NETWORK_H__
+#define __NETWORK_H__
+
+#include "../src/networkshared.h"
+
+//*****************************************************************************
+//	PROTOTYPES
+
+void			NETWORK_Construct( void );
+void			NETWORK_Destruct( void );
+
+SOCKET			NETWORK_AllocateClientSocket( void );
+void			NETWORK_FreeClientSocket( SOCKET Socket );
+
+int				NETWORK_GetPackets( SOCKET Socket );
+LONG			NETWORK_GetLastPacketEncodedSize( void );
+NETADDRESS_s	NETWORK_GetFromAddress( void );
+NETBUFFER_s		*NETWORK_GetNetworkMessageBuffer( void );
+LONG			NETWORK_LaunchPacket( SOCKET Socket, NETBUFFER_s *pBuffer, NETADDRESS_s Address );
+void			NETWORK_WaitForPackets( const SOCKET *pSockets, ULONG ulNumSockets, ULONG ulMS );
+
+char			*NETWORK_AddressToString( NETADDRESS_s Address );
+
+#endif	// __NETWORK_H__
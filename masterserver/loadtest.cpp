@@ -0,0 +1,395 @@
+//-----------------------------------------------------------------------------
+//
+// Skulltag Master Server Source
+// Copyright (C) 2007-2012 Skulltag Development Team
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the Skulltag Development Team nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+// 4. Redistributions in any form must be accompanied by information on how to
+//    obtain complete source code for the software and any accompanying
+//    software that uses the software. The source code must either be included
+//    in the distribution or be available for no more than the cost of
+//    distribution plus a nominal fee, and must be freely redistributable
+//    under reasonable conditions. For an executable file, complete source
+//    code means the source code for all modules it contains. It does not
+//    include source code for modules or files that typically accompany the
+//    major components of the operating system on which the executable file
+//    runs.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Date created:  10/18/26
+//
+//
+// Filename: loadtest.cpp
+//
+// Description: Emulates servers and launchers inside the master server process.
+// The packets of the emulated clients are injected into the network code, and
+// whatever the master sends to them is answered right away. This way, thousands
+// of servers and launchers from different IPs can be simulated on one machine.
+//
+//-----------------------------------------------------------------------------
+
+#include "../src/networkheaders.h"
+#include "../src/networkshared.h"
+#include "../src/huffman/huffman.h"
+#include "network.h"
+#include "main.h"
+#include "loadtest.h"
+#include <algorithm>
+
+//*****************************************************************************
+//	DEFINES
+
+// Every emulated server IP hosts this many servers.
+#define	LOADTEST_SERVERS_PER_IP		4
+
+// The revision the emulated servers claim to have. It's new enough for split ban lists.
+#define	LOADTEST_SERVER_REVISION	4000
+
+// How long the servers may take to get on the list before the test is aborted (in ms).
+#define	LOADTEST_REGISTRATION_TIMEOUT	60000
+
+// The emulated servers send heartbeats and the launchers request the list this often (in ms).
+#define	LOADTEST_ROUND_INTERVAL		1000
+
+//*****************************************************************************
+//	VARIABLES
+
+// What the user asked for.
+static	unsigned long	g_ulNumServers = 0;
+static	unsigned long	g_ulNumLaunchers = 0;
+static	unsigned long	g_ulNumSeconds = 0;
+
+// Buffer the packets of the emulated servers and launchers are written to.
+static	NETBUFFER_s		g_PacketBuffer;
+
+// Buffer the packets of the master server are decoded to.
+static	UCHAR			g_aucDecodedPacket[( MAX_UDP_PACKET * 8 ) / 3 + 1];
+
+// When the test was started, when all servers were on the list and when the test ended (in ms).
+static	unsigned int	g_uiStartTime = 0;
+static	unsigned int	g_uiRegisteredTime = 0;
+static	bool			g_bRegistered = false;
+static	unsigned int	g_uiEndTime = 0;
+
+// When the current round was started (in ms) and whether the master server is still working on it.
+static	unsigned int	g_uiRoundStartTime = 0;
+static	bool			g_bRoundPending = false;
+
+// Every launcher query comes from a new IP, so that the flood protection doesn't ignore it.
+static	unsigned long	g_ulNextLauncherIP = 0;
+
+// Statistics.
+static	unsigned long	g_ulNumRounds = 0;
+static	unsigned int	g_uiTotalRoundTime = 0;
+static	unsigned int	g_uiMaxRoundTime = 0;
+static	unsigned long	g_ulNumCompleteLists = 0;
+static	unsigned long	g_ulNumIncompleteLists = 0;
+static	unsigned long	g_ulNumIgnoredQueries = 0;
+static	unsigned long	g_ulNumPacketsSent = 0;
+static	unsigned long	g_ulNumBytesSent = 0;
+
+// How many servers the launcher that is currently receiving the list got so far.
+static	unsigned long	g_ulNumServersInList = 0;
+
+//*****************************************************************************
+//	PROTOTYPES
+
+static	NETADDRESS_s	loadtest_GetServerAddress( unsigned long ulServer );
+static	NETADDRESS_s	loadtest_GetLauncherAddress( unsigned long ulLauncher );
+static	void			loadtest_SendServerChallenge( unsigned long ulServer );
+static	void			loadtest_SendLauncherChallenge( unsigned long ulLauncher );
+static	void			loadtest_ReceivePacket( const UCHAR *pucData, INT iNumBytes, NETADDRESS_s Address );
+static	void			loadtest_ParseServerPacket( BYTESTREAM_s *pByteStream, const NETADDRESS_s &Address );
+static	void			loadtest_ParseLauncherPacket( BYTESTREAM_s *pByteStream );
+static	void			loadtest_FinishList( void );
+
+//*****************************************************************************
+//	FUNCTIONS
+
+void LOADTEST_Start( unsigned long ulNumServers, unsigned long ulNumLaunchers, unsigned long ulNumSeconds )
+{
+	g_ulNumServers = ulNumServers;
+	g_ulNumLaunchers = ulNumLaunchers;
+	g_ulNumSeconds = ulNumSeconds;
+
+	NETWORK_InitBuffer( &g_PacketBuffer, MAX_UDP_PACKET, BUFFERTYPE_WRITE );
+	NETWORK_ClearBuffer( &g_PacketBuffer );
+
+	// From now on, nothing is sent or received through the socket.
+	NETWORK_SetPacketSink( loadtest_ReceivePacket );
+
+	std::cerr << "Load test: " << g_ulNumServers << " servers and " << g_ulNumLaunchers << " launchers for " << g_ulNumSeconds << " seconds.\n";
+
+	// All servers introduce themselves at once.
+	g_uiStartTime = I_GetTimeMS( );
+	for ( unsigned long ulIdx = 0; ulIdx < g_ulNumServers; ulIdx++ )
+		loadtest_SendServerChallenge( ulIdx );
+}
+
+//*****************************************************************************
+//
+// Called once per frame of the master server, before the packets are parsed. Returns false when the test is over.
+bool LOADTEST_Tick( void )
+{
+	const unsigned int uiTime = I_GetTimeMS( );
+
+	// The master server parsed all packets of the last round and answered them.
+	if ( g_bRoundPending )
+	{
+		const unsigned int uiRoundTime = uiTime - g_uiRoundStartTime;
+		g_uiTotalRoundTime += uiRoundTime;
+		g_uiMaxRoundTime = std::max( g_uiMaxRoundTime, uiRoundTime );
+		g_ulNumRounds++;
+		g_bRoundPending = false;
+	}
+
+	// Wait until all servers are verified and on the list.
+	if ( g_bRegistered == false )
+	{
+		if ( MASTERSERVER_NumServers( ) < g_ulNumServers )
+		{
+			if ( uiTime - g_uiStartTime < LOADTEST_REGISTRATION_TIMEOUT )
+				return true;
+
+			std::cerr << "Load test: Only " << MASTERSERVER_NumServers( ) << " of " << g_ulNumServers << " servers got on the list. Aborting...\n";
+			g_uiEndTime = uiTime;
+			return false;
+		}
+
+		g_uiRegisteredTime = uiTime;
+		g_bRegistered = true;
+	}
+
+	if ( uiTime - g_uiRegisteredTime >= g_ulNumSeconds * 1000 )
+	{
+		g_uiEndTime = uiTime;
+		return false;
+	}
+
+	if ( uiTime - g_uiRoundStartTime < LOADTEST_ROUND_INTERVAL )
+		return true;
+
+	// Start a new round: every server sends a heartbeat, every launcher asks for the list.
+	g_uiRoundStartTime = uiTime;
+	g_bRoundPending = true;
+
+	for ( unsigned long ulIdx = 0; ulIdx < g_ulNumServers; ulIdx++ )
+		loadtest_SendServerChallenge( ulIdx );
+
+	for ( unsigned long ulIdx = 0; ulIdx < g_ulNumLaunchers; ulIdx++ )
+		loadtest_SendLauncherChallenge( g_ulNextLauncherIP++ );
+
+	return true;
+}
+
+//*****************************************************************************
+//
+void LOADTEST_PrintResults( void )
+{
+	std::cerr << "\n=== Load test results ===\n";
+	std::cerr << "Servers on the list: " << MASTERSERVER_NumServers( ) << " of " << g_ulNumServers;
+	if ( g_bRegistered )
+		std::cerr << ", registered within " << g_uiRegisteredTime - g_uiStartTime << " ms";
+	std::cerr << ".\n";
+
+	std::cerr << "Rounds: " << g_ulNumRounds << " (" << g_ulNumServers << " heartbeats and " << g_ulNumLaunchers << " list requests each).\n";
+	if ( g_ulNumRounds > 0 )
+		std::cerr << "Time to handle a round: " << g_uiTotalRoundTime / g_ulNumRounds << " ms on average, " << g_uiMaxRoundTime << " ms at most.\n";
+
+	std::cerr << "Server lists: " << g_ulNumCompleteLists << " complete, " << g_ulNumIncompleteLists << " incomplete, " << g_ulNumIgnoredQueries << " requests refused.\n";
+	std::cerr << "Sent: " << g_ulNumPacketsSent << " packets, " << g_ulNumBytesSent << " bytes.\n";
+}
+
+//*****************************************************************************
+//
+// The servers are on 10.0.0.1, 10.0.0.2, ... each with LOADTEST_SERVERS_PER_IP ports.
+static NETADDRESS_s loadtest_GetServerAddress( unsigned long ulServer )
+{
+	NETADDRESS_s		Address;
+	const unsigned long	ulIP = ulServer / LOADTEST_SERVERS_PER_IP + 1;
+
+	memset( &Address, 0, sizeof( Address ));
+	Address.abIP[0] = 10;
+	Address.abIP[1] = ( ulIP >> 16 ) & 0xFF;
+	Address.abIP[2] = ( ulIP >> 8 ) & 0xFF;
+	Address.abIP[3] = ulIP & 0xFF;
+	Address.usPort = htons( DEFAULT_SERVER_PORT + ulServer % LOADTEST_SERVERS_PER_IP );
+	return Address;
+}
+
+//*****************************************************************************
+//
+// The launchers are on 100.64.0.0 and up.
+static NETADDRESS_s loadtest_GetLauncherAddress( unsigned long ulLauncher )
+{
+	NETADDRESS_s		Address;
+
+	memset( &Address, 0, sizeof( Address ));
+	Address.abIP[0] = 100;
+	Address.abIP[1] = 64 + (( ulLauncher >> 16 ) & 0x3F );
+	Address.abIP[2] = ( ulLauncher >> 8 ) & 0xFF;
+	Address.abIP[3] = ulLauncher & 0xFF;
+	Address.usPort = htons( DEFAULT_CLIENT_PORT );
+	return Address;
+}
+
+//*****************************************************************************
+//
+static void loadtest_SendServerChallenge( unsigned long ulServer )
+{
+	NETWORK_ClearBuffer( &g_PacketBuffer );
+	NETWORK_WriteLong( &g_PacketBuffer.ByteStream, SERVER_MASTER_CHALLENGE );
+	NETWORK_WriteString( &g_PacketBuffer.ByteStream, "loadtest" );
+	NETWORK_WriteByte( &g_PacketBuffer.ByteStream, true ); // Enforces the ban list.
+	NETWORK_WriteLong( &g_PacketBuffer.ByteStream, LOADTEST_SERVER_REVISION );
+	NETWORK_InjectPacket( &g_PacketBuffer, loadtest_GetServerAddress( ulServer ));
+}
+
+//*****************************************************************************
+//
+static void loadtest_SendLauncherChallenge( unsigned long ulLauncher )
+{
+	NETWORK_ClearBuffer( &g_PacketBuffer );
+	NETWORK_WriteLong( &g_PacketBuffer.ByteStream, LAUNCHER_MASTER_CHALLENGE );
+	NETWORK_WriteShort( &g_PacketBuffer.ByteStream, MASTER_SERVER_VERSION );
+	NETWORK_InjectPacket( &g_PacketBuffer, loadtest_GetLauncherAddress( ulLauncher ));
+}
+
+//*****************************************************************************
+//
+// Everything the master server sends ends up here.
+static void loadtest_ReceivePacket( const UCHAR *pucData, INT iNumBytes, NETADDRESS_s Address )
+{
+	INT				iDecodedNumBytes = sizeof( g_aucDecodedPacket );
+	BYTESTREAM_s	ByteStream;
+
+	g_ulNumPacketsSent++;
+	g_ulNumBytesSent += iNumBytes;
+
+	HUFFMAN_Decode( pucData, g_aucDecodedPacket, iNumBytes, &iDecodedNumBytes );
+	memset( &ByteStream, 0, sizeof( ByteStream ));
+	ByteStream.pbStream = g_aucDecodedPacket;
+	ByteStream.pbStreamEnd = g_aucDecodedPacket + iDecodedNumBytes;
+
+	if ( Address.abIP[0] == 10 )
+		loadtest_ParseServerPacket( &ByteStream, Address );
+	else
+		loadtest_ParseLauncherPacket( &ByteStream );
+}
+
+//*****************************************************************************
+//
+// Answers the master server like a real server would.
+static void loadtest_ParseServerPacket( BYTESTREAM_s *pByteStream, const NETADDRESS_s &Address )
+{
+	const BYTE * const	pbEnd = pByteStream->pbStreamEnd;
+
+	switch ( NETWORK_ReadByte( pByteStream ))
+	{
+	case MASTER_SERVER_VERIFICATION:
+		{
+			const std::string verificationString = NETWORK_ReadString( pByteStream );
+			const int iVerificationInt = NETWORK_ReadLong( pByteStream );
+
+			NETWORK_ClearBuffer( &g_PacketBuffer );
+			NETWORK_WriteLong( &g_PacketBuffer.ByteStream, SERVER_MASTER_VERIFICATION );
+			NETWORK_WriteString( &g_PacketBuffer.ByteStream, verificationString.c_str( ));
+			NETWORK_WriteLong( &g_PacketBuffer.ByteStream, iVerificationInt );
+			NETWORK_InjectPacket( &g_PacketBuffer, Address );
+		}
+		break;
+	case MASTER_SERVER_BANLISTPART:
+	case MASTER_SERVER_BANLIST:
+		{
+			// Only the last part of a ban list is acknowledged.
+			const std::string verificationString = NETWORK_ReadString( pByteStream );
+			if (( pbEnd > pByteStream->pbStream ) && ( pbEnd[-1] == MSB_ENDBANLISTPART ))
+				break;
+
+			NETWORK_ClearBuffer( &g_PacketBuffer );
+			NETWORK_WriteLong( &g_PacketBuffer.ByteStream, SERVER_MASTER_BANLIST_RECEIPT );
+			NETWORK_WriteString( &g_PacketBuffer.ByteStream, verificationString.c_str( ));
+			NETWORK_InjectPacket( &g_PacketBuffer, Address );
+		}
+		break;
+	}
+}
+
+//*****************************************************************************
+//
+// Counts the servers on the list, like a launcher would.
+static void loadtest_ParseLauncherPacket( BYTESTREAM_s *pByteStream )
+{
+	switch ( NETWORK_ReadLong( pByteStream ))
+	{
+	case MSC_BEGINSERVERLISTPART:
+		{
+			int iNumPorts;
+
+			NETWORK_ReadByte( pByteStream ); // Packet number.
+			if ( NETWORK_ReadByte( pByteStream ) != MSC_SERVERBLOCK )
+				break;
+
+			while (( iNumPorts = NETWORK_ReadByte( pByteStream )) > 0 )
+			{
+				NETWORK_ReadLong( pByteStream ); // IP.
+				for ( int i = 0; i < iNumPorts; i++ )
+					NETWORK_ReadShort( pByteStream );
+				g_ulNumServersInList += iNumPorts;
+			}
+
+			if ( NETWORK_ReadByte( pByteStream ) == MSC_ENDSERVERLIST )
+				loadtest_FinishList( );
+		}
+		break;
+	case MSC_BEGINSERVERLIST:
+		while ( NETWORK_ReadByte( pByteStream ) == MSC_SERVER )
+		{
+			NETWORK_ReadLong( pByteStream ); // IP.
+			NETWORK_ReadShort( pByteStream ); // Port.
+			g_ulNumServersInList++;
+		}
+		loadtest_FinishList( );
+		break;
+	case MSC_IPISBANNED:
+	case MSC_REQUESTIGNORED:
+	case MSC_WRONGVERSION:
+
+		g_ulNumIgnoredQueries++;
+		break;
+	}
+}
+
+//*****************************************************************************
+//
+static void loadtest_FinishList( void )
+{
+	if ( g_ulNumServersInList == MASTERSERVER_NumServers( ))
+		g_ulNumCompleteLists++;
+	else
+		g_ulNumIncompleteLists++;
+
+	g_ulNumServersInList = 0;
+}
@@ -53,8 +53,9 @@
 #include "svnrevision.h"
 #include "network.h"
 #include "main.h"
+#include "loadtest.h"
 #include <sstream>
-#include <set>
+#include <algorithm>
 
 // [BB] Needed for I_GetTime.
 #ifdef _MSC_VER
@@ -67,24 +68,16 @@
 //*****************************************************************************
 //	VARIABLES
 
-// [BB] Comparision function, necessary to put SERVER_s entries into a std::set.
-class SERVERCompFunc
-{
-public:
-	bool operator()(SERVER_s s1, SERVER_s s2) const
-	{
-		// [BB] NETWORK_AddressToString uses a static char array to generate the string, so we
-		// need to cache the string conversion of the first string when comparing to two.
-		// Note: Because we need a "<" comparison and not a "!=" comparison we can't use
-		// NETWORK_CompareAddress.
-		std::string address1 = NETWORK_AddressToString ( s1.Address );
-		return ( stricmp ( address1.c_str(), NETWORK_AddressToString ( s2.Address ) ) < 0 );
-	}
-};
-
 // Global server list.
-static	std::set<SERVER_s, SERVERCompFunc> g_Servers;
-static	std::set<SERVER_s, SERVERCompFunc> g_UnverifiedServers;
+static	ServerRegistry			g_Servers;
+static	ServerRegistry			g_UnverifiedServers;
+
+// The encoded replies to LAUNCHER_SERVER_CHALLENGE and LAUNCHER_MASTER_CHALLENGE. They are
+// only rebuilt when the revision of g_Servers changes, not for every launcher.
+static	std::vector<UCHAR>					g_ServerListPacket;
+static	std::vector<std::vector<UCHAR> >	g_ServerListParts;
+static	unsigned long						g_ulServerListRevision = 0;
+static	bool								g_bServerListValid = false;
 
 // Message buffer we write our commands to.
 static	NETBUFFER_s				g_MessageBuffer;
@@ -99,15 +92,19 @@ static	IPList					g_BannedIPExemptions;
 static	IPList					g_MultiServerExceptions;
 
 // IPs of launchers that we've sent full lists to recently.
-static	QueryIPQueue			g_queryIPQueue( 10 );
+static	QueryIPQueue			g_queryIPQueue( 10, MAX_IGNORED_IPS );
 
 // [RC] IPs that are completely ignored.
-static	QueryIPQueue			g_floodProtectionIPQueue( 10 );
-static	QueryIPQueue			g_ShortFloodQueue( 3 );
+static	QueryIPQueue			g_floodProtectionIPQueue( 10, MAX_IGNORED_IPS );
+static	QueryIPQueue			g_ShortFloodQueue( 3, MAX_IGNORED_IPS );
 
 // [BB] Do we want to hide servers that ignore our ban list?
 static	bool					g_bHideBanIgnoringServers = false;
 
+// When the ban list receipts were last checked and the ban lists were last parsed.
+static	int						g_iLastBanlistVerificationTimeout;
+static	int						g_iLastParsingTime;
+
 //*****************************************************************************
 //	CLASSES
 
@@ -186,11 +183,68 @@ private:
 	}
 };
 
+//*****************************************************************************
+//
+SERVER_s *ServerRegistry::find( const NETADDRESS_s &Address )
+{
+	unsigned int *pulIdx = _serverIndices.find( Address );
+	return ( pulIdx != NULL ) ? &_servers[*pulIdx] : NULL;
+}
+
+//*****************************************************************************
+//
+// The server must not be in the registry yet.
+SERVER_s &ServerRegistry::add( const SERVER_s &Server )
+{
+	_serverIndices.insert( Server.Address ) = _servers.size( );
+	_serversPerIP.insert( Server.Address )++;
+	_servers.push_back( Server );
+	markChanged( );
+	return _servers.back( );
+}
+
+//*****************************************************************************
+//
+// The last server takes the place of the removed one, so this changes the index of at most one other server.
+void ServerRegistry::remove( const unsigned int ulIdx )
+{
+	const NETADDRESS_s Address = _servers[ulIdx].Address;
+
+	_serverIndices.remove( Address );
+	if ( --_serversPerIP.insert( Address ) == 0 )
+		_serversPerIP.remove( Address );
+
+	if ( ulIdx + 1 < _servers.size( ))
+	{
+		_servers[ulIdx] = _servers.back( );
+		_serverIndices.insert( _servers[ulIdx].Address ) = ulIdx;
+	}
+	_servers.pop_back( );
+	markChanged( );
+}
+
+//*****************************************************************************
+//
+void ServerRegistry::remove( const NETADDRESS_s &Address )
+{
+	unsigned int *pulIdx = _serverIndices.find( Address );
+	if ( pulIdx != NULL )
+		remove( *pulIdx );
+}
+
+//*****************************************************************************
+//
+unsigned int ServerRegistry::numServersOnIP( const NETADDRESS_s &Address ) const
+{
+	const unsigned int *pulNumServers = _serversPerIP.find( Address );
+	return ( pulNumServers != NULL ) ? *pulNumServers : 0;
+}
+
 //*****************************************************************************
 //	FUNCTIONS
 
-// Returns time in seconds
-int I_GetTime (void)
+// Returns time in milliseconds since the first call. On Linux, this doesn't wrap around.
+static long long int main_GetTime64 (void)
 {
 #ifdef _MSC_VER
 	static DWORD  basetime;
@@ -200,7 +254,7 @@ int I_GetTime (void)
 	if (!basetime)
 		basetime = tm;
 
-	return (tm-basetime)/1000;
+	return (tm-basetime);
 #else
 	struct timeval tv;
 	struct timezone tz;
@@ -214,10 +268,27 @@ int I_GetTime (void)
 	if (!basetime)
 		basetime = thistimereply;
 
-	return (thistimereply - basetime)/1000;
+	return (thistimereply - basetime);
 #endif
 }
 
+//*****************************************************************************
+//
+// Returns time in seconds
+int I_GetTime (void)
+{
+	return static_cast<int>( main_GetTime64() / 1000 );
+}
+
+//*****************************************************************************
+//
+// Returns time in milliseconds. This wraps around after 49.7 days, so it's only good for
+// measuring short durations.
+unsigned int I_GetTimeMS (void)
+{
+	return static_cast<unsigned int>( main_GetTime64() );
+}
+
 //*****************************************************************************
 //
 void MASTERSERVER_SendBanlistToServer( const SERVER_s &Server )
@@ -361,10 +432,10 @@ void MASTERSERVER_InitializeBans( void )
 	if ( BannedIPsChanged || BannedIPExemptionsChanged )
 	{
 		// [BB] The ban list was changed, so no server has the latest list anymore.
-		for( std::set<SERVER_s, SERVERCompFunc>::iterator it = g_Servers.begin(); it != g_Servers.end(); ++it )
+		for ( unsigned int i = 0; i < g_Servers.size( ); ++i )
 		{
-			it->bHasLatestBanList = false;
-			it->bVerifiedLatestBanList = false;
+			g_Servers[i].bHasLatestBanList = false;
+			g_Servers[i].bVerifiedLatestBanList = false;
 		}
 
 		std::cerr << "Ban lists were changed since last refresh\n";
@@ -384,33 +455,122 @@ void MASTERSERVER_InitializeBans( void )
 
 //*****************************************************************************
 //
-void MASTERSERVER_AddServer( const SERVER_s &Server, std::set<SERVER_s, SERVERCompFunc> &ServerSet )
+void MASTERSERVER_AddServer( const SERVER_s &Server, ServerRegistry &Registry )
 {
-	std::set<SERVER_s, SERVERCompFunc>::iterator addedServer = ServerSet.insert ( Server ).first;
+	if ( Registry.find( Server.Address ) != NULL )
+	{
+		printf( "ERROR: %s is already in the list. This should not happen!\n", NETWORK_AddressToString( Server.Address ));
+		return;
+	}
 
-	if ( addedServer == ServerSet.end() )
-		printf( "ERROR: Adding new entry to the set failed. This should not happen!\n" );
+	SERVER_s &addedServer = Registry.add( Server );
+	addedServer.lLastReceived = g_lCurrentTime;
+	if ( &Registry == &g_Servers )
+	{
+		printf( "+ Adding %s (revision %d) to the server list.\n", NETWORK_AddressToString( addedServer.Address ), addedServer.iServerRevision );
+		MASTERSERVER_SendBanlistToServer( addedServer );
+	}
 	else
+		printf( "+ Adding %s (revision %d) to the verification list.\n", NETWORK_AddressToString( addedServer.Address ), addedServer.iServerRevision );
+}
+
+//*****************************************************************************
+//
+// Orders servers by IP and then by port, so that all servers on an IP are next to each other.
+static bool MASTERSERVER_CompareServerAddresses( const SERVER_s *pServer1, const SERVER_s *pServer2 )
+{
+	const int iResult = memcmp( pServer1->Address.abIP, pServer2->Address.abIP, sizeof( pServer1->Address.abIP ));
+	if ( iResult != 0 )
+		return ( iResult < 0 );
+
+	return ( ntohs( pServer1->Address.usPort ) < ntohs( pServer2->Address.usPort ));
+}
+
+//*****************************************************************************
+//
+// Encodes the server list for both launcher protocols, unless it's still up to date.
+void MASTERSERVER_UpdateServerListPackets( void )
+{
+	if ( g_bServerListValid && ( g_ulServerListRevision == g_Servers.getRevision( )))
+		return;
+
+	// [BB] Possibly omit servers that don't enforce our ban list.
+	std::vector<const SERVER_s *> listedServers;
+	listedServers.reserve( g_Servers.size( ));
+	for ( unsigned int i = 0; i < g_Servers.size( ); ++i )
+	{
+		if ( ( g_Servers[i].bEnforcesBanList == true ) || ( g_bHideBanIgnoringServers == false ) )
+			listedServers.push_back( &g_Servers[i] );
+	}
+	std::sort( listedServers.begin( ), listedServers.end( ), MASTERSERVER_CompareServerAddresses );
+
+	// The reply to LAUNCHER_SERVER_CHALLENGE: the whole list in one packet.
+	NETWORK_ClearBuffer( &g_MessageBuffer );
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, MSC_BEGINSERVERLIST );
+	for ( unsigned int i = 0; i < listedServers.size( ); ++i )
+		MASTERSERVER_SendServerIPToLauncher ( listedServers[i]->Address, &g_MessageBuffer.ByteStream );
+
+	// Tell the launcher that we're done sending servers.
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, MSC_ENDSERVERLIST );
+	NETWORK_EncodePacket( &g_MessageBuffer, g_ServerListPacket );
+
+	// The reply to LAUNCHER_MASTER_CHALLENGE: the list split into blocks of servers on the same IP.
+	const unsigned long ulMaxPacketSize = 1024;
+	unsigned long ulPacketNum = 0;
+	unsigned int i = 0;
+
+	g_ServerListParts.clear( );
+	NETWORK_ClearBuffer( &g_MessageBuffer );
+	NETWORK_WriteLong( &g_MessageBuffer.ByteStream, MSC_BEGINSERVERLISTPART );
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, ulPacketNum );
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, MSC_SERVERBLOCK );
+	unsigned long ulSizeOfPacket = 6; // 4 (MSC_BEGINSERVERLISTPART) + 1 (0) + 1 (MSC_SERVERBLOCK)
+
+	while ( i < listedServers.size( ) )
 	{
-		addedServer->lLastReceived = g_lCurrentTime;						
-		if ( &ServerSet == &g_Servers )
+		NETADDRESS_s serverAddress = listedServers[i]->Address;
+		std::vector<USHORT> serverPortList;
+
+		do {
+			serverPortList.push_back ( listedServers[i]->Address.usPort );
+			++i;
+		} while ( ( i < listedServers.size( ) ) && NETWORK_CompareAddress( listedServers[i]->Address, serverAddress, true ) );
+
+		const unsigned long ulServerBlockNetSize = MASTERSERVER_CalcServerIPBlockNetSize( serverAddress, serverPortList );
+
+		// [BB] If sending this block would cause the current packet to exceed ulMaxPacketSize ...
+		if ( ulSizeOfPacket + ulServerBlockNetSize > ulMaxPacketSize - 1 )
 		{
-			printf( "+ Adding %s (revision %d) to the server list.\n", NETWORK_AddressToString( addedServer->Address ), addedServer->iServerRevision );
-			MASTERSERVER_SendBanlistToServer( *addedServer );
+			// [BB] ... close the current packet and start a new one.
+			NETWORK_WriteByte( &g_MessageBuffer.ByteStream, 0 ); // [BB] Terminate MSC_SERVERBLOCK by sending 0 ports.
+			NETWORK_WriteByte( &g_MessageBuffer.ByteStream, MSC_ENDSERVERLISTPART );
+			g_ServerListParts.push_back( std::vector<UCHAR>( ));
+			NETWORK_EncodePacket( &g_MessageBuffer, g_ServerListParts.back( ));
+
+			NETWORK_ClearBuffer( &g_MessageBuffer );
+			++ulPacketNum;
+			ulSizeOfPacket = 5;
+			NETWORK_WriteLong( &g_MessageBuffer.ByteStream, MSC_BEGINSERVERLISTPART );
+			NETWORK_WriteByte( &g_MessageBuffer.ByteStream, ulPacketNum );
+			NETWORK_WriteByte( &g_MessageBuffer.ByteStream, MSC_SERVERBLOCK );
 		}
-		else
-			printf( "+ Adding %s (revision %d) to the verification list.\n", NETWORK_AddressToString( addedServer->Address ), addedServer->iServerRevision );
+		ulSizeOfPacket += ulServerBlockNetSize;
+		MASTERSERVER_SendServerIPBlockToLauncher ( serverAddress, serverPortList, &g_MessageBuffer.ByteStream );
 	}
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, 0 ); // [BB] Terminate MSC_SERVERBLOCK by sending 0 ports.
+	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, MSC_ENDSERVERLIST );
+	g_ServerListParts.push_back( std::vector<UCHAR>( ));
+	NETWORK_EncodePacket( &g_MessageBuffer, g_ServerListParts.back( ));
+
+	g_ulServerListRevision = g_Servers.getRevision( );
+	g_bServerListValid = true;
 }
 
 //*****************************************************************************
 //
-void MASTERSERVER_ParseCommands( BYTESTREAM_s *pByteStream )
+void MASTERSERVER_ParseCommands( BYTESTREAM_s *pByteStream, const NETADDRESS_s &AddressFrom )
 {
 	long			lCommand;
-	NETADDRESS_s	AddressFrom;
-
-	AddressFrom = NETWORK_GetFromAddress( );
 
 	// [RC] If this IP is in our flood queue, ignore it completely.
 	if ( g_floodProtectionIPQueue.addressInQueue( AddressFrom ) || g_ShortFloodQueue.addressInQueue( AddressFrom ))
@@ -463,19 +623,13 @@ void MASTERSERVER_ParseCommands( BYTESTREAM_s *pByteStream )
 			newServer.bNewFormatServer = ( temp != -1 );
 			newServer.iServerRevision = ( ( pByteStream->pbStreamEnd - pByteStream->pbStream ) >= 4 ) ? NETWORK_ReadLong( pByteStream ) : NETWORK_ReadShort( pByteStream );
 
-			std::set<SERVER_s, SERVERCompFunc>::iterator currentServer = g_Servers.find ( newServer );
+			SERVER_s *pCurrentServer = g_Servers.find( AddressFrom );
 
 			// This is a new server; add it to the list.
-			if ( currentServer == g_Servers.end() )
+			if ( pCurrentServer == NULL )
 			{
-				unsigned int iNumOtherServers = 0;
-
 				// First count the number of servers from this IP.
-				for( std::set<SERVER_s, SERVERCompFunc>::const_iterator it = g_Servers.begin(); it != g_Servers.end(); ++it )
-				{
-					if ( NETWORK_CompareAddress( it->Address, AddressFrom, true ))
-						iNumOtherServers++;
-				}
+				const unsigned int iNumOtherServers = g_Servers.numServersOnIP( AddressFrom );
 
 				if ( iNumOtherServers >= 10 && !g_MultiServerExceptions.isIPInList( AddressFrom ))
 					printf( "* More than 10 servers received from %s. Ignoring request...\n", NETWORK_AddressToString( AddressFrom ));
@@ -484,9 +638,8 @@ void MASTERSERVER_ParseCommands( BYTESTREAM_s *pByteStream )
 					// [BB] 3021 is 98d, don't put those servers on the list.
 					if ( ( newServer.bNewFormatServer ) && ( newServer.iServerRevision != 3021 ) )
 					{
-						std::set<SERVER_s, SERVERCompFunc>::iterator currentUnverifiedServer = g_UnverifiedServers.find ( newServer );
 						// [BB] This is a new server, but we still need to verify it.
-						if ( currentUnverifiedServer == g_UnverifiedServers.end() )
+						if ( g_UnverifiedServers.find( AddressFrom ) == NULL )
 						{
 							srand ( time(NULL) );
 							newServer.ServerVerificationInt = rand() + rand() * rand() + rand() * rand() * rand();
@@ -509,11 +662,15 @@ void MASTERSERVER_ParseCommands( BYTESTREAM_s *pByteStream )
 			else
 			{
 				// [BB] Only if the verification string matches.
-				if ( stricmp ( currentServer->MasterBanlistVerificationString.c_str(), newServer.MasterBanlistVerificationString.c_str() ) == 0 )
+				if ( stricmp ( pCurrentServer->MasterBanlistVerificationString.c_str(), newServer.MasterBanlistVerificationString.c_str() ) == 0 )
 				{
-					currentServer->lLastReceived = g_lCurrentTime;
+					pCurrentServer->lLastReceived = g_lCurrentTime;
 					// [BB] The server possibly changed the ban setting, so update it.
-					currentServer->bEnforcesBanList = newServer.bEnforcesBanList;
+					if ( pCurrentServer->bEnforcesBanList != newServer.bEnforcesBanList )
+					{
+						pCurrentServer->bEnforcesBanList = newServer.bEnforcesBanList;
+						g_Servers.markChanged( );
+					}
 				}
 			}
 
@@ -529,17 +686,17 @@ void MASTERSERVER_ParseCommands( BYTESTREAM_s *pByteStream )
 			newServer.MasterBanlistVerificationString = NETWORK_ReadString( pByteStream );
 			newServer.ServerVerificationInt = NETWORK_ReadLong( pByteStream );
 
-			std::set<SERVER_s, SERVERCompFunc>::iterator currentServer = g_UnverifiedServers.find ( newServer );
+			const SERVER_s *pCurrentServer = g_UnverifiedServers.find( AddressFrom );
 
 			// [BB] Apparently, we didn't request any verification from this server, so ignore it.
-			if ( currentServer == g_UnverifiedServers.end() )
+			if ( pCurrentServer == NULL )
 				return;
 
-			if ( ( stricmp ( newServer.MasterBanlistVerificationString.c_str(), currentServer->MasterBanlistVerificationString.c_str() ) == 0 )
-				&& ( newServer.ServerVerificationInt == currentServer->ServerVerificationInt ) )
+			if ( ( stricmp ( newServer.MasterBanlistVerificationString.c_str(), pCurrentServer->MasterBanlistVerificationString.c_str() ) == 0 )
+				&& ( newServer.ServerVerificationInt == pCurrentServer->ServerVerificationInt ) )
 			{
-				MASTERSERVER_AddServer( *currentServer, g_Servers );
-				g_UnverifiedServers.erase ( currentServer );
+				MASTERSERVER_AddServer( *pCurrentServer, g_Servers );
+				g_UnverifiedServers.remove( AddressFrom );
 			}
 			return;
 		}
@@ -549,15 +706,15 @@ void MASTERSERVER_ParseCommands( BYTESTREAM_s *pByteStream )
 			server.Address = AddressFrom;
 			server.MasterBanlistVerificationString = NETWORK_ReadString( pByteStream );
 
-			std::set<SERVER_s, SERVERCompFunc>::iterator currentServer = g_Servers.find ( server );
+			SERVER_s *pCurrentServer = g_Servers.find( AddressFrom );
 
 			// [BB] We don't know the server. Just ignore it.
-			if ( currentServer == g_Servers.end() )
+			if ( pCurrentServer == NULL )
 				return;
 
-			if ( stricmp ( server.MasterBanlistVerificationString.c_str(), currentServer->MasterBanlistVerificationString.c_str() ) == 0 )
+			if ( stricmp ( server.MasterBanlistVerificationString.c_str(), pCurrentServer->MasterBanlistVerificationString.c_str() ) == 0 )
 			{
-				currentServer->bVerifiedLatestBanList = true;
+				pCurrentServer->bVerifiedLatestBanList = true;
 				std::cerr << NETWORK_AddressToString ( AddressFrom ) << " acknowledged receipt of the banlist.\n";
 			}
 		}
@@ -598,78 +755,13 @@ void MASTERSERVER_ParseCommands( BYTESTREAM_s *pByteStream )
 			// Wait 10 seconds before sending this IP the server list again.
 			g_queryIPQueue.addAddress( AddressFrom, g_lCurrentTime, &std::cerr );
 
-			switch ( lCommand )
-			{
-			case LAUNCHER_SERVER_CHALLENGE:
-				// Send the list of servers.
-				NETWORK_WriteLong( &g_MessageBuffer.ByteStream, MSC_BEGINSERVERLIST );
-				for( std::set<SERVER_s, SERVERCompFunc>::const_iterator it = g_Servers.begin(); it != g_Servers.end(); ++it )
-				{
-					// [BB] Possibly omit servers that don't enforce our ban list.
-					if ( ( it->bEnforcesBanList == true ) || ( g_bHideBanIgnoringServers == false ) )
-						MASTERSERVER_SendServerIPToLauncher ( it->Address, &g_MessageBuffer.ByteStream );
-				}
-
-				// Tell the launcher that we're done sending servers.
-				NETWORK_WriteByte( &g_MessageBuffer.ByteStream, MSC_ENDSERVERLIST );
-
-				// Send the launcher our packet.
-				NETWORK_LaunchPacket( &g_MessageBuffer, AddressFrom );
-				return;
-
-			case LAUNCHER_MASTER_CHALLENGE:
-
-				const unsigned long ulMaxPacketSize = 1024;
-				unsigned long ulPacketNum = 0;
-
-				std::set<SERVER_s, SERVERCompFunc>::const_iterator it = g_Servers.begin();
-
-				NETWORK_WriteLong( &g_MessageBuffer.ByteStream, MSC_BEGINSERVERLISTPART );
-				NETWORK_WriteByte( &g_MessageBuffer.ByteStream, ulPacketNum );
-				NETWORK_WriteByte( &g_MessageBuffer.ByteStream, MSC_SERVERBLOCK );
-				unsigned long ulSizeOfPacket = 6; // 4 (MSC_BEGINSERVERLISTPART) + 1 (0) + 1 (MSC_SERVERBLOCK)
-
-				while ( it != g_Servers.end() )
-				{
-					NETADDRESS_s serverAddress = it->Address;
-					std::vector<USHORT> serverPortList;
-
-					do {
-						// [BB] Possibly omit servers that don't enforce our ban list.
-						if ( ( it->bEnforcesBanList == true ) || ( g_bHideBanIgnoringServers == false ) )
-							serverPortList.push_back ( it->Address.usPort );
-						++it;
-					} while ( ( it != g_Servers.end() ) && NETWORK_CompareAddress( it->Address, serverAddress, true ) );
-
-					// [BB] All servers on this IP ignore the list, nothing to send.
-					if ( serverPortList.size() == 0 )
-						continue;
-
-					const unsigned long ulServerBlockNetSize = MASTERSERVER_CalcServerIPBlockNetSize( serverAddress, serverPortList );
-
-					// [BB] If sending this block would cause the current packet to exceed ulMaxPacketSize ...
-					if ( ulSizeOfPacket + ulServerBlockNetSize > ulMaxPacketSize - 1 )
-					{
-						// [BB] ... close the current packet and start a new one.
-						NETWORK_WriteByte( &g_MessageBuffer.ByteStream, 0 ); // [BB] Terminate MSC_SERVERBLOCK by sending 0 ports.
-						NETWORK_WriteByte( &g_MessageBuffer.ByteStream, MSC_ENDSERVERLISTPART );
-						NETWORK_LaunchPacket( &g_MessageBuffer, AddressFrom );
-
-						NETWORK_ClearBuffer( &g_MessageBuffer );
-						++ulPacketNum;
-						ulSizeOfPacket = 5;
-						NETWORK_WriteLong( &g_MessageBuffer.ByteStream, MSC_BEGINSERVERLISTPART );
-						NETWORK_WriteByte( &g_MessageBuffer.ByteStream, ulPacketNum );
-						NETWORK_WriteByte( &g_MessageBuffer.ByteStream, MSC_SERVERBLOCK );
-					}
-					ulSizeOfPacket += ulServerBlockNetSize;
-					MASTERSERVER_SendServerIPBlockToLauncher ( serverAddress, serverPortList, &g_MessageBuffer.ByteStream );
-				}
-				NETWORK_WriteByte( &g_MessageBuffer.ByteStream, 0 ); // [BB] Terminate MSC_SERVERBLOCK by sending 0 ports.
-				NETWORK_WriteByte( &g_MessageBuffer.ByteStream, MSC_ENDSERVERLIST );
-				NETWORK_LaunchPacket( &g_MessageBuffer, AddressFrom );
-				return;
-			}
+			// Send the launcher the list of servers, encoded only if the servers changed since the last launcher.
+			MASTERSERVER_UpdateServerListPackets( );
+			if ( lCommand == LAUNCHER_SERVER_CHALLENGE )
+				NETWORK_LaunchEncodedPacket( &g_ServerListPacket[0], g_ServerListPacket.size( ), AddressFrom );
+			else
+				NETWORK_LaunchEncodedPackets( g_ServerListParts, AddressFrom );
+			return;
 		}
 	}
 
@@ -679,19 +771,19 @@ void MASTERSERVER_ParseCommands( BYTESTREAM_s *pByteStream )
 
 //*****************************************************************************
 //
-void MASTERSERVER_CheckTimeouts( std::set<SERVER_s, SERVERCompFunc> &ServerSet )
+void MASTERSERVER_CheckTimeouts( ServerRegistry &Registry )
 {
-	// [BB] Because we are erasing entries from the set, the iterator has to be incremented inside
-	// the loop, depending on whether and element was erased or not.
-	for( std::set<SERVER_s, SERVERCompFunc>::iterator it = ServerSet.begin(); it != ServerSet.end(); )
+	// Because removing a server moves the last server into its place, the index has to be
+	// incremented inside the loop, depending on whether a server was removed or not.
+	for ( unsigned int i = 0; i < Registry.size( ); )
 	{
+		const SERVER_s &server = Registry[i];
+
 		// If the server has timed out, make it an open slot!
-		if (( g_lCurrentTime - it->lLastReceived ) >= 60 )
+		if (( g_lCurrentTime - server.lLastReceived ) >= 60 )
 		{
-			printf( "- %server at %s timed out.\n", ( &ServerSet == &g_UnverifiedServers ) ? "Unverified s" : "S", NETWORK_AddressToString( it->Address ));
-			// [BB] The standard does not require set::erase to return the incremented operator,
-			// that's why we must use the post increment operator here.
-			ServerSet.erase ( it++ );
+			printf( "- %server at %s timed out.\n", ( &Registry == &g_UnverifiedServers ) ? "Unverified s" : "S", NETWORK_AddressToString( server.Address ));
+			Registry.remove( i );
 			continue;
 		}
 		else
@@ -699,10 +791,10 @@ void MASTERSERVER_CheckTimeouts( std::set<SERVER_s, SERVERCompFunc> &ServerSet )
 			// [BB] If the server doesn't have the latest ban list, send it now.
 			// This construction has the drawback that all servers are updated at once.
 			// Possibly it will be necessary to do this differently.
-			if ( it->bHasLatestBanList == false )
-				MASTERSERVER_SendBanlistToServer( *it );
+			if ( server.bHasLatestBanList == false )
+				MASTERSERVER_SendBanlistToServer( server );
 
-			++it;
+			++i;
 		}
 	}
 }
@@ -715,6 +807,41 @@ void MASTERSERVER_CheckTimeouts( void )
 	MASTERSERVER_CheckTimeouts ( g_UnverifiedServers );
 }
 
+//*****************************************************************************
+//
+// Handles everything that doesn't depend on incoming packets.
+void MASTERSERVER_Tick( void )
+{
+	// Update the ignore queues.
+	g_queryIPQueue.adjustHead ( g_lCurrentTime );
+	g_floodProtectionIPQueue.adjustHead ( g_lCurrentTime );
+	g_ShortFloodQueue.adjustHead ( g_lCurrentTime );
+
+	// See if any servers have timed out.
+	MASTERSERVER_CheckTimeouts( );
+
+	if ( g_lCurrentTime > g_iLastBanlistVerificationTimeout + 10 )
+	{
+		for ( unsigned int i = 0; i < g_Servers.size( ); ++i )
+		{
+			if ( ( g_Servers[i].bVerifiedLatestBanList == false ) && ( g_Servers[i].bNewFormatServer == true ) )
+			{
+				g_Servers[i].bHasLatestBanList = false;
+				std::cerr << "No receipt received from " << NETWORK_AddressToString ( g_Servers[i].Address ) << ". Resending banlist.\n";
+			}
+		}
+		g_iLastBanlistVerificationTimeout = g_lCurrentTime;
+	}
+
+	// [BB] Reparse the ban list every 15 minutes.
+	if ( g_lCurrentTime > g_iLastParsingTime + 15*60 )
+	{
+		std::cerr << "~ Reparsing the ban lists...\n";
+		MASTERSERVER_InitializeBans( );
+		g_iLastParsingTime = g_lCurrentTime;
+	}
+}
+
 //*****************************************************************************
 //
 int main( int argc, char **argv )
@@ -726,6 +853,21 @@ int main( int argc, char **argv )
 
 	std::cerr << "Port: " << DEFAULT_MASTER_PORT << std::endl << std::endl;
 
+	// Instead of the network, the load test emulates servers and launchers in this process.
+	unsigned long ulLoadTestServers = 0;
+	unsigned long ulLoadTestLaunchers = 0;
+	unsigned long ulLoadTestSeconds = 0;
+	for ( int i = 1; i < argc; ++i )
+	{
+		if (( stricmp( argv[i], "-loadtest" ) == 0 ) && ( i + 2 < argc ))
+		{
+			ulLoadTestServers = strtoul( argv[i+1], NULL, 10 );
+			ulLoadTestLaunchers = strtoul( argv[i+2], NULL, 10 );
+			ulLoadTestSeconds = ( i + 3 < argc ) ? strtoul( argv[i+3], NULL, 10 ) : 10;
+		}
+	}
+	const bool bLoadTest = ( ulLoadTestServers > 0 );
+
 	// Initialize the network system.
 	NETWORK_Construct( DEFAULT_MASTER_PORT, ( ( argc >= 4 ) && ( stricmp ( argv[2], "-useip" ) == 0 ) ) ? argv[3] : NULL );
 
@@ -736,8 +878,8 @@ int main( int argc, char **argv )
 	// Initialize the bans subsystem.
 	std::cerr << "Initializing ban list...\n";
 	MASTERSERVER_InitializeBans( );
-	int lastParsingTime = I_GetTime( );
-	int lastBanlistVerificationTimeout = lastParsingTime;
+	g_iLastParsingTime = I_GetTime( );
+	g_iLastBanlistVerificationTimeout = g_iLastParsingTime;
 
 	// [BB] Do we want to hide servers that ignore our ban list?
 	if ( ( argc >= 2 ) && ( stricmp ( argv[1], "-DontHideBanIgnoringServers" ) == 0 ) )
@@ -754,10 +896,20 @@ int main( int argc, char **argv )
 	// Done setting up!
 	std::cerr << "\n=== Master server started! ===\n";
 
+	if ( bLoadTest )
+		LOADTEST_Start( ulLoadTestServers, ulLoadTestLaunchers, ulLoadTestSeconds );
+
 	while ( 1 )
 	{
 		g_lCurrentTime = I_GetTime( );
-		I_DoSelect( );
+
+		if ( bLoadTest )
+		{
+			if ( LOADTEST_Tick( ) == false )
+				break;
+		}
+		else
+			I_DoSelect( );
 	
 		while ( NETWORK_GetPackets( ))
 		{
@@ -767,38 +919,14 @@ int main( int argc, char **argv )
 			pByteStream->pbStreamEnd = pByteStream->pbStream + NETWORK_GetNetworkMessageBuffer( )->ulCurrentSize;
 
 			// Now parse the packet.
-			MASTERSERVER_ParseCommands( pByteStream );
+			MASTERSERVER_ParseCommands( pByteStream, NETWORK_GetFromAddress( ));
 		}
 
-		// Update the ignore queues.
-		g_queryIPQueue.adjustHead ( g_lCurrentTime );
-		g_floodProtectionIPQueue.adjustHead ( g_lCurrentTime );
-		g_ShortFloodQueue.adjustHead ( g_lCurrentTime );
-
-		// See if any servers have timed out.
-		MASTERSERVER_CheckTimeouts( );
-
-		if ( g_lCurrentTime > lastBanlistVerificationTimeout + 10 )
-		{
-			for( std::set<SERVER_s, SERVERCompFunc>::iterator it = g_Servers.begin(); it != g_Servers.end(); ++it )
-			{
-				if ( ( it->bVerifiedLatestBanList == false ) && ( it->bNewFormatServer == true ) )
-				{
-					it->bHasLatestBanList = false;
-					std::cerr << "No receipt received from " << NETWORK_AddressToString ( it->Address ) << ". Resending banlist.\n";
-				}
-			}
-			lastBanlistVerificationTimeout = g_lCurrentTime;
-		}
-
-		// [BB] Reparse the ban list every 15 minutes.
-		if ( g_lCurrentTime > lastParsingTime + 15*60 )
-		{
-			std::cerr << "~ Reparsing the ban lists...\n";
-			MASTERSERVER_InitializeBans( );
-			lastParsingTime = g_lCurrentTime;
-		}
+		MASTERSERVER_Tick( );
 	}	
+
+	if ( bLoadTest )
+		LOADTEST_PrintResults( );
 	
 	return ( 0 );
 }
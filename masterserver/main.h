@@ -61,6 +61,9 @@ typedef int32_t __int32;
 // This is the maximum number of servers we can store in our list. Hopefully ST won't grow so big that this number can't hold them all!
 #define	MAX_SERVERS						512
 
+// How many IPs each of the queues of ignored IPs can hold.
+#define	MAX_IGNORED_IPS					65536
+
 //*****************************************************************************
 //	STRUCTURES
 
@@ -69,9 +72,8 @@ typedef struct
 	// The IP address of this server.
 	NETADDRESS_s	Address;
 
-	// [BB] lLastReceived and bHasLatestBanList don't affect the ordering in the set we are going to
-	// organize the servers in. Thus we can mark them as mutable, which in turn allows us to change
-	// both values using the set iterators.
+	// lLastReceived and bHasLatestBanList don't affect where the server is stored. Thus we can
+	// mark them as mutable, which in turn allows us to change both values through const references.
 
 	// The last time we heard from this server (used for timeouts).
 	mutable long	lLastReceived;
@@ -99,4 +101,55 @@ typedef struct
 
 } SERVER_s;
 
+//*****************************************************************************
+//	CLASSES
+
+//==========================================================================
+//
+// ServerRegistry
+//
+// Stores servers in an array that is indexed by their addresses, so that
+// finding a server or counting the servers on an IP doesn't depend on the
+// number of servers.
+//
+//==========================================================================
+
+class ServerRegistry
+{
+	std::vector<SERVER_s>		_servers;
+
+	// Position of each server in _servers.
+	AddressHashTable			_serverIndices;
+
+	// Number of servers on each IP.
+	AddressHashTable			_serversPerIP;
+
+	// Increased whenever the servers that are sent to the launchers may have changed.
+	unsigned long				_ulRevision;
+
+//*************************************************************************
+public:
+	ServerRegistry( ) : _serverIndices( false ), _serversPerIP( true ), _ulRevision( 0 ) { }
+
+	SERVER_s			*find( const NETADDRESS_s &Address );
+	SERVER_s			&add( const SERVER_s &Server );
+	void				remove( const unsigned int ulIdx );
+	void				remove( const NETADDRESS_s &Address );
+	unsigned int		numServersOnIP( const NETADDRESS_s &Address ) const;
+
+	unsigned int		size( ) const { return _servers.size( ); }
+	SERVER_s			&operator[]( const unsigned int ulIdx ) { return _servers[ulIdx]; }
+	const SERVER_s		&operator[]( const unsigned int ulIdx ) const { return _servers[ulIdx]; }
+
+	unsigned long		getRevision( ) const { return _ulRevision; }
+	void				markChanged( ) { ++_ulRevision; }
+};
+
+//*****************************************************************************
+//	PROTOTYPES
+
+int				I_GetTime( void );
+unsigned int	I_GetTimeMS( void );
+unsigned long	MASTERSERVER_NumServers( void );
+
 #endif	// __MAIN_H__
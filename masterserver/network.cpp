@@ -57,10 +57,16 @@
 
 #include <ctype.h>
 #include <math.h>
+#include <algorithm>
 
 #include "../src/huffman/huffman.h"
 #include "network.h"
 
+// Batched datagram I/O (recvmmsg/sendmmsg) and waiting with epoll are only available under Linux.
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
 //*****************************************************************************
 //	VARIABLES
 
@@ -79,12 +85,41 @@ static	USHORT			g_usLocalPort;
 // Buffer for the Huffman encoding.
 static	UCHAR			g_ucHuffmanBuffer[131072];
 
+// If set, launched packets are handed to this function instead of being sent, and only
+// injected packets are received.
+static	NETWORK_PACKETSINK_f	g_pPacketSink = NULL;
+
+// Packets queued by NETWORK_InjectPacket that NETWORK_GetPackets hasn't returned yet.
+static	std::vector<std::vector<UCHAR> >	g_InjectedPackets;
+static	std::vector<NETADDRESS_s>			g_InjectedPacketAddresses;
+static	unsigned int						g_ulInjectedPacketPosition = 0;
+
+#ifdef __linux__
+// Maximum number of datagrams read by one recvmmsg or sent by one sendmmsg call.
+#define	NETWORK_BATCH_SIZE			64
+
+// Datagrams larger than this are ignored by NETWORK_GetPackets anyway.
+#define	NETWORK_BATCH_RECEIVE_SIZE	(( MAX_UDP_PACKET * 8 ) / 3 + 1 )
+
+// Datagrams read by the last recvmmsg call. NETWORK_GetPackets hands them out one by one.
+static	UCHAR				g_aucReceiveBatch[NETWORK_BATCH_SIZE][NETWORK_BATCH_RECEIVE_SIZE];
+static	struct sockaddr_in	g_ReceiveBatchAddresses[NETWORK_BATCH_SIZE];
+static	struct iovec		g_ReceiveBatchVectors[NETWORK_BATCH_SIZE];
+static	struct mmsghdr		g_ReceiveBatchHeaders[NETWORK_BATCH_SIZE];
+static	int					g_iReceiveBatchSize = 0;
+static	int					g_iReceiveBatchPosition = 0;
+
+// epoll instance watching the socket and the console for I_DoSelect.
+static	int					g_iEpollFD = -1;
+#endif
+
 //*****************************************************************************
 //	PROTOTYPES
 
 static	void			network_Error( const char *pszError );
 static	SOCKET			network_AllocateSocket( void );
 static	bool			network_BindSocketToPort( SOCKET Socket, ULONG ulInAddr, USHORT usPort, bool bReUse );
+static	bool			network_HandleSendError( NETADDRESS_s Address );
 
 //*****************************************************************************
 //	FUNCTIONS
@@ -201,13 +236,72 @@ int NETWORK_GetPackets( void )
 	LONG				lNumBytes;
 	INT					iDecodedNumBytes = sizeof(g_ucHuffmanBuffer);
 	struct sockaddr_in	SocketFrom;
-	INT					iSocketFromLength;
 
-    iSocketFromLength = sizeof( SocketFrom );
+	const UCHAR			*pucData = g_ucHuffmanBuffer;
+
+	// Without the socket, only the injected packets are received.
+	if ( g_pPacketSink != NULL )
+	{
+		if ( g_ulInjectedPacketPosition >= g_InjectedPackets.size( ))
+		{
+			g_InjectedPackets.clear( );
+			g_InjectedPacketAddresses.clear( );
+			g_ulInjectedPacketPosition = 0;
+			return ( 0 );
+		}
+
+		const std::vector<UCHAR> &Packet = g_InjectedPackets[g_ulInjectedPacketPosition];
+		HUFFMAN_Decode( &Packet[0], (unsigned char *)g_NetworkMessage.pbData, Packet.size( ), &iDecodedNumBytes );
+		g_NetworkMessage.ulCurrentSize = iDecodedNumBytes;
+		g_NetworkMessage.ByteStream.pbStream = g_NetworkMessage.pbData;
+		g_NetworkMessage.ByteStream.pbStreamEnd = g_NetworkMessage.ByteStream.pbStream + g_NetworkMessage.ulCurrentSize;
+		g_AddressFrom = g_InjectedPacketAddresses[g_ulInjectedPacketPosition];
+		g_ulInjectedPacketPosition++;
+
+		return ( g_NetworkMessage.ulCurrentSize );
+	}
 
 #ifdef	WIN32
+	INT iSocketFromLength = sizeof( SocketFrom );
 	lNumBytes = recvfrom( g_NetworkSocket, (char *)g_ucHuffmanBuffer, sizeof( g_ucHuffmanBuffer ), 0, (struct sockaddr *)&SocketFrom, &iSocketFromLength );
+#elif defined ( __linux__ )
+	// Read as many datagrams as possible with one system call.
+	if ( g_iReceiveBatchPosition >= g_iReceiveBatchSize )
+	{
+		g_iReceiveBatchPosition = 0;
+		g_iReceiveBatchSize = 0;
+
+		// recvmmsg changes some of the fields, so they need to be set up every time.
+		for ( int i = 0; i < NETWORK_BATCH_SIZE; i++ )
+		{
+			g_ReceiveBatchVectors[i].iov_base = g_aucReceiveBatch[i];
+			g_ReceiveBatchVectors[i].iov_len = NETWORK_BATCH_RECEIVE_SIZE;
+			memset( &g_ReceiveBatchHeaders[i], 0, sizeof( g_ReceiveBatchHeaders[i] ));
+			g_ReceiveBatchHeaders[i].msg_hdr.msg_name = &g_ReceiveBatchAddresses[i];
+			g_ReceiveBatchHeaders[i].msg_hdr.msg_namelen = sizeof( g_ReceiveBatchAddresses[i] );
+			g_ReceiveBatchHeaders[i].msg_hdr.msg_iov = &g_ReceiveBatchVectors[i];
+			g_ReceiveBatchHeaders[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		const int iNumReceived = recvmmsg( g_NetworkSocket, g_ReceiveBatchHeaders, NETWORK_BATCH_SIZE, MSG_DONTWAIT, NULL );
+		if ( iNumReceived > 0 )
+			g_iReceiveBatchSize = iNumReceived;
+	}
+
+	if ( g_iReceiveBatchPosition < g_iReceiveBatchSize )
+	{
+		const struct mmsghdr &Header = g_ReceiveBatchHeaders[g_iReceiveBatchPosition];
+		SocketFrom = g_ReceiveBatchAddresses[g_iReceiveBatchPosition];
+		pucData = g_aucReceiveBatch[g_iReceiveBatchPosition];
+		g_iReceiveBatchPosition++;
+
+		// A truncated datagram is too large for g_NetworkMessage, make sure it's ignored.
+		lNumBytes = ( Header.msg_hdr.msg_flags & MSG_TRUNC ) ? NETWORK_BATCH_RECEIVE_SIZE : Header.msg_len;
+	}
+	else
+		lNumBytes = -1;
 #else
+	INT iSocketFromLength = sizeof( SocketFrom );
 	lNumBytes = recvfrom( g_NetworkSocket, (char *)g_ucHuffmanBuffer, sizeof( g_ucHuffmanBuffer ), 0, (struct sockaddr *)&SocketFrom, (socklen_t *)&iSocketFromLength );
 #endif
 
@@ -253,7 +347,7 @@ int NETWORK_GetPackets( void )
 		return ( 0 );
 
 	// Decode the huffman-encoded message we received.
-	HUFFMAN_Decode( g_ucHuffmanBuffer, (unsigned char *)g_NetworkMessage.pbData, lNumBytes, &iDecodedNumBytes );
+	HUFFMAN_Decode( pucData, (unsigned char *)g_NetworkMessage.pbData, lNumBytes, &iDecodedNumBytes );
 	g_NetworkMessage.ulCurrentSize = iDecodedNumBytes;
 	g_NetworkMessage.ByteStream.pbStream = g_NetworkMessage.pbData;
 	g_NetworkMessage.ByteStream.pbStreamEnd = g_NetworkMessage.ByteStream.pbStream + g_NetworkMessage.ulCurrentSize;
@@ -275,9 +369,7 @@ NETADDRESS_s NETWORK_GetFromAddress( void )
 //
 void NETWORK_LaunchPacket( NETBUFFER_s *pBuffer, NETADDRESS_s Address )
 {
-	LONG				lNumBytes;
 	INT					iNumBytesOut = sizeof(g_ucHuffmanBuffer);
-	struct sockaddr_in	SocketAddress;
 
 	pBuffer->ulCurrentSize = NETWORK_CalcBufferSize( pBuffer );
 
@@ -285,54 +377,167 @@ void NETWORK_LaunchPacket( NETBUFFER_s *pBuffer, NETADDRESS_s Address )
 	if ( pBuffer->ulCurrentSize == 0 )
 		return;
 
-	// Convert the IP address to a socket address.
-	NETWORK_NetAddressToSocketAddress( Address, SocketAddress );
+	HUFFMAN_Encode( (unsigned char *)pBuffer->pbData, g_ucHuffmanBuffer, pBuffer->ulCurrentSize, &iNumBytesOut );
+	NETWORK_LaunchEncodedPacket( g_ucHuffmanBuffer, iNumBytesOut, Address );
+}
+
+//*****************************************************************************
+//
+// Huffman-encodes the buffer, so that it can be sent more than once without encoding it again.
+void NETWORK_EncodePacket( NETBUFFER_s *pBuffer, std::vector<UCHAR> &Encoded )
+{
+	INT					iNumBytesOut = sizeof(g_ucHuffmanBuffer);
+
+	pBuffer->ulCurrentSize = NETWORK_CalcBufferSize( pBuffer );
+	Encoded.clear( );
+
+	if ( pBuffer->ulCurrentSize == 0 )
+		return;
 
 	HUFFMAN_Encode( (unsigned char *)pBuffer->pbData, g_ucHuffmanBuffer, pBuffer->ulCurrentSize, &iNumBytesOut );
+	Encoded.assign( g_ucHuffmanBuffer, g_ucHuffmanBuffer + iNumBytesOut );
+}
+
+//*****************************************************************************
+//
+void NETWORK_LaunchEncodedPacket( const UCHAR *pucData, INT iNumBytes, NETADDRESS_s Address )
+{
+	struct sockaddr_in	SocketAddress;
 
-	lNumBytes = sendto( g_NetworkSocket, (const char*)g_ucHuffmanBuffer, iNumBytesOut, 0, (struct sockaddr *)&SocketAddress, sizeof( SocketAddress ));
+	if ( iNumBytes <= 0 )
+		return;
+
+	if ( g_pPacketSink != NULL )
+	{
+		g_pPacketSink( pucData, iNumBytes, Address );
+		return;
+	}
+
+	// Convert the IP address to a socket address.
+	NETWORK_NetAddressToSocketAddress( Address, SocketAddress );
 
 	// If sendto returns -1, there was an error.
-	if ( lNumBytes == -1 )
+	if ( sendto( g_NetworkSocket, (const char*)pucData, iNumBytes, 0, (struct sockaddr *)&SocketAddress, sizeof( SocketAddress )) == -1 )
+		network_HandleSendError( Address );
+}
+
+//*****************************************************************************
+//
+// Sends all packets to the same address, with as few system calls as possible.
+void NETWORK_LaunchEncodedPackets( const std::vector<std::vector<UCHAR> > &Packets, NETADDRESS_s Address )
+{
+#ifdef __linux__
+	if ( g_pPacketSink == NULL )
 	{
-#ifdef __WIN32__
-		INT	iError = WSAGetLastError( );
+		struct sockaddr_in	SocketAddress;
+		struct iovec		Vectors[NETWORK_BATCH_SIZE];
+		struct mmsghdr		Headers[NETWORK_BATCH_SIZE];
 
-		// Wouldblock is silent.
-		if ( iError == WSAEWOULDBLOCK )
-			return;
+		NETWORK_NetAddressToSocketAddress( Address, SocketAddress );
 
-		switch ( iError )
+		for ( unsigned int ulFirst = 0; ulFirst < Packets.size( ); )
 		{
-		case WSAEACCES:
+			const unsigned int ulNumPackets = std::min<unsigned int>( Packets.size( ) - ulFirst, NETWORK_BATCH_SIZE );
+			for ( unsigned int i = 0; i < ulNumPackets; i++ )
+			{
+				Vectors[i].iov_base = const_cast<UCHAR *>( &Packets[ulFirst + i][0] );
+				Vectors[i].iov_len = Packets[ulFirst + i].size( );
+				memset( &Headers[i], 0, sizeof( Headers[i] ));
+				Headers[i].msg_hdr.msg_name = &SocketAddress;
+				Headers[i].msg_hdr.msg_namelen = sizeof( SocketAddress );
+				Headers[i].msg_hdr.msg_iov = &Vectors[i];
+				Headers[i].msg_hdr.msg_iovlen = 1;
+			}
 
-			printf( "NETWORK_LaunchPacket: Error #%d, WSAEACCES: Permission denied for address: %s\n", iError, NETWORK_AddressToString( Address ));
-			return;
-		case WSAEADDRNOTAVAIL:
+			const int iNumSent = sendmmsg( g_NetworkSocket, Headers, ulNumPackets, 0 );
+			if ( iNumSent > 0 )
+				ulFirst += iNumSent;
+			// The next packet couldn't be sent. Report the error and skip it, like sendto would.
+			else
+			{
+				network_HandleSendError( Address );
+				ulFirst++;
+			}
+		}
+		return;
+	}
+#endif
 
-			printf( "NETWORK_LaunchPacket: Error #%d, WSAEADDRENOTAVAIL: Address %s not available\n", iError, NETWORK_AddressToString( Address ));
-			return;
-		case WSAEHOSTUNREACH:
+	for ( unsigned int i = 0; i < Packets.size( ); i++ )
+	{
+		if ( Packets[i].size( ) > 0 )
+			NETWORK_LaunchEncodedPacket( &Packets[i][0], Packets[i].size( ), Address );
+	}
+}
 
-			printf( "NETWORK_LaunchPacket: Error #%d, WSAEHOSTUNREACH: Address %s unreachable\n", iError, NETWORK_AddressToString( Address ));
-			return;				
-		default:
+//*****************************************************************************
+//
+// Replaces the socket, e.g. to emulate servers and launchers in the same process.
+void NETWORK_SetPacketSink( NETWORK_PACKETSINK_f pSink )
+{
+	g_pPacketSink = pSink;
+}
 
-			printf( "NETWORK_LaunchPacket: Error #%d\n", iError );
-			return;
-		}
+//*****************************************************************************
+//
+// Queues a Huffman-encoded packet, NETWORK_GetPackets returns it as if it was received from Address.
+// Only used together with NETWORK_SetPacketSink.
+void NETWORK_InjectPacket( NETBUFFER_s *pBuffer, NETADDRESS_s Address )
+{
+	g_InjectedPackets.push_back( std::vector<UCHAR>( ));
+	NETWORK_EncodePacket( pBuffer, g_InjectedPackets.back( ));
+	g_InjectedPacketAddresses.push_back( Address );
+
+	// An empty packet would be taken for the end of the queue.
+	if ( g_InjectedPackets.back( ).size( ) == 0 )
+	{
+		g_InjectedPackets.pop_back( );
+		g_InjectedPacketAddresses.pop_back( );
+	}
+}
+
+//*****************************************************************************
+//
+// Prints the error of the last failed send. Returns false if there was no real error.
+static bool network_HandleSendError( NETADDRESS_s Address )
+{
+#ifdef __WIN32__
+	INT	iError = WSAGetLastError( );
+
+	// Wouldblock is silent.
+	if ( iError == WSAEWOULDBLOCK )
+		return false;
+
+	switch ( iError )
+	{
+	case WSAEACCES:
+
+		printf( "NETWORK_LaunchPacket: Error #%d, WSAEACCES: Permission denied for address: %s\n", iError, NETWORK_AddressToString( Address ));
+		return true;
+	case WSAEADDRNOTAVAIL:
+
+		printf( "NETWORK_LaunchPacket: Error #%d, WSAEADDRENOTAVAIL: Address %s not available\n", iError, NETWORK_AddressToString( Address ));
+		return true;
+	case WSAEHOSTUNREACH:
+
+		printf( "NETWORK_LaunchPacket: Error #%d, WSAEHOSTUNREACH: Address %s unreachable\n", iError, NETWORK_AddressToString( Address ));
+		return true;
+	default:
+
+		printf( "NETWORK_LaunchPacket: Error #%d\n", iError );
+		return true;
+	}
 #else
 	if ( errno == EWOULDBLOCK )
-return;
-
-          if ( errno == ECONNREFUSED )
-              return;
+		return false;
 
-		printf( "NETWORK_LaunchPacket: %s\n", strerror( errno ));
-		printf( "NETWORK_LaunchPacket: Address %s\n", NETWORK_AddressToString( Address ));
+	if ( errno == ECONNREFUSED )
+		return false;
 
+	printf( "NETWORK_LaunchPacket: %s\n", strerror( errno ));
+	printf( "NETWORK_LaunchPacket: Address %s\n", NETWORK_AddressToString( Address ));
+	return true;
 #endif
-	}
 }
 
 //*****************************************************************************
@@ -487,6 +692,44 @@ void I_DoSelect (void)
     timeout.tv_usec = 0;
     if (select (static_cast<int>(g_NetworkSocket)+1, &fdset, NULL, NULL, &timeout) == -1)
         return;
+#elif defined ( __linux__ )
+	// Set up the epoll instance the first time we wait.
+	if ( g_iEpollFD == -1 )
+	{
+		struct epoll_event Event;
+		g_iEpollFD = epoll_create( 2 );
+		if ( g_iEpollFD == -1 )
+		{
+			printf( "I_DoSelect: epoll_create: %s\n", strerror( errno ));
+			return;
+		}
+
+		memset( &Event, 0, sizeof( Event ));
+		Event.events = EPOLLIN;
+		Event.data.fd = g_NetworkSocket;
+		epoll_ctl( g_iEpollFD, EPOLL_CTL_ADD, g_NetworkSocket, &Event );
+
+		// This fails if stdin is a regular file, which is fine.
+		if ( do_stdin )
+		{
+			Event.data.fd = 0;
+			epoll_ctl( g_iEpollFD, EPOLL_CTL_ADD, 0, &Event );
+		}
+	}
+
+	// Datagrams of the last recvmmsg call are still waiting to be processed.
+	if ( g_iReceiveBatchPosition < g_iReceiveBatchSize )
+		return;
+
+	struct epoll_event Events[2];
+	const int iNumEvents = epoll_wait( g_iEpollFD, Events, 2, 1000 );
+
+	stdin_ready = 0;
+	for ( int i = 0; i < iNumEvents; i++ )
+	{
+		if ( Events[i].data.fd == 0 )
+			stdin_ready = 1;
+	}
 #else
     struct timeval   timeout;
     fd_set           fdset;
@@ -64,6 +64,12 @@
 // Network messages (universal)
 #define	NETWORK_ERROR			254
 
+//*****************************************************************************
+//	TYPES
+
+// Receives the Huffman-encoded packets instead of the socket, see NETWORK_SetPacketSink.
+typedef void (*NETWORK_PACKETSINK_f)( const UCHAR *pucData, INT iNumBytes, NETADDRESS_s Address );
+
 //*****************************************************************************
 //	PROTOTYPES
 
@@ -73,6 +79,11 @@ int				NETWORK_GetPackets( void );
 int				NETWORK_GetLANPackets( void );
 NETADDRESS_s	NETWORK_GetFromAddress( void );
 void			NETWORK_LaunchPacket( NETBUFFER_s *pBuffer, NETADDRESS_s Address );
+void			NETWORK_EncodePacket( NETBUFFER_s *pBuffer, std::vector<UCHAR> &Encoded );
+void			NETWORK_LaunchEncodedPacket( const UCHAR *pucData, INT iNumBytes, NETADDRESS_s Address );
+void			NETWORK_LaunchEncodedPackets( const std::vector<std::vector<UCHAR> > &Packets, NETADDRESS_s Address );
+void			NETWORK_SetPacketSink( NETWORK_PACKETSINK_f pSink );
+void			NETWORK_InjectPacket( NETBUFFER_s *pBuffer, NETADDRESS_s Address );
 char			*NETWORK_AddressToString( NETADDRESS_s Address );
 char			*NETWORK_AddressToStringIgnorePort( NETADDRESS_s Address );
 void			NETWORK_NetAddressToSocketAddress( NETADDRESS_s &Address, struct sockaddr_in &SocketAddress );
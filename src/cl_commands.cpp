@@ -159,6 +159,8 @@ void CLIENTCOMMANDS_UserInfo( ULONG ulFlags )
 		NETWORK_WriteByte( &CLIENT_GetLocalBuffer( )->ByteStream, players[consoleplayer].userinfo.GetConnectionType() );
 	if ( ulFlags & USERINFO_CLIENTFLAGS )
 		NETWORK_WriteByte( &CLIENT_GetLocalBuffer( )->ByteStream, players[consoleplayer].userinfo.GetClientFlags() ); // [CK] Bitfields are used now.
+	if ( ulFlags & USERINFO_RATE )
+		NETWORK_WriteLong( &CLIENT_GetLocalBuffer( )->ByteStream, players[consoleplayer].userinfo.GetRate() );
 	if (( PlayerClasses.Size( ) > 1 ) && ( ulFlags & USERINFO_PLAYERCLASS ))
 	{
 		if ( players[consoleplayer].userinfo.GetPlayerClassNum() == -1 )
@@ -302,6 +304,13 @@ void CLIENTCOMMANDS_ClientMove( void )
 		else
 			NETWORK_WriteShort( &CLIENT_GetLocalBuffer( )->ByteStream, players[consoleplayer].ReadyWeapon->GetClass( )->getActorNetworkIndex() );
 	}
+
+	// Tell the server which keyframes of the other players' movement we received.
+	USHORT	usNewestKeyframe;
+	ULONG	ulKeyframeBits;
+	CLIENT_GetPlayerMoveKeyframeAcks( usNewestKeyframe, ulKeyframeBits );
+	NETWORK_WriteShort( &CLIENT_GetLocalBuffer( )->ByteStream, usNewestKeyframe );
+	NETWORK_WriteLong( &CLIENT_GetLocalBuffer( )->ByteStream, ulKeyframeBits );
 }
 
 //*****************************************************************************
@@ -160,10 +160,15 @@ static	void	client_Header( BYTESTREAM_s *pByteStream );
 static	void	client_Ping( BYTESTREAM_s *pByteStream );
 static	void	client_BeginSnapshot( BYTESTREAM_s *pByteStream );
 static	void	client_EndSnapshot( BYTESTREAM_s *pByteStream );
+static	void	client_SaveReceivedPacket( LONG lSequence, const BYTE *pbData, LONG lSize );
 
 // Player functions.
 static	void	client_SpawnPlayer( BYTESTREAM_s *pByteStream, bool bMorph = false );
 static	void	client_MovePlayer( BYTESTREAM_s *pByteStream );
+static	void	client_MovePlayerDelta( BYTESTREAM_s *pByteStream );
+static	LONG	client_ReadPlayerMovePositionDelta( BYTESTREAM_s *pByteStream );
+static	void	client_SetPlayerMovement( ULONG ulPlayer, ULONG ulFlags, const PLAYERMOVESTATE_s &State );
+static	void	client_ClearPlayerMoveKeyframes( void );
 static	void	client_DamagePlayer( BYTESTREAM_s *pByteStream );
 static	void	client_KillPlayer( BYTESTREAM_s *pByteStream );
 static	void	client_SetPlayerHealth( BYTESTREAM_s *pByteStream );
@@ -535,6 +540,15 @@ static	LONG				g_lLastCmd;
 // [CK] The most up-to-date server gametic
 static	int				g_lLatestServerGametic = 0;
 
+// The keyframes of the movement of each player we received with SVC_MOVEPLAYERDELTA.
+static	PLAYERMOVESTATE_s	g_PlayerMoveKeyframes[MAXPLAYERS][NUM_PLAYER_MOVE_KEYFRAMES];
+static	ULONG				g_ulNextPlayerMoveKeyframe[MAXPLAYERS];
+
+// The sequence number of the newest keyframe we received. Bit n of g_ulPlayerMoveKeyframeAckBits
+// is set if we received the keyframe with the sequence number g_usNewestPlayerMoveKeyframe - n.
+static	USHORT				g_usNewestPlayerMoveKeyframe;
+static	ULONG				g_ulPlayerMoveKeyframeAckBits;
+
 //*****************************************************************************
 //	FUNCTIONS
 
@@ -907,6 +921,16 @@ void CLIENT_SetLatestServerGametic( int latestServerGametic )
 		g_lLatestServerGametic = latestServerGametic;
 }
 
+//*****************************************************************************
+//
+// Which of the keyframes sent with SVC_MOVEPLAYERDELTA we received. These are sent to the
+// server with every CLC_CLIENTMOVE, the server only uses acknowledged keyframes as baselines.
+void CLIENT_GetPlayerMoveKeyframeAcks( USHORT &usNewestSequence, ULONG &ulBits )
+{
+	usNewestSequence = g_usNewestPlayerMoveKeyframe;
+	ulBits = g_ulPlayerMoveKeyframeAckBits;
+}
+
 void CLIENT_SendServerPacket( void )
 {
 	// Add the size of the packet to the number of bytes sent.
@@ -1277,51 +1301,79 @@ void CLIENT_CheckForMissingPackets( void )
 //
 bool CLIENT_ReadPacketHeader( BYTESTREAM_s *pByteStream )
 {
-	LONG	lIdx;
 	LONG	lCommand;
 	LONG	lSequence;
 
 	// Read in the command. Since it's the first one in the packet, it should be
-	// SVC_HEADER or SVC_UNRELIABLEPACKET.
+	// SVC_HEADER, SVC_UNRELIABLEPACKET or SVC_RETRANSMITTEDPACKETS.
 	lCommand = NETWORK_ReadByte( pByteStream );
 
 	// If this is an unreliable packet, just break out of here and begin parsing it. There's no
 	// need to store it.
 	if ( lCommand == SVC_UNRELIABLEPACKET )
 		return ( true );
-	else
+
+	// The server sends the packets we told it we're missing together. Each one is its
+	// sequence and size followed by the packet itself.
+	if ( lCommand == SVC_RETRANSMITTEDPACKETS )
+	{
+		while ( pByteStream->pbStream + 6 <= pByteStream->pbStreamEnd )
+		{
+			lSequence = NETWORK_ReadLong( pByteStream );
+			const LONG lSize = NETWORK_ReadShort( pByteStream ) & 0xFFFF;
+
+			if (( lSize > MAX_UDP_PACKET ) || ( pByteStream->pbStream + lSize > pByteStream->pbStreamEnd ))
+			{
+				Printf( "CLIENT_ReadPacketHeader: WARNING! Invalid size of retransmitted packet %d!\n", static_cast<int> (lSequence) );
+				break;
+			}
+
+			client_SaveReceivedPacket( lSequence, pByteStream->pbStream, lSize );
+			pByteStream->pbStream += lSize;
+		}
+
+		return ( false );
+	}
 
 	// Read in the sequence. This is the # of the packet the server has sent us.
 	lSequence = NETWORK_ReadLong( pByteStream );
 	if ( lCommand != SVC_HEADER )
 		Printf( "CLIENT_ReadPacketHeader: WARNING! Expected SVC_HEADER or SVC_UNRELIABLEPACKET!\n" );
 
+	client_SaveReceivedPacket( lSequence, pByteStream->pbStream, NETWORK_CalcBufferSize( NETWORK_GetNetworkMessageBuffer( )));
+	return ( false );
+}
+
+//*****************************************************************************
+//
+static void client_SaveReceivedPacket( LONG lSequence, const BYTE *pbData, LONG lSize )
+{
+	LONG	lIdx;
+
 	// Check to see if we've already received this packet. If so, skip it.
 	for ( lIdx = 0; lIdx < PACKET_BUFFER_SIZE; lIdx++ )
 	{
 		if ( g_lPacketSequence[lIdx] == lSequence )
-			return ( false );
+			return;
 	}
 
 	// The end of the buffer has been reached.
-	if (( g_lCurrentPosition + ( NETWORK_CalcBufferSize( NETWORK_GetNetworkMessageBuffer( )))) >= g_ReceivedPacketBuffer.lMaxSize )
+	if (( g_lCurrentPosition + lSize ) >= g_ReceivedPacketBuffer.lMaxSize )
 		g_lCurrentPosition = 0;
 
 	// Save a bunch of information about this incoming packet.
 	g_lPacketBeginning[g_bPacketNum] = g_lCurrentPosition;
-	g_lPacketSize[g_bPacketNum] = NETWORK_CalcBufferSize( NETWORK_GetNetworkMessageBuffer( ));
+	g_lPacketSize[g_bPacketNum] = lSize;
 	g_lPacketSequence[g_bPacketNum] = lSequence;
 
 	// Save the received packet.
-	memcpy( g_ReceivedPacketBuffer.abData + g_lPacketBeginning[g_bPacketNum], NETWORK_GetNetworkMessageBuffer( )->ByteStream.pbStream, NETWORK_CalcBufferSize( NETWORK_GetNetworkMessageBuffer( )));
-	g_lCurrentPosition += NETWORK_CalcBufferSize( NETWORK_GetNetworkMessageBuffer( ));
+	memcpy( g_ReceivedPacketBuffer.abData + g_lPacketBeginning[g_bPacketNum], pbData, lSize );
+	g_lCurrentPosition += lSize;
 
 	if ( lSequence > g_lHighestReceivedSequence )
 		g_lHighestReceivedSequence = lSequence;
 
 	g_bPacketNum++;
-
-	return ( false );
 }
 
 //*****************************************************************************
@@ -1414,6 +1466,9 @@ void CLIENT_ProcessCommand( LONG lCommand, BYTESTREAM_s *pByteStream )
 		// [CK] Use the server's gametic to start at a reasonable number
 		CLIENT_SetLatestServerGametic( NETWORK_ReadLong( pByteStream ) );
 
+		// The keyframes of the previous connection are no baselines of the new one.
+		client_ClearPlayerMoveKeyframes( );
+
 		// [BB] If we don't have the map, something went horribly wrong.
 		if ( P_CheckIfMapExists( g_szMapName ) == false )
 			I_Error ( "SVCC_AUTHENTICATE: Unknown map: %s\n", g_szMapName );
@@ -1603,6 +1658,10 @@ void CLIENT_ProcessCommand( LONG lCommand, BYTESTREAM_s *pByteStream )
 
 		client_MovePlayer( pByteStream );
 		break;
+	case SVC_MOVEPLAYERDELTA:
+
+		client_MovePlayerDelta( pByteStream );
+		break;
 	case SVC_DAMAGEPLAYER:
 
 		client_DamagePlayer( pByteStream );
@@ -2920,7 +2979,7 @@ void CLIENT_PrintCommand( LONG lCommand )
 	{
 		if (( cl_showcommands >= 2 ) && ( lCommand == SVC_MOVELOCALPLAYER ))
 			return;
-		if (( cl_showcommands >= 3 ) && ( lCommand == SVC_MOVEPLAYER ))
+		if (( cl_showcommands >= 3 ) && (( lCommand == SVC_MOVEPLAYER ) || ( lCommand == SVC_MOVEPLAYERDELTA )))
 			return;
 		if (( cl_showcommands >= 4 ) && ( lCommand == SVC_UPDATEPLAYEREXTRADATA ))
 			return;
@@ -4288,46 +4347,155 @@ static void client_SpawnPlayer( BYTESTREAM_s *pByteStream, bool bMorph )
 //
 static void client_MovePlayer( BYTESTREAM_s *pByteStream )
 {
-	ULONG		ulPlayer;
-	bool		bVisible;
-	fixed_t		X = 0;
-	fixed_t		Y = 0;
-	fixed_t		Z = 0;
-	angle_t		Angle = 0;
-	fixed_t		MomX = 0;
-	fixed_t		MomY = 0;
-	fixed_t		MomZ = 0;
-	bool		bCrouching = false;
+	ULONG				ulPlayer;
+	PLAYERMOVESTATE_s	State = { 0 };
 
 	// Read in the player number.
 	ulPlayer = NETWORK_ReadByte( pByteStream );
 
 	// Is this player visible? If not, there's no other information to read in.
 	ULONG ulFlags = NETWORK_ReadByte( pByteStream );
-	bVisible = ( ulFlags & PLAYER_VISIBLE );
 
 	// The server only sends position, angle, etc. information if the player is actually
 	// visible to us.
-	if ( bVisible )
+	if ( ulFlags & PLAYER_VISIBLE )
 	{
 		// Read in the player's XYZ position.
 		// [BB] The x/y position has to be sent at full precision.
-		X = NETWORK_ReadLong( pByteStream );
-		Y = NETWORK_ReadLong( pByteStream );
-		Z = NETWORK_ReadShort( pByteStream ) << FRACBITS;
+		State.X = NETWORK_ReadLong( pByteStream );
+		State.Y = NETWORK_ReadLong( pByteStream );
+		State.sZ = NETWORK_ReadShort( pByteStream );
 
 		// Read in the player's angle.
-		Angle = NETWORK_ReadLong( pByteStream );
+		State.Angle = NETWORK_ReadLong( pByteStream );
 
 		// Read in the player's XYZ momentum.
-		MomX = NETWORK_ReadShort( pByteStream ) << FRACBITS;
-		MomY = NETWORK_ReadShort( pByteStream ) << FRACBITS;
-		MomZ = NETWORK_ReadShort( pByteStream ) << FRACBITS;
+		State.sMomX = NETWORK_ReadShort( pByteStream );
+		State.sMomY = NETWORK_ReadShort( pByteStream );
+		State.sMomZ = NETWORK_ReadShort( pByteStream );
 
 		// Read in whether or not the player's crouching.
-		bCrouching = !!NETWORK_ReadByte( pByteStream );
+		State.bCrouching = !!NETWORK_ReadByte( pByteStream );
+	}
+
+	client_SetPlayerMovement( ulPlayer, ulFlags, State );
+}
+
+//*****************************************************************************
+//
+// Reads the 24 bit fixed point x/y difference of SVC_MOVEPLAYERDELTA, the lower 16 bits come first.
+static LONG client_ReadPlayerMovePositionDelta( BYTESTREAM_s *pByteStream )
+{
+	const LONG lLow = NETWORK_ReadShort( pByteStream ) & 0xFFFF;
+	const LONG lHigh = static_cast<SBYTE>( NETWORK_ReadByte( pByteStream ));
+
+	return ( lHigh * 65536 + lLow );
+}
+
+//*****************************************************************************
+//
+static void client_MovePlayerDelta( BYTESTREAM_s *pByteStream )
+{
+	PLAYERMOVESTATE_s	Baseline = { 0 };
+	PLAYERMOVESTATE_s	State;
+
+	// Read in the player number and the same flags as for SVC_MOVEPLAYER.
+	const ULONG ulPlayer = NETWORK_ReadByte( pByteStream );
+	const ULONG ulFlags = NETWORK_ReadByte( pByteStream );
+
+	// Read in the server tic of this update and how many tics before that the baseline
+	// keyframe was sent. If there's no baseline, this update is a new keyframe.
+	const LONG lTic = NETWORK_ReadShort( pByteStream ) & 0xFFFF;
+	const ULONG ulBaselineDistance = NETWORK_ReadByte( pByteStream );
+	const USHORT usSequence = ( ulBaselineDistance == 0 ) ? NETWORK_ReadShort( pByteStream ) : 0;
+	const ULONG ulBits = NETWORK_ReadShort( pByteStream ) & 0xFFFF;
+	bool bBaselineFound = ( ulBaselineDistance == 0 );
+
+	if (( bBaselineFound == false ) && ( ulPlayer < MAXPLAYERS ))
+	{
+		const LONG lBaselineTic = ( lTic - ulBaselineDistance ) & 0xFFFF;
+
+		for ( ULONG ulIdx = 0; ulIdx < NUM_PLAYER_MOVE_KEYFRAMES; ulIdx++ )
+		{
+			if ( g_PlayerMoveKeyframes[ulPlayer][ulIdx].lTic == lBaselineTic )
+			{
+				Baseline = g_PlayerMoveKeyframes[ulPlayer][ulIdx];
+				bBaselineFound = true;
+				break;
+			}
+		}
 	}
 
+	// Read in the fields that differ from the baseline.
+	State.X = Baseline.X;
+	if ( ulBits & PMD_X )
+		State.X = ( ulBits & PMD_SMALL_X ) ? Baseline.X + client_ReadPlayerMovePositionDelta( pByteStream ) : NETWORK_ReadLong( pByteStream );
+
+	State.Y = Baseline.Y;
+	if ( ulBits & PMD_Y )
+		State.Y = ( ulBits & PMD_SMALL_Y ) ? Baseline.Y + client_ReadPlayerMovePositionDelta( pByteStream ) : NETWORK_ReadLong( pByteStream );
+
+	State.sZ = Baseline.sZ;
+	if ( ulBits & PMD_Z )
+		State.sZ = ( ulBits & PMD_SMALL_Z ) ? Baseline.sZ + static_cast<SBYTE>( NETWORK_ReadByte( pByteStream )) : NETWORK_ReadShort( pByteStream );
+
+	State.Angle = ( ulBits & PMD_ANGLE ) ? NETWORK_ReadLong( pByteStream ) : Baseline.Angle;
+
+	State.sMomX = Baseline.sMomX;
+	if ( ulBits & PMD_MOMX )
+		State.sMomX = ( ulBits & PMD_SMALL_MOMX ) ? Baseline.sMomX + static_cast<SBYTE>( NETWORK_ReadByte( pByteStream )) : NETWORK_ReadShort( pByteStream );
+
+	State.sMomY = Baseline.sMomY;
+	if ( ulBits & PMD_MOMY )
+		State.sMomY = ( ulBits & PMD_SMALL_MOMY ) ? Baseline.sMomY + static_cast<SBYTE>( NETWORK_ReadByte( pByteStream )) : NETWORK_ReadShort( pByteStream );
+
+	State.sMomZ = Baseline.sMomZ;
+	if ( ulBits & PMD_MOMZ )
+		State.sMomZ = ( ulBits & PMD_SMALL_MOMZ ) ? Baseline.sMomZ + static_cast<SBYTE>( NETWORK_ReadByte( pByteStream )) : NETWORK_ReadShort( pByteStream );
+
+	State.bCrouching = !!( ulBits & PMD_CROUCHING );
+
+	if ( ulPlayer >= MAXPLAYERS )
+		return;
+
+	// Remember the keyframe, even if the player isn't valid right now. The server uses
+	// it as baseline as soon as we acknowledged it.
+	if ( ulBaselineDistance == 0 )
+	{
+		ULONG &ulNext = g_ulNextPlayerMoveKeyframe[ulPlayer];
+		g_PlayerMoveKeyframes[ulPlayer][ulNext] = State;
+		g_PlayerMoveKeyframes[ulPlayer][ulNext].lTic = lTic;
+		ulNext = ( ulNext + 1 ) % NUM_PLAYER_MOVE_KEYFRAMES;
+
+		const SWORD sNewer = static_cast<SWORD>( usSequence - g_usNewestPlayerMoveKeyframe );
+		if (( g_ulPlayerMoveKeyframeAckBits == 0 ) || ( sNewer >= 32 ))
+		{
+			g_usNewestPlayerMoveKeyframe = usSequence;
+			g_ulPlayerMoveKeyframeAckBits = 1;
+		}
+		else if ( sNewer > 0 )
+		{
+			g_usNewestPlayerMoveKeyframe = usSequence;
+			g_ulPlayerMoveKeyframeAckBits = ( g_ulPlayerMoveKeyframeAckBits << sNewer ) | 1;
+		}
+		else if ( sNewer > -32 )
+			g_ulPlayerMoveKeyframeAckBits |= static_cast<ULONG>( 1 ) << -sNewer;
+	}
+
+	// The server only uses keyframes we acknowledged as baselines, so this can only happen
+	// if a packet is damaged.
+	if ( bBaselineFound == false )
+		return;
+
+	client_SetPlayerMovement( ulPlayer, ulFlags, State );
+}
+
+//*****************************************************************************
+//
+static void client_SetPlayerMovement( ULONG ulPlayer, ULONG ulFlags, const PLAYERMOVESTATE_s &State )
+{
+	const bool bVisible = !!( ulFlags & PLAYER_VISIBLE );
+
 	// Check to make sure everything is valid. If not, break out.
 	if (( PLAYER_IsValidPlayer( ulPlayer ) == false ) || ( players[ulPlayer].mo == NULL ) || ( gamestate != GS_LEVEL ))
 		return;
@@ -4345,18 +4513,18 @@ static void client_MovePlayer( BYTESTREAM_s *pByteStream )
 
 	// Set the player's XYZ position.
 	// [BB] But don't just set the position, but also properly set floorz and ceilingz, etc.
-	CLIENT_MoveThing( players[ulPlayer].mo, X, Y, Z );
+	CLIENT_MoveThing( players[ulPlayer].mo, State.X, State.Y, State.sZ << FRACBITS );
 
 	// Set the player's angle.
-	players[ulPlayer].mo->angle = Angle;
+	players[ulPlayer].mo->angle = State.Angle;
 
 	// Set the player's XYZ momentum.
-	players[ulPlayer].mo->velx = MomX;
-	players[ulPlayer].mo->vely = MomY;
-	players[ulPlayer].mo->velz = MomZ;
+	players[ulPlayer].mo->velx = State.sMomX << FRACBITS;
+	players[ulPlayer].mo->vely = State.sMomY << FRACBITS;
+	players[ulPlayer].mo->velz = State.sMomZ << FRACBITS;
 
 	// Is the player crouching?
-	players[ulPlayer].crouchdir = ( bCrouching ) ? 1 : -1;
+	players[ulPlayer].crouchdir = ( State.bCrouching ) ? 1 : -1;
 
 	if (( players[ulPlayer].crouchdir == 1 ) &&
 		( players[ulPlayer].crouchfactor < FRACUNIT ) &&
@@ -4383,6 +4551,22 @@ static void client_MovePlayer( BYTESTREAM_s *pByteStream )
 		players[ulPlayer].cmd.ucmd.buttons &= ~BT_ALTATTACK;
 }
 
+//*****************************************************************************
+//
+static void client_ClearPlayerMoveKeyframes( void )
+{
+	for ( ULONG ulPlayer = 0; ulPlayer < MAXPLAYERS; ulPlayer++ )
+	{
+		for ( ULONG ulIdx = 0; ulIdx < NUM_PLAYER_MOVE_KEYFRAMES; ulIdx++ )
+			g_PlayerMoveKeyframes[ulPlayer][ulIdx].lTic = -1;
+
+		g_ulNextPlayerMoveKeyframe[ulPlayer] = 0;
+	}
+
+	g_usNewestPlayerMoveKeyframe = 0;
+	g_ulPlayerMoveKeyframeAckBits = 0;
+}
+
 //*****************************************************************************
 //
 static void client_DamagePlayer( BYTESTREAM_s *pByteStream )
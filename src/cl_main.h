@@ -138,6 +138,7 @@ bool				CLIENT_GetAllowSendingOfUserInfo( void );
 void				CLIENT_SetAllowSendingOfUserInfo( bool bAllow );
 int					CLIENT_GetLatestServerGametic( void );
 void				CLIENT_SetLatestServerGametic( LONG latestServerGametic );
+void				CLIENT_GetPlayerMoveKeyframeAcks( USHORT &usNewestSequence, ULONG &ulBits );
 
 // Functions necessary to carry out client-side operations.
 void				CLIENT_SendServerPacket( void );
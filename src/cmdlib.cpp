@@ -3,6 +3,11 @@
 #ifdef _WIN32
 #include <direct.h>
 #include <io.h>
+#include <process.h>
+
+#define getpid _getpid
+#define MOVEFILE_REPLACE_EXISTING	0x00000001
+extern "C" __declspec(dllimport) int __stdcall MoveFileExA(const char *lpExistingFileName, const char *lpNewFileName, unsigned long dwFlags);
 #else
 #include <unistd.h>
 #include <sys/types.h>
@@ -558,7 +563,8 @@ void CreatePath(const char *fn)
 			if (info.st_mode & S_IFDIR)
 				goto exists;
 		}
-		if (mkdir(copy, 0755) == -1)
+		// Another process may have created the directory in the meantime.
+		if (mkdir(copy, 0755) == -1 && errno != EEXIST)
 		{ // failed
 			free(copy);
 			return;
@@ -572,6 +578,56 @@ exists:	if (p != NULL)
 }
 #endif
 
+//==========================================================================
+//
+// OpenTempFile
+//
+// Opens a temporary file next to path that CommitTempFile later moves
+// over path. Its name contains the process ID, so several processes
+// can replace the same file at the same time.
+//
+//==========================================================================
+
+FILE *OpenTempFile(const char *path, FString &temppath, const char *mode)
+{
+	temppath.Format("%s.%d.tmp", path, (int)getpid());
+	return fopen(temppath, mode);
+}
+
+//==========================================================================
+//
+// CommitTempFile
+//
+// Closes a file opened by OpenTempFile and atomically replaces path with
+// it, so that readers either see the old or the complete new file. On
+// failure, the temporary file is removed and errno describes the error.
+//
+//==========================================================================
+
+bool CommitTempFile(FILE *file, const char *temppath, const char *path)
+{
+	bool success = (ferror(file) == 0);
+	success = (fclose(file) == 0) && success;
+
+	if (success)
+	{
+#ifdef _WIN32
+		// Unlike rename under Linux, rename under Windows doesn't replace existing files.
+		success = (MoveFileExA(temppath, path, MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+		success = (rename(temppath, path) == 0);
+#endif
+	}
+
+	if (!success)
+	{
+		int error = errno;
+		remove(temppath);
+		errno = error;
+	}
+	return success;
+}
+
 //==========================================================================
 //
 // strbin	-- In-place version
@@ -52,6 +52,8 @@ FString strbin1 (const char *start);
 char *CleanseString (char *str);
 
 void CreatePath(const char * fn);
+FILE *OpenTempFile(const char *path, FString &temppath, const char *mode);
+bool CommitTempFile(FILE *file, const char *temppath, const char *path);
 
 FString ExpandEnvVars(const char *searchpathstring);
 FString NicePath(const char *path);
@@ -102,6 +102,8 @@ CVAR (Int,		cl_ticsperupdate,			3,		CVAR_USERINFO | CVAR_ARCHIVE);
 CVAR (Int,		cl_connectiontype,			1,		CVAR_USERINFO | CVAR_ARCHIVE);
 // [CK] Let the user control if they want clientside puffs or not.
 CVAR (Flag,		cl_clientsidepuffs,			cl_clientflags, CLIENTFLAGS_CLIENTSIDEPUFFS );
+// Let the user limit how many bytes per second the server sends him (0 = no limit).
+CVAR (Int,		cl_rate,					0,		CVAR_USERINFO | CVAR_ARCHIVE);
 
 // [TP] Userinfo changes yet to be sent.
 static DWORD PendingUserinfoChanges = 0;
@@ -230,7 +232,8 @@ enum
 	// [BB]
 	INFO_ConnectionType,
 	// [CK}
-	INFO_ClientFlags
+	INFO_ClientFlags,
+	INFO_Rate
 };
 
 const char *GenderNames[3] = { "male", "female", "other" };
@@ -603,6 +606,7 @@ void D_SetupUserInfo ()
 			case NAME_CL_TicsPerUpdate:		coninfo->TicsPerUpdateChanged(cl_ticsperupdate); break;
 			case NAME_CL_ConnectionType:	coninfo->ConnectionTypeChanged(cl_connectiontype); break;
 			case NAME_CL_ClientFlags:		coninfo->ClientFlagsChanged(cl_clientflags); break;
+			case NAME_CL_Rate:				coninfo->RateChanged(cl_rate); break;
 
 			// The rest do.
 			default:
@@ -817,6 +821,20 @@ int userinfo_t::ClientFlagsChanged(int flags)
 	return flags;
 }
 
+int userinfo_t::RateChanged(int rate)
+{
+	if ( (*this)[NAME_CL_Rate] == NULL )
+	{
+		Printf ( "Error: No Rate key found!\n" );
+		return 0;
+	}
+	// 0 means that the client doesn't limit the rate.
+	if ( rate != 0 )
+		rate = clamp ( rate, MIN_CLIENT_RATE, MAX_CLIENT_RATE );
+	*static_cast<FIntCVar *>((*this)[NAME_CL_Rate]) = rate;
+	return rate;
+}
+
 void D_UserInfoChanged (FBaseCVar *cvar)
 {
 	UCVarValue val;
@@ -977,6 +995,26 @@ void D_UserInfoChanged (FBaseCVar *cvar)
 
 		ulUpdateFlags |= USERINFO_CONNECTIONTYPE;
 	}
+	else if ( cvar == &cl_rate )
+	{
+		if ( cl_rate < 0 )
+		{
+			cl_rate = 0;
+			return;
+		}
+		if (( cl_rate > 0 ) && ( cl_rate < MIN_CLIENT_RATE ))
+		{
+			cl_rate = MIN_CLIENT_RATE;
+			return;
+		}
+		if ( cl_rate > MAX_CLIENT_RATE )
+		{
+			cl_rate = MAX_CLIENT_RATE;
+			return;
+		}
+
+		ulUpdateFlags |= USERINFO_RATE;
+	}
 
 	val = cvar->GetGenericRep (CVAR_String);
 	escaped_val = D_EscapeUserInfo(val.String);
@@ -1394,6 +1432,10 @@ void D_ReadUserInfoStrings (int pnum, BYTE **stream, bool update)
 				info->ClientFlagsChanged ( atoi( value ) );
 				break;
 
+			case NAME_CL_Rate:
+				info->RateChanged ( atoi( value ) );
+				break;
+
 			default:
 				cvar_ptr = info->CheckKey(keyname);
 				if (cvar_ptr != NULL)
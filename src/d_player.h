@@ -399,6 +399,7 @@ struct userinfo_t : TMap<FName,FBaseCVar *>
 	int TicsPerUpdateChanged(int ticsperupdate);
 	int ConnectionTypeChanged(int connectiontype);
 	int ClientFlagsChanged(int flags);
+	int RateChanged(int rate);
 	int GetRailColor() const 
 	{
 		if ( CheckKey(NAME_RailColor) != NULL )
@@ -444,6 +445,15 @@ struct userinfo_t : TMap<FName,FBaseCVar *>
 			return 0;
 		}
 	}
+	int GetRate() const
+	{
+		if ( CheckKey(NAME_CL_Rate) != NULL )
+			return *static_cast<FIntCVar *>(*CheckKey(NAME_CL_Rate));
+		else {
+			Printf ( "Error: No Rate key found!\n" );
+			return 0;
+		}
+	}
 };
 
 FArchive &operator<< (FArchive &arc, userinfo_t &info);
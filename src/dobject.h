@@ -239,6 +239,9 @@ namespace GC
 	// Number of bytes currently allocated through M_Malloc/M_Realloc.
 	extern size_t AllocBytes;
 
+	// Number of blocks allocated or reallocated through M_Malloc/M_Realloc so far.
+	extern size_t AllocCount;
+
 	// Amount of memory to allocate before triggering a collection.
 	extern size_t Threshold;
 
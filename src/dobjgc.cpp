@@ -138,6 +138,7 @@ extern DThinker *NextToThink;
 namespace GC
 {
 size_t AllocBytes;
+size_t AllocCount;
 size_t Threshold;
 size_t Estimate;
 DObject *Gray;
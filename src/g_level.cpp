@@ -1574,6 +1574,7 @@ void G_DoLoadLevel (int position, bool autosave)
 		sprintf( szString, "%s: %s", level.mapname, level.LevelName.GetChars() );
 		SERVERCONSOLE_SetCurrentMapname( szString );
 		SERVERCONSOLE_UpdateScoreboard( );
+		SERVER_MASTER_InvalidateServerInfo( );
 
 		// Reset the columns.
 		SERVERCONSOLE_SetupColumns( );
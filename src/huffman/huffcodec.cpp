@@ -72,6 +72,8 @@ namespace skulltag {
 		// recursive Huffman tree builder.
 		buildTree( root, treeData, 0, dataLength, codeTable, 256 );
 		huffResourceOwner = true;
+		buildDecodeTable();
+		buildEncodeTable();
 	}
 	
 
@@ -88,6 +90,9 @@ namespace skulltag {
 		root = treeRootNode;
 		codeTable = leafCodeTable;
 		huffResourceOwner = false;
+		// the lookup tables are derived data and always owned by this HuffmanCodec.
+		buildDecodeTable();
+		buildEncodeTable();
 	}
 	
 	/** Checks the ownership state of this HuffmanCodec's resources.
@@ -103,6 +108,9 @@ namespace skulltag {
 		reverseBits = false;
 		expandable = true;
 		huffResourceOwner = false;
+		decodeTable = 0;
+		decodeTableBits = 0;
+		encodeTable = 0;
 	}
 	
 	/** Increases a codeLength up to the longest Huffman code bit length found in the node or any of its children. <br>
@@ -206,13 +214,221 @@ namespace skulltag {
 		return index;
 	}
 
-	/** Decodes data read from an input buffer and stores the result in the output buffer.
+	/** Builds encodeTable from the code table. <br>
+	 * The table is left NULL (0) if a byte value has no code or a code doesn't fit into an int. */
+	void HuffmanCodec::buildEncodeTable(){
+		delete[] encodeTable;
+		encodeTable = 0;
+
+		if ( codeTable == 0 ) return;
+		for ( int i = 0; i < 256; i++ ){
+			if ( (codeTable[i] == 0) || (codeTable[i]->bitCount < 1) || (codeTable[i]->bitCount > 32) ) return;
+		}
+
+		HuffmanEncodeEntry * table = new HuffmanEncodeEntry[256];
+		for ( int i = 0; i < 256; i++ ){
+			HuffmanNode const * node = codeTable[i];
+			// Store the code backwards, so that its first bit can be shifted into the accumulator first.
+			unsigned int code = 0;
+			for ( int bit = 0; bit < node->bitCount; bit++ ){
+				code |= ((node->code >> (node->bitCount - 1 - bit)) & 0x01) << bit;
+			}
+			table[i].code = code;
+			table[i].bitCount = node->bitCount;
+		}
+		encodeTable = table;
+	}
+
+	/** Encodes data read from an input buffer and stores the result in the output buffer. <br>
+	 * Packs the codes from the encoding lookup table into a 64 bit accumulator.
 	 * @return number of bytes stored in the output buffer or -1 if an error occurs while encoding. */
 	int HuffmanCodec::encode(
 		unsigned char const * const input,	/**< in: pointer to the first byte to encode. */
 		unsigned char * const output,		/**< out: pointer to an output buffer to store data. */
 		int const &inLength,				/**< in: number of bytes of input buffer to encoded. */
 		int const &outLength				/**< in: maximum length of data to output. */
+	) const {
+		if ( encodeTable == 0 ) return encodeWithWriter( input, output, inLength, outLength );
+
+		// if not expandable Limit output to input length.
+		int maxBytes = outLength;
+		if ( (!expandable) && ((inLength + 1) < outLength) ) maxBytes = inLength + 1;
+		if ( maxBytes < 1 ) return -1;
+
+		// The accumulator holds the stream in Old Huffman Compatibility Mode bit order: the first
+		// bit of the stream is the least significant bit of each byte.
+		unsigned long long bits = 0;
+		int bitsStored = 0;
+		int wIndex = 1; // reserve place for padding signal.
+
+		for ( int i = 0; i < inLength; i++ ){
+			HuffmanEncodeEntry const &entry = encodeTable[ 0xff & input[i] ];
+			bits |= (unsigned long long)entry.code << bitsStored;
+			bitsStored += entry.bitCount;
+
+			// Output four bytes at a time.
+			if ( bitsStored >= 32 ){
+				if ( (wIndex + 4) > maxBytes ) return -1;
+				output[wIndex] = (unsigned char)(bits & 0xff);
+				output[wIndex+1] = (unsigned char)((bits >> 8) & 0xff);
+				output[wIndex+2] = (unsigned char)((bits >> 16) & 0xff);
+				output[wIndex+3] = (unsigned char)((bits >> 24) & 0xff);
+				wIndex += 4;
+				bits >>= 32;
+				bitsStored -= 32;
+			}
+		}
+
+		// Output the remaining bits, padding the last byte with zeros.
+		int padding = (8 - (bitsStored & 7)) & 7;
+		while ( bitsStored > 0 ){
+			if ( wIndex >= maxBytes ) return -1;
+			output[wIndex++] = (unsigned char)(bits & 0xff);
+			bits >>= 8;
+			bitsStored -= 8;
+		}
+
+		// write padding signal byte to begining of stream.
+		output[0] = (unsigned char)padding;
+
+		// The bits are stored backwards already, reverse them unless Old Huffman Compatibility Mode is wanted.
+		if ( !reverseBits ) for ( int i = 1; i < wIndex; i++ ){
+			output[i] = reverseMap[ 0xff & output[i] ];
+		}
+
+		return wIndex;
+	} // end function encode
+
+	/** Appends the Huffman codes of the input to a bit stream in Old Huffman Compatibility Mode bit order,
+	 * the first bit of the stream being the least significant bit of its first byte. <br>
+	 * Bits of the output past bitPosition are overwritten, the bits before it are kept.
+	 * @return false if the encoding lookup table is missing or the codes don't fit within maxBits. */
+	bool HuffmanCodec::encodeBits(
+		unsigned char const * const input,	/**< in: pointer to the first byte to encode. */
+		int const &inLength,				/**< in: number of bytes of input buffer to encode. */
+		unsigned char * const output,		/**< out: pointer to the start of the bit stream. */
+		int &bitPosition,					/**< in+out: bit at which to append the codes. Upon success holds the end of the stream. */
+		int const &maxBits,					/**< in: maximum length of the bit stream. */
+		int * const bitPositions			/**< out: if not NULL (0), receives the bit position of each input byte's code and the end of the stream (inLength + 1 entries). */
+	) const {
+		if ( encodeTable == 0 ) return false;
+
+		// Continue from the partially filled byte the stream ends with.
+		int position = bitPosition;
+		int wIndex = position >> 3;
+		int bitsStored = position & 7;
+		unsigned long long bits = bitsStored ? (output[wIndex] & ((1 << bitsStored) - 1)) : 0;
+
+		for ( int i = 0; i < inLength; i++ ){
+			HuffmanEncodeEntry const &entry = encodeTable[ 0xff & input[i] ];
+			if ( bitPositions ) bitPositions[i] = position;
+			position += entry.bitCount;
+			if ( position > maxBits ) return false;
+			bits |= (unsigned long long)entry.code << bitsStored;
+			bitsStored += entry.bitCount;
+
+			// Output four bytes at a time.
+			if ( bitsStored >= 32 ){
+				output[wIndex] = (unsigned char)(bits & 0xff);
+				output[wIndex+1] = (unsigned char)((bits >> 8) & 0xff);
+				output[wIndex+2] = (unsigned char)((bits >> 16) & 0xff);
+				output[wIndex+3] = (unsigned char)((bits >> 24) & 0xff);
+				wIndex += 4;
+				bits >>= 32;
+				bitsStored -= 32;
+			}
+		}
+		if ( bitPositions ) bitPositions[inLength] = position;
+
+		// Output the remaining bits, padding the last byte with zeros.
+		while ( bitsStored > 0 ){
+			output[wIndex++] = (unsigned char)(bits & 0xff);
+			bits >>= 8;
+			bitsStored -= 8;
+		}
+
+		bitPosition = position;
+		return true;
+	} // end function encodeBits
+
+	/** Counts the bits the Huffman codes of the input take up, without encoding it.
+	 * @return number of bits or -1 if the encoding lookup table is missing. */
+	int HuffmanCodec::encodedBitCount(
+		unsigned char const * const input,	/**< in: pointer to the first byte to measure. */
+		int const &inLength					/**< in: number of bytes of input buffer to measure. */
+	) const {
+		if ( encodeTable == 0 ) return -1;
+
+		int bitCount = 0;
+		for ( int i = 0; i < inLength; i++ ) bitCount += encodeTable[ 0xff & input[i] ].bitCount;
+		return bitCount;
+	} // end function encodedBitCount
+
+	/** Copies a run of bits between two bit streams in Old Huffman Compatibility Mode bit order. <br>
+	 * Bits of the output past outBitPosition are overwritten, the bits before it are kept. */
+	void HuffmanCodec::copyBits(
+		unsigned char * const output,		/**< out: pointer to the start of the destination bit stream. */
+		int outBitPosition,					/**< in: bit of the destination stream at which to store the first bit. */
+		unsigned char const * const input,	/**< in: pointer to the start of the source bit stream. */
+		int inBitPosition,					/**< in: bit of the source stream to copy first. */
+		int bitCount						/**< in: number of bits to copy. */
+	){
+		if ( bitCount <= 0 ) return;
+
+		// Continue from the partially filled byte the destination ends with.
+		int wIndex = outBitPosition >> 3;
+		int bitsStored = outBitPosition & 7;
+		unsigned long long bits = bitsStored ? (output[wIndex] & ((1 << bitsStored) - 1)) : 0;
+
+		// Align the source to a byte boundary.
+		int rIndex = inBitPosition >> 3;
+		int skip = inBitPosition & 7;
+		if ( skip ){
+			int count = ( bitCount < (8 - skip) ) ? bitCount : (8 - skip);
+			bits |= (unsigned long long)((input[rIndex++] >> skip) & ((1 << count) - 1)) << bitsStored;
+			bitsStored += count;
+			bitCount -= count;
+		}
+
+		// Move four bytes at a time.
+		while ( bitCount >= 32 ){
+			unsigned long long word = (unsigned long long)input[rIndex]
+				| ((unsigned long long)input[rIndex+1] << 8)
+				| ((unsigned long long)input[rIndex+2] << 16)
+				| ((unsigned long long)input[rIndex+3] << 24);
+			rIndex += 4;
+			bits |= word << bitsStored;
+			bitCount -= 32;
+			output[wIndex] = (unsigned char)(bits & 0xff);
+			output[wIndex+1] = (unsigned char)((bits >> 8) & 0xff);
+			output[wIndex+2] = (unsigned char)((bits >> 16) & 0xff);
+			output[wIndex+3] = (unsigned char)((bits >> 24) & 0xff);
+			wIndex += 4;
+			bits >>= 32;
+		}
+
+		// Move the remaining bits, the last source byte may only be used partially.
+		while ( bitCount > 0 ){
+			int count = ( bitCount < 8 ) ? bitCount : 8;
+			bits |= (unsigned long long)(input[rIndex++] & ((1 << count) - 1)) << bitsStored;
+			bitsStored += count;
+			bitCount -= count;
+		}
+		while ( bitsStored > 0 ){
+			output[wIndex++] = (unsigned char)(bits & 0xff);
+			bits >>= 8;
+			bitsStored -= 8;
+		}
+	} // end function copyBits
+
+	/** Encodes data read from an input buffer and stores the result in the output buffer. <br>
+	 * Puts each code through the BitWriter. Produces the same output as encode(), but slower.
+	 * @return number of bytes stored in the output buffer or -1 if an error occurs while encoding. */
+	int HuffmanCodec::encodeWithWriter(
+		unsigned char const * const input,	/**< in: pointer to the first byte to encode. */
+		unsigned char * const output,		/**< out: pointer to an output buffer to store data. */
+		int const &inLength,				/**< in: number of bytes of input buffer to encoded. */
+		int const &outLength				/**< in: maximum length of data to output. */
 	) const {
 		// setup the bit buffer to output. if not expandable Limit output to input length.
 		if ( expandable ) writer->outputBuffer( output, outLength );
@@ -238,15 +454,141 @@ namespace skulltag {
 		}
 
 		return bytesWritten;
-	} // end function encode
+	} // end function encodeWithWriter
+
+	/** Builds decodeTable from the Huffman tree. <br>
+	 * The table is left NULL (0) if the tree is empty or corrupt. */
+	void HuffmanCodec::buildDecodeTable(){
+		delete[] decodeTable;
+		decodeTable = 0;
+		decodeTableBits = 0;
+
+		// bail on an empty tree.
+		if ( (root == 0) || (root->branch == 0) ) return;
+
+		// Make the table wide enough to hold the longest code, within reasonable size limits.
+		int longestCode = 0;
+		maxCodeLength( root, longestCode );
+		int tableBits = longestCode;
+		if ( tableBits < minDecodeTableBits ) tableBits = minDecodeTableBits;
+		if ( tableBits > maxDecodeTableBits ) tableBits = maxDecodeTableBits;
+
+		int tableSize = 1 << tableBits;
+		HuffmanDecodeEntry * table = new HuffmanDecodeEntry[tableSize];
+
+		for ( int index = 0; index < tableSize; index++ ){
+			HuffmanDecodeEntry &entry = table[index];
+			entry.symbolCount = 0;
+			entry.node = 0;
+			HuffmanNode * node = root;
+
+			// Walk the tree with the bits of the index, least significant bit first.
+			for ( int bit = 0; bit < tableBits; bit++ ){
+				node = &(node->branch[ (index >> bit) & 0x01 ]);
+
+				// Is the node a leaf?
+				if ( node->branch == 0 ){
+					entry.symbols[ entry.symbolCount ] = (unsigned char)(node->value & 0xff);
+					entry.symbolEnd[ entry.symbolCount ] = (unsigned char)(bit + 1);
+					entry.symbolCount++;
+					node = root;
+					// no room for more symbols in this entry.
+					if ( entry.symbolCount == (int)(sizeof entry.symbols) ) break;
+				}
+			}
 
-	/** Decodes data read from an input buffer and stores the result in the output buffer.
+			// The first code is longer than the table, remember where to continue the tree walk.
+			if ( entry.symbolCount == 0 ) entry.node = node;
+		}
+
+		decodeTable = table;
+		decodeTableBits = tableBits;
+	}
+
+	/** Decodes data read from an input buffer and stores the result in the output buffer. <br>
+	 * Uses the decoding lookup table to decode up to four symbols per lookup.
 	 * @return number of bytes stored in the output buffer or -1 if an error occurs while decoding. */
 	int HuffmanCodec::decode(
 		unsigned char const * const input,	/**< in: pointer to data that needs decoding. */
 		unsigned char * const output,		/**< out: pointer to output buffer to store decoded data. */
 		int const &inLength,				/**< in: number of bytes of input buffer to read. */
 		int const &outLength				/**< in: maximum length of data to output. */
+	){
+		if ( decodeTable == 0 ) return decodeWithTree( input, output, inLength, outLength );
+		if ( inLength < 1 ) return 0;
+		int bitsAvailable = ((inLength-1) << 3) - (0xff & input[0]);
+		int rIndex = 1;				// read index of input buffer.
+		int wIndex = 0;				// write index of output buffer.
+		unsigned int bits = 0;		// bit buffer, the next bit of the stream is the least significant bit.
+		int bitsStored = 0;			// number of bits in the bit buffer.
+		unsigned int const tableMask = (1 << decodeTableBits) - 1;
+
+		while ( bitsAvailable > 0 ){
+
+			// Top up the bit buffer. Bits past the end of the input read as zero.
+			while ( (bitsStored <= 24) && (rIndex < inLength) ){
+				// The table expects the first bit of the stream in the least significant bit, which is
+				// how the bytes are stored in Old Huffman Compatibility Mode.
+				unsigned int byte = 0xff & input[rIndex++];
+				if ( !reverseBits ) byte = reverseMap[ byte ];
+				bits |= byte << bitsStored;
+				bitsStored += 8;
+			}
+
+			HuffmanDecodeEntry const &entry = decodeTable[ bits & tableMask ];
+
+			if ( entry.symbolCount > 0 ){
+				// Output all symbols whose codes lie completely within the input stream.
+				int used = 0;
+				for ( int i = 0; i < entry.symbolCount; i++ ){
+					if ( entry.symbolEnd[i] > bitsAvailable ) return wIndex;
+					// buffer overflow prevention
+					if ( wIndex >= outLength ) return wIndex;
+					output[ wIndex++ ] = entry.symbols[i];
+					used = entry.symbolEnd[i];
+				}
+				bits >>= used;
+				bitsStored -= used;
+				bitsAvailable -= used;
+			} else {
+				// The code is longer than the table, walk the rest of it one bit at a time.
+				if ( decodeTableBits >= bitsAvailable ) return wIndex;
+				HuffmanNode * node = entry.node;
+				bits >>= decodeTableBits;
+				bitsStored -= decodeTableBits;
+				bitsAvailable -= decodeTableBits;
+
+				while ( node->branch != 0 ){
+					if ( bitsAvailable <= 0 ) return wIndex;
+					if ( bitsStored <= 0 ){
+						if ( rIndex >= inLength ) return wIndex;
+						bits = 0xff & input[rIndex++];
+						if ( !reverseBits ) bits = reverseMap[ bits ];
+						bitsStored = 8;
+					}
+					node = &(node->branch[ bits & 0x01 ]);
+					bits >>= 1;
+					bitsStored--;
+					bitsAvailable--;
+				}
+
+				// buffer overflow prevention
+				if ( wIndex >= outLength ) return wIndex;
+				output[ wIndex++ ] = (unsigned char)(node->value & 0xff);
+			}
+		}
+
+		return wIndex;
+	} // end function decode
+
+	/** Decodes data read from an input buffer and stores the result in the output buffer. <br>
+	 * Walks the Huffman tree one bit at a time. Produces the same output as decode(), but slower.
+	 * @return number of bytes stored in the output buffer or -1 if an error occurs while decoding. */
+	int HuffmanCodec::decodeWithTree(
+		unsigned char const * const input,	/**< in: pointer to data that needs decoding. */
+		unsigned char * const output,		/**< out: pointer to output buffer to store decoded data. */
+		int const &inLength,				/**< in: number of bytes of input buffer to read. */
+		int const &outLength				/**< in: maximum length of data to output. */
 	){
 		if ( inLength < 1 ) return 0;
 		int bitsAvailable = ((inLength-1) << 3) - (0xff & input[0]);
@@ -285,7 +627,7 @@ namespace skulltag {
 		}
 
 		return wIndex;
-	} // end function decode
+	} // end function decodeWithTree
 
 	/** Deletes all sub nodes of a HuffmanNode by traversing and deleting its child nodes.
 	 * @param treeNode pointer to a HuffmanNode whos children will be deleted. */
@@ -301,6 +643,8 @@ namespace skulltag {
 	/** Destructor - frees resources. */
 	HuffmanCodec::~HuffmanCodec() {
 		delete writer;
+		delete[] decodeTable;
+		delete[] encodeTable;
 		//check for resource ownership before deletion
 		if ( huffmanResourceOwner() ){
 			delete[] codeTable;
@@ -34,6 +34,23 @@
 /** Prevents naming convention problems via encapsulation. */
 namespace skulltag {
 
+	/** Entry of the decoding lookup table. <br>
+	 * Each entry describes what the decoder should do when the next table width bits of the
+	 * input stream equal the entry's index, the first bit of the stream being the least
+	 * significant bit of the index. */
+	struct HuffmanDecodeEntry {
+		unsigned char symbols[4];	/**< values of the complete Huffman codes found in the index bits. */
+		unsigned char symbolEnd[4];	/**< number of bits consumed after decoding the corresponding symbol. */
+		int symbolCount;			/**< number of complete codes in the index bits. Zero if the first code is longer than the table width. */
+		HuffmanNode * node;			/**< tree node reached after the table width bits if symbolCount is zero, else NULL (0). */
+	};
+
+	/** Entry of the encoding lookup table. */
+	struct HuffmanEncodeEntry {
+		unsigned int code;		/**< Huffman code with its bits in stream order, the first bit being the least significant bit. */
+		int bitCount;			/**< number of bits in the Huffman code. */
+	};
+
 	/** HuffmanCodec class - Encodes and Decodes data using a Huffman tree. */
 	class HuffmanCodec : public Codec {
 
@@ -67,6 +84,19 @@ namespace skulltag {
 		/** Number of bits the shortest huffman code in the tree has. */
 		int shortestCode;	
 
+		/** Lookup table used by decode() to decode several bits at once, or NULL (0) if no table could be built. */
+		HuffmanDecodeEntry * decodeTable;
+
+		/** Number of input bits used to index decodeTable. */
+		int decodeTableBits;
+
+		/** Codes of all byte values used by encode(), or NULL (0) if no table could be built. */
+		HuffmanEncodeEntry * encodeTable;
+
+		/** Smallest and largest width of decodeTable in bits. */
+		static int const minDecodeTableBits = 8;
+		static int const maxDecodeTableBits = 12;
+
 	public:	
 
 		/** Creates a new HuffmanCodec from the Huffman tree data.
@@ -86,7 +116,8 @@ namespace skulltag {
 		/** Frees resources used internally by this HuffmanCodec. */
 		virtual ~HuffmanCodec();
 
-		/** Decodes data read from an input buffer and stores the result in the output buffer.
+		/** Encodes data read from an input buffer and stores the result in the output buffer. <br>
+		 * Packs the codes from the encoding lookup table into a 64 bit accumulator.
 		 * @return number of bytes stored in the output buffer or -1 if an error occurs while encoding. */
 		virtual int encode(
 			unsigned char const * const input,	/**< in: pointer to the first byte to encode. */
@@ -95,7 +126,48 @@ namespace skulltag {
 			int const &outLength				/**< in: maximum length of data to output. */
 		) const;
 
-		/** Decodes data read from an input buffer and stores the result in the output buffer.
+		/** Encodes data read from an input buffer and stores the result in the output buffer. <br>
+		 * Puts each code through the BitWriter. Produces the same output as encode(), but slower.
+		 * @return number of bytes stored in the output buffer or -1 if an error occurs while encoding. */
+		int encodeWithWriter(
+			unsigned char const * const input,	/**< in: pointer to the first byte to encode. */
+			unsigned char * const output,		/**< out: pointer to an output buffer to store data. */
+			int const &inLength,				/**< in: number of bytes of input buffer to encoded. */
+			int const &outLength				/**< in: maximum length of data to output. */
+		) const;
+
+		/** Appends the Huffman codes of the input to a bit stream in Old Huffman Compatibility Mode bit order,
+		 * the first bit of the stream being the least significant bit of its first byte. <br>
+		 * Bits of the output past bitPosition are overwritten, the bits before it are kept.
+		 * @return false if the encoding lookup table is missing or the codes don't fit within maxBits. */
+		bool encodeBits(
+			unsigned char const * const input,	/**< in: pointer to the first byte to encode. */
+			int const &inLength,				/**< in: number of bytes of input buffer to encode. */
+			unsigned char * const output,		/**< out: pointer to the start of the bit stream. */
+			int &bitPosition,					/**< in+out: bit at which to append the codes. Upon success holds the end of the stream. */
+			int const &maxBits,					/**< in: maximum length of the bit stream. */
+			int * const bitPositions			/**< out: if not NULL (0), receives the bit position of each input byte's code and the end of the stream (inLength + 1 entries). */
+		) const;
+
+		/** Counts the bits the Huffman codes of the input take up, without encoding it.
+		 * @return number of bits or -1 if the encoding lookup table is missing. */
+		int encodedBitCount(
+			unsigned char const * const input,	/**< in: pointer to the first byte to measure. */
+			int const &inLength					/**< in: number of bytes of input buffer to measure. */
+		) const;
+
+		/** Copies a run of bits between two bit streams in Old Huffman Compatibility Mode bit order. <br>
+		 * Bits of the output past outBitPosition are overwritten, the bits before it are kept. */
+		static void copyBits(
+			unsigned char * const output,		/**< out: pointer to the start of the destination bit stream. */
+			int outBitPosition,					/**< in: bit of the destination stream at which to store the first bit. */
+			unsigned char const * const input,	/**< in: pointer to the start of the source bit stream. */
+			int inBitPosition,					/**< in: bit of the source stream to copy first. */
+			int bitCount						/**< in: number of bits to copy. */
+		);
+
+		/** Decodes data read from an input buffer and stores the result in the output buffer. <br>
+		 * Uses the decoding lookup table to decode up to four symbols per lookup.
 		 * @return number of bytes stored in the output buffer or -1 if an error occurs while decoding. */
 		virtual int decode(
 			unsigned char const * const input,	/**< in: pointer to data that needs decoding. */
@@ -104,6 +176,16 @@ namespace skulltag {
 			int const &outLength				/**< in: maximum length of data to output. */
 		);
 
+		/** Decodes data read from an input buffer and stores the result in the output buffer. <br>
+		 * Walks the Huffman tree one bit at a time. Produces the same output as decode(), but slower.
+		 * @return number of bytes stored in the output buffer or -1 if an error occurs while decoding. */
+		int decodeWithTree(
+			unsigned char const * const input,	/**< in: pointer to data that needs decoding. */
+			unsigned char * const output,		/**< out: pointer to output buffer to store decoded data. */
+			int const &inLength,				/**< in: number of bytes of input buffer to read. */
+			int const &outLength				/**< in: maximum length of data to output. */
+		);
+
 		/** Enables or Disables backwards bit ordering of bytes.
 		 * @param backwards  "true" enables reversed bit order bytes, "false" uses standard byte bit ordering. */
 		void reversedBytes( bool backwards );
@@ -176,6 +258,14 @@ namespace skulltag {
 		/** Perform initialization procedures common to all constructors. */
 		void init();
 
+		/** Builds decodeTable from the Huffman tree. <br>
+		 * The table is left NULL (0) if the tree is empty or corrupt. */
+		void buildDecodeTable();
+
+		/** Builds encodeTable from the code table. <br>
+		 * The table is left NULL (0) if a byte value has no code or a code doesn't fit into an int. */
+		void buildEncodeTable();
+
 	}; // end class Huffman Codec.
 } // end namespace skulltag
 
@@ -25,6 +25,8 @@
 
 // required for atexit()
 #include <stdlib.h>
+// required for memcpy() and memcmp()
+#include <string.h>
 
 #include "huffman.h"
 #include "huffcodec.h"
@@ -95,46 +97,203 @@ void HUFFMAN_Destruct(){
 	__codec = NULL;
 }
 
-/** Applies Huffman encoding to a block of data. */
-void HUFFMAN_Encode(
-	/** in: Pointer to start of data that is to be encoded. */
-	unsigned char const * const inputBuffer,
-	/** out: Pointer to destination buffer where encoded data will be stored. */
-	unsigned char * const outputBuffer,
-	/** in: Number of chars to read from inputBuffer. */
-	int const &inputBufferSize,
-	/**< in+out: Max chars to write into outputBuffer. <br>
-	 * 		Upon return holds the number of chars stored or 0 if an error occurs. */
-	int * outputBufferSize
+/** Stores a block of data unencoded, preceded by the "unencoded" signal. Used when encoding would expand the data. */
+static void huffman_StoreUnencoded(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be stored. */
+	unsigned char * const outputBuffer,			/**< out: Pointer to destination buffer where the data will be stored. */
+	int const &inputBufferSize,					/**< in: Number of chars to read from inputBuffer. */
+	int *outputBufferSize						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+){
+	// check buffer sizes
+	if ( *outputBufferSize < (inputBufferSize + 1) ){
+		// outputBuffer too small, return "no bytes written"
+		*outputBufferSize = 0;
+		return;
+	}
+	
+	// perform the unencoded copy
+	for ( int i = 0; i < inputBufferSize; i++ ) outputBuffer[i+1] = inputBuffer[i];
+	// supply the "unencoded" signal and bytesWritten
+	outputBuffer[0] = 0xff;
+	*outputBufferSize = inputBufferSize + 1;
+} // end function huffman_StoreUnencoded
+
+/** Applies Huffman encoding to a block of data, either with the encoding lookup table or through the BitWriter. */
+static void huffman_Encode(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be encoded. */
+	unsigned char * const outputBuffer,			/**< out: Pointer to destination buffer where encoded data will be stored. */
+	int const &inputBufferSize,					/**< in: Number of chars to read from inputBuffer. */
+	int *outputBufferSize,						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+	bool useTable								/**< in: Use HuffmanCodec::encode() if true, HuffmanCodec::encodeWithWriter() otherwise. */
 ){
-	int bytesWritten = __codec->encode( inputBuffer, outputBuffer, inputBufferSize, *outputBufferSize );
+	int bytesWritten = useTable
+		? __codec->encode( inputBuffer, outputBuffer, inputBufferSize, *outputBufferSize )
+		: __codec->encodeWithWriter( inputBuffer, outputBuffer, inputBufferSize, *outputBufferSize );
 	
 	// expansion occured -- provide backwards compatibility
 	if ( bytesWritten < 0 ){
-		// check buffer sizes
-		if ( *outputBufferSize < (inputBufferSize + 1) ){
-			// outputBuffer too small, return "no bytes written"
-			*outputBufferSize = 0;
-			return;
-		}
-		
-		// perform the unencoded copy
-		for ( int i = 0; i < inputBufferSize; i++ ) outputBuffer[i+1] = inputBuffer[i];
-		// supply the "unencoded" signal and bytesWritten
-		outputBuffer[0] = 0xff;
-		*outputBufferSize = inputBufferSize + 1;
+		huffman_StoreUnencoded( inputBuffer, outputBuffer, inputBufferSize, outputBufferSize );
 	} else {
 		// assign the bytesWritten return value
 		*outputBufferSize = bytesWritten;
 	}
+} // end function huffman_Encode
+
+/** Applies Huffman encoding to a block of data. */
+void HUFFMAN_Encode(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be encoded. */
+	unsigned char * const outputBuffer,			/**< out: Pointer to destination buffer where encoded data will be stored. */
+	int const &inputBufferSize,					/**< in: Number of chars to read from inputBuffer. */
+	int *outputBufferSize						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+){
+	huffman_Encode( inputBuffer, outputBuffer, inputBufferSize, outputBufferSize, true );
 } // end function HUFFMAN_Encode
 
-/** Decodes a block of data that is Huffman encoded. */
-void HUFFMAN_Decode(
+/** Applies Huffman encoding to a block of data by putting each code through the BitWriter. <br>
+ * Slower than HUFFMAN_Encode, only kept as a reference for testing and benchmarking. */
+void HUFFMAN_EncodeWithWriter(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be encoded. */
+	unsigned char * const outputBuffer,			/**< out: Pointer to destination buffer where encoded data will be stored. */
+	int const &inputBufferSize,					/**< in: Number of chars to read from inputBuffer. */
+	int *outputBufferSize						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+){
+	huffman_Encode( inputBuffer, outputBuffer, inputBufferSize, outputBufferSize, false );
+} // end function HUFFMAN_EncodeWithWriter
+
+/** Counts the bits the Huffman codes of a block of data take up, without encoding it. */
+int HUFFMAN_GetEncodedBitCount(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be measured. */
+	int const &inputBufferSize					/**< in: Number of chars to read from inputBuffer. */
+){
+	if ( __codec == NULL ) return -1;
+	return __codec->encodedBitCount( inputBuffer, inputBufferSize );
+} // end function HUFFMAN_GetEncodedBitCount
+
+HuffmanSegment::HuffmanSegment() : raw( NULL ), rawLength( 0 ), bits( NULL ), bitPositions( NULL ), encodedLength( 0 ){
+}
+
+HuffmanSegment::~HuffmanSegment(){
+	delete[] raw;
+	delete[] bits;
+	delete[] bitPositions;
+}
+
+/** Removes all data from the segment. */
+void HuffmanSegment::clear(){
+	rawLength = 0;
+	encodedLength = 0;
+} // end function clear
+
+/** Appends data to the end of the segment.
+ * @return position of the data in the segment or -1 if the segment is full. */
+int HuffmanSegment::append(
+	unsigned char const * const data,	/**< in: Pointer to start of data that is to be appended. */
+	int const &length					/**< in: Number of chars to append. */
+){
+	if ( (length <= 0) || ((rawLength + length) > capacity) ) return -1;
+
+	// The buffers are only allocated once something is shared.
+	if ( raw == NULL ){
+		raw = new unsigned char[capacity];
+		// Codes of the encoding lookup table fit into an int.
+		bits = new unsigned char[capacity * sizeof( int )];
+		bitPositions = new int[capacity + 1];
+	}
+
+	int offset = rawLength;
+	memcpy( raw + rawLength, data, length );
+	rawLength += length;
+	return offset;
+} // end function append
+
+/** Encodes the data that was appended since the last update.
+ * @return false if the data can't be encoded this way. */
+bool HuffmanSegment::update(){
+	if ( raw == NULL ) return false;
+	if ( encodedLength == rawLength ) return true;
+	if ( encodedLength == 0 ) bitPositions[0] = 0;
+
+	int bitPosition = bitPositions[encodedLength];
+	if ( !__codec->encodeBits( raw + encodedLength, rawLength - encodedLength, bits, bitPosition,
+		capacity * sizeof( int ) * 8, bitPositions + encodedLength ) ) return false;
+
+	encodedLength = rawLength;
+	return true;
+} // end function update
+
+/** Applies Huffman encoding to a block of data, copying the codes of the runs from the segment. <br>
+ * Produces the same output as HUFFMAN_Encode(). Runs that are out of order or don't match the segment's data are encoded normally. */
+void HUFFMAN_EncodeWithSegment(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be encoded. */
+	unsigned char * const outputBuffer,			/**< out: Pointer to destination buffer where encoded data will be stored. */
+	int const &inputBufferSize,					/**< in: Number of chars to read from inputBuffer. */
+	int *outputBufferSize,						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+	HuffmanSegment &segment,					/**< in: Segment containing the originals of the runs. */
+	HuffmanSegmentRun const *runs,				/**< in: Parts of inputBuffer copied from the segment, ordered by offset. */
+	int numRuns									/**< in: Number of elements of runs. */
+){
+	// The codes are only compatible with the stream when the bits are stored backwards.
+	if ( (numRuns <= 0) || (__codec->reversedBytes() == false) || (segment.update() == false) ){
+		huffman_Encode( inputBuffer, outputBuffer, inputBufferSize, outputBufferSize, true );
+		return;
+	}
+
+	// if not expandable Limit output to input length, same as HuffmanCodec::encode().
+	int maxBytes = *outputBufferSize;
+	if ( (__codec->allowExpansion() == false) && ((inputBufferSize + 1) < maxBytes) ) maxBytes = inputBufferSize + 1;
+	if ( maxBytes < 1 ){
+		*outputBufferSize = 0;
+		return;
+	}
+
+	// The stream starts after the padding signal.
+	unsigned char * const stream = outputBuffer + 1;
+	int const maxBits = (maxBytes - 1) * 8;
+	int bitPosition = 0;
+	int encoded = 0;
+	bool fits = true;
+
+	for ( int i = 0; fits && (i < numRuns); i++ ){
+		HuffmanSegmentRun const &run = runs[i];
+
+		// Only use runs that still match the segment.
+		if ( (run.length <= 0) || (run.offset < encoded) || ((run.offset + run.length) > inputBufferSize)
+			|| (run.segmentOffset < 0) || ((run.segmentOffset + run.length) > segment.encodedLength)
+			|| (memcmp( inputBuffer + run.offset, segment.raw + run.segmentOffset, run.length ) != 0) ) continue;
+
+		// Encode whatever precedes the run, then copy the run's codes.
+		fits = __codec->encodeBits( inputBuffer + encoded, run.offset - encoded, stream, bitPosition, maxBits, NULL );
+		if ( fits ){
+			int const start = segment.bitPositions[run.segmentOffset];
+			int const count = segment.bitPositions[run.segmentOffset + run.length] - start;
+			if ( (bitPosition + count) > maxBits ) fits = false;
+			else {
+				HuffmanCodec::copyBits( stream, bitPosition, segment.bits, start, count );
+				bitPosition += count;
+				encoded = run.offset + run.length;
+			}
+		}
+	}
+	if ( fits ) fits = __codec->encodeBits( inputBuffer + encoded, inputBufferSize - encoded, stream, bitPosition, maxBits, NULL );
+
+	// expansion occured -- provide backwards compatibility
+	if ( fits == false ){
+		huffman_StoreUnencoded( inputBuffer, outputBuffer, inputBufferSize, outputBufferSize );
+		return;
+	}
+
+	// write padding signal byte to begining of stream.
+	outputBuffer[0] = (unsigned char)((8 - (bitPosition & 7)) & 7);
+	*outputBufferSize = 1 + ((bitPosition + 7) >> 3);
+} // end function HUFFMAN_EncodeWithSegment
+
+/** Decodes a block of data that is Huffman encoded, either with the decoding lookup table or by walking the Huffman tree. */
+static void huffman_Decode(
 	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be decoded. */
 	unsigned char * const outputBuffer,			/**< out: Pointer to destination buffer where decoded data will be stored. */
 	int const &inputBufferSize,					/**< in: Number of chars to read from inputBuffer. */
-	int *outputBufferSize						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+	int *outputBufferSize,						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+	bool useTable								/**< in: Use HuffmanCodec::decode() if true, HuffmanCodec::decodeWithTree() otherwise. */
 ){
 	// check for "unencoded" signal & provide backwards compatibility
 	if ((inputBufferSize > 0) && ((inputBuffer[0]&0xff) == 0xff)){
@@ -150,8 +309,32 @@ void HUFFMAN_Decode(
 		
 		// supply the bytesWritten
 		*outputBufferSize = inputBufferSize - 1;
-	} else {
+	} else if ( useTable ) {
 		// decode the data
 		*outputBufferSize = __codec->decode( inputBuffer, outputBuffer, inputBufferSize, *outputBufferSize );
+	} else {
+		// decode the data the slow way
+		*outputBufferSize = __codec->decodeWithTree( inputBuffer, outputBuffer, inputBufferSize, *outputBufferSize );
 	}
+} // end function huffman_Decode
+
+/** Decodes a block of data that is Huffman encoded. */
+void HUFFMAN_Decode(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be decoded. */
+	unsigned char * const outputBuffer,			/**< out: Pointer to destination buffer where decoded data will be stored. */
+	int const &inputBufferSize,					/**< in: Number of chars to read from inputBuffer. */
+	int *outputBufferSize						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+){
+	huffman_Decode( inputBuffer, outputBuffer, inputBufferSize, outputBufferSize, true );
 } // end function HUFFMAN_Decode
+
+/** Decodes a block of data that is Huffman encoded by walking the Huffman tree bit by bit. <br>
+ * Slower than HUFFMAN_Decode, only kept as a reference for testing and benchmarking. */
+void HUFFMAN_DecodeWithTree(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be decoded. */
+	unsigned char * const outputBuffer,			/**< out: Pointer to destination buffer where decoded data will be stored. */
+	int const &inputBufferSize,					/**< in: Number of chars to read from inputBuffer. */
+	int *outputBufferSize						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+){
+	huffman_Decode( inputBuffer, outputBuffer, inputBufferSize, outputBufferSize, false );
+} // end function HUFFMAN_DecodeWithTree
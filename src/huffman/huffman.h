@@ -27,8 +27,6 @@
 #ifndef __HUFFMAN_H__
 #define __HUFFMAN_H__
 
-#include "huffcodec.h"
-
 /** Creates and intitializes a HuffmanCodec Object. <br>
  * Also arranges for HUFFMAN_Destruct() to be called upon termination. */
 void HUFFMAN_Construct();
@@ -52,4 +50,86 @@ void HUFFMAN_Decode(
 	int *outputBufferSize						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
 );
 
+/** Applies Huffman encoding to a block of data by putting each code through the BitWriter. <br>
+ * Slower than HUFFMAN_Encode, only kept as a reference for testing and benchmarking. */
+void HUFFMAN_EncodeWithWriter(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be encoded. */
+	unsigned char * const outputBuffer,			/**< out: Pointer to destination buffer where encoded data will be stored. */
+	int const &inputBufferSize,					/**< in: Number of chars to read from inputBuffer. */
+	int *outputBufferSize						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+);
+
+/** Decodes a block of data that is Huffman encoded by walking the Huffman tree bit by bit. <br>
+ * Slower than HUFFMAN_Decode, only kept as a reference for testing and benchmarking. */
+void HUFFMAN_DecodeWithTree(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be decoded. */
+	unsigned char * const outputBuffer,			/**< out: Pointer to destination buffer where decoded data will be stored. */
+	int const &inputBufferSize,					/**< in: Number of chars to read from inputBuffer. */
+	int *outputBufferSize						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+);
+
+/** Counts the bits the Huffman codes of a block of data take up, without encoding it.
+ * @return number of bits or -1 if the codec isn't initialized. */
+int HUFFMAN_GetEncodedBitCount(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be measured. */
+	int const &inputBufferSize					/**< in: Number of chars to read from inputBuffer. */
+);
+
+/** Part of a block of data that is a copy of data stored in a HuffmanSegment. */
+struct HuffmanSegmentRun {
+	int offset;			/**< Position of the copy in the block of data. */
+	int segmentOffset;	/**< Position of the original in the segment. */
+	int length;			/**< Number of chars copied. */
+};
+
+/** Data that is sent to several recipients as part of different blocks of data. <br>
+ * The segment is Huffman encoded only once, HUFFMAN_EncodeWithSegment() copies the codes of the
+ * parts of a block that are found in the segment instead of encoding those parts again. */
+class HuffmanSegment {
+public:
+	HuffmanSegment();
+	~HuffmanSegment();
+
+	/** Removes all data from the segment. */
+	void clear();
+
+	/** Appends data to the end of the segment.
+	 * @return position of the data in the segment or -1 if the segment is full. */
+	int append(
+		unsigned char const * const data,	/**< in: Pointer to start of data that is to be appended. */
+		int const &length					/**< in: Number of chars to append. */
+	);
+
+	/** Number of chars stored in the segment. */
+	int size() const { return rawLength; }
+
+	/** Maximum number of chars the segment can store. */
+	static int const capacity = 32768;
+
+private:
+	friend void HUFFMAN_EncodeWithSegment( unsigned char const * const, unsigned char * const, int const &, int *, HuffmanSegment &, HuffmanSegmentRun const *, int );
+
+	/** Encodes the data that was appended since the last update.
+	 * @return false if the data can't be encoded this way. */
+	bool update();
+
+	unsigned char * raw;	/**< The data of the segment. */
+	int rawLength;			/**< Number of chars stored in raw. */
+	unsigned char * bits;	/**< Huffman codes of the data in Old Huffman Compatibility Mode bit order. */
+	int * bitPositions;		/**< Position in bits of each char's code plus the end of the codes. */
+	int encodedLength;		/**< Number of chars of raw already encoded into bits. */
+};
+
+/** Applies Huffman encoding to a block of data, copying the codes of the runs from the segment. <br>
+ * Produces the same output as HUFFMAN_Encode(). Runs that are out of order or don't match the segment's data are encoded normally. */
+void HUFFMAN_EncodeWithSegment(
+	unsigned char const * const inputBuffer,	/**< in: Pointer to start of data that is to be encoded. */
+	unsigned char * const outputBuffer,			/**< out: Pointer to destination buffer where encoded data will be stored. */
+	int const &inputBufferSize,					/**< in: Number of chars to read from inputBuffer. */
+	int *outputBufferSize,						/**< in+out: Max chars to write into outputBuffer. Upon return holds the number of chars stored or 0 if an error occurs. */
+	HuffmanSegment &segment,					/**< in: Segment containing the originals of the runs. */
+	HuffmanSegmentRun const *runs,				/**< in: Parts of inputBuffer copied from the segment, ordered by offset. */
+	int numRuns									/**< in: Number of elements of runs. */
+);
+
 #endif // __HUFFMAN_H__
@@ -68,6 +68,7 @@ void *M_Malloc(size_t size)
 		I_FatalError("Could not malloc %zu bytes", size);
 
 	GC::AllocBytes += _msize(block);
+	GC::AllocCount++;
 	return block;
 }
 
@@ -83,6 +84,7 @@ void *M_Realloc(void *memblock, size_t size)
 		I_FatalError("Could not realloc %zu bytes", size);
 	}
 	GC::AllocBytes += _msize(block);
+	GC::AllocCount++;
 	return block;
 }
 #else
@@ -98,6 +100,7 @@ void *M_Malloc(size_t size)
 	block = sizeStore+1;
 
 	GC::AllocBytes += _msize(block);
+	GC::AllocCount++;
 	return block;
 }
 
@@ -121,6 +124,7 @@ void *M_Realloc(void *memblock, size_t size)
 	block = sizeStore+1;
 
 	GC::AllocBytes += _msize(block);
+	GC::AllocCount++;
 	return block;
 }
 #endif
@@ -138,6 +142,7 @@ void *M_Malloc_Dbg(size_t size, const char *file, int lineno)
 		I_FatalError("Could not malloc %zu bytes", size);
 
 	GC::AllocBytes += _msize(block);
+	GC::AllocCount++;
 	return block;
 }
 
@@ -153,6 +158,7 @@ void *M_Realloc_Dbg(void *memblock, size_t size, const char *file, int lineno)
 		I_FatalError("Could not realloc %zu bytes", size);
 	}
 	GC::AllocBytes += _msize(block);
+	GC::AllocCount++;
 	return block;
 }
 #else
@@ -168,6 +174,7 @@ void *M_Malloc_Dbg(size_t size, const char *file, int lineno)
 	block = sizeStore+1;
 
 	GC::AllocBytes += _msize(block);
+	GC::AllocCount++;
 	return block;
 }
 
@@ -192,6 +199,7 @@ void *M_Realloc_Dbg(void *memblock, size_t size, const char *file, int lineno)
 	block = sizeStore+1;
 
 	GC::AllocBytes += _msize(block);
+	GC::AllocCount++;
 	return block;
 }
 #endif
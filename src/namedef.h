@@ -584,3 +584,5 @@ xx(CL_TicsPerUpdate)
 xx(CL_ConnectionType)
 // [CK] Client flags for various booleans masked in a bitfield.
 xx(CL_ClientFlags)
+// How many bytes per second the server may send to the client at most.
+xx(CL_Rate)
@@ -50,6 +50,17 @@
 
 #include "networkheaders.h"
 
+// Batched datagram I/O (recvmmsg/sendmmsg) and event-driven waiting (epoll/timerfd)
+// are only available under Linux.
+#ifdef __linux__
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <pthread.h>
+#endif
+
 // [BB] Special things necessary for NETWORK_GetLocalAddress() under Linux.
 #ifdef unix
 #include <net/if.h>
@@ -87,8 +98,10 @@
 #include "templates.h"
 
 #include "md5.h"
+#include "za_checksumcache.h"
 #include "network/sv_auth.h"
 #include "doomerrors.h"
+#include "stats.h"
 
 enum LumpAuthenticationMode {
 	LAST_LUMP,
@@ -126,7 +139,7 @@ static	NETADDRESS_s	g_AddressFrom;
 static	SOCKET			g_NetworkSocket;
 
 // Socket for listening for LAN games.
-static	SOCKET			g_LANSocket;
+static	SOCKET			g_LANSocket = INVALID_SOCKET;
 // [BB] Did binding the LAN socket fail?
 static	bool				g_bLANSocketInvalid = false;
 
@@ -148,6 +161,132 @@ static GeoIP * g_GeoIPDB = NULL;
 // [BB]
 extern int restart;
 
+// File the Huffman-encoded packets we receive are written to (see the capturehuffmancorpus command).
+static	FILE			*g_HuffmanCorpusFile = NULL;
+
+// Number of packets that still need to be written to g_HuffmanCorpusFile.
+static	LONG			g_lHuffmanCorpusPacketsLeft = 0;
+
+// While set, launched packets are encoded but not sent, see NETWORK_SetDiscardOutboundPackets.
+static	bool			g_bDiscardOutboundPackets = false;
+
+// Number of encoded bytes of the packets discarded so far.
+static	QWORD			g_qwNumDiscardedBytes = 0;
+
+#ifdef __linux__
+// Maximum number of datagrams read by one recvmmsg or sent by one sendmmsg call.
+#define	NETWORK_BATCH_SIZE			32
+
+// Datagrams larger than this are ignored by NETWORK_GetPackets anyway.
+#define	NETWORK_BATCH_RECEIVE_SIZE	(( MAX_UDP_PACKET * 8 ) / 3 + 1 )
+
+// Datagrams read by the last recvmmsg call. NETWORK_GetPackets hands them out one by one.
+static	BYTE				g_abReceiveBatch[NETWORK_BATCH_SIZE][NETWORK_BATCH_RECEIVE_SIZE];
+static	struct sockaddr_in	g_ReceiveBatchAddresses[NETWORK_BATCH_SIZE];
+static	struct iovec		g_ReceiveBatchVectors[NETWORK_BATCH_SIZE];
+static	struct mmsghdr		g_ReceiveBatchHeaders[NETWORK_BATCH_SIZE];
+static	int					g_iReceiveBatchSize = 0;
+static	int					g_iReceiveBatchPosition = 0;
+
+// Encoded datagrams launched between NETWORK_BeginBatchedSend and NETWORK_FlushBatchedSend.
+static	BYTE				g_abSendBatch[NETWORK_BATCH_SIZE][MAX_UDP_PACKET + 1];
+static	NETADDRESS_s		g_SendBatchAddresses[NETWORK_BATCH_SIZE];
+static	struct sockaddr_in	g_SendBatchSocketAddresses[NETWORK_BATCH_SIZE];
+static	struct iovec		g_SendBatchVectors[NETWORK_BATCH_SIZE];
+static	struct mmsghdr		g_SendBatchHeaders[NETWORK_BATCH_SIZE];
+static	int					g_iSendBatchSize = 0;
+static	bool				g_bBatchingSends = false;
+
+// epoll instance watching the sockets, the console and g_iWaitTimerFD for NETWORK_WaitForInput.
+static	int					g_iEpollFD = -1;
+static	int					g_iWaitTimerFD = -1;
+
+// Is stdin currently watched by g_iEpollFD?
+static	bool				g_bEpollWatchesStdin = false;
+
+// Did setting up g_iEpollFD fail?
+static	bool				g_bEventWaitFailed = false;
+
+// Number of decoded packets the ingress thread can queue for the game thread.
+#define	NETWORK_INGRESS_QUEUE_SIZE	128
+
+// A packet that was received, validated and decoded by the ingress thread.
+typedef struct
+{
+	// Who sent the packet.
+	NETADDRESS_s	Address;
+
+	// Size of the datagram as it was received, for the traffic statistics.
+	LONG			lNumReceivedBytes;
+
+	// Number of bytes in abData.
+	LONG			lNumBytes;
+
+	// The Huffman-decoded payload (or the raw payload if it came from the auth server).
+	BYTE			abData[NETWORK_BATCH_RECEIVE_SIZE];
+
+} INGRESSPACKET_t;
+
+// Single producer (ingress thread), single consumer (game thread) ring of received packets.
+// Both counters only ever increase, the slot of a counter value is value % NETWORK_INGRESS_QUEUE_SIZE.
+static	INGRESSPACKET_t		*g_pIngressQueue = NULL;
+static	unsigned int		g_uiIngressHead = 0;
+static	unsigned int		g_uiIngressTail = 0;
+
+// The ingress thread, and whether it's running or supposed to stop.
+static	pthread_t			g_IngressThread;
+static	bool				g_bIngressThreadRunning = false;
+static	bool				g_bStopIngressThread = false;
+
+// Signaled by the ingress thread after it queued packets, so that NETWORK_WaitForInput wakes up.
+static	int					g_iIngressEventFD = -1;
+
+// Protects the settings below, which the game thread hands to the ingress thread.
+static	pthread_mutex_t		g_IngressMutex = PTHREAD_MUTEX_INITIALIZER;
+static	NETADDRESS_s		g_IngressAuthServerAddress;
+static	LONG				g_lIngressQueryIgnoreTime = 10;
+
+// The ingress thread drops all packets from these addresses (mirrors the server's flood protection).
+static	QueryIPQueue		g_IngressFloodQueue( 10 );
+
+// Addresses of connected clients and RCON sessions (see SERVER_GetAddressKey), counting how often
+// each was added. The flood queue only matches IPs, so these are exempt from it, like on the game thread.
+static	TMap<QWORD, int, AddressKeyHashTraits>	g_IngressExemptAddresses;
+
+// Addresses that recently queried the server with a launcher. Only used by the ingress thread.
+static	QueryIPQueue		g_IngressLauncherQueue( 10 );
+
+// What the ingress thread did with the packets it received. Only accessed atomically.
+static	ULONG				g_ulIngressNumQueued = 0;
+static	ULONG				g_ulIngressNumRejected = 0;
+static	ULONG				g_ulIngressNumLauncherIgnored = 0;
+static	ULONG				g_ulIngressNumOverflows = 0;
+
+// Size of the datagrams that weren't queued and of the replies the ingress thread sent. Still needs to be
+// added to the traffic statistics by the game thread.
+static	ULONG				g_ulIngressRejectedBytes = 0;
+static	ULONG				g_ulIngressSentBytes = 0;
+
+// Copy of the server's prepared launcher replies, protected by g_IngressMutex.
+static	ServerInfoSnapshot	*g_pIngressServerInfo = NULL;
+
+// Was g_pIngressServerInfo used to answer a launcher since NETWORK_WasServerInfoSnapshotUsed was called?
+static	bool				g_bIngressServerInfoUsed = false;
+static	ULONG				g_ulIngressNumLauncherAnswered = 0;
+
+// Replies sent by the ingress thread are written and encoded here.
+static	BYTE				g_abIngressReply[MAX_UDP_PACKET];
+static	UCHAR				g_aucIngressEncodedReply[MAX_UDP_PACKET + 1];
+#endif
+
+// Use recvmmsg/sendmmsg to reduce the number of system calls. Only has an effect under Linux.
+CVAR( Bool, net_batchedio, true, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+
+// Receive, validate and decode packets on a separate thread. Only has an effect for servers under Linux.
+CVAR( Bool, net_ingressthread, true, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+
+EXTERN_CVAR( Int, sv_queryignoretime )
+
 //*****************************************************************************
 //	PROTOTYPES
 
@@ -156,6 +295,16 @@ static	void			network_Error( const char *pszError );
 static	SOCKET			network_AllocateSocket( void );
 static	bool			network_BindSocketToPort( SOCKET Socket, ULONG ulInAddr, USHORT usPort, bool bReUse );
 static	bool			network_GenerateLumpMD5HashAndWarnIfNeeded( const int LumpNum, const char *LumpName, FString &MD5Hash );
+static	void			network_WriteToHuffmanCorpus( const BYTE *pbData, LONG lNumBytes );
+static	void			network_SendDatagram( const UCHAR *pucData, INT iNumBytes, NETADDRESS_s Address, struct sockaddr_in &SocketAddress );
+#ifdef __linux__
+static	LONG			network_ReceiveFromBatch( struct sockaddr_in &SocketFrom, const UCHAR *&pucData );
+static	void			network_FlushSendBatch( void );
+static	void			network_AddToSendBatch( const UCHAR *pucData, INT iNumBytes, NETADDRESS_s Address, struct sockaddr_in &SocketAddress );
+static	void			network_UpdateIngressThread( void );
+static	void			network_StopIngressThread( void );
+static	bool			network_GetIngressPacket( void );
+#endif
 
 //*****************************************************************************
 //	FUNCTIONS
@@ -497,6 +646,39 @@ void NETWORK_Destruct( void )
 	// Free the network message buffer.
 	NETWORK_FreeBuffer( &g_NetworkMessage );
 
+	// Close the packet corpus if we are still capturing.
+	if ( g_HuffmanCorpusFile != NULL )
+	{
+		fclose( g_HuffmanCorpusFile );
+		g_HuffmanCorpusFile = NULL;
+	}
+
+#ifdef __linux__
+	// The ingress thread must not touch the socket or the queue anymore.
+	network_StopIngressThread( );
+	delete[] g_pIngressQueue;
+	g_pIngressQueue = NULL;
+	NETWORK_PublishServerInfoSnapshot( NULL );
+	g_uiIngressHead = g_uiIngressTail = 0;
+	if ( g_iIngressEventFD != -1 )
+	{
+		close( g_iIngressEventFD );
+		g_iIngressEventFD = -1;
+	}
+
+	if ( g_iEpollFD != -1 )
+	{
+		close( g_iEpollFD );
+		g_iEpollFD = -1;
+	}
+	if ( g_iWaitTimerFD != -1 )
+	{
+		close( g_iWaitTimerFD );
+		g_iWaitTimerFD = -1;
+	}
+	g_bEpollWatchesStdin = false;
+#endif
+
 	// [BB] Delete the GeoIP database.
 	GeoIP_delete ( g_GeoIPDB );
 	g_GeoIPDB = NULL;
@@ -513,6 +695,7 @@ int NETWORK_GetPackets( void )
 	INT					iDecodedNumBytes = sizeof(g_ucHuffmanBuffer);
 	struct sockaddr_in	SocketFrom;
 	INT					iSocketFromLength;
+	const UCHAR			*pucData = g_ucHuffmanBuffer;
 
 	iSocketFromLength = sizeof( SocketFrom );
 
@@ -520,9 +703,24 @@ int NETWORK_GetPackets( void )
 	if ( g_NetworkSocket == INVALID_SOCKET )
 		return ( 0 );
 
+#ifdef __linux__
+	// Hand out what the ingress thread received. Once it's stopped, whatever it queued
+	// before is handed out before we read from the socket ourselves again.
+	network_UpdateIngressThread( );
+	if ( network_GetIngressPacket( ))
+		return ( g_NetworkMessage.ulCurrentSize );
+	if ( g_bIngressThreadRunning )
+		return ( 0 );
+#endif
+
 #ifdef	WIN32
 	lNumBytes = recvfrom( g_NetworkSocket, (char *)g_ucHuffmanBuffer, sizeof( g_ucHuffmanBuffer ), 0, (struct sockaddr *)&SocketFrom, &iSocketFromLength );
 #else
+#ifdef __linux__
+	if ( net_batchedio )
+		lNumBytes = network_ReceiveFromBatch( SocketFrom, pucData );
+	else
+#endif
 	lNumBytes = recvfrom( g_NetworkSocket, (char *)g_ucHuffmanBuffer, sizeof( g_ucHuffmanBuffer ), 0, (struct sockaddr *)&SocketFrom, (socklen_t *)&iSocketFromLength );
 #endif
 
@@ -578,14 +776,17 @@ int NETWORK_GetPackets( void )
 	// [BB] Communication with the auth server is not Huffman-encoded.
 	if ( NETWORK_CompareAddress( g_AddressFrom, NETWORK_AUTH_GetCachedServerAddress( ), false ) == false )
 	{
-		HUFFMAN_Decode( g_ucHuffmanBuffer, (unsigned char *)g_NetworkMessage.pbData, lNumBytes, &iDecodedNumBytes );
+		if ( g_HuffmanCorpusFile != NULL )
+			network_WriteToHuffmanCorpus( pucData, lNumBytes );
+
+		HUFFMAN_Decode( pucData, (unsigned char *)g_NetworkMessage.pbData, lNumBytes, &iDecodedNumBytes );
 		g_NetworkMessage.ulCurrentSize = iDecodedNumBytes;
 	}
 	else
 	{
 		// [BB] We don't need to decode, so we just copy the data.
 		// Not very efficient, but this keeps the changes at a minimum for now.
-		memcpy ( g_NetworkMessage.pbData, g_ucHuffmanBuffer, lNumBytes );
+		memcpy ( g_NetworkMessage.pbData, pucData, lNumBytes );
 		g_NetworkMessage.ulCurrentSize = lNumBytes;
 	}
 	g_NetworkMessage.ByteStream.pbStream = g_NetworkMessage.pbData;
@@ -692,33 +893,51 @@ NETADDRESS_s NETWORK_GetFromAddress( void )
 
 //*****************************************************************************
 //
-void NETWORK_LaunchPacket( NETBUFFER_s *pBuffer, NETADDRESS_s Address )
+// Puts an already decoded packet into the network message buffer as if NETWORK_GetPackets
+// had just received it from Address. Used to replay captured packets without a socket.
+int NETWORK_InjectPacket( const BYTE *pbData, ULONG ulSize, NETADDRESS_s Address )
 {
-	LONG				lNumBytes;
-	INT					iNumBytesOut = sizeof(g_ucHuffmanBuffer);
-	struct sockaddr_in	SocketAddress;
+	if ( ulSize >= g_NetworkMessage.ulMaxSize )
+		return ( 0 );
 
-	pBuffer->ulCurrentSize = NETWORK_CalcBufferSize( pBuffer );
+	g_AddressFrom = Address;
+	memcpy( g_NetworkMessage.pbData, pbData, ulSize );
+	g_NetworkMessage.ulCurrentSize = ulSize;
+	g_NetworkMessage.ByteStream.pbStream = g_NetworkMessage.pbData;
+	g_NetworkMessage.ByteStream.pbStreamEnd = g_NetworkMessage.ByteStream.pbStream + g_NetworkMessage.ulCurrentSize;
 
-	// Nothing to do.
-	if ( pBuffer->ulCurrentSize == 0 )
-		return;
+	return ( g_NetworkMessage.ulCurrentSize );
+}
 
-	// Convert the IP address to a socket address.
-	NETWORK_NetAddressToSocketAddress( Address, SocketAddress );
+//*****************************************************************************
+//
+// Packets launched while bDiscard is set are still Huffman-encoded, but only counted instead of sent.
+void NETWORK_SetDiscardOutboundPackets( bool bDiscard )
+{
+	g_bDiscardOutboundPackets = bDiscard;
 
-	// [BB] Communication with the auth server is not Huffman-encoded.
-	if ( NETWORK_CompareAddress( Address, NETWORK_AUTH_GetCachedServerAddress( ), false ) == false )
-		HUFFMAN_Encode( (unsigned char *)pBuffer->pbData, g_ucHuffmanBuffer, pBuffer->ulCurrentSize, &iNumBytesOut );
-	else
-	{
-		// [BB] We don't need to encode, so we just copy the data.
-		// Not very efficient, but this keeps the changes at a minimum for now.
-		memcpy ( g_ucHuffmanBuffer, pBuffer->pbData, pBuffer->ulCurrentSize );
-		iNumBytesOut = pBuffer->ulCurrentSize;
-	}
+#ifdef __linux__
+	// The ingress thread answers launchers by itself, see network_UpdateIngressThread.
+	if ( bDiscard )
+		network_StopIngressThread( );
+#endif
+}
+
+//*****************************************************************************
+//
+QWORD NETWORK_GetNumDiscardedBytes( void )
+{
+	return ( g_qwNumDiscardedBytes );
+}
+
+//*****************************************************************************
+//
+// Sends an already encoded datagram right away.
+static void network_SendDatagram( const UCHAR *pucData, INT iNumBytes, NETADDRESS_s Address, struct sockaddr_in &SocketAddress )
+{
+	LONG				lNumBytes;
 
-	lNumBytes = sendto( g_NetworkSocket, (const char*)g_ucHuffmanBuffer, iNumBytesOut, 0, (struct sockaddr *)&SocketAddress, sizeof( SocketAddress ));
+	lNumBytes = sendto( g_NetworkSocket, (const char*)pucData, iNumBytes, 0, (struct sockaddr *)&SocketAddress, sizeof( SocketAddress ));
 
 	// If sendto returns -1, there was an error.
 	if ( lNumBytes == -1 )
@@ -771,206 +990,819 @@ return;
 		SERVER_STATISTIC_AddToOutboundDataTransfer( lNumBytes );
 }
 
+#ifdef __linux__
 //*****************************************************************************
 //
-const char *NETWORK_AddressToString( NETADDRESS_s Address )
+// Returns the next datagram of the current receive batch, reading a new batch from the
+// socket once the current one is used up. Behaves like recvfrom otherwise.
+static LONG network_ReceiveFromBatch( struct sockaddr_in &SocketFrom, const UCHAR *&pucData )
 {
-	static char	s_szAddress[64];
+	if ( g_iReceiveBatchPosition >= g_iReceiveBatchSize )
+	{
+		g_iReceiveBatchPosition = 0;
+		g_iReceiveBatchSize = 0;
 
-	sprintf( s_szAddress, "%i.%i.%i.%i:%i", Address.abIP[0], Address.abIP[1], Address.abIP[2], Address.abIP[3], ntohs( Address.usPort ));
+		// recvmmsg changes some of the fields, so they need to be set up every time.
+		for ( int i = 0; i < NETWORK_BATCH_SIZE; i++ )
+		{
+			g_ReceiveBatchVectors[i].iov_base = g_abReceiveBatch[i];
+			g_ReceiveBatchVectors[i].iov_len = NETWORK_BATCH_RECEIVE_SIZE;
+			memset( &g_ReceiveBatchHeaders[i], 0, sizeof( g_ReceiveBatchHeaders[i] ));
+			g_ReceiveBatchHeaders[i].msg_hdr.msg_name = &g_ReceiveBatchAddresses[i];
+			g_ReceiveBatchHeaders[i].msg_hdr.msg_namelen = sizeof( g_ReceiveBatchAddresses[i] );
+			g_ReceiveBatchHeaders[i].msg_hdr.msg_iov = &g_ReceiveBatchVectors[i];
+			g_ReceiveBatchHeaders[i].msg_hdr.msg_iovlen = 1;
+		}
 
-	return ( s_szAddress );
-}
+		const int iNumReceived = recvmmsg( g_NetworkSocket, g_ReceiveBatchHeaders, NETWORK_BATCH_SIZE, MSG_DONTWAIT, NULL );
+		if ( iNumReceived <= 0 )
+			return ( iNumReceived );
 
-//*****************************************************************************
-//
-const char *NETWORK_AddressToStringIgnorePort( NETADDRESS_s Address )
-{
-	static char	s_szAddress[64];
+		g_iReceiveBatchSize = iNumReceived;
+	}
 
-	sprintf( s_szAddress, "%i.%i.%i.%i", Address.abIP[0], Address.abIP[1], Address.abIP[2], Address.abIP[3] );
+	const struct mmsghdr &Header = g_ReceiveBatchHeaders[g_iReceiveBatchPosition];
+	SocketFrom = g_ReceiveBatchAddresses[g_iReceiveBatchPosition];
+	pucData = g_abReceiveBatch[g_iReceiveBatchPosition];
+	g_iReceiveBatchPosition++;
 
-	return ( s_szAddress );
-}
+	// A truncated datagram is too large for g_NetworkMessage, make sure it's ignored.
+	if ( Header.msg_hdr.msg_flags & MSG_TRUNC )
+		return ( NETWORK_BATCH_RECEIVE_SIZE );
 
-//*****************************************************************************
-//
-void NETWORK_SetAddressPort( NETADDRESS_s &Address, USHORT usPort )
-{
-	Address.usPort = htons( usPort );
+	return ( Header.msg_len );
 }
 
 //*****************************************************************************
 //
-NETADDRESS_s NETWORK_GetLocalAddress( void )
+// Sends all datagrams of the send batch with as few sendmmsg calls as possible.
+static void network_FlushSendBatch( void )
 {
-	char				szBuffer[512];
-	struct sockaddr_in	SocketAddress;
-	NETADDRESS_s		Address;
-	int					iNameLength;
-
-#ifndef __WINE__
-	gethostname( szBuffer, 512 );
-#endif
-	szBuffer[512-1] = 0;
-
-	// Convert the host name to our local 
-	bool stringToAddress = NETWORK_StringToAddress( szBuffer, &Address );
+	int iNumSent = 0;
 
-	iNameLength = sizeof( SocketAddress );
-#ifndef	WIN32
-	if ( getsockname ( g_NetworkSocket, (struct sockaddr *)&SocketAddress, (socklen_t *)&iNameLength) == -1 )
-#else
-	if ( getsockname ( g_NetworkSocket, (struct sockaddr *)&SocketAddress, &iNameLength ) == -1 )
-#endif
+	while ( iNumSent < g_iSendBatchSize )
 	{
-		Printf( "NETWORK_GetLocalAddress: Error getting socket name: %s", strerror( errno ));
-	}
+		const int iResult = sendmmsg( g_NetworkSocket, &g_SendBatchHeaders[iNumSent], g_iSendBatchSize - iNumSent, 0 );
 
-#ifdef unix
-	// [BB] The "gethostname -> gethostbyname" trick didn't reveal the local IP.
-	// Now we need to resort to something more complicated.
-	if ( stringToAddress == false )
-	{
-#ifndef __FreeBSD__
-		unsigned char      *u;
-		int                size  = 1;
-		struct ifreq       *ifr;
-		struct ifconf      ifc;
-		struct sockaddr_in sa;
-		
-		ifc.ifc_len = IFRSIZE;
-		ifc.ifc_req = NULL;
-		
-		do {
-			++size;
-			/* realloc buffer size until no overflow occurs  */
-			if (NULL == (ifc.ifc_req = (ifreq*)realloc(ifc.ifc_req, IFRSIZE)))
-			{
-				fprintf(stderr, "Out of memory.\n");
-				exit(EXIT_FAILURE);
-			}
-			ifc.ifc_len = IFRSIZE;
-			if (ioctl(g_NetworkSocket, SIOCGIFCONF, &ifc))
-			{
-				perror("ioctl SIOCFIFCONF");
-				exit(EXIT_FAILURE);
-			}
-		} while  (IFRSIZE <= ifc.ifc_len);
-		
-		ifr = ifc.ifc_req;
-		for (;(char *) ifr < (char *) ifc.ifc_req + ifc.ifc_len; ++ifr)
+		if ( iResult > 0 )
 		{
-		
-			if (ifr->ifr_addr.sa_data == (ifr+1)->ifr_addr.sa_data)
-			{
-				continue;  /* duplicate, skip it */
-			}
-		
-			if (ioctl(g_NetworkSocket, SIOCGIFFLAGS, ifr))
-			{
-				continue;  /* failed to get flags, skip it */
-			}
-		
-			Printf("Found interface %s", ifr->ifr_name);
-			Printf(" with IP address: %s\n", inet_ntoa(inaddrr(ifr_addr.sa_data)));
-			*(int *)&Address.abIP = *(int *)&inaddrr(ifr_addr.sa_data);
-			if ( Address.abIP[0] != 127 )
+			// Record this for our statistics window.
+			if ( NETWORK_GetState( ) == NETSTATE_SERVER )
 			{
-				Printf ( "Using IP address of interface %s as local address.\n", ifr->ifr_name );
-				break;
+				for ( int i = iNumSent; i < iNumSent + iResult; i++ )
+					SERVER_STATISTIC_AddToOutboundDataTransfer( g_SendBatchHeaders[i].msg_len );
 			}
+			iNumSent += iResult;
 		}
-		if ( ifc.ifc_req != NULL )
-			free ( ifc.ifc_req );
-#else
-		struct ifreq       *ifr;
-		struct ifconf      ifc;
-		bzero(&ifc, sizeof(ifc));
-		unsigned int n = 1;
-		struct ifreq *lifr;
-		ifr = (ifreq*)calloc( ifc.ifc_len, sizeof(*ifr) );
-		do
-		{
-			n *= 2;
-			ifr = (ifreq*)realloc( ifr, PAGE_SIZE * n );
-			bzero( ifr, PAGE_SIZE * n );
-			ifc.ifc_req = ifr;
-			ifc.ifc_len = n * PAGE_SIZE;
-		} while( ( ioctl( g_NetworkSocket, SIOCGIFCONF, &ifc ) == -1 ) || ( ifc.ifc_len >= ( (n-1) * PAGE_SIZE)) );
-		
-		lifr = (struct ifreq *)&ifc.ifc_buf[ifc.ifc_len];
-		
-		while (ifr < lifr)
+		else
 		{
-			struct sockaddr *sa = &ifr->ifr_ifru.ifru_addr;
-			if( AF_INET == sa->sa_family )
-			{
-				struct sockaddr_in dummysa;
-				in_addr inAddr = *(struct in_addr *) &ifr->ifr_addr.sa_data[sizeof dummysa.sin_port];
-	
-				Printf("Found interface %s", ifr->ifr_name);
-				Printf(" with IP address: %s\n", inet_ntoa(inAddr));
-				*(int *)&Address.abIP = *(int *)&inAddr;
-				if ( Address.abIP[0] != 127 )
-				{
-					Printf ( "Using IP address of interface %s as local address.\n", ifr->ifr_name );
-					break;
-				}
-			 }
-	 	ifr = (struct ifreq *)(((char *)ifr) + _SIZEOF_ADDR_IFREQ(*ifr));
- 		}
-#endif
+			// The next datagram couldn't be sent. Send it on its own, so that the
+			// error is handled like it always was, and continue with the rest.
+			network_SendDatagram( g_abSendBatch[iNumSent], g_SendBatchVectors[iNumSent].iov_len, g_SendBatchAddresses[iNumSent], g_SendBatchSocketAddresses[iNumSent] );
+			iNumSent++;
+		}
 	}
-#endif
 
-	Address.usPort = SocketAddress.sin_port;
-	return ( Address );
+	g_iSendBatchSize = 0;
 }
 
 //*****************************************************************************
 //
-NETADDRESS_s	NETWORK_GetCachedLocalAddress( void )
+static void network_AddToSendBatch( const UCHAR *pucData, INT iNumBytes, NETADDRESS_s Address, struct sockaddr_in &SocketAddress )
 {
-	return g_LocalAddress;
+	if ( g_iSendBatchSize == NETWORK_BATCH_SIZE )
+		network_FlushSendBatch( );
+
+	const int i = g_iSendBatchSize++;
+	memcpy( g_abSendBatch[i], pucData, iNumBytes );
+	g_SendBatchAddresses[i] = Address;
+	g_SendBatchSocketAddresses[i] = SocketAddress;
+	g_SendBatchVectors[i].iov_base = g_abSendBatch[i];
+	g_SendBatchVectors[i].iov_len = iNumBytes;
+	memset( &g_SendBatchHeaders[i], 0, sizeof( g_SendBatchHeaders[i] ));
+	g_SendBatchHeaders[i].msg_hdr.msg_name = &g_SendBatchSocketAddresses[i];
+	g_SendBatchHeaders[i].msg_hdr.msg_namelen = sizeof( g_SendBatchSocketAddresses[i] );
+	g_SendBatchHeaders[i].msg_hdr.msg_iov = &g_SendBatchVectors[i];
+	g_SendBatchHeaders[i].msg_hdr.msg_iovlen = 1;
 }
+#endif
 
 //*****************************************************************************
 //
-NETBUFFER_s *NETWORK_GetNetworkMessageBuffer( void )
+// Until NETWORK_FlushBatchedSend is called, launched packets are collected and then sent
+// with as few system calls as possible. Without batched I/O support, this does nothing.
+void NETWORK_BeginBatchedSend( void )
 {
-	return ( &g_NetworkMessage );
+#ifdef __linux__
+	g_bBatchingSends = ( net_batchedio && ( g_NetworkSocket != INVALID_SOCKET ));
+#endif
 }
 
 //*****************************************************************************
 //
-USHORT NETWORK_ntohs( ULONG ul )
+void NETWORK_FlushBatchedSend( void )
 {
-	return ( ntohs( (u_short)ul ));
+#ifdef __linux__
+	if ( g_iSendBatchSize > 0 )
+		network_FlushSendBatch( );
+
+	g_bBatchingSends = false;
+#endif
 }
 
+#ifdef __linux__
 //*****************************************************************************
 //
-USHORT NETWORK_GetLocalPort( void )
+static LONG network_GetIngressSeconds( void )
 {
-	return ( g_usLocalPort );
+	struct timespec	Now;
+
+	clock_gettime( CLOCK_MONOTONIC, &Now );
+	return ( static_cast<LONG>( Now.tv_sec ));
 }
 
 //*****************************************************************************
-// [BB] 
-bool NETWORK_IsGeoIPAvailable ( void )
+//
+static void network_IngressWriteLong( BYTE *pbData, LONG lValue )
 {
-	return ( g_GeoIPDB != NULL );
+	for ( int i = 0; i < 4; i++ )
+		pbData[i] = static_cast<BYTE>( lValue >> ( 8 * i ));
 }
 
 //*****************************************************************************
-// [BB] 
-FString NETWORK_GetCountryCodeFromAddress( NETADDRESS_s Address )
+//
+static LONG network_IngressReadLong( const BYTE *pbData )
 {
-	const char * addressString = NETWORK_AddressToStringIgnorePort( Address );
-	if ( ( strnicmp( "10.", addressString, 3 ) == 0 ) ||
-		 ( strnicmp( "192.168.", addressString, 8 ) == 0 ) ||
-		 ( strnicmp( "127.", addressString, 4 ) == 0 ) )
+	return ( pbData[0] | ( pbData[1] << 8 ) | ( pbData[2] << 16 ) | ( pbData[3] << 24 ));
+}
+
+//*****************************************************************************
+//
+// Encodes and sends a reply of the ingress thread. NETWORK_LaunchPacket can't be used
+// here, since it uses the buffers of the game thread.
+static void network_IngressSendReply( NETADDRESS_s Address, const BYTE *pbReply, LONG lNumBytes )
+{
+	int					iEncodedNumBytes = sizeof( g_aucIngressEncodedReply );
+	struct sockaddr_in	SocketAddress;
+
+	HUFFMAN_Encode( pbReply, g_aucIngressEncodedReply, lNumBytes, &iEncodedNumBytes );
+	if ( iEncodedNumBytes <= 0 )
+		return;
+
+	NETWORK_NetAddressToSocketAddress( Address, SocketAddress );
+	if ( sendto( g_NetworkSocket, (const char *)g_aucIngressEncodedReply, iEncodedNumBytes, 0, (struct sockaddr *)&SocketAddress, sizeof( SocketAddress )) > 0 )
+		__atomic_add_fetch( &g_ulIngressSentBytes, iEncodedNumBytes, __ATOMIC_RELAXED );
+}
+
+//*****************************************************************************
+//
+// Tells a launcher that queried us too often to wait, like SERVER_MASTER_SendServerInfo does.
+static void network_IngressIgnoreLauncher( NETADDRESS_s Address, const BYTE *pbQuery, LONG lNumBytes )
+{
+	// The query consists of the challenge, the flags and the time the launcher sent it.
+	network_IngressWriteLong( g_abIngressReply, SERVER_LAUNCHER_IGNORING );
+	network_IngressWriteLong( g_abIngressReply + 4, ( lNumBytes >= 12 ) ? network_IngressReadLong( pbQuery + 8 ) : -1 );
+	network_IngressSendReply( Address, g_abIngressReply, 8 );
+}
+
+//*****************************************************************************
+//
+// Answers a launcher query with the replies the server prepared. Returns false if the game
+// thread has to answer it.
+static bool network_IngressAnswerLauncher( NETADDRESS_s Address, const BYTE *pbQuery, LONG lNumBytes )
+{
+	LONG	lReplySize = sizeof( g_abIngressReply );
+	bool	bAnswered = false;
+
+	if ( lNumBytes < 12 )
+		return ( false );
+
+	const ULONG ulFlags = network_IngressReadLong( pbQuery + 4 ) & SQF_ALL;
+	const ULONG ulTime = network_IngressReadLong( pbQuery + 8 );
+
+	pthread_mutex_lock( &g_IngressMutex );
+	if ( g_pIngressServerInfo != NULL )
+	{
+		if ( g_pIngressServerInfo->isIPBanned( Address ))
+		{
+			network_IngressWriteLong( g_abIngressReply, SERVER_LAUNCHER_BANNED );
+			network_IngressWriteLong( g_abIngressReply + 4, ulTime );
+			lReplySize = 8;
+			bAnswered = true;
+		}
+		else
+			bAnswered = g_pIngressServerInfo->writeReply( ulFlags, ulTime, g_abIngressReply, lReplySize );
+	}
+	pthread_mutex_unlock( &g_IngressMutex );
+
+	if ( bAnswered == false )
+		return ( false );
+
+	network_IngressSendReply( Address, g_abIngressReply, lReplySize );
+	__atomic_store_n( &g_bIngressServerInfoUsed, true, __ATOMIC_RELAXED );
+	__atomic_add_fetch( &g_ulIngressNumLauncherAnswered, 1, __ATOMIC_RELAXED );
+	return ( true );
+}
+
+//*****************************************************************************
+//
+// Validates and decodes a datagram that the ingress thread received and queues it for the
+// game thread. Packets the game thread would throw away anyway are dropped right here.
+// Returns whether the packet was queued.
+static bool network_QueueIngressPacket( struct sockaddr_in &SocketFrom, const UCHAR *pucData, LONG lNumBytes )
+{
+	NETADDRESS_s	Address;
+	bool			bFlooding;
+	bool			bFromAuthServer;
+	LONG			lQueryIgnoreTime;
+	const LONG		lNow = network_GetIngressSeconds( );
+
+	NETWORK_SocketAddressToNetAddress( &SocketFrom, &Address );
+
+	pthread_mutex_lock( &g_IngressMutex );
+	g_IngressFloodQueue.adjustHead( lNow );
+	bFlooding = g_IngressFloodQueue.addressInQueue( Address )
+		&& ( g_IngressExemptAddresses.CheckKey( SERVER_GetAddressKey( Address )) == NULL );
+	bFromAuthServer = NETWORK_CompareAddress( Address, g_IngressAuthServerAddress, false );
+	lQueryIgnoreTime = g_lIngressQueryIgnoreTime;
+	pthread_mutex_unlock( &g_IngressMutex );
+
+	// Empty packets, packets too large for g_NetworkMessage and packets from flooding IPs that
+	// don't belong to a client or an RCON session are ignored.
+	if (( lNumBytes <= 0 ) || ( lNumBytes >= NETWORK_BATCH_RECEIVE_SIZE ) || bFlooding )
+	{
+		__atomic_add_fetch( &g_ulIngressNumRejected, 1, __ATOMIC_RELAXED );
+		__atomic_add_fetch( &g_ulIngressRejectedBytes, lNumBytes, __ATOMIC_RELAXED );
+		return ( false );
+	}
+
+	const unsigned int uiTail = g_uiIngressTail;
+	if ( uiTail - __atomic_load_n( &g_uiIngressHead, __ATOMIC_ACQUIRE ) >= NETWORK_INGRESS_QUEUE_SIZE )
+	{
+		__atomic_add_fetch( &g_ulIngressNumOverflows, 1, __ATOMIC_RELAXED );
+		__atomic_add_fetch( &g_ulIngressRejectedBytes, lNumBytes, __ATOMIC_RELAXED );
+		return ( false );
+	}
+
+	INGRESSPACKET_t &Packet = g_pIngressQueue[uiTail % NETWORK_INGRESS_QUEUE_SIZE];
+	Packet.Address = Address;
+	Packet.lNumReceivedBytes = lNumBytes;
+
+	// [BB] Communication with the auth server is not Huffman-encoded.
+	if ( bFromAuthServer )
+	{
+		memcpy( Packet.abData, pucData, lNumBytes );
+		Packet.lNumBytes = lNumBytes;
+	}
+	else
+	{
+		INT iDecodedNumBytes = sizeof( Packet.abData );
+		HUFFMAN_Decode( pucData, Packet.abData, lNumBytes, &iDecodedNumBytes );
+		Packet.lNumBytes = iDecodedNumBytes;
+
+		// A launcher queries the server with a long, which is handled in SERVER_DetermineConnectionType.
+		// Launchers that were already answered recently only get told to wait.
+		if (( Packet.lNumBytes >= 4 ) && ( Packet.abData[0] == LAUNCHER_SERVER_CHALLENGE )
+			&& ( Packet.abData[1] == 0 ) && ( Packet.abData[2] == 0 ) && ( Packet.abData[3] == 0 ))
+		{
+			g_IngressLauncherQueue.setEntryLength( lQueryIgnoreTime );
+			g_IngressLauncherQueue.adjustHead( lNow );
+			if ( g_IngressLauncherQueue.addressInQueue( Address ))
+			{
+				network_IngressIgnoreLauncher( Address, Packet.abData, Packet.lNumBytes );
+				__atomic_add_fetch( &g_ulIngressNumLauncherIgnored, 1, __ATOMIC_RELAXED );
+				__atomic_add_fetch( &g_ulIngressRejectedBytes, lNumBytes, __ATOMIC_RELAXED );
+				return ( false );
+			}
+
+			g_IngressLauncherQueue.addAddress( Address, lNow );
+
+			if ( network_IngressAnswerLauncher( Address, Packet.abData, Packet.lNumBytes ))
+			{
+				__atomic_add_fetch( &g_ulIngressRejectedBytes, lNumBytes, __ATOMIC_RELAXED );
+				return ( false );
+			}
+		}
+	}
+
+	if ( Packet.lNumBytes <= 0 )
+	{
+		__atomic_add_fetch( &g_ulIngressNumRejected, 1, __ATOMIC_RELAXED );
+		__atomic_add_fetch( &g_ulIngressRejectedBytes, lNumBytes, __ATOMIC_RELAXED );
+		return ( false );
+	}
+
+	__atomic_add_fetch( &g_ulIngressNumQueued, 1, __ATOMIC_RELAXED );
+	__atomic_store_n( &g_uiIngressTail, uiTail + 1, __ATOMIC_RELEASE );
+	return ( true );
+}
+
+//*****************************************************************************
+//
+static void *network_IngressThread( void * )
+{
+	struct sockaddr_in	SocketFrom;
+	const UCHAR			*pucData;
+	struct pollfd		PollFD;
+	bool				bQueuedPackets = false;
+
+	PollFD.fd = g_NetworkSocket;
+	PollFD.events = POLLIN;
+
+	while ( __atomic_load_n( &g_bStopIngressThread, __ATOMIC_ACQUIRE ) == false )
+	{
+		const LONG lNumBytes = network_ReceiveFromBatch( SocketFrom, pucData );
+
+		if ( lNumBytes < 0 )
+		{
+			// The socket is drained, wake up the game thread once for everything we queued.
+			if ( bQueuedPackets )
+			{
+				eventfd_write( g_iIngressEventFD, 1 );
+				bQueuedPackets = false;
+			}
+
+			// Check for a stop request every now and then.
+			PollFD.revents = 0;
+			poll( &PollFD, 1, 100 );
+			continue;
+		}
+
+		if ( network_QueueIngressPacket( SocketFrom, pucData, lNumBytes ))
+			bQueuedPackets = true;
+	}
+
+	return ( NULL );
+}
+
+//*****************************************************************************
+//
+// While the ingress thread is running, NETWORK_WaitForInput waits for its event instead of the socket.
+static void network_WatchIngressEvent( bool bWatch )
+{
+	struct epoll_event	Event;
+
+	if ( g_iEpollFD == -1 )
+		return;
+
+	memset( &Event, 0, sizeof( Event ));
+	Event.events = EPOLLIN;
+
+	Event.data.fd = bWatch ? g_iIngressEventFD : g_NetworkSocket;
+	epoll_ctl( g_iEpollFD, EPOLL_CTL_ADD, Event.data.fd, &Event );
+	epoll_ctl( g_iEpollFD, EPOLL_CTL_DEL, bWatch ? g_NetworkSocket : g_iIngressEventFD, NULL );
+}
+
+//*****************************************************************************
+//
+static void network_StopIngressThread( void )
+{
+	if ( g_bIngressThreadRunning == false )
+		return;
+
+	__atomic_store_n( &g_bStopIngressThread, true, __ATOMIC_RELEASE );
+	pthread_join( g_IngressThread, NULL );
+	g_bIngressThreadRunning = false;
+	network_WatchIngressEvent( false );
+
+	// Don't answer launchers with an outdated copy when the thread is started again.
+	NETWORK_PublishServerInfoSnapshot( NULL );
+}
+
+//*****************************************************************************
+//
+// Starts or stops the ingress thread as needed and hands it the settings it needs.
+static void network_UpdateIngressThread( void )
+{
+	// The Huffman corpus needs the encoded packets, so the ingress thread can't be used while capturing.
+	// It also answers launchers on the socket by itself, so it can't be used while outbound packets
+	// are discarded (e.g. while a packet capture is replayed).
+	const bool bUseThread = net_ingressthread && ( NETWORK_GetState( ) == NETSTATE_SERVER ) && ( g_HuffmanCorpusFile == NULL )
+		&& ( g_bDiscardOutboundPackets == false );
+
+	if ( bUseThread == false )
+	{
+		network_StopIngressThread( );
+		return;
+	}
+
+	// Only lock if something actually changed, this is called for every packet.
+	const NETADDRESS_s AuthServerAddress = NETWORK_AUTH_GetCachedServerAddress( );
+	if (( NETWORK_CompareAddress( AuthServerAddress, g_IngressAuthServerAddress, false ) == false )
+		|| ( AuthServerAddress.usPort != g_IngressAuthServerAddress.usPort )
+		|| ( g_lIngressQueryIgnoreTime != sv_queryignoretime ))
+	{
+		pthread_mutex_lock( &g_IngressMutex );
+		g_IngressAuthServerAddress = AuthServerAddress;
+		g_lIngressQueryIgnoreTime = sv_queryignoretime;
+		pthread_mutex_unlock( &g_IngressMutex );
+	}
+
+	if ( g_bIngressThreadRunning )
+		return;
+
+	if ( g_pIngressQueue == NULL )
+		g_pIngressQueue = new INGRESSPACKET_t[NETWORK_INGRESS_QUEUE_SIZE];
+
+	if ( g_iIngressEventFD == -1 )
+	{
+		g_iIngressEventFD = eventfd( 0, EFD_NONBLOCK );
+		if ( g_iIngressEventFD == -1 )
+		{
+			Printf( "network_UpdateIngressThread: %s\n", strerror( errno ));
+			net_ingressthread = false;
+			return;
+		}
+	}
+
+	g_bStopIngressThread = false;
+	if ( pthread_create( &g_IngressThread, NULL, network_IngressThread, NULL ) != 0 )
+	{
+		Printf( "network_UpdateIngressThread: Couldn't create the ingress thread.\n" );
+		net_ingressthread = false;
+		return;
+	}
+
+	g_bIngressThreadRunning = true;
+	network_WatchIngressEvent( true );
+}
+
+//*****************************************************************************
+//
+// Moves the next packet the ingress thread queued into g_NetworkMessage. Returns false if there is none.
+static bool network_GetIngressPacket( void )
+{
+	const ULONG ulRejectedBytes = __atomic_exchange_n( &g_ulIngressRejectedBytes, 0, __ATOMIC_RELAXED );
+	if ( ulRejectedBytes > 0 )
+		SERVER_STATISTIC_AddToInboundDataTransfer( ulRejectedBytes );
+	const ULONG ulSentBytes = __atomic_exchange_n( &g_ulIngressSentBytes, 0, __ATOMIC_RELAXED );
+	if ( ulSentBytes > 0 )
+		SERVER_STATISTIC_AddToOutboundDataTransfer( ulSentBytes );
+
+	const unsigned int uiHead = g_uiIngressHead;
+	if ( uiHead == __atomic_load_n( &g_uiIngressTail, __ATOMIC_ACQUIRE ))
+		return ( false );
+
+	const INGRESSPACKET_t &Packet = g_pIngressQueue[uiHead % NETWORK_INGRESS_QUEUE_SIZE];
+
+	SERVER_STATISTIC_AddToInboundDataTransfer( Packet.lNumReceivedBytes );
+	g_AddressFrom = Packet.Address;
+	memcpy( g_NetworkMessage.pbData, Packet.abData, Packet.lNumBytes );
+	g_NetworkMessage.ulCurrentSize = Packet.lNumBytes;
+	g_NetworkMessage.ByteStream.pbStream = g_NetworkMessage.pbData;
+	g_NetworkMessage.ByteStream.pbStreamEnd = g_NetworkMessage.ByteStream.pbStream + g_NetworkMessage.ulCurrentSize;
+
+	__atomic_store_n( &g_uiIngressHead, uiHead + 1, __ATOMIC_RELEASE );
+	return ( true );
+}
+#endif
+
+//*****************************************************************************
+//
+// Lets the ingress thread answer launcher queries with a copy of pSnapshot. With NULL, the
+// queries are passed to the game thread again.
+void NETWORK_PublishServerInfoSnapshot( const ServerInfoSnapshot *pSnapshot )
+{
+#ifdef __linux__
+	ServerInfoSnapshot	*pCopy = NULL;
+	bool				bReuseBanLists = false;
+
+	// Without the ingress thread, there is no need for a copy.
+	if (( pSnapshot != NULL ) && g_bIngressThreadRunning )
+	{
+		pCopy = new ServerInfoSnapshot;
+		pCopy->copyReplies( *pSnapshot );
+
+		// The ban lists rarely change, so the copy the ingress thread has is taken over if possible.
+		// Only this thread changes g_pIngressServerInfo, so it can be read here without the lock.
+		bReuseBanLists = ( g_pIngressServerInfo != NULL ) && g_pIngressServerInfo->haveSameBanLists( *pSnapshot );
+		if ( bReuseBanLists == false )
+			pCopy->copyBanLists( *pSnapshot );
+	}
+
+	pthread_mutex_lock( &g_IngressMutex );
+	ServerInfoSnapshot *pOld = g_pIngressServerInfo;
+	if ( bReuseBanLists )
+		pCopy->swapBanLists( *pOld );
+	g_pIngressServerInfo = pCopy;
+	pthread_mutex_unlock( &g_IngressMutex );
+
+	delete pOld;
+#endif
+}
+
+//*****************************************************************************
+//
+// Returns whether the ingress thread answered a launcher since the last call.
+bool NETWORK_WasServerInfoSnapshotUsed( void )
+{
+#ifdef __linux__
+	return ( __atomic_exchange_n( &g_bIngressServerInfoUsed, false, __ATOMIC_RELAXED ));
+#else
+	return ( false );
+#endif
+}
+
+//*****************************************************************************
+//
+// Makes the ingress thread drop all packets from this address for a while. Called by the server
+// whenever it adds an address to its flood protection queue.
+void NETWORK_IgnoreAddressOnIngress( NETADDRESS_s Address )
+{
+#ifdef __linux__
+	pthread_mutex_lock( &g_IngressMutex );
+	g_IngressFloodQueue.addAddress( Address, network_GetIngressSeconds( ));
+	pthread_mutex_unlock( &g_IngressMutex );
+#endif
+}
+
+//*****************************************************************************
+//
+// Exempts the address of a client or an RCON session from NETWORK_IgnoreAddressOnIngress,
+// until NETWORK_RemoveIngressExemption is called as often for it.
+void NETWORK_AddIngressExemption( NETADDRESS_s Address )
+{
+#ifdef __linux__
+	pthread_mutex_lock( &g_IngressMutex );
+	g_IngressExemptAddresses[SERVER_GetAddressKey( Address )]++;
+	pthread_mutex_unlock( &g_IngressMutex );
+#endif
+}
+
+//*****************************************************************************
+//
+void NETWORK_RemoveIngressExemption( NETADDRESS_s Address )
+{
+#ifdef __linux__
+	pthread_mutex_lock( &g_IngressMutex );
+	int *piCount = g_IngressExemptAddresses.CheckKey( SERVER_GetAddressKey( Address ));
+	if (( piCount != NULL ) && ( --*piCount <= 0 ))
+		g_IngressExemptAddresses.Remove( SERVER_GetAddressKey( Address ));
+	pthread_mutex_unlock( &g_IngressMutex );
+#endif
+}
+
+//*****************************************************************************
+//
+LONG NETWORK_LaunchPacket( NETBUFFER_s *pBuffer, NETADDRESS_s Address )
+{
+	return ( NETWORK_LaunchPacket( pBuffer, Address, NULL, NULL, 0 ));
+}
+
+//*****************************************************************************
+//
+// Same as above, but the parts of the buffer listed in pRuns are copies of the data in
+// pSegment. Their Huffman codes are copied from the segment instead of being encoded again.
+// Returns the size of the datagram after the encoding.
+LONG NETWORK_LaunchPacket( NETBUFFER_s *pBuffer, NETADDRESS_s Address, HuffmanSegment *pSegment, const HuffmanSegmentRun *pRuns, int iNumRuns )
+{
+	INT					iNumBytesOut = sizeof(g_ucHuffmanBuffer);
+	struct sockaddr_in	SocketAddress;
+
+	pBuffer->ulCurrentSize = NETWORK_CalcBufferSize( pBuffer );
+
+	// Nothing to do.
+	if ( pBuffer->ulCurrentSize == 0 )
+		return ( 0 );
+
+	// Convert the IP address to a socket address.
+	NETWORK_NetAddressToSocketAddress( Address, SocketAddress );
+
+	// [BB] Communication with the auth server is not Huffman-encoded.
+	if ( NETWORK_CompareAddress( Address, NETWORK_AUTH_GetCachedServerAddress( ), false ) == false )
+	{
+		if ( pSegment )
+			HUFFMAN_EncodeWithSegment( (unsigned char *)pBuffer->pbData, g_ucHuffmanBuffer, pBuffer->ulCurrentSize, &iNumBytesOut, *pSegment, pRuns, iNumRuns );
+		else
+			HUFFMAN_Encode( (unsigned char *)pBuffer->pbData, g_ucHuffmanBuffer, pBuffer->ulCurrentSize, &iNumBytesOut );
+	}
+	else
+	{
+		// [BB] We don't need to encode, so we just copy the data.
+		// Not very efficient, but this keeps the changes at a minimum for now.
+		memcpy ( g_ucHuffmanBuffer, pBuffer->pbData, pBuffer->ulCurrentSize );
+		iNumBytesOut = pBuffer->ulCurrentSize;
+	}
+
+	if ( g_bDiscardOutboundPackets )
+	{
+		g_qwNumDiscardedBytes += iNumBytesOut;
+		return ( iNumBytesOut );
+	}
+
+#ifdef __linux__
+	// Keep the datagram until NETWORK_FlushBatchedSend sends all of them at once.
+	if ( g_bBatchingSends && ( iNumBytesOut <= MAX_UDP_PACKET + 1 ))
+	{
+		network_AddToSendBatch( g_ucHuffmanBuffer, iNumBytesOut, Address, SocketAddress );
+		return ( iNumBytesOut );
+	}
+#endif
+
+	network_SendDatagram( g_ucHuffmanBuffer, iNumBytesOut, Address, SocketAddress );
+	return ( iNumBytesOut );
+}
+
+//*****************************************************************************
+//
+const char *NETWORK_AddressToString( NETADDRESS_s Address )
+{
+	static char	s_szAddress[64];
+
+	sprintf( s_szAddress, "%i.%i.%i.%i:%i", Address.abIP[0], Address.abIP[1], Address.abIP[2], Address.abIP[3], ntohs( Address.usPort ));
+
+	return ( s_szAddress );
+}
+
+//*****************************************************************************
+//
+const char *NETWORK_AddressToStringIgnorePort( NETADDRESS_s Address )
+{
+	static char	s_szAddress[64];
+
+	sprintf( s_szAddress, "%i.%i.%i.%i", Address.abIP[0], Address.abIP[1], Address.abIP[2], Address.abIP[3] );
+
+	return ( s_szAddress );
+}
+
+//*****************************************************************************
+//
+void NETWORK_SetAddressPort( NETADDRESS_s &Address, USHORT usPort )
+{
+	Address.usPort = htons( usPort );
+}
+
+//*****************************************************************************
+//
+NETADDRESS_s NETWORK_GetLocalAddress( void )
+{
+	char				szBuffer[512];
+	struct sockaddr_in	SocketAddress;
+	NETADDRESS_s		Address;
+	int					iNameLength;
+
+#ifndef __WINE__
+	gethostname( szBuffer, 512 );
+#endif
+	szBuffer[512-1] = 0;
+
+	// Convert the host name to our local 
+	bool stringToAddress = NETWORK_StringToAddress( szBuffer, &Address );
+
+	iNameLength = sizeof( SocketAddress );
+#ifndef	WIN32
+	if ( getsockname ( g_NetworkSocket, (struct sockaddr *)&SocketAddress, (socklen_t *)&iNameLength) == -1 )
+#else
+	if ( getsockname ( g_NetworkSocket, (struct sockaddr *)&SocketAddress, &iNameLength ) == -1 )
+#endif
+	{
+		Printf( "NETWORK_GetLocalAddress: Error getting socket name: %s", strerror( errno ));
+	}
+
+#ifdef unix
+	// [BB] The "gethostname -> gethostbyname" trick didn't reveal the local IP.
+	// Now we need to resort to something more complicated.
+	if ( stringToAddress == false )
+	{
+#ifndef __FreeBSD__
+		unsigned char      *u;
+		int                size  = 1;
+		struct ifreq       *ifr;
+		struct ifconf      ifc;
+		struct sockaddr_in sa;
+		
+		ifc.ifc_len = IFRSIZE;
+		ifc.ifc_req = NULL;
+		
+		do {
+			++size;
+			/* realloc buffer size until no overflow occurs  */
+			if (NULL == (ifc.ifc_req = (ifreq*)realloc(ifc.ifc_req, IFRSIZE)))
+			{
+				fprintf(stderr, "Out of memory.\n");
+				exit(EXIT_FAILURE);
+			}
+			ifc.ifc_len = IFRSIZE;
+			if (ioctl(g_NetworkSocket, SIOCGIFCONF, &ifc))
+			{
+				perror("ioctl SIOCFIFCONF");
+				exit(EXIT_FAILURE);
+			}
+		} while  (IFRSIZE <= ifc.ifc_len);
+		
+		ifr = ifc.ifc_req;
+		for (;(char *) ifr < (char *) ifc.ifc_req + ifc.ifc_len; ++ifr)
+		{
+		
+			if (ifr->ifr_addr.sa_data == (ifr+1)->ifr_addr.sa_data)
+			{
+				continue;  /* duplicate, skip it */
+			}
+		
+			if (ioctl(g_NetworkSocket, SIOCGIFFLAGS, ifr))
+			{
+				continue;  /* failed to get flags, skip it */
+			}
+		
+			Printf("Found interface %s", ifr->ifr_name);
+			Printf(" with IP address: %s\n", inet_ntoa(inaddrr(ifr_addr.sa_data)));
+			*(int *)&Address.abIP = *(int *)&inaddrr(ifr_addr.sa_data);
+			if ( Address.abIP[0] != 127 )
+			{
+				Printf ( "Using IP address of interface %s as local address.\n", ifr->ifr_name );
+				break;
+			}
+		}
+		if ( ifc.ifc_req != NULL )
+			free ( ifc.ifc_req );
+#else
+		struct ifreq       *ifr;
+		struct ifconf      ifc;
+		bzero(&ifc, sizeof(ifc));
+		unsigned int n = 1;
+		struct ifreq *lifr;
+		ifr = (ifreq*)calloc( ifc.ifc_len, sizeof(*ifr) );
+		do
+		{
+			n *= 2;
+			ifr = (ifreq*)realloc( ifr, PAGE_SIZE * n );
+			bzero( ifr, PAGE_SIZE * n );
+			ifc.ifc_req = ifr;
+			ifc.ifc_len = n * PAGE_SIZE;
+		} while( ( ioctl( g_NetworkSocket, SIOCGIFCONF, &ifc ) == -1 ) || ( ifc.ifc_len >= ( (n-1) * PAGE_SIZE)) );
+		
+		lifr = (struct ifreq *)&ifc.ifc_buf[ifc.ifc_len];
+		
+		while (ifr < lifr)
+		{
+			struct sockaddr *sa = &ifr->ifr_ifru.ifru_addr;
+			if( AF_INET == sa->sa_family )
+			{
+				struct sockaddr_in dummysa;
+				in_addr inAddr = *(struct in_addr *) &ifr->ifr_addr.sa_data[sizeof dummysa.sin_port];
+	
+				Printf("Found interface %s", ifr->ifr_name);
+				Printf(" with IP address: %s\n", inet_ntoa(inAddr));
+				*(int *)&Address.abIP = *(int *)&inAddr;
+				if ( Address.abIP[0] != 127 )
+				{
+					Printf ( "Using IP address of interface %s as local address.\n", ifr->ifr_name );
+					break;
+				}
+			 }
+	 	ifr = (struct ifreq *)(((char *)ifr) + _SIZEOF_ADDR_IFREQ(*ifr));
+ 		}
+#endif
+	}
+#endif
+
+	Address.usPort = SocketAddress.sin_port;
+	return ( Address );
+}
+
+//*****************************************************************************
+//
+NETADDRESS_s	NETWORK_GetCachedLocalAddress( void )
+{
+	return g_LocalAddress;
+}
+
+//*****************************************************************************
+//
+NETBUFFER_s *NETWORK_GetNetworkMessageBuffer( void )
+{
+	return ( &g_NetworkMessage );
+}
+
+//*****************************************************************************
+//
+USHORT NETWORK_ntohs( ULONG ul )
+{
+	return ( ntohs( (u_short)ul ));
+}
+
+//*****************************************************************************
+//
+USHORT NETWORK_GetLocalPort( void )
+{
+	return ( g_usLocalPort );
+}
+
+//*****************************************************************************
+// [BB] 
+bool NETWORK_IsGeoIPAvailable ( void )
+{
+	return ( g_GeoIPDB != NULL );
+}
+
+//*****************************************************************************
+// [BB] 
+FString NETWORK_GetCountryCodeFromAddress( NETADDRESS_s Address )
+{
+	const char * addressString = NETWORK_AddressToStringIgnorePort( Address );
+	if ( ( strnicmp( "10.", addressString, 3 ) == 0 ) ||
+		 ( strnicmp( "192.168.", addressString, 8 ) == 0 ) ||
+		 ( strnicmp( "127.", addressString, 4 ) == 0 ) )
 		return "LAN";
 
 	if ( g_GeoIPDB == NULL )
@@ -1008,32 +1840,19 @@ void NETWORK_AddLumpForAuthentication( const LONG LumpNumber )
 //
 void NETWORK_GenerateMapLumpMD5Hash( MapData *Map, const LONG LumpNumber, FString &MD5Hash )
 {
-	LONG lLumpSize = Map->Size( LumpNumber );
-	BYTE *pbData = new BYTE[lLumpSize];
-
-	// Dump the data from the lump into our data buffer.
-	Map->Read( LumpNumber, pbData );
-
-	// Perform the checksum on our buffer, and free it.
-	CMD5Checksum::GetMD5( pbData, lLumpSize, MD5Hash );
-	delete[] pbData;
+	// Stream the lump into the checksum, instead of reading all of it into memory first.
+	Map->Seek( LumpNumber );
+	CMD5Checksum::GetMD5( Map->file, Map->Size( LumpNumber ), MD5Hash );
 }
 
 //*****************************************************************************
 //
 void NETWORK_GenerateLumpMD5Hash( const int LumpNum, FString &MD5Hash )
 {
-	const int lumpSize = Wads.LumpLength (LumpNum);
-	BYTE *pbData = new BYTE[lumpSize];
-
 	FWadLump lump = Wads.OpenLumpNum (LumpNum);
 
-	// Dump the data from the lump into our data buffer.
-	lump.Read (pbData, lumpSize);
-
-	// Perform the checksum on our buffer, and free it.
-	CMD5Checksum::GetMD5( pbData, lumpSize, MD5Hash );
-	delete[] pbData;
+	// Stream the lump into the checksum, instead of reading all of it into memory first.
+	CMD5Checksum::GetMD5( &lump, Wads.LumpLength (LumpNum), MD5Hash );
 }
 
 //*****************************************************************************
@@ -1060,6 +1879,19 @@ bool network_GenerateLumpMD5HashAndWarnIfNeeded( const int LumpNum, const char *
 FString NETWORK_MapCollectionChecksum( )
 {
 	FString longSum, fullSum;
+
+	// The checksum only depends on the maps and the files they can be loaded from, which
+	// rarely change between two starts. So try to take it from the checksum cache.
+	FString description = "mapcollection";
+	TArray<FString> files;
+	for ( unsigned i = 0; i < wadlevelinfos.Size( ); i++ )
+		description.AppendFormat( " %s", wadlevelinfos[i].mapname );
+	for ( ULONG ulIdx = 0; Wads.GetWadFullName( ulIdx ) != NULL; ulIdx++ )
+		files.Push( Wads.GetWadFullName( ulIdx ));
+
+	if ( CHECKSUMCACHE_FindChecksum( description, files, fullSum ))
+		return fullSum;
+
 	for( unsigned i = 0; i < wadlevelinfos.Size( ); i++ )
 	{
 		char* mname = wadlevelinfos[i].mapname;
@@ -1084,6 +1916,7 @@ FString NETWORK_MapCollectionChecksum( )
 
 	CMD5Checksum::GetMD5( reinterpret_cast<const BYTE *>( longSum.GetChars( ) ),
 		longSum.Len( ), fullSum );
+	CHECKSUMCACHE_StoreChecksum( description, files, fullSum );
 	return fullSum;
 }
 
@@ -1301,6 +2134,7 @@ static void network_InitPWADList( void )
 	g_IWAD = Wads.GetWadName( ulRealIWADIdx );
 
 	// Collect all the PWADs into a list.
+	TArray<FString> files;
 	for ( ULONG ulIdx = 0; Wads.GetWadName( ulIdx ) != NULL; ulIdx++ )
 	{
 		// Skip the IWAD, zandronum.pk3, files that were automatically loaded from subdirectories (such as skin files), and WADs loaded automatically within pk3 files.
@@ -1311,17 +2145,43 @@ static void network_InitPWADList( void )
 		{
 			continue;
 		}
-		char MD5Sum[33];
-		MD5SumOfFile ( Wads.GetWadFullName( ulIdx ), MD5Sum );
 
 		NetworkPWAD pwad;
 		pwad.name = Wads.GetWadName( ulIdx );
-		pwad.checksum = MD5Sum;
 		pwad.wadnum = ulIdx;
 		g_PWADs.Push( pwad );
+		files.Push( Wads.GetWadFullName( ulIdx ));
+	}
+
+	// Unchanged files are taken from the checksum cache, the others are hashed in parallel.
+	TArray<FString> checksums;
+	CHECKSUMCACHE_GetFileMD5Sums( files, checksums );
+	for ( unsigned int i = 0; i < g_PWADs.Size(); i++ )
+		g_PWADs[i].checksum = checksums[i];
+}
+
+//*****************************************************************************
+//
+// Packet corpus files store one record per packet: the packet size as four byte
+// little endian integer, followed by the Huffman-encoded packet data.
+static void network_WriteToHuffmanCorpus( const BYTE *pbData, LONG lNumBytes )
+{
+	const BYTE abSize[4] = { static_cast<BYTE>( lNumBytes & 0xff ), static_cast<BYTE>(( lNumBytes >> 8 ) & 0xff ),
+		static_cast<BYTE>(( lNumBytes >> 16 ) & 0xff ), static_cast<BYTE>(( lNumBytes >> 24 ) & 0xff ) };
+
+	fwrite( abSize, 1, sizeof( abSize ), g_HuffmanCorpusFile );
+	fwrite( pbData, 1, lNumBytes, g_HuffmanCorpusFile );
+
+	if ( --g_lHuffmanCorpusPacketsLeft <= 0 )
+	{
+		fclose( g_HuffmanCorpusFile );
+		g_HuffmanCorpusFile = NULL;
+		Printf( "Finished capturing the Huffman packet corpus.\n" );
 	}
 }
 
+//*****************************************************************************
+//
 void network_Error( const char *pszError )
 {
 	Printf( "\\cd%s\n", pszError );
@@ -1377,6 +2237,117 @@ extern int	stdin_ready;
 extern int	do_stdin;
 #endif
 
+#ifdef __linux__
+//*****************************************************************************
+//
+static bool network_InitEventWait( void )
+{
+	if ( g_iEpollFD != -1 )
+		return ( true );
+
+	if ( g_bEventWaitFailed || ( g_NetworkSocket == INVALID_SOCKET ))
+		return ( false );
+
+	struct epoll_event	Event;
+
+	g_iEpollFD = epoll_create( 4 );
+	g_iWaitTimerFD = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+	if (( g_iEpollFD == -1 ) || ( g_iWaitTimerFD == -1 ))
+	{
+		Printf( "network_InitEventWait: %s\n", strerror( errno ));
+		g_bEventWaitFailed = true;
+		if ( g_iEpollFD != -1 )
+			close( g_iEpollFD );
+		if ( g_iWaitTimerFD != -1 )
+			close( g_iWaitTimerFD );
+		g_iEpollFD = g_iWaitTimerFD = -1;
+		return ( false );
+	}
+
+	memset( &Event, 0, sizeof( Event ));
+	Event.events = EPOLLIN;
+
+	// While the ingress thread is running, it reads the socket and tells us when it queued something.
+	Event.data.fd = g_bIngressThreadRunning ? g_iIngressEventFD : g_NetworkSocket;
+	epoll_ctl( g_iEpollFD, EPOLL_CTL_ADD, Event.data.fd, &Event );
+
+	if (( g_LANSocket != INVALID_SOCKET ) && ( g_bLANSocketInvalid == false ))
+	{
+		Event.data.fd = g_LANSocket;
+		epoll_ctl( g_iEpollFD, EPOLL_CTL_ADD, g_LANSocket, &Event );
+	}
+
+	Event.data.fd = g_iWaitTimerFD;
+	epoll_ctl( g_iEpollFD, EPOLL_CTL_ADD, g_iWaitTimerFD, &Event );
+	return ( true );
+}
+#endif
+
+//*****************************************************************************
+//
+// Sleeps until one of our sockets or the console has input, or until lTimeoutUS microseconds
+// have passed. Returns false if this kind of waiting isn't supported, the caller has to poll then.
+bool NETWORK_WaitForInput( LONG lTimeoutUS )
+{
+#ifdef __linux__
+	struct epoll_event	aEvents[4];
+	struct itimerspec	Deadline;
+	uint64_t			ulExpirations;
+	int					iNumEvents;
+
+	if ( network_InitEventWait( ) == false )
+		return ( false );
+
+	if ( lTimeoutUS <= 0 )
+		return ( true );
+
+	// Watch the console until it has input that I_ConsoleInput hasn't read yet. Otherwise
+	// a closed stdin would wake us up all the time.
+	if ( do_stdin && ( stdin_ready == 0 ) && ( g_bEpollWatchesStdin == false ))
+	{
+		struct epoll_event	Event;
+
+		memset( &Event, 0, sizeof( Event ));
+		Event.events = EPOLLIN;
+		Event.data.fd = 0;
+		g_bEpollWatchesStdin = ( epoll_ctl( g_iEpollFD, EPOLL_CTL_ADD, 0, &Event ) == 0 );
+	}
+
+	// The timer fires once when the timeout is over.
+	memset( &Deadline, 0, sizeof( Deadline ));
+	Deadline.it_value.tv_sec = lTimeoutUS / 1000000;
+	Deadline.it_value.tv_nsec = ( lTimeoutUS % 1000000 ) * 1000;
+	timerfd_settime( g_iWaitTimerFD, 0, &Deadline, NULL );
+
+	iNumEvents = epoll_wait( g_iEpollFD, aEvents, 4, -1 );
+
+	for ( int i = 0; i < iNumEvents; i++ )
+	{
+		if ( aEvents[i].data.fd == 0 )
+		{
+			stdin_ready = 1;
+			epoll_ctl( g_iEpollFD, EPOLL_CTL_DEL, 0, NULL );
+			g_bEpollWatchesStdin = false;
+		}
+		else if (( aEvents[i].data.fd == g_iIngressEventFD ) && ( g_iIngressEventFD != -1 ))
+		{
+			eventfd_t	Value;
+			eventfd_read( g_iIngressEventFD, &Value );
+		}
+	}
+
+	// Disarm the timer and consume a possible expiration, so that it doesn't wake up the next wait.
+	memset( &Deadline, 0, sizeof( Deadline ));
+	timerfd_settime( g_iWaitTimerFD, 0, &Deadline, NULL );
+	if ( read( g_iWaitTimerFD, &ulExpirations, sizeof( ulExpirations )) == -1 )
+		ulExpirations = 0;
+
+	return ( true );
+#else
+	return ( false );
+#endif
+}
+
 // [BB] We only need this for the server console input under Linux.
 void I_DoSelect (void)
 {
@@ -1415,10 +2386,26 @@ void I_DoSelect (void)
 void CMD5Checksum::GetMD5(const BYTE* pBuf, UINT nLength, FString &OutString)
 {
 	MD5Context md5;
+	md5.Update(pBuf, nLength);
+	FormatMD5(md5, OutString);
+}
+
+//*****************************************************************************
+//
+void CMD5Checksum::GetMD5(FileReader* pReader, UINT nLength, FString &OutString)
+{
+	MD5Context md5;
+	md5.Update(pReader, nLength);
+	FormatMD5(md5, OutString);
+}
+
+//*****************************************************************************
+//
+void CMD5Checksum::FormatMD5(MD5Context &md5, FString &OutString)
+{
 	BYTE readbuf[16];
 	char MD5SumFull[33];
 	char *MD5Sum = MD5SumFull;
-	md5.Update(pBuf, nLength);
 	md5.Final(readbuf);
 	for(int j = 0; j < 16; ++j)
 	{
@@ -1473,6 +2460,225 @@ CCMD( netstate )
 	}
 }
 
+//*****************************************************************************
+//
+CCMD( ingressstats )
+{
+#ifdef __linux__
+	if ( NETWORK_GetState( ) != NETSTATE_SERVER )
+		return;
+
+	Printf( "Ingress thread: %s\n", g_bIngressThreadRunning ? "running" : "not running" );
+	Printf( "Queued packets: %u (%u waiting)\n", static_cast<unsigned int> ( __atomic_load_n( &g_ulIngressNumQueued, __ATOMIC_RELAXED )), __atomic_load_n( &g_uiIngressTail, __ATOMIC_ACQUIRE ) - g_uiIngressHead );
+	Printf( "Rejected packets: %u\n", static_cast<unsigned int> ( __atomic_load_n( &g_ulIngressNumRejected, __ATOMIC_RELAXED )));
+	Printf( "Answered launcher queries: %u\n", static_cast<unsigned int> ( __atomic_load_n( &g_ulIngressNumLauncherAnswered, __ATOMIC_RELAXED )));
+	Printf( "Ignored launcher queries: %u\n", static_cast<unsigned int> ( __atomic_load_n( &g_ulIngressNumLauncherIgnored, __ATOMIC_RELAXED )));
+	Printf( "Packets dropped because the queue was full: %u\n", static_cast<unsigned int> ( __atomic_load_n( &g_ulIngressNumOverflows, __ATOMIC_RELAXED )));
+#else
+	Printf( "The ingress thread is only available under Linux.\n" );
+#endif
+}
+
+//*****************************************************************************
+//
+CCMD( capturehuffmancorpus )
+{
+	// The network module isn't initialized in these cases.
+	if (( NETWORK_GetState( ) != NETSTATE_SERVER ) &&
+		( NETWORK_GetState( ) != NETSTATE_CLIENT ))
+	{
+		return;
+	}
+
+	if ( argv.argc( ) < 3 )
+	{
+		Printf( "Usage: capturehuffmancorpus <filename> <number of packets>\n" );
+		return;
+	}
+
+	if ( g_HuffmanCorpusFile != NULL )
+		fclose( g_HuffmanCorpusFile );
+
+	g_lHuffmanCorpusPacketsLeft = atoi( argv[2] );
+	g_HuffmanCorpusFile = ( g_lHuffmanCorpusPacketsLeft > 0 ) ? fopen( argv[1], "wb" ) : NULL;
+	if ( g_HuffmanCorpusFile == NULL )
+	{
+		Printf( "Couldn't open %s for writing.\n", argv[1] );
+		return;
+	}
+
+	Printf( "Capturing the next %d received packets to %s.\n", static_cast<int> ( g_lHuffmanCorpusPacketsLeft ), argv[1] );
+}
+
+//*****************************************************************************
+// Runs the table-driven and the reference Huffman coder over the packets of a corpus
+// recorded by capturehuffmancorpus, comparing speed and output. The encoders are also
+// checked against each other on random packets, since their output has to be identical.
+CCMD( benchmarkhuffman )
+{
+	// The network module isn't initialized in these cases.
+	if (( NETWORK_GetState( ) != NETSTATE_SERVER ) &&
+		( NETWORK_GetState( ) != NETSTATE_CLIENT ))
+	{
+		return;
+	}
+
+	if ( argv.argc( ) < 2 )
+	{
+		Printf( "Usage: benchmarkhuffman <filename> [iterations]\n" );
+		return;
+	}
+
+	const int iterations = ( argv.argc( ) > 2 ) ? MAX( 1, atoi( argv[2] )) : 100;
+
+	FILE *pFile = fopen( argv[1], "rb" );
+	if ( pFile == NULL )
+	{
+		Printf( "Couldn't open %s.\n", argv[1] );
+		return;
+	}
+
+	// Load all packets of the corpus.
+	TArray<BYTE> corpus;
+	TArray<ULONG> packetOffsets;
+	BYTE abSize[4];
+	while ( fread( abSize, 1, sizeof( abSize ), pFile ) == sizeof( abSize ))
+	{
+		const ULONG ulSize = abSize[0] | ( abSize[1] << 8 ) | ( abSize[2] << 16 ) | ( abSize[3] << 24 );
+		if (( ulSize == 0 ) || ( ulSize > sizeof( g_ucHuffmanBuffer )))
+			break;
+
+		const ULONG ulOffset = corpus.Size( );
+		corpus.Resize( ulOffset + ulSize );
+		if ( fread( &corpus[ulOffset], 1, ulSize, pFile ) != ulSize )
+		{
+			corpus.Resize( ulOffset );
+			break;
+		}
+		packetOffsets.Push( ulOffset );
+	}
+	fclose( pFile );
+
+	if ( packetOffsets.Size( ) == 0 )
+	{
+		Printf( "%s doesn't contain any packets.\n", argv[1] );
+		return;
+	}
+	packetOffsets.Push( corpus.Size( ));
+
+	const unsigned int numPackets = packetOffsets.Size( ) - 1;
+	const int decodedSize = ((MAX_UDP_PACKET * 8) / 3 + 1);
+	const int encodedSize = sizeof( g_ucHuffmanBuffer );
+	BYTE *pbTableOutput = new BYTE[encodedSize];
+	BYTE *pbReferenceOutput = new BYTE[encodedSize];
+	cycle_t tableTime, referenceTime;
+	double decodedBytes = 0;
+	ULONG ulMismatches = 0;
+
+	// The decoded packets are the input for the encoder benchmark.
+	TArray<BYTE> decodedCorpus;
+	TArray<ULONG> decodedOffsets;
+
+	tableTime.Reset( );
+	referenceTime.Reset( );
+	for ( int i = 0; i < iterations; ++i )
+	{
+		for ( unsigned int packet = 0; packet < numPackets; ++packet )
+		{
+			const int packetSize = packetOffsets[packet + 1] - packetOffsets[packet];
+			int tableDecodedSize = decodedSize;
+			int referenceDecodedSize = decodedSize;
+
+			tableTime.Clock( );
+			HUFFMAN_Decode( &corpus[packetOffsets[packet]], pbTableOutput, packetSize, &tableDecodedSize );
+			tableTime.Unclock( );
+
+			referenceTime.Clock( );
+			HUFFMAN_DecodeWithTree( &corpus[packetOffsets[packet]], pbReferenceOutput, packetSize, &referenceDecodedSize );
+			referenceTime.Unclock( );
+
+			// Both decoders need to produce the same output, otherwise we would break the protocol.
+			if ( i == 0 )
+			{
+				if (( tableDecodedSize != referenceDecodedSize ) || ( memcmp( pbTableOutput, pbReferenceOutput, referenceDecodedSize ) != 0 ))
+					++ulMismatches;
+
+				decodedOffsets.Push( decodedCorpus.Size( ));
+				decodedCorpus.Resize( decodedCorpus.Size( ) + referenceDecodedSize );
+				if ( referenceDecodedSize > 0 )
+					memcpy( &decodedCorpus[decodedOffsets.Last( )], pbReferenceOutput, referenceDecodedSize );
+			}
+			decodedBytes += referenceDecodedSize;
+		}
+	}
+	decodedOffsets.Push( decodedCorpus.Size( ));
+
+	Printf( "Decoded %u packets (%u bytes) %d times.\n", numPackets, corpus.Size( ), iterations );
+	Printf( "Table decoder: %.3f ms (%.1f MB/s)\n", tableTime.TimeMS( ), decodedBytes / ( 1048.576 * MAX( tableTime.TimeMS( ), 0.001 )));
+	Printf( "Tree decoder: %.3f ms (%.1f MB/s)\n", referenceTime.TimeMS( ), decodedBytes / ( 1048.576 * MAX( referenceTime.TimeMS( ), 0.001 )));
+	if ( ulMismatches > 0 )
+		Printf( "\\cgWARNING: The decoders disagree on %d packets!\n", static_cast<int> ( ulMismatches ));
+
+	ulMismatches = 0;
+	tableTime.Reset( );
+	referenceTime.Reset( );
+	for ( int i = 0; i < iterations; ++i )
+	{
+		for ( unsigned int packet = 0; packet < numPackets; ++packet )
+		{
+			const int packetSize = decodedOffsets[packet + 1] - decodedOffsets[packet];
+			const BYTE *pbPacket = ( packetSize > 0 ) ? &decodedCorpus[decodedOffsets[packet]] : pbTableOutput;
+			int tableEncodedSize = encodedSize;
+			int referenceEncodedSize = encodedSize;
+
+			tableTime.Clock( );
+			HUFFMAN_Encode( pbPacket, pbTableOutput, packetSize, &tableEncodedSize );
+			tableTime.Unclock( );
+
+			referenceTime.Clock( );
+			HUFFMAN_EncodeWithWriter( pbPacket, pbReferenceOutput, packetSize, &referenceEncodedSize );
+			referenceTime.Unclock( );
+
+			if (( i == 0 ) && (( tableEncodedSize != referenceEncodedSize ) || ( memcmp( pbTableOutput, pbReferenceOutput, referenceEncodedSize ) != 0 )))
+				++ulMismatches;
+		}
+	}
+
+	Printf( "Encoded %u packets (%u bytes) %d times.\n", numPackets, decodedCorpus.Size( ), iterations );
+	Printf( "Table encoder: %.3f ms (%.1f MB/s)\n", tableTime.TimeMS( ), decodedBytes / ( 1048.576 * MAX( tableTime.TimeMS( ), 0.001 )));
+	Printf( "BitWriter encoder: %.3f ms (%.1f MB/s)\n", referenceTime.TimeMS( ), decodedBytes / ( 1048.576 * MAX( referenceTime.TimeMS( ), 0.001 )));
+
+	// Fuzz the encoders with random packets of random size, skewed towards small byte values like real packets.
+	static FRandom pr_huffmanfuzz( "HuffmanFuzz" );
+	const int fuzzPackets = 10000;
+	BYTE *pbFuzzInput = new BYTE[MAX_UDP_PACKET];
+	for ( int i = 0; i < fuzzPackets; ++i )
+	{
+		const int packetSize = pr_huffmanfuzz( MAX_UDP_PACKET );
+		const bool skewed = ( i & 1 ) == 0;
+		for ( int j = 0; j < packetSize; ++j )
+			pbFuzzInput[j] = skewed ? ( pr_huffmanfuzz( 8 ) * pr_huffmanfuzz( 4 )) : pr_huffmanfuzz( );
+
+		// Limit the output size now and then to test the overflow handling.
+		int tableEncodedSize = ( i % 4 == 0 ) ? pr_huffmanfuzz( MAX_UDP_PACKET ) : encodedSize;
+		int referenceEncodedSize = tableEncodedSize;
+		HUFFMAN_Encode( pbFuzzInput, pbTableOutput, packetSize, &tableEncodedSize );
+		HUFFMAN_EncodeWithWriter( pbFuzzInput, pbReferenceOutput, packetSize, &referenceEncodedSize );
+
+		if (( tableEncodedSize != referenceEncodedSize ) || ( memcmp( pbTableOutput, pbReferenceOutput, referenceEncodedSize ) != 0 ))
+			++ulMismatches;
+	}
+	delete[] pbFuzzInput;
+
+	delete[] pbTableOutput;
+	delete[] pbReferenceOutput;
+
+	if ( ulMismatches > 0 )
+		Printf( "\\cgWARNING: The encoders disagree on %d packets!\n", static_cast<int> ( ulMismatches ));
+	else
+		Printf( "The encoders agree on all packets and on %d random packets.\n", fuzzPackets );
+}
+
 #ifdef	_DEBUG
 // DEBUG FUNCTION!
 void NETWORK_FillBufferWithShit( BYTESTREAM_s *pByteStream, ULONG ulSize )
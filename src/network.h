@@ -89,6 +89,48 @@ enum
 	PLAYER_ALTATTACK	= 1 << 2,
 };
 
+// Flags for client_MovePlayerDelta/SERVERCOMMANDS_MovePlayer. Fields whose flag isn't set are
+// the same as in the baseline. The PMD_SMALL_* flags mean the field is sent as difference to the baseline,
+// x/y as 24 bit fixed point number (a short with the lower and a byte with the upper bits).
+enum
+{
+	PMD_X			= 1 << 0,
+	PMD_Y			= 1 << 1,
+	PMD_Z			= 1 << 2,
+	PMD_ANGLE		= 1 << 3,
+	PMD_MOMX		= 1 << 4,
+	PMD_MOMY		= 1 << 5,
+	PMD_MOMZ		= 1 << 6,
+	PMD_CROUCHING	= 1 << 7,
+	PMD_SMALL_X		= 1 << 8,
+	PMD_SMALL_Y		= 1 << 9,
+	PMD_SMALL_Z		= 1 << 10,
+	PMD_SMALL_MOMX	= 1 << 11,
+	PMD_SMALL_MOMY	= 1 << 12,
+	PMD_SMALL_MOMZ	= 1 << 13,
+};
+
+// How many keyframes of a player's movement the server (for each client) and the clients remember
+// as baselines for SVC_MOVEPLAYERDELTA.
+#define	NUM_PLAYER_MOVE_KEYFRAMES	4
+
+// The movement of a player as it's sent with SVC_MOVEPLAYERDELTA.
+typedef struct
+{
+	// The server gametic this keyframe was sent at (clients only know the lower 16 bits), -1 if unused.
+	LONG		lTic;
+
+	fixed_t		X;
+	fixed_t		Y;
+	SWORD		sZ;
+	angle_t		Angle;
+	SWORD		sMomX;
+	SWORD		sMomY;
+	SWORD		sMomZ;
+	bool		bCrouching;
+
+} PLAYERMOVESTATE_s;
+
 /* [BB] This is not used anywhere anymore.
 // Should we use huffman compression?
 #define	USE_HUFFMAN_COMPRESSION
@@ -98,16 +140,6 @@ enum
 #define	PLAYER_UPDATE_PITCH		2
 */
 
-// Movement flags being sent by the client.
-#define	CLIENT_UPDATE_YAW				0x01
-#define	CLIENT_UPDATE_PITCH				0x02
-#define	CLIENT_UPDATE_ROLL				0x04
-#define	CLIENT_UPDATE_BUTTONS			0x08
-#define	CLIENT_UPDATE_FORWARDMOVE		0x10
-#define	CLIENT_UPDATE_SIDEMOVE			0x20
-#define	CLIENT_UPDATE_UPMOVE			0x40
-#define	CLIENT_UPDATE_BUTTONS_LONG		0x80
-
 // Identifying states (the cheap & easy way out)
 #define	STATE_SPAWN				1
 #define	STATE_SEE				2
@@ -163,65 +195,11 @@ enum FlagSet
 #define	ACTORSOUND_DEATHSOUND		4
 #define	ACTORSOUND_ACTIVESOUND		5
 
-// Which userinfo categories are being updated?
-#define	USERINFO_NAME				1
-#define	USERINFO_GENDER				2
-#define	USERINFO_COLOR				4
-#define	USERINFO_AIMDISTANCE		8
-#define	USERINFO_SKIN				16
-#define	USERINFO_RAILCOLOR			32
-#define	USERINFO_HANDICAP			64
-#define	USERINFO_PLAYERCLASS		128
-#define	USERINFO_TICSPERUPDATE		256
-#define	USERINFO_CONNECTIONTYPE		512
-#define	USERINFO_CLIENTFLAGS		1024
-
-#define	USERINFO_ALL				( USERINFO_NAME | USERINFO_GENDER | USERINFO_COLOR | \
-									USERINFO_AIMDISTANCE | USERINFO_SKIN | USERINFO_RAILCOLOR | \
-									USERINFO_HANDICAP | USERINFO_PLAYERCLASS | USERINFO_TICSPERUPDATE | \
-									USERINFO_CONNECTIONTYPE | USERINFO_CLIENTFLAGS )
-
 // [BB]: Some optimization. For some actors that are sent in bunches, to reduce the size,
 // just send some key letter that identifies the actor, instead of the full name.
 #define NUMBER_OF_ACTOR_NAME_KEY_LETTERS	3
 #define NUMBER_OF_WEAPON_NAME_KEY_LETTERS	10
 
-//*****************************************************************************
-enum
-{
-	// Client has the wrong password.
-	NETWORK_ERRORCODE_WRONGPASSWORD,
-
-	// Client has the wrong version.
-	NETWORK_ERRORCODE_WRONGVERSION,
-
-	// Client is using a version with different network protocol.
-	NETWORK_ERRORCODE_WRONGPROTOCOLVERSION,
-
-	// Client has been banned.
-	NETWORK_ERRORCODE_BANNED,
-
-	// The server is full.
-	NETWORK_ERRORCODE_SERVERISFULL,
-
-	// Client has the wrong version of the current level.
-	NETWORK_ERRORCODE_AUTHENTICATIONFAILED,
-
-	// Client failed to send userinfo when connecting.
-	NETWORK_ERRORCODE_FAILEDTOSENDUSERINFO,
-
-	// [RC] Too many connections from the IP.
-	NETWORK_ERRORCODE_TOOMANYCONNECTIONSFROMIP,
-
-	// [BB] The protected lump authentication failed.
-	NETWORK_ERRORCODE_PROTECTED_LUMP_AUTHENTICATIONFAILED,
-
-	// [TP] The client sent bad userinfo
-	NETWORK_ERRORCODE_USERINFOREJECTED,
-
-	NUM_NETWORK_ERRORCODES
-};
-
 //*****************************************************************************
 enum
 {
@@ -241,85 +219,9 @@ enum
 };
 
 //*****************************************************************************
-enum
-{
-	// The server has properly received the client's challenge, and is telling
-	// the client to authenticate his map.
-	SVCC_AUTHENTICATE,
-
-	// The server received the client's checksum, and it's valid. Now the server
-	// is telling the client to load the map.
-	SVCC_MAPLOAD,
-
-	// There was an error during the course of the client trying to connect.
-	SVCC_ERROR,
-
-	NUM_SERVERCONNECT_COMMANDS
-};
-
-// [BB] The SVC and SVC2 defines are in a separate header so that they can be used with "EnumToString".
-#include "network_enums.h"
-
-//*****************************************************************************
-enum
-{
-	// Client is telling the server he wishes to connect.
-	CLCC_ATTEMPTCONNECTION,
-
-	// Client is attempting to authenticate the map.
-	CLCC_ATTEMPTAUTHENTICATION,
-
-	// Client has loaded the map, and is requesting the snapshot.
-	CLCC_REQUESTSNAPSHOT,
-
-	NUM_CLIENTCONNECT_COMMANDS
-};
-
-//*****************************************************************************
-enum
-{
-	CLC_USERINFO = NUM_CLIENTCONNECT_COMMANDS,
-	CLC_QUIT,
-	CLC_STARTCHAT,
-	CLC_ENDCHAT,
-	CLC_SAY,
-	CLC_CLIENTMOVE,
-	CLC_MISSINGPACKET,
-	CLC_PONG,
-	CLC_WEAPONSELECT,
-	CLC_TAUNT,
-	CLC_SPECTATE,
-	CLC_REQUESTJOIN,
-	CLC_REQUESTRCON,
-	CLC_RCONCOMMAND,
-	CLC_SUICIDE,
-	CLC_CHANGETEAM,
-	CLC_SPECTATEINFO,
-	CLC_GENERICCHEAT,
-	CLC_GIVECHEAT,
-	CLC_SUMMONCHEAT,
-	CLC_READYTOGOON,
-	CLC_CHANGEDISPLAYPLAYER,
-	CLC_AUTHENTICATELEVEL,
-	CLC_CALLVOTE,
-	CLC_VOTEYES,
-	CLC_VOTENO,
-	CLC_INVENTORYUSEALL,
-	CLC_INVENTORYUSE,
-	CLC_INVENTORYDROP,
-	CLC_SUMMONFRIENDCHEAT,
-	CLC_SUMMONFOECHEAT,
-	CLC_ENTERCONSOLE,
-	CLC_EXITCONSOLE,
-	CLC_IGNORE,
-	CLC_PUKE,
-	CLC_MORPHEX,
-	CLC_FULLUPDATE,
-	CLC_INFOCHEAT,
-
-	NUM_CLIENT_COMMANDS
-
-};
+// The protocol commands and connection error codes are in a separate header so that
+// standalone tools can speak the protocol without pulling in the engine.
+#include "network_protocol.h"
 
 //*****************************************************************************
 //	VARIABLES
@@ -336,7 +238,19 @@ void			NETWORK_Destruct( void );
 int				NETWORK_GetPackets( void );
 int				NETWORK_GetLANPackets( void );
 NETADDRESS_s	NETWORK_GetFromAddress( void );
-void			NETWORK_LaunchPacket( NETBUFFER_s *pBuffer, NETADDRESS_s Address );
+int				NETWORK_InjectPacket( const BYTE *pbData, ULONG ulSize, NETADDRESS_s Address );
+void			NETWORK_SetDiscardOutboundPackets( bool bDiscard );
+QWORD			NETWORK_GetNumDiscardedBytes( void );
+LONG			NETWORK_LaunchPacket( NETBUFFER_s *pBuffer, NETADDRESS_s Address );
+LONG			NETWORK_LaunchPacket( NETBUFFER_s *pBuffer, NETADDRESS_s Address, HuffmanSegment *pSegment, const HuffmanSegmentRun *pRuns, int iNumRuns );
+void			NETWORK_BeginBatchedSend( void );
+void			NETWORK_FlushBatchedSend( void );
+bool			NETWORK_WaitForInput( LONG lTimeoutUS );
+void			NETWORK_IgnoreAddressOnIngress( NETADDRESS_s Address );
+void			NETWORK_AddIngressExemption( NETADDRESS_s Address );
+void			NETWORK_RemoveIngressExemption( NETADDRESS_s Address );
+void			NETWORK_PublishServerInfoSnapshot( const ServerInfoSnapshot *pSnapshot );
+bool			NETWORK_WasServerInfoSnapshotUsed( void );
 const char		*NETWORK_AddressToString( NETADDRESS_s Address );
 const char		*NETWORK_AddressToStringIgnorePort( NETADDRESS_s Address );
 void			NETWORK_SetAddressPort( NETADDRESS_s &Address, USHORT usPort );
@@ -434,11 +348,17 @@ LONG NETWORK_GetFirstFreeID ( void )
 	return ( -1 );
 }
 
+struct MD5Context;
+
 // [BB] Legacy interface that redirects all calls to Skulltag's old MD5 code to the ZDoom MD5 code.
 class CMD5Checksum  
 {
 public:
 	static void GetMD5 ( const BYTE* pBuf, UINT nLength, FString &OutString );
+	static void GetMD5 ( FileReader* pReader, UINT nLength, FString &OutString );
+
+private:
+	static void FormatMD5 ( MD5Context &md5, FString &OutString );
 };
 
 #endif	// __NETWORK_H__
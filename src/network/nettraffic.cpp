@@ -48,8 +48,14 @@
 #include "nettraffic.h"
 #include "network.h"
 #include "c_dispatch.h"
+#include "d_player.h"
+#include "doomstat.h"
+#include "huffman.h"
+#include "sv_main.h"
+#include "v_text.h"
 
 #include <map>
+#include <algorithm>
 
 //*****************************************************************************
 //	VARIABLES
@@ -67,6 +73,71 @@ std::map<int, int> g_ACSScriptTrafficMap;
 
 CVAR( Bool, sv_measureoutboundtraffic, false, 0 )
 
+// Messages, bytes before the Huffman encoding and bits after it counted for one entry of the traffic profile.
+struct NETTRAFFICCOUNT_s
+{
+	QWORD	qwMessages;
+	QWORD	qwBytes;
+	QWORD	qwEncodedBits;
+};
+
+// The ways the traffic profile breaks the outbound traffic down.
+enum NETTRAFFICCATEGORY_e
+{
+	// By the command type (SVC_* and SVC2_*).
+	NETTRAFFIC_COMMANDS,
+
+	// By the class of the actor whose Tick sent the commands.
+	NETTRAFFIC_ACTORS,
+
+	// By the client the commands were written to.
+	NETTRAFFIC_CLIENTS,
+
+	// By the client the datagrams were sent to, including the packet headers.
+	NETTRAFFIC_PACKETS,
+
+	NUM_NETTRAFFICCATEGORIES
+};
+
+static const char *g_pszTrafficCategoryNames[NUM_NETTRAFFICCATEGORIES] = { "commands", "actors", "clients", "packets" };
+
+// One line of the printed or exported traffic profile.
+struct NETTRAFFICROW_s
+{
+	FString				Name;
+	NETTRAFFICCOUNT_s	Count;
+};
+
+// The traffic profile, see sv_profiletraffic. SVC2 commands follow the SVC ones in g_CommandProfile.
+static NETTRAFFICCOUNT_s g_CommandProfile[NUM_SERVER_COMMANDS + NUM_SVC2_COMMANDS];
+static std::map<const char*, NETTRAFFICCOUNT_s, ltstr> g_ActorClassProfile;
+static NETTRAFFICCOUNT_s g_ClientCommandProfile[MAXPLAYERS];
+static NETTRAFFICCOUNT_s g_ClientPacketProfile[MAXPLAYERS];
+
+// Name of the class of the actor that is currently ticking, see NetTrafficActorScope.
+static const char *g_pszProfiledActorClass = NULL;
+
+// Tic the profile was cleared at and tic it was last written to sv_trafficprofilefile.
+static int g_iProfileStartTic = 0;
+static int g_iLastProfileExportTic = 0;
+
+static void nettraffic_ClearProfile ( );
+
+//*****************************************************************************
+//	CONSOLE VARIABLES
+
+// Counts the outbound traffic by command type, actor class and client. Turning it on clears the profile.
+CUSTOM_CVAR( Bool, sv_profiletraffic, false, CVAR_NOSETBYACS )
+{
+	if ( self )
+		nettraffic_ClearProfile( );
+}
+
+// If set, the traffic profile is written to this file every sv_trafficprofileinterval seconds.
+// The file is written as JSON if its name ends with ".json", as CSV otherwise.
+CVAR( String, sv_trafficprofilefile, "", CVAR_NOSETBYACS )
+CVAR( Int, sv_trafficprofileinterval, 10, CVAR_NOSETBYACS )
+
 //*****************************************************************************
 //
 void NETTRAFFIC_AddActorTraffic ( const AActor* pActor, const int BytesUsed )
@@ -124,3 +195,366 @@ CCMD( cleartrafficmeasure )
 {
 	NETTRAFFIC_Reset ();
 }
+
+//*****************************************************************************
+//
+static void nettraffic_ClearProfile ( )
+{
+	memset( g_CommandProfile, 0, sizeof( g_CommandProfile ));
+	memset( g_ClientCommandProfile, 0, sizeof( g_ClientCommandProfile ));
+	memset( g_ClientPacketProfile, 0, sizeof( g_ClientPacketProfile ));
+	g_ActorClassProfile.clear();
+	g_iProfileStartTic = gametic;
+	g_iLastProfileExportTic = gametic;
+}
+
+//*****************************************************************************
+//
+static void nettraffic_Count ( NETTRAFFICCOUNT_s &Count, const ULONG ulBytes, const QWORD qwEncodedBits )
+{
+	Count.qwMessages++;
+	Count.qwBytes += ulBytes;
+	Count.qwEncodedBits += qwEncodedBits;
+}
+
+//*****************************************************************************
+//
+bool NETTRAFFIC_IsProfiling ( )
+{
+	return ( sv_profiletraffic && ( NETWORK_GetState( ) == NETSTATE_SERVER ));
+}
+
+//*****************************************************************************
+//
+// iEncodedBits caches the length of the command's Huffman codes, the command is the same
+// for all the clients it is sent to. It has to be negative before the first call.
+void NETTRAFFIC_AddCommandTraffic ( const ULONG ulClient, const BYTE *pbCommand, const ULONG ulSize, int &iEncodedBits )
+{
+	if (( NETTRAFFIC_IsProfiling( ) == false ) || ( ulSize == 0 ) || ( ulClient >= MAXPLAYERS ))
+		return;
+
+	if ( iEncodedBits < 0 )
+	{
+		iEncodedBits = HUFFMAN_GetEncodedBitCount( pbCommand, ulSize );
+
+		// Without the codec, the packets are sent unencoded.
+		if ( iEncodedBits < 0 )
+			iEncodedBits = ulSize * 8;
+	}
+
+	ULONG ulCommand = pbCommand[0];
+	if (( ulCommand == SVC_EXTENDEDCOMMAND ) && ( ulSize > 1 ))
+		ulCommand = NUM_SERVER_COMMANDS + pbCommand[1];
+
+	if ( ulCommand < countof( g_CommandProfile ))
+		nettraffic_Count( g_CommandProfile[ulCommand], ulSize, iEncodedBits );
+
+	nettraffic_Count( g_ClientCommandProfile[ulClient], ulSize, iEncodedBits );
+
+	if ( g_pszProfiledActorClass != NULL )
+		nettraffic_Count( g_ActorClassProfile[g_pszProfiledActorClass], ulSize, iEncodedBits );
+}
+
+//*****************************************************************************
+//
+void NETTRAFFIC_AddPacketTraffic ( const ULONG ulClient, const ULONG ulSize, const LONG lEncodedSize )
+{
+	if (( NETTRAFFIC_IsProfiling( ) == false ) || ( ulClient >= MAXPLAYERS ))
+		return;
+
+	nettraffic_Count( g_ClientPacketProfile[ulClient], ulSize, static_cast<QWORD>( MAX<LONG>( lEncodedSize, 0 )) * 8 );
+}
+
+//*****************************************************************************
+//
+// The slot is taken by a new client.
+void NETTRAFFIC_ResetClient ( const ULONG ulClient )
+{
+	if ( ulClient >= MAXPLAYERS )
+		return;
+
+	memset( &g_ClientCommandProfile[ulClient], 0, sizeof( g_ClientCommandProfile[ulClient] ));
+	memset( &g_ClientPacketProfile[ulClient], 0, sizeof( g_ClientPacketProfile[ulClient] ));
+}
+
+//*****************************************************************************
+//
+NetTrafficActorScope::NetTrafficActorScope ( const AActor *pActor ) :
+	_previousClassName( g_pszProfiledActorClass )
+{
+	if (( pActor != NULL ) && NETTRAFFIC_IsProfiling( ))
+		g_pszProfiledActorClass = pActor->GetClass()->TypeName.GetChars();
+}
+
+//*****************************************************************************
+//
+NetTrafficActorScope::~NetTrafficActorScope ( )
+{
+	g_pszProfiledActorClass = _previousClassName;
+}
+
+//*****************************************************************************
+//
+static bool nettraffic_CompareRows ( const NETTRAFFICROW_s &Row1, const NETTRAFFICROW_s &Row2 )
+{
+	return ( Row1.Count.qwBytes > Row2.Count.qwBytes );
+}
+
+//*****************************************************************************
+//
+// Collects the non-empty entries of one category, sorted by the number of bytes.
+static void nettraffic_CollectRows ( const NETTRAFFICCATEGORY_e Category, TArray<NETTRAFFICROW_s> &Rows )
+{
+	NETTRAFFICROW_s	Row;
+
+	Rows.Clear();
+
+	switch ( Category )
+	{
+	case NETTRAFFIC_COMMANDS:
+
+		for ( ULONG ulIdx = 0; ulIdx < countof( g_CommandProfile ); ulIdx++ )
+		{
+			if ( g_CommandProfile[ulIdx].qwMessages == 0 )
+				continue;
+
+			if ( ulIdx < NUM_SERVER_COMMANDS )
+				Row.Name = GetStringSVC( static_cast<SVC>( ulIdx ));
+			else
+				Row.Name = GetStringSVC2( static_cast<SVC2>( ulIdx - NUM_SERVER_COMMANDS ));
+			Row.Count = g_CommandProfile[ulIdx];
+			Rows.Push( Row );
+		}
+		break;
+	case NETTRAFFIC_ACTORS:
+
+		for ( std::map<const char*, NETTRAFFICCOUNT_s, ltstr>::const_iterator it = g_ActorClassProfile.begin(); it != g_ActorClassProfile.end(); ++it )
+		{
+			Row.Name = (*it).first;
+			Row.Count = (*it).second;
+			Rows.Push( Row );
+		}
+		break;
+	case NETTRAFFIC_CLIENTS:
+	case NETTRAFFIC_PACKETS:
+
+		for ( ULONG ulIdx = 0; ulIdx < MAXPLAYERS; ulIdx++ )
+		{
+			const NETTRAFFICCOUNT_s &Count = ( Category == NETTRAFFIC_CLIENTS ) ? g_ClientCommandProfile[ulIdx] : g_ClientPacketProfile[ulIdx];
+			if ( Count.qwMessages == 0 )
+				continue;
+
+			Row.Name.Format( "%u %s", static_cast<unsigned int>( ulIdx ), SERVER_IsValidClient( ulIdx ) ? players[ulIdx].userinfo.GetName() : "" );
+			V_RemoveColorCodes( Row.Name );
+			Row.Name.StripRight();
+			Row.Count = Count;
+			Rows.Push( Row );
+		}
+		break;
+	default:
+
+		break;
+	}
+
+	if ( Rows.Size() > 1 )
+		std::sort( &Rows[0], &Rows[0] + Rows.Size(), nettraffic_CompareRows );
+}
+
+//*****************************************************************************
+//
+static int nettraffic_GetProfileSeconds ( )
+{
+	return ( MAX( ( gametic - g_iProfileStartTic ) / TICRATE, 1 ));
+}
+
+//*****************************************************************************
+//
+static void nettraffic_PrintProfile ( const NETTRAFFICCATEGORY_e Category )
+{
+	TArray<NETTRAFFICROW_s>	Rows;
+	const int				iSeconds = nettraffic_GetProfileSeconds( );
+
+	nettraffic_CollectRows( Category, Rows );
+
+	Printf( "Outbound traffic by %s over %d seconds:\n", g_pszTrafficCategoryNames[Category], iSeconds );
+	Printf( "%-36s %10s %12s %12s %7s %10s\n", "Name", "Messages", "Bytes", "Encoded", "Ratio", "Bytes/s" );
+
+	for ( unsigned int i = 0; i < Rows.Size(); i++ )
+	{
+		const NETTRAFFICCOUNT_s &Count = Rows[i].Count;
+		const QWORD qwEncodedBytes = ( Count.qwEncodedBits + 7 ) / 8;
+
+		Printf( "%-36s %10llu %12llu %12llu %6.1f%% %10llu\n", Rows[i].Name.GetChars(),
+			static_cast<unsigned long long>( Count.qwMessages ), static_cast<unsigned long long>( Count.qwBytes ),
+			static_cast<unsigned long long>( qwEncodedBytes ), ( Count.qwBytes > 0 ) ? 100.0 * qwEncodedBytes / Count.qwBytes : 0.0,
+			static_cast<unsigned long long>( qwEncodedBytes / iSeconds ));
+	}
+}
+
+//*****************************************************************************
+//
+// Quotes a name for the CSV or JSON export.
+static FString nettraffic_QuoteName ( const FString &Name, const bool bJSON )
+{
+	FString	Quoted = "\"";
+
+	for ( unsigned int i = 0; i < Name.Len(); i++ )
+	{
+		const char c = Name[i];
+
+		if ( bJSON == false )
+		{
+			if ( c == '"' )
+				Quoted += '"';
+			Quoted += c;
+		}
+		else if (( c == '"' ) || ( c == '\\' ))
+		{
+			Quoted += '\\';
+			Quoted += c;
+		}
+		else if ( static_cast<unsigned char>( c ) < 0x20 )
+			Quoted.AppendFormat( "\\u%04x", static_cast<unsigned char>( c ));
+		else
+			Quoted += c;
+	}
+
+	Quoted += '"';
+	return Quoted;
+}
+
+//*****************************************************************************
+//
+// Writes the whole traffic profile to a file, as JSON if its name ends with ".json", as CSV otherwise.
+// The profile is written to a temporary file first, so that programs reading the file never see it half-written.
+static bool nettraffic_ExportProfile ( const char *pszFileName )
+{
+	const FString	FileName = pszFileName;
+	FString			TempFileName;
+	const bool		bJSON = ( FileName.Len() >= 5 ) && ( stricmp( FileName.GetChars() + FileName.Len() - 5, ".json" ) == 0 );
+	const int		iSeconds = nettraffic_GetProfileSeconds( );
+	TArray<NETTRAFFICROW_s>	Rows;
+	FString			Line;
+
+	FILE *pFile = OpenTempFile( FileName, TempFileName, "w" );
+	if ( pFile == NULL )
+		return false;
+
+	if ( bJSON )
+		fprintf( pFile, "{\n\t\"seconds\": %d", iSeconds );
+	else
+		fputs( "category,name,messages,bytes,encodedbytes,seconds\n", pFile );
+
+	for ( int iCategory = 0; iCategory < NUM_NETTRAFFICCATEGORIES; iCategory++ )
+	{
+		nettraffic_CollectRows( static_cast<NETTRAFFICCATEGORY_e>( iCategory ), Rows );
+
+		if ( bJSON )
+			fprintf( pFile, ",\n\t\"%s\": [", g_pszTrafficCategoryNames[iCategory] );
+
+		for ( unsigned int i = 0; i < Rows.Size(); i++ )
+		{
+			const NETTRAFFICCOUNT_s &Count = Rows[i].Count;
+
+			if ( bJSON )
+			{
+				Line.Format( "%s\n\t\t{ \"name\": %s, \"messages\": %llu, \"bytes\": %llu, \"encodedbytes\": %llu }", ( i > 0 ) ? "," : "",
+					nettraffic_QuoteName( Rows[i].Name, true ).GetChars(), static_cast<unsigned long long>( Count.qwMessages ),
+					static_cast<unsigned long long>( Count.qwBytes ), static_cast<unsigned long long>(( Count.qwEncodedBits + 7 ) / 8 ));
+			}
+			else
+			{
+				Line.Format( "%s,%s,%llu,%llu,%llu,%d\n", g_pszTrafficCategoryNames[iCategory],
+					nettraffic_QuoteName( Rows[i].Name, false ).GetChars(), static_cast<unsigned long long>( Count.qwMessages ),
+					static_cast<unsigned long long>( Count.qwBytes ), static_cast<unsigned long long>(( Count.qwEncodedBits + 7 ) / 8 ), iSeconds );
+			}
+			fputs( Line.GetChars(), pFile );
+		}
+
+		if ( bJSON )
+			fputs(( Rows.Size() > 0 ) ? "\n\t]" : "]", pFile );
+	}
+
+	if ( bJSON )
+		fputs( "\n}\n", pFile );
+
+	return CommitTempFile( pFile, TempFileName, FileName );
+}
+
+//*****************************************************************************
+//
+// Periodically writes the traffic profile to sv_trafficprofilefile.
+void NETTRAFFIC_Tick ( )
+{
+	if (( NETTRAFFIC_IsProfiling( ) == false ) || ( strlen( sv_trafficprofilefile ) == 0 ))
+		return;
+
+	if (( gametic - g_iLastProfileExportTic ) < MAX<int>( sv_trafficprofileinterval, 1 ) * TICRATE )
+		return;
+
+	g_iLastProfileExportTic = gametic;
+	if ( nettraffic_ExportProfile( sv_trafficprofilefile ) == false )
+	{
+		Printf( "Couldn't write the traffic profile to %s, stopping the export.\n", *sv_trafficprofilefile );
+		sv_trafficprofilefile = "";
+	}
+}
+
+//*****************************************************************************
+//
+CCMD( dumptrafficprofile )
+{
+	if ( NETWORK_GetState( ) != NETSTATE_SERVER )
+		return;
+
+	if ( sv_profiletraffic == false )
+		Printf( "The traffic profile is only updated while sv_profiletraffic is on.\n" );
+
+	if ( argv.argc( ) < 2 )
+	{
+		for ( int iCategory = 0; iCategory < NUM_NETTRAFFICCATEGORIES; iCategory++ )
+		{
+			if ( iCategory > 0 )
+				Printf( "\n" );
+			nettraffic_PrintProfile( static_cast<NETTRAFFICCATEGORY_e>( iCategory ));
+		}
+		return;
+	}
+
+	for ( int iCategory = 0; iCategory < NUM_NETTRAFFICCATEGORIES; iCategory++ )
+	{
+		if ( stricmp( argv[1], g_pszTrafficCategoryNames[iCategory] ) == 0 )
+		{
+			nettraffic_PrintProfile( static_cast<NETTRAFFICCATEGORY_e>( iCategory ));
+			return;
+		}
+	}
+
+	Printf( "Usage: dumptrafficprofile [commands|actors|clients|packets]\n" );
+}
+
+//*****************************************************************************
+//
+CCMD( exporttrafficprofile )
+{
+	if ( NETWORK_GetState( ) != NETSTATE_SERVER )
+		return;
+
+	if ( argv.argc( ) < 2 )
+	{
+		Printf( "Usage: exporttrafficprofile <file>\nWrites the traffic profile as JSON if the file name ends with .json, as CSV otherwise.\n" );
+		return;
+	}
+
+	if ( nettraffic_ExportProfile( argv[1] ))
+		Printf( "Traffic profile written to %s.\n", argv[1] );
+	else
+		Printf( "Couldn't write the traffic profile to %s.\n", argv[1] );
+}
+
+//*****************************************************************************
+//
+CCMD( cleartrafficprofile )
+{
+	nettraffic_ClearProfile( );
+}
@@ -54,4 +54,23 @@ void	NETTRAFFIC_AddActorTraffic ( const AActor* pActor, const int BytesUsed );
 void	NETTRAFFIC_AddACSScriptTraffic ( const int ScriptNum, const int BytesUsed );
 void	NETTRAFFIC_Reset ( );
 
+bool	NETTRAFFIC_IsProfiling ( );
+void	NETTRAFFIC_AddCommandTraffic ( const ULONG ulClient, const BYTE *pbCommand, const ULONG ulSize, int &iEncodedBits );
+void	NETTRAFFIC_AddPacketTraffic ( const ULONG ulClient, const ULONG ulSize, const LONG lEncodedSize );
+void	NETTRAFFIC_ResetClient ( const ULONG ulClient );
+void	NETTRAFFIC_Tick ( );
+
+//*****************************************************************************
+/**
+ * \brief Attributes the commands sent while it exists to the class of an actor in the traffic profile.
+ */
+class NetTrafficActorScope
+{
+	const char	*_previousClassName;
+
+public:
+	NetTrafficActorScope ( const AActor *pActor );
+	~NetTrafficActorScope ( );
+};
+
 #endif	// __NETTRAFFIC_H__
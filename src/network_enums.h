@@ -63,6 +63,7 @@ BEGIN_ENUM( SVC )
 {
 	ENUM_ELEMENT2 ( SVC_HEADER, NUM_SERVERCONNECT_COMMANDS ),	// GENERAL PROTOCOL COMMANDS
 	ENUM_ELEMENT ( SVC_UNRELIABLEPACKET ),
+	ENUM_ELEMENT ( SVC_RETRANSMITTEDPACKETS ),
 	ENUM_ELEMENT ( SVC_PING ),
 	ENUM_ELEMENT ( SVC_NOTHING ),
 	ENUM_ELEMENT ( SVC_BEGINSNAPSHOT ),
@@ -70,6 +71,7 @@ BEGIN_ENUM( SVC )
 	ENUM_ELEMENT ( SVC_SPAWNPLAYER ),					// PLAYER COMMANDS
 	ENUM_ELEMENT ( SVC_SPAWNMORPHPLAYER ),
 	ENUM_ELEMENT ( SVC_MOVEPLAYER ),
+	ENUM_ELEMENT ( SVC_MOVEPLAYERDELTA ),
 	ENUM_ELEMENT ( SVC_DAMAGEPLAYER ),
 	ENUM_ELEMENT ( SVC_KILLPLAYER ),
 	ENUM_ELEMENT ( SVC_SETPLAYERHEALTH ),
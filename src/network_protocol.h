@@ -0,0 +1,207 @@
+//-----------------------------------------------------------------------------
+//
+// Skulltag Source
+// Copyright (C) 2003 Brad Carney
+// Copyright (C) 2007-2012 Skulltag Development Team
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the Skulltag Development Team nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+// 4. Redistributions in any form must be accompanied by information on how to
+//    obtain complete source code for the software and any accompanying
+//    software that uses the software. The source code must either be included
+//    in the distribution or be available for no more than the cost of
+//    distribution plus a nominal fee, and must be freely redistributable
+//    under reasonable conditions. For an executable file, complete source
+//    code means the source code for all modules it contains. It does not
+//    include source code for modules or files that typically accompany the
+//    major components of the operating system on which the executable file
+//    runs.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//
+// Filename: network_protocol.h
+//
+// Description: Contains the command numbers and error codes of the client/server
+// protocol. Doesn't depend on the engine, so tools can share it.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __NETWORK_PROTOCOL_H__
+#define __NETWORK_PROTOCOL_H__
+
+//*****************************************************************************
+//	DEFINES
+
+// Movement flags being sent by the client.
+#define	CLIENT_UPDATE_YAW				0x01
+#define	CLIENT_UPDATE_PITCH				0x02
+#define	CLIENT_UPDATE_ROLL				0x04
+#define	CLIENT_UPDATE_BUTTONS			0x08
+#define	CLIENT_UPDATE_FORWARDMOVE		0x10
+#define	CLIENT_UPDATE_SIDEMOVE			0x20
+#define	CLIENT_UPDATE_UPMOVE			0x40
+#define	CLIENT_UPDATE_BUTTONS_LONG		0x80
+
+// Which userinfo categories are being updated?
+#define	USERINFO_NAME				1
+#define	USERINFO_GENDER				2
+#define	USERINFO_COLOR				4
+#define	USERINFO_AIMDISTANCE		8
+#define	USERINFO_SKIN				16
+#define	USERINFO_RAILCOLOR			32
+#define	USERINFO_HANDICAP			64
+#define	USERINFO_PLAYERCLASS		128
+#define	USERINFO_TICSPERUPDATE		256
+#define	USERINFO_CONNECTIONTYPE		512
+#define	USERINFO_CLIENTFLAGS		1024
+#define	USERINFO_RATE				2048
+
+#define	USERINFO_ALL				( USERINFO_NAME | USERINFO_GENDER | USERINFO_COLOR | \
+									USERINFO_AIMDISTANCE | USERINFO_SKIN | USERINFO_RAILCOLOR | \
+									USERINFO_HANDICAP | USERINFO_PLAYERCLASS | USERINFO_TICSPERUPDATE | \
+									USERINFO_CONNECTIONTYPE | USERINFO_CLIENTFLAGS | USERINFO_RATE )
+
+// Bounds of the cl_rate userinfo in bytes per second.
+#define	MIN_CLIENT_RATE				4000
+#define	MAX_CLIENT_RATE				1000000
+
+//*****************************************************************************
+enum
+{
+	// Client has the wrong password.
+	NETWORK_ERRORCODE_WRONGPASSWORD,
+
+	// Client has the wrong version.
+	NETWORK_ERRORCODE_WRONGVERSION,
+
+	// Client is using a version with different network protocol.
+	NETWORK_ERRORCODE_WRONGPROTOCOLVERSION,
+
+	// Client has been banned.
+	NETWORK_ERRORCODE_BANNED,
+
+	// The server is full.
+	NETWORK_ERRORCODE_SERVERISFULL,
+
+	// Client has the wrong version of the current level.
+	NETWORK_ERRORCODE_AUTHENTICATIONFAILED,
+
+	// Client failed to send userinfo when connecting.
+	NETWORK_ERRORCODE_FAILEDTOSENDUSERINFO,
+
+	// [RC] Too many connections from the IP.
+	NETWORK_ERRORCODE_TOOMANYCONNECTIONSFROMIP,
+
+	// [BB] The protected lump authentication failed.
+	NETWORK_ERRORCODE_PROTECTED_LUMP_AUTHENTICATIONFAILED,
+
+	// [TP] The client sent bad userinfo
+	NETWORK_ERRORCODE_USERINFOREJECTED,
+
+	NUM_NETWORK_ERRORCODES
+};
+
+//*****************************************************************************
+enum
+{
+	// The server has properly received the client's challenge, and is telling
+	// the client to authenticate his map.
+	SVCC_AUTHENTICATE,
+
+	// The server received the client's checksum, and it's valid. Now the server
+	// is telling the client to load the map.
+	SVCC_MAPLOAD,
+
+	// There was an error during the course of the client trying to connect.
+	SVCC_ERROR,
+
+	NUM_SERVERCONNECT_COMMANDS
+};
+
+// [BB] The SVC and SVC2 defines are in a separate header so that they can be used with "EnumToString".
+#include "network_enums.h"
+
+//*****************************************************************************
+enum
+{
+	// Client is telling the server he wishes to connect.
+	CLCC_ATTEMPTCONNECTION,
+
+	// Client is attempting to authenticate the map.
+	CLCC_ATTEMPTAUTHENTICATION,
+
+	// Client has loaded the map, and is requesting the snapshot.
+	CLCC_REQUESTSNAPSHOT,
+
+	NUM_CLIENTCONNECT_COMMANDS
+};
+
+//*****************************************************************************
+enum
+{
+	CLC_USERINFO = NUM_CLIENTCONNECT_COMMANDS,
+	CLC_QUIT,
+	CLC_STARTCHAT,
+	CLC_ENDCHAT,
+	CLC_SAY,
+	CLC_CLIENTMOVE,
+	CLC_MISSINGPACKET,
+	CLC_PONG,
+	CLC_WEAPONSELECT,
+	CLC_TAUNT,
+	CLC_SPECTATE,
+	CLC_REQUESTJOIN,
+	CLC_REQUESTRCON,
+	CLC_RCONCOMMAND,
+	CLC_SUICIDE,
+	CLC_CHANGETEAM,
+	CLC_SPECTATEINFO,
+	CLC_GENERICCHEAT,
+	CLC_GIVECHEAT,
+	CLC_SUMMONCHEAT,
+	CLC_READYTOGOON,
+	CLC_CHANGEDISPLAYPLAYER,
+	CLC_AUTHENTICATELEVEL,
+	CLC_CALLVOTE,
+	CLC_VOTEYES,
+	CLC_VOTENO,
+	CLC_INVENTORYUSEALL,
+	CLC_INVENTORYUSE,
+	CLC_INVENTORYDROP,
+	CLC_SUMMONFRIENDCHEAT,
+	CLC_SUMMONFOECHEAT,
+	CLC_ENTERCONSOLE,
+	CLC_EXITCONSOLE,
+	CLC_IGNORE,
+	CLC_PUKE,
+	CLC_MORPHEX,
+	CLC_FULLUPDATE,
+	CLC_INFOCHEAT,
+
+	NUM_CLIENT_COMMANDS
+
+};
+
+#endif	// __NETWORK_PROTOCOL_H__
@@ -876,6 +876,10 @@ time_t IPFileParser::readExpirationDate( FILE *pFile )
 	return mktime( pTimeInfo );
 }
 
+//*****************************************************************************
+//
+unsigned int IPList::_nextRevision = 0;
+
 //*****************************************************************************
 //
 void IPList::copy( IPList &destination )
@@ -899,6 +903,7 @@ bool IPList::clearAndLoadFromFile( const char *Filename )
 	IPFileParser parser( 65536 );
 
 	success = parser.parseIPList( Filename, _ipVector );
+	contentsChanged( );
 	if ( !success )
 		_error = parser.getErrorMessage();
 
@@ -952,6 +957,19 @@ void IPList::removeExpiredEntries( void )
 //
 ULONG IPList::getFirstMatchingEntryIndex( const IPStringArray &szAddress ) const
 {
+	BYTE	abIP[4];
+	bool	bNumeric = true;
+
+	for ( int i = 0; i < 4; i++ )
+		bNumeric = bNumeric && IPMatcher::parseOctet( szAddress[i], abIP[i] );
+
+	// Only addresses in the form NETWORK_AddressToIPStringArray uses can be looked up with the matcher.
+	if ( bNumeric )
+	{
+		ULONG ulIdx;
+		return getMatcher( ).findFirstMatch( abIP, ulIdx ) ? ulIdx : size();
+	}
+
 	for ( ULONG ulIdx = 0; ulIdx < _ipVector.size(); ulIdx++ )
 	{
 		if ((( _ipVector[ulIdx].szIP[0][0] == '*' ) || ( stricmp( szAddress[0], _ipVector[ulIdx].szIP[0] ) == 0 )) &&
@@ -970,9 +988,21 @@ ULONG IPList::getFirstMatchingEntryIndex( const IPStringArray &szAddress ) const
 //
 ULONG IPList::getFirstMatchingEntryIndex( const NETADDRESS_s &Address ) const
 {
-	IPStringArray szAddress;
-	NETWORK_AddressToIPStringArray( Address, szAddress );
-	return getFirstMatchingEntryIndex( szAddress );
+	ULONG ulIdx;
+	return getMatcher( ).findFirstMatch( Address.abIP, ulIdx ) ? ulIdx : size();
+}
+
+//*****************************************************************************
+//
+const IPMatcher &IPList::getMatcher( ) const
+{
+	if ( _matcherOutdated )
+	{
+		_matcher.build( _ipVector );
+		_matcherOutdated = false;
+	}
+
+	return ( _matcher );
 }
 
 //*****************************************************************************
@@ -1166,6 +1196,7 @@ void IPList::addEntry( const char *pszIP0, const char *pszIP1, const char *pszIP
 	newIPEntry.szComment[127] = 0;
 	newIPEntry.tExpirationDate = tExpiration;
 	_ipVector.push_back( newIPEntry );
+	contentsChanged( );
 
 	// Finally, append the IP to the file.
 	if ( (pFile = fopen( _filename.c_str(), "a" )) )
@@ -1239,6 +1270,7 @@ void IPList::removeEntry( ULONG ulEntryIdx )
 			_ipVector[ulIdx] = _ipVector[ulIdx+1];
 
 	_ipVector.pop_back();
+	contentsChanged( );
 	rewriteListToFile ();
 }
 
@@ -1328,6 +1360,270 @@ struct ASCENDINGIPSORT_S
 void IPList::sort()
 {
 	std::sort( _ipVector.begin(), _ipVector.end(), ASCENDINGIPSORT_S() );
+	contentsChanged( );
+}
+
+//=============================================================================
+// IPMatcher
+//=============================================================================
+
+//=============================================================================
+//
+// build
+//
+// Groups and sorts the entries of an IP list. Entries that can't match any address
+// (i.e. that have octets NETWORK_AddressToIPStringArray never produces) are left out.
+//
+//=============================================================================
+
+void IPMatcher::build( const std::vector<IPADDRESSBAN_s> &IPs )
+{
+	for ( int i = 0; i < 16; i++ )
+		_groups[i].clear( );
+
+	for ( ULONG ulIdx = 0; ulIdx < IPs.size( ); ulIdx++ )
+	{
+		unsigned int	uiAddress = 0;
+		int				iWildcards = 0;
+		bool			bValid = true;
+
+		for ( int i = 0; i < 4; i++ )
+		{
+			BYTE bOctet = 0;
+
+			if ( IPs[ulIdx].szIP[i][0] == '*' )
+				iWildcards |= ( 1 << i );
+			else if ( parseOctet( IPs[ulIdx].szIP[i], bOctet ) == false )
+				bValid = false;
+
+			uiAddress = ( uiAddress << 8 ) | bOctet;
+		}
+
+		if ( bValid )
+			_groups[iWildcards].push_back( MATCHER_ENTRY_t( uiAddress, ulIdx ));
+	}
+
+	// Sorting by the index too puts the first of several equal entries in front.
+	for ( int i = 0; i < 16; i++ )
+		std::sort( _groups[i].begin( ), _groups[i].end( ));
+}
+
+//=============================================================================
+//
+// findFirstMatch
+//
+// Finds the lowest index of the entries matching the address pbIP[0].pbIP[1].pbIP[2].pbIP[3].
+//
+//=============================================================================
+
+bool IPMatcher::findFirstMatch( const BYTE *pbIP, ULONG &ulIdx ) const
+{
+	bool bFound = false;
+
+	for ( int i = 0; i < 16; i++ )
+	{
+		if ( _groups[i].empty( ))
+			continue;
+
+		unsigned int uiAddress = 0;
+		for ( int j = 0; j < 4; j++ )
+			uiAddress = ( uiAddress << 8 ) | (( i & ( 1 << j )) ? 0 : pbIP[j] );
+
+		std::vector<MATCHER_ENTRY_t>::const_iterator it = std::lower_bound( _groups[i].begin( ), _groups[i].end( ), MATCHER_ENTRY_t( uiAddress, 0 ));
+		if (( it != _groups[i].end( )) && ( it->first == uiAddress ) && (( bFound == false ) || ( it->second < ulIdx )))
+		{
+			ulIdx = it->second;
+			bFound = true;
+		}
+	}
+
+	return ( bFound );
+}
+
+//=============================================================================
+//
+// parseOctet
+//
+// Converts an octet written like NETWORK_AddressToIPStringArray writes it (decimal,
+// no leading zeros) to a number. IPList compares octets as strings, so other ways to
+// write the octet never match.
+//
+//=============================================================================
+
+bool IPMatcher::parseOctet( const char *pszOctet, BYTE &bOctet )
+{
+	int iValue = 0;
+	int i;
+
+	for ( i = 0; ( i < 3 ) && isdigit( static_cast<unsigned char>( pszOctet[i] )); i++ )
+		iValue = iValue * 10 + ( pszOctet[i] - '0' );
+
+	if (( i == 0 ) || ( pszOctet[i] != 0 ) || (( i > 1 ) && ( pszOctet[0] == '0' )) || ( iValue > 255 ))
+		return ( false );
+
+	bOctet = static_cast<BYTE>( iValue );
+	return ( true );
+}
+
+//=============================================================================
+// AddressHashTable
+//=============================================================================
+
+enum
+{
+	HASH_ENTRY_EMPTY,
+	HASH_ENTRY_USED,
+	HASH_ENTRY_REMOVED,
+};
+
+//=============================================================================
+//
+// find
+//
+// Returns the value stored for the address or NULL if there is none.
+//
+//=============================================================================
+
+unsigned int *AddressHashTable::find( const NETADDRESS_s &Address )
+{
+	const int iSlot = findSlot( makeKey( Address ));
+	return ( iSlot != -1 ) ? &_entries[iSlot].Value : NULL;
+}
+
+const unsigned int *AddressHashTable::find( const NETADDRESS_s &Address ) const
+{
+	const int iSlot = findSlot( makeKey( Address ));
+	return ( iSlot != -1 ) ? &_entries[iSlot].Value : NULL;
+}
+
+//=============================================================================
+//
+// insert
+//
+// Returns the value stored for the address, a new address starts with zero.
+//
+//=============================================================================
+
+unsigned int &AddressHashTable::insert( const NETADDRESS_s &Address )
+{
+	const unsigned long long Key = makeKey( Address );
+	const int iSlot = findSlot( Key );
+	if ( iSlot != -1 )
+		return _entries[iSlot].Value;
+
+	// Keep at least a quarter of the slots empty, so that searches end quickly.
+	if (( _numUsed + _numRemoved + 1 ) * 4 > _entries.size( ) * 3 )
+		rehash(( _numUsed + 1 ) * 4 > _entries.size( ) * 2 ? std::max<unsigned int>( 16, _entries.size( ) * 2 ) : _entries.size( ));
+
+	const unsigned int ulMask = _entries.size( ) - 1;
+	unsigned int ulSlot = static_cast<unsigned int>( Key * 0x9E3779B97F4A7C15ULL >> 32 ) & ulMask;
+	while ( _entries[ulSlot].State == HASH_ENTRY_USED )
+		ulSlot = ( ulSlot + 1 ) & ulMask;
+
+	if ( _entries[ulSlot].State == HASH_ENTRY_REMOVED )
+		_numRemoved--;
+
+	_entries[ulSlot].Key = Key;
+	_entries[ulSlot].Value = 0;
+	_entries[ulSlot].State = HASH_ENTRY_USED;
+	_numUsed++;
+	return _entries[ulSlot].Value;
+}
+
+//=============================================================================
+//
+// remove
+//
+//=============================================================================
+
+void AddressHashTable::remove( const NETADDRESS_s &Address )
+{
+	const int iSlot = findSlot( makeKey( Address ));
+	if ( iSlot == -1 )
+		return;
+
+	_entries[iSlot].State = HASH_ENTRY_REMOVED;
+	_numUsed--;
+	_numRemoved++;
+}
+
+//=============================================================================
+//
+// clear
+//
+//=============================================================================
+
+void AddressHashTable::clear( )
+{
+	_entries.clear( );
+	_numUsed = 0;
+	_numRemoved = 0;
+}
+
+//=============================================================================
+//
+// makeKey
+//
+//=============================================================================
+
+unsigned long long AddressHashTable::makeKey( const NETADDRESS_s &Address ) const
+{
+	const unsigned long long IP = ( static_cast<unsigned long long>( Address.abIP[0] ) << 24 ) | ( Address.abIP[1] << 16 ) | ( Address.abIP[2] << 8 ) | Address.abIP[3];
+	return ( IP << 16 ) | ( _ignorePort ? 0 : Address.usPort );
+}
+
+//=============================================================================
+//
+// findSlot
+//
+// Returns the slot that holds Key or -1 if Key isn't in the table.
+//
+//=============================================================================
+
+int AddressHashTable::findSlot( const unsigned long long Key ) const
+{
+	if ( _numUsed == 0 )
+		return -1;
+
+	const unsigned int ulMask = _entries.size( ) - 1;
+	for ( unsigned int ulSlot = static_cast<unsigned int>( Key * 0x9E3779B97F4A7C15ULL >> 32 ) & ulMask; ; ulSlot = ( ulSlot + 1 ) & ulMask )
+	{
+		if ( _entries[ulSlot].State == HASH_ENTRY_EMPTY )
+			return -1;
+
+		if (( _entries[ulSlot].State == HASH_ENTRY_USED ) && ( _entries[ulSlot].Key == Key ))
+			return static_cast<int>( ulSlot );
+	}
+}
+
+//=============================================================================
+//
+// rehash
+//
+// Moves all entries to a table with NumSlots slots, which drops the removed ones.
+// NumSlots has to be a power of two.
+//
+//=============================================================================
+
+void AddressHashTable::rehash( const unsigned int NumSlots )
+{
+	std::vector<HASH_ENTRY_t> oldEntries( NumSlots );
+	for ( unsigned int i = 0; i < NumSlots; i++ )
+		oldEntries[i].State = HASH_ENTRY_EMPTY;
+	oldEntries.swap( _entries );
+	_numRemoved = 0;
+
+	const unsigned int ulMask = NumSlots - 1;
+	for ( unsigned int i = 0; i < oldEntries.size( ); i++ )
+	{
+		if ( oldEntries[i].State != HASH_ENTRY_USED )
+			continue;
+
+		unsigned int ulSlot = static_cast<unsigned int>( oldEntries[i].Key * 0x9E3779B97F4A7C15ULL >> 32 ) & ulMask;
+		while ( _entries[ulSlot].State == HASH_ENTRY_USED )
+			ulSlot = ( ulSlot + 1 ) & ulMask;
+		_entries[ulSlot] = oldEntries[i];
+	}
 }
 
 //=============================================================================
@@ -1345,7 +1641,24 @@ void IPList::sort()
 void QueryIPQueue::adjustHead( const LONG CurrentTime )
 {
 	while (( _iQueueHead != _iQueueTail ) && ( CurrentTime >= _IPQueue[_iQueueHead].lNextAllowedTime ))
-		_iQueueHead = ( _iQueueHead + 1 ) % MAX_QUERY_IPS;
+		removeHead( );
+}
+
+//=============================================================================
+//
+// removeHead
+//
+// Removes the oldest entry.
+//
+//=============================================================================
+
+void QueryIPQueue::removeHead( )
+{
+	unsigned int *pCount = _IPCounts.find( _IPQueue[_iQueueHead].Address );
+	if (( pCount != NULL ) && ( --*pCount == 0 ))
+		_IPCounts.remove( _IPQueue[_iQueueHead].Address );
+
+	_iQueueHead = ( _iQueueHead + 1 ) % _IPQueue.size( );
 }
 
 //=============================================================================
@@ -1358,15 +1671,7 @@ void QueryIPQueue::adjustHead( const LONG CurrentTime )
 
 bool QueryIPQueue::addressInQueue( const NETADDRESS_s AddressFrom ) const
 {
-	// Search through the queue.
-	for ( unsigned int i = _iQueueHead; i != _iQueueTail; i = ( i + 1 ) % MAX_QUERY_IPS )
-	{
-		if ( NETWORK_CompareAddress( AddressFrom, _IPQueue[i].Address, true ))
-			return true;
-	}
-
-	// Not found, or the queue is empty.
-	return false;
+	return ( _IPCounts.find( AddressFrom ) != NULL );
 }
 
 //=============================================================================
@@ -1380,7 +1685,7 @@ bool QueryIPQueue::addressInQueue( const NETADDRESS_s AddressFrom ) const
 
 bool QueryIPQueue::isFull( ) const
 {
-	return ((( _iQueueTail + 1 ) % MAX_QUERY_IPS ) == _iQueueHead );
+	return ((( _iQueueTail + 1 ) % _IPQueue.size( )) == _iQueueHead );
 }
 
 //=============================================================================
@@ -1394,16 +1699,17 @@ bool QueryIPQueue::isFull( ) const
 void QueryIPQueue::addAddress( const NETADDRESS_s AddressFrom, const LONG lCurrentTime, std::ostream *errorOut )
 {
 	// Add and advance the tail.
-	_IPQueue[_iQueueTail].Address = AddressFrom;
-	_IPQueue[_iQueueTail].lNextAllowedTime = lCurrentTime + _iEntryLength;
-	_iQueueTail = ( _iQueueTail + 1 ) % MAX_QUERY_IPS;
-
 	// Is the queue full?
-	if (_iQueueTail == _iQueueHead )
+	if ( isFull( ))
 	{
 		if ( errorOut )
 			*errorOut << "WARNING! The IP flood queue is full.\n";
 
-		_iQueueHead = ( _iQueueHead + 1 ) % MAX_QUERY_IPS; // [RC] Start removing older entries.
+		removeHead( ); // [RC] Start removing older entries.
 	}
+
+	_IPQueue[_iQueueTail].Address = AddressFrom;
+	_IPQueue[_iQueueTail].lNextAllowedTime = lCurrentTime + _iEntryLength;
+	_iQueueTail = ( _iQueueTail + 1 ) % _IPQueue.size( );
+	_IPCounts.insert( AddressFrom )++;
 }
@@ -333,6 +333,32 @@ private:
 	bool		parseNextLine( FILE *pFile, IPADDRESSBAN_s &IP, ULONG &BanIdx );
 };
 
+//==========================================================================
+//
+// IPMatcher
+//
+// Finds the first entry of an IP list that matches an address without comparing
+// the address to every entry. The entries are grouped by their wildcard octets,
+// so a lookup needs at most one binary search for each of the 16 combinations.
+//
+//==========================================================================
+
+class IPMatcher
+{
+	// An entry is stored as its address with the wildcard octets set to zero and its index
+	// in the list. _groups[i] holds the entries whose wildcard octets are the set bits of i.
+	typedef std::pair<unsigned int, ULONG>	MATCHER_ENTRY_t;
+
+	std::vector<MATCHER_ENTRY_t>	_groups[16];
+
+//*************************************************************************
+public:
+	void			build( const std::vector<IPADDRESSBAN_s> &IPs );
+	bool			findFirstMatch( const BYTE *pbIP, ULONG &ulIdx ) const;
+
+	static bool		parseOctet( const char *pszOctet, BYTE &bOctet );
+};
+
 //==========================================================================
 //
 // IPList
@@ -348,8 +374,18 @@ class IPList
 	std::string						_filename;
 	std::string						_error;
 
+	// Built from _ipVector when it's needed the next time after _ipVector was changed.
+	mutable IPMatcher				_matcher;
+	mutable bool					_matcherOutdated;
+
+	// Changes whenever _ipVector is changed. No two lists ever share a revision, unless one is a copy of the other.
+	unsigned int					_revision;
+	static unsigned int				_nextRevision;
+
 //*************************************************************************
 public:
+	IPList() : _matcherOutdated( true ), _revision( ++_nextRevision ) { }
+
 	bool			clearAndLoadFromFile( const char *Filename );
 	ULONG			getFirstMatchingEntryIndex( const IPStringArray &szAddress ) const;
 	ULONG			getFirstMatchingEntryIndex( const NETADDRESS_s &Address ) const;
@@ -371,15 +407,64 @@ public:
 	void			removeExpiredEntries( void ); // [RC]
 
 	unsigned int	size() const { return static_cast<unsigned int>( _ipVector.size( )); }
-	void			clear() { _ipVector.clear(); }
-	void			push_back ( IPADDRESSBAN_s &IP ) { _ipVector.push_back(IP); }
+	void			clear() { _ipVector.clear(); contentsChanged(); }
+	void			push_back ( IPADDRESSBAN_s &IP ) { _ipVector.push_back(IP); contentsChanged(); }
 	const char*		getErrorMessage() const { return _error.c_str(); }
+	const IPMatcher	&getMatcher() const;
+	unsigned int	getRevision() const { return _revision; }
 	
-	std::vector<IPADDRESSBAN_s>&	getVector() { return _ipVector; }
+	std::vector<IPADDRESSBAN_s>&	getVector() { contentsChanged(); return _ipVector; }
+	const std::vector<IPADDRESSBAN_s>&	getVector() const { return _ipVector; }
 
 //*************************************************************************
 private:
 	bool rewriteListToFile ();
+	void contentsChanged () { _matcherOutdated = true; _revision = ++_nextRevision; }
+};
+
+//==========================================================================
+//
+// AddressHashTable
+//
+// Maps addresses to unsigned integers, either with or without their port.
+// Uses open addressing, so lookups never allocate.
+//
+//==========================================================================
+
+class AddressHashTable
+{
+	typedef struct
+	{
+		// IP and port of the address, the port is zero if the table ignores ports.
+		unsigned long long	Key;
+		unsigned int		Value;
+
+		// Empty, used or removed. Removed slots don't end a search.
+		BYTE				State;
+
+	} HASH_ENTRY_t;
+
+	std::vector<HASH_ENTRY_t>	_entries;
+	unsigned int				_numUsed;
+	unsigned int				_numRemoved;
+	const bool					_ignorePort;
+
+//*************************************************************************
+public:
+	AddressHashTable( const bool IgnorePort ) : _numUsed( 0 ), _numRemoved( 0 ), _ignorePort( IgnorePort ) { }
+
+	unsigned int	*find( const NETADDRESS_s &Address );
+	const unsigned int	*find( const NETADDRESS_s &Address ) const;
+	unsigned int	&insert( const NETADDRESS_s &Address );
+	void			remove( const NETADDRESS_s &Address );
+	void			clear( );
+	unsigned int	size( ) const { return _numUsed; }
+
+//*************************************************************************
+private:
+	unsigned long long	makeKey( const NETADDRESS_s &Address ) const;
+	int					findSlot( const unsigned long long Key ) const;
+	void				rehash( const unsigned int NumSlots );
 };
 
 //==========================================================================
@@ -404,11 +489,14 @@ class QueryIPQueue
 
 	} STORED_QUERY_IP_t;
 
-	// The maximum number of entries that we can store.
+	// The default maximum number of entries that we can store.
 	static const unsigned int	MAX_QUERY_IPS = 512;
 
 	// The array of IPs.
-	STORED_QUERY_IP_t			_IPQueue[MAX_QUERY_IPS];
+	std::vector<STORED_QUERY_IP_t>	_IPQueue;
+
+	// How many entries of the queue each IP has, so that addressInQueue doesn't need to search the queue.
+	AddressHashTable			_IPCounts;
 
 	// Head and tail of the queue.
 	unsigned int				_iQueueHead;
@@ -419,14 +507,19 @@ class QueryIPQueue
 
 //*************************************************************************
 public:
-	QueryIPQueue( int iEntryLength ) : _iQueueHead( 0 ), _iQueueTail( 0 ), _iEntryLength( iEntryLength )
+	QueryIPQueue( int iEntryLength, unsigned int iMaxEntries = MAX_QUERY_IPS ) : _IPQueue( iMaxEntries ), _IPCounts( true ), _iQueueHead( 0 ), _iQueueTail( 0 ), _iEntryLength( iEntryLength )
 	{
 	}
 
+	void	setEntryLength( int iEntryLength ) { _iEntryLength = iEntryLength; }
 	void	adjustHead( const LONG CurrentTime );
 	bool	addressInQueue( const NETADDRESS_s AddressFrom ) const;
 	void	addAddress( const NETADDRESS_s AddressFrom, const LONG lCurrentTime, std::ostream *errorOut = NULL );
 	bool	isFull( ) const;
+
+//*************************************************************************
+private:
+	void	removeHead( );
 };
 
 //==========================================================================
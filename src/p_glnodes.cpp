@@ -85,7 +85,11 @@ CVAR(Float, gl_cachetime, 0.6f, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 
 void P_LoadZNodes (FileReader &dalump, DWORD id);
 static bool CheckCachedNodes(MapData *map);
-static void CreateCachedNodes(MapData *map);
+static void CreateCachedNodes(MapData *map, int buildtime);
+
+// Cached nodes end with "ZCHK", the time it took to build them and the MD5 sum of everything before it.
+// Files without a valid trailer are incomplete or corrupt and get replaced.
+#define CACHE_TRAILER_SIZE	24
 
 
 // fixed 32 bit gl_vert format v2.0+ (glBsp 1.91)
@@ -1017,30 +1021,48 @@ bool P_CheckNodes(MapData * map, bool rebuilt, int buildtime)
 		}
 	}
 
+	P_CacheNodes(map, buildtime);
+
+
+	if (!gamenodes)
+	{
+		gamenodes = nodes;
+		numgamenodes = numnodes;
+		gamesubsectors = subsectors;
+		numgamesubsectors = numsubsectors;
+	}
+	return ret;
+}
+
+//==========================================================================
+//
+// Caches the GL nodes that were just built, if building them took long enough.
+// This used to be skipped on the server, because it reportedly crashed there.
+// The cache files are now written atomically and verified when they are read.
+//
+//==========================================================================
+
+void P_CacheNodes(MapData *map, int buildtime)
+{
+	// Without GL nodes there is nothing to cache.
+	if (glsegextras == NULL || numsegs == 0)
+	{
+		return;
+	}
+
 #ifdef DEBUG
 	// Building nodes in debug is much slower so let's cache them only if cachetime is 0
 	buildtime = 0;
 #endif
-	// [BB] Reportedly, the server can crash in case "gl_cachenodes true".
-	if ( ( NETWORK_GetState( ) != NETSTATE_SERVER ) && gl_cachenodes && buildtime/1000.f >= gl_cachetime)
+	if (gl_cachenodes && buildtime/1000.f >= gl_cachetime)
 	{
 		DPrintf("Caching nodes\n");
-		CreateCachedNodes(map);
+		CreateCachedNodes(map, buildtime);
 	}
 	else
 	{
 		DPrintf("Not caching nodes (time = %f)\n", buildtime/1000.f);
 	}
-
-
-	if (!gamenodes)
-	{
-		gamenodes = nodes;
-		numgamenodes = numnodes;
-		gamesubsectors = subsectors;
-		numgamesubsectors = numsubsectors;
-	}
-	return ret;
 }
 
 //==========================================================================
@@ -1121,7 +1143,35 @@ static void WriteLong(MemFile &f, DWORD b)
 	f[v+3] = (BYTE)(b>>24);
 }
 
-static void CreateCachedNodes(MapData *map)
+//==========================================================================
+//
+// Writes to a temporary file first and renames it afterwards, so that neither a crash
+// nor another process writing the same file at the same time can leave an incomplete
+// file behind. Readers either see the old or the new file.
+//
+//==========================================================================
+
+static bool WriteCacheFile(const FString &path, const BYTE *data, size_t size)
+{
+	FString temppath;
+
+	FILE *f = OpenTempFile(path, temppath, "wb");
+	if (f == NULL)
+	{
+		Printf("Could not write node cache file %s: %s\n", temppath.GetChars(), strerror(errno));
+		return false;
+	}
+
+	fwrite(data, 1, size, f);
+	if (!CommitTempFile(f, temppath, path))
+	{
+		Printf("Could not write node cache file %s: %s\n", path.GetChars(), strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+static void CreateCachedNodes(MapData *map, int buildtime)
 {
 	MemFile ZNodes;
 
@@ -1192,7 +1242,7 @@ static void CreateCachedNodes(MapData *map)
 	int r;
 	do
 	{
-		compressed = new Bytef[outlen + offset];
+		compressed = new Bytef[outlen + offset + CACHE_TRAILER_SIZE];
 		r = compress (compressed + offset, &outlen, &ZNodes[0], ZNodes.Size());
 		if (r == Z_BUF_ERROR)
 		{
@@ -1213,49 +1263,76 @@ static void CreateCachedNodes(MapData *map)
 	}
 	memcpy(compressed + offset - 4, "ZGL2", 4);
 
+	BYTE *trailer = compressed + offset + outlen;
+	DWORD time = LittleLong(DWORD(buildtime));
+	memcpy(trailer, "ZCHK", 4);
+	memcpy(trailer + 4, &time, 4);
+	MD5Context md5;
+	md5.Update(compressed, offset + outlen + 8);
+	md5.Final(trailer + 8);
+
 	FString path = CreateCacheName(map, true);
-	FILE *f = fopen(path, "wb");
-	fwrite(compressed, 1, outlen+offset, f);
-	fclose(f);
+	if (WriteCacheFile(path, compressed, outlen + offset + CACHE_TRAILER_SIZE))
+	{
+		Printf("Cached the nodes of %.8s, building them took %d ms.\n", map->MapLumps[0].Name, buildtime);
+	}
 	delete [] compressed;
 }
 
 
 static bool CheckCachedNodes(MapData *map)
 {
-	char magic[4] = {0,0,0,0};
-	BYTE md5[16];
 	BYTE md5map[16];
-	DWORD numlin;
-	DWORD *verts = NULL;
+	BYTE md5[16];
+	unsigned int startTime = I_FPSTime();
 
 	FString path = CreateCacheName(map, false);
 	FILE *f = fopen(path, "rb");
 	if (f == NULL) return false;
 
-	if (fread(magic, 1, 4, f) != 4) goto errorout;
-	if (memcmp(magic, "CACH", 4))  goto errorout;
+	// Read the whole file, so that it can be verified before anything is loaded from it.
+	TArray<BYTE> data;
+	long size = -1;
+	if (fseek(f, 0, SEEK_END) == 0)
+	{
+		size = ftell(f);
+	}
+	if (size > 0 && fseek(f, 0, SEEK_SET) == 0)
+	{
+		data.Resize(size);
+		if (fread(&data[0], 1, size, f) != (size_t)size) size = -1;
+	}
+	fclose(f);
+
+	// Header, vertex indices of the lines, "ZGL2" and the trailer.
+	int offset = numlines * 8 + 12 + 16;
+	if (size < offset + CACHE_TRAILER_SIZE) return false;
+	if (memcmp(&data[0], "CACH", 4)) return false;
+
+	const BYTE *trailer = &data[size - CACHE_TRAILER_SIZE];
+	if (memcmp(trailer, "ZCHK", 4)) return false;
+	MD5Context filemd5;
+	filemd5.Update(&data[0], size - CACHE_TRAILER_SIZE + 8);
+	filemd5.Final(md5);
+	if (memcmp(md5, trailer + 8, 16))
+	{
+		Printf("Node cache file %s is corrupt, the nodes will be rebuilt.\n", path.GetChars());
+		return false;
+	}
 
-	if (fread(&numlin, 4, 1, f) != 1) goto errorout; 
+	DWORD numlin;
+	memcpy(&numlin, &data[4], 4);
 	numlin = LittleLong(numlin);
-	if ((int)numlin != numlines) goto errorout;
+	if ((int)numlin != numlines) return false;
 
-	if (fread(md5, 1, 16, f) != 16) goto errorout;
 	map->GetChecksum(md5map);
-	if (memcmp(md5, md5map, 16)) goto errorout;
-
-	verts = new DWORD[numlin * 8];
-	if (fread(verts, 8, numlin, f) != numlin) goto errorout;
-
-	if (fread(magic, 1, 4, f) != 4) goto errorout;
-	if (memcmp(magic, "ZGL2", 4))  goto errorout;
+	if (memcmp(&data[8], md5map, 16)) return false;
 
+	if (memcmp(&data[offset - 4], "ZGL2", 4)) return false;
 
 	try
 	{
-		long pos = ftell(f);
-		FileReader fr(f);
-		fr.Seek(pos, SEEK_SET);
+		MemoryReader fr((const char *)&data[offset], size - offset - CACHE_TRAILER_SIZE);
 		P_LoadZNodes (fr, MAKE_ID('Z','G','L','2'));
 	}
 	catch (CRecoverableError &error)
@@ -1277,26 +1354,22 @@ static bool CheckCachedNodes(MapData *map)
 			delete[] nodes;
 			nodes = NULL;
 		}
-		goto errorout;
+		return false;
 	}
 
 	for(int i=0;i<numlines;i++)
 	{
-		lines[i].v1 = &vertexes[LittleLong(verts[i*2])];
-		lines[i].v2 = &vertexes[LittleLong(verts[i*2+1])];
+		DWORD ndx[2];
+		memcpy(ndx, &data[8 + 16 + 8*i], 8);
+		lines[i].v1 = &vertexes[LittleLong(ndx[0])];
+		lines[i].v2 = &vertexes[LittleLong(ndx[1])];
 	}
-	delete [] verts;
 
-	fclose(f);
+	DWORD buildtime;
+	memcpy(&buildtime, trailer + 4, 4);
+	Printf("Loaded the cached nodes of %.8s in %u ms, building them took %u ms.\n", map->MapLumps[0].Name,
+		I_FPSTime() - startTime, LittleLong(buildtime));
 	return true;
-
-errorout:
-	if (verts != NULL)
-	{
-		delete[] verts;
-	}
-	fclose(f);
-	return false;
 }
 
 CCMD(clearnodecache)
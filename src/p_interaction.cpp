@@ -2150,6 +2150,7 @@ void PLAYER_SetFragcount( player_t *pPlayer, LONG lFragCount, bool bAnnounce, bo
 		// Also, update the scoreboard.
 		SERVERCONSOLE_UpdatePlayerInfo( pPlayer - players, UDF_FRAGS );
 		SERVERCONSOLE_UpdateScoreboard( );
+		SERVER_MASTER_InvalidateServerInfo( );
 	}
 
 	// Refresh the HUD since a score has changed.
@@ -2192,6 +2193,7 @@ void PLAYER_ResetAllPlayersFragcount( void )
 		{
 			SERVERCONSOLE_UpdatePlayerInfo( ulIdx, UDF_FRAGS );
 			SERVERCONSOLE_UpdateScoreboard( );
+			SERVER_MASTER_InvalidateServerInfo( );
 		}
 	}
 
@@ -2417,7 +2419,10 @@ void PLAYER_SetTeam( player_t *pPlayer, ULONG ulTeam, bool bNoBroadcast )
 
 	// Update this player's info on the scoreboard.
 	if ( NETWORK_GetState( ) == NETSTATE_SERVER )
+	{
 		SERVERCONSOLE_UpdatePlayerInfo( pPlayer - players, UDF_FRAGS );
+		SERVER_MASTER_InvalidateServerInfo( );
+	}
 
 	// [BL] If the player was "unarmed" give back his inventory now.
 	// [BB] Note: On the clients bUnarmed is never true!
@@ -2641,7 +2646,10 @@ void PLAYER_SetSpectator( player_t *pPlayer, bool bBroadcast, bool bDeadSpectato
 
 	// Update this player's info on the scoreboard.
 	if ( NETWORK_GetState( ) == NETSTATE_SERVER )
+	{
 		SERVERCONSOLE_UpdatePlayerInfo( pPlayer - players, UDF_FRAGS );
+		SERVER_MASTER_InvalidateServerInfo( );
+	}
 
 	// [TP] If we left the game, we need to rebuild player translations if we overrid them.
 	if ( D_ShouldOverridePlayerColors() && pPlayer - players == consoleplayer )
@@ -2771,6 +2779,7 @@ void PLAYER_SetPoints( player_t *pPlayer, ULONG ulPoints )
 		// Also, update the scoreboard.
 		SERVERCONSOLE_UpdatePlayerInfo( static_cast<ULONG>( pPlayer - players ), UDF_FRAGS );
 		SERVERCONSOLE_UpdateScoreboard( );
+		SERVER_MASTER_InvalidateServerInfo( );
 	}
 }
 
@@ -2792,6 +2801,7 @@ void PLAYER_SetWins( player_t *pPlayer, ULONG ulWins )
 		// Also, update the scoreboard.
 		SERVERCONSOLE_UpdatePlayerInfo( pPlayer - players, UDF_FRAGS );
 		SERVERCONSOLE_UpdateScoreboard( );
+		SERVER_MASTER_InvalidateServerInfo( );
 	}
 }
 
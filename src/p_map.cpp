@@ -3959,7 +3959,7 @@ fixed_t P_AimLineAttack (AActor *t1, angle_t angle, fixed_t distance, AActor **p
 	aim_t aim;
 
 	// [Spleen]
-	UNLAGGED_Reconcile( t1 );
+	UNLAGGED_Reconcile( t1, angle, distance );
 
 	angle >>= ANGLETOFINESHIFT;
 	aim.flags = flags;
@@ -4143,7 +4143,7 @@ AActor *P_LineAttack (AActor *t1, angle_t angle, fixed_t distance,
 	vz = -finesine[pitch];
 
 	// [Spleen]
-	UNLAGGED_Reconcile( t1 );
+	UNLAGGED_Reconcile( t1, srcangle, distance );
 
 	shootz = t1->z - t1->floorclip + (t1->height>>1);
 	if (t1->player != NULL)
@@ -4678,8 +4678,8 @@ void P_RailAttack (AActor *source, int damage, int offset_xy, fixed_t offset_z,
 	FTraceResults trace;
 	fixed_t shootz;
 
-	// [Spleen]
-	UNLAGGED_Reconcile( source );
+	// [Spleen] The trace starts offset_xy to the side.
+	UNLAGGED_Reconcile( source, source->angle + angleoffset, distance, abs( offset_xy ) << FRACBITS );
 
 	if (puffclass == NULL) puffclass = PClass::FindClass(NAME_BulletPuff);
 
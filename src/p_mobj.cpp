@@ -3881,6 +3881,9 @@ void AActor::Tick ()
 	// [BB] Start to measure how much outbound net traffic this call of AActor::Tick() needs.
 	NETWORK_StartTrafficMeasurement ( );
 
+	// Attribute the commands sent by this Tick to the actor's class in the traffic profile.
+	NetTrafficActorScope trafficScope ( this );
+
 	// [RH] Data for Heretic/Hexen scrolling sectors
 	static const BYTE HexenScrollDirs[8] = { 64, 0, 192, 128, 96, 32, 224, 160 };
 	static const BYTE HexenSpeedMuls[3] = { 5, 10, 25 };
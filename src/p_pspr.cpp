@@ -1062,7 +1062,7 @@ angle_t P_BulletSlope (AActor *mo, AActor **pLineTarget)
 	int endIndex = zacompatflags & ZACOMPATF_AUTOAIM ? 12 : 0; // [CK/TP] Our ending index depends on compatflags.
 
 	// [Spleen]
-	UNLAGGED_Reconcile( mo );
+	UNLAGGED_ReconcileRange( mo, 16*64*FRACUNIT );
 	UNLAGGED_AddReconciliationBlocker( );
 
 	// see which target is to be aimed at
@@ -87,6 +87,7 @@
 #include "joinqueue.h"
 #include "cl_demo.h"
 #include "domination.h"
+#include "unlagged.h"
 
 // [BB] New #includes..
 #include "gl/dynlights/gl_dynlight.h"
@@ -3714,6 +3715,7 @@ void P_FreeLevelData ()
 		delete[] glsegextras;
 		glsegextras = NULL;
 	}
+	UNLAGGED_ClearSectors();
 	if (sectors != NULL)
 	{
 		delete[] sectors[0].e;
@@ -4285,6 +4287,11 @@ void P_SetupLevel (char *lumpname, int position)
 	}
 	else
 	{
+		// P_CheckNodes isn't called without a GL renderer (e.g. on the server), so cache the nodes here.
+		if (ForceNodeBuild && BuildGLNodes)
+		{
+			P_CacheNodes(map, endTime - startTime);
+		}
 		hasglnodes = P_CheckForGLNodes();
 	}
 
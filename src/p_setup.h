@@ -125,6 +125,7 @@ fixed_t GetUDMFFixed(int type, int index, const char *key);
 
 bool P_LoadGLNodes(MapData * map);
 bool P_CheckNodes(MapData * map, bool rebuilt, int buildtime);
+void P_CacheNodes(MapData * map, int buildtime);
 bool P_CheckForGLNodes();
 void P_SetRenderSector();
 
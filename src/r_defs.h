@@ -811,6 +811,9 @@ struct sector_t
 	// [BC] Is this sector a floor or ceiling?
 	int		floorOrCeiling;
 
+	// The last tic the floor or ceiling of this sector moved, see UNLAGGED_RecordSectors.
+	int		unlaggedMovedTic;
+
 	// [BC] Has the height changed during the course of the level?
 	bool		bCeilingHeightChange;
 	bool		bFloorHeightChange;
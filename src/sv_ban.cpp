@@ -167,6 +167,40 @@ bool SERVERBAN_IsIPBanned( const NETADDRESS_s &Address )
 	return ( sv_enforcebans && g_ServerBans.isIPInList( Address ) && !g_ServerBanExemptions.isIPInList( Address ));
 }
 
+//*****************************************************************************
+//
+// Copies the bans that are currently enforced, so that SERVERBAN_IsIPBanned can be answered by the snapshot.
+// Copying them is expensive, so this is only done when they changed since the last call.
+void SERVERBAN_UpdateServerInfoSnapshot( ServerInfoSnapshot &Snapshot )
+{
+	const IPList	*pLists[4];
+	unsigned int	uiNumLists = 0;
+	bool			bCurrent;
+
+	if ( sv_enforcemasterbanlist )
+	{
+		pLists[uiNumLists++] = &g_MasterServerBans;
+		pLists[uiNumLists++] = &g_MasterServerBanExemptions;
+	}
+
+	if ( sv_enforcebans )
+	{
+		pLists[uiNumLists++] = &g_ServerBans;
+		pLists[uiNumLists++] = &g_ServerBanExemptions;
+	}
+
+	bCurrent = ( Snapshot.getNumBanLists( ) == uiNumLists / 2 );
+	for ( unsigned int i = 0; bCurrent && ( i < uiNumLists ); i += 2 )
+		bCurrent = Snapshot.isBanListCurrent( i / 2, *pLists[i], *pLists[i + 1] );
+
+	if ( bCurrent )
+		return;
+
+	Snapshot.clearBanLists( );
+	for ( unsigned int i = 0; i < uiNumLists; i += 2 )
+		Snapshot.addBanList( *pLists[i], *pLists[i + 1] );
+}
+
 //*****************************************************************************
 //
 void SERVERBAN_ClearBans( void )
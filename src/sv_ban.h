@@ -67,6 +67,7 @@ time_t			SERVERBAN_ParseBanLength( const char *szLengthString );
 IPList			*SERVERBAN_GetBanList( void );
 IPList			*SERVERBAN_GetBanExemptionList( void );
 void			SERVERBAN_BanPlayer( ULONG ulPlayer, const char *pszBanLength, const char *pszBanReason );
+void			SERVERBAN_UpdateServerInfoSnapshot( ServerInfoSnapshot &Snapshot );
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------
 //-- EXTERNAL CONSOLE VARIABLES --------------------------------------------------------------------------------------------------------------------
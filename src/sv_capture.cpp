@@ -0,0 +1,477 @@
+//-----------------------------------------------------------------------------
+//
+// Skulltag Source
+// Copyright (C) 2007-2012 Skulltag Development Team
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the Skulltag Development Team nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+// 4. Redistributions in any form must be accompanied by information on how to
+//    obtain complete source code for the software and any accompanying
+//    software that uses the software. The source code must either be included
+//    in the distribution or be available for no more than the cost of
+//    distribution plus a nominal fee, and must be freely redistributable
+//    under reasonable conditions. For an executable file, complete source
+//    code means the source code for all modules it contains. It does not
+//    include source code for modules or files that typically accompany the
+//    major components of the operating system on which the executable file
+//    runs.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//
+// Filename: sv_capture.cpp
+//
+// Description: Binary capture of the server's inbound packets and their headless replay.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "c_dispatch.h"
+#include "dobject.h"
+#include "doomstat.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_random.h"
+#include "network.h"
+#include "stats.h"
+#include "sv_capture.h"
+#include "templates.h"
+
+//*****************************************************************************
+//	DEFINES
+
+// Identifies capture files and the version of their format.
+#define	CAPTURE_MAGIC				"ZCAP"
+#define	CAPTURE_VERSION				1
+
+// Size of the file header: magic, version and the RNG seed of the server.
+#define	CAPTURE_FILE_HEADER_SIZE	( 4 + 4 + 4 )
+
+// Size of the header of each packet: tic, time, IP, port and size.
+#define	CAPTURE_PACKET_HEADER_SIZE	( 4 + 4 + 4 + 2 + 2 )
+
+//*****************************************************************************
+//	STRUCTURES
+
+// What one replayed tic cost.
+typedef struct
+{
+	// CPU time spent on the tic in milliseconds.
+	double			dCPUMS;
+
+	// Number of blocks allocated by M_Malloc/M_Realloc.
+	ULONG			ulNumAllocations;
+
+	// Huffman-encoded bytes the server would have sent.
+	ULONG			ulOutboundBytes;
+
+	// Number of captured packets handed to the server.
+	ULONG			ulNumPackets;
+
+} CAPTURETICSTATS_t;
+
+//*****************************************************************************
+//	VARIABLES
+
+// The file the inbound packets are written to while capturing.
+static	FILE						*g_CaptureFile = NULL;
+
+// Tic and time at which the capture started.
+static	LONG						g_lCaptureStartTic = 0;
+static	ULONG						g_ulCaptureStartTime = 0;
+
+// Number of packets captured so far.
+static	ULONG						g_ulNumCapturedPackets = 0;
+
+// The whole capture being replayed and the position of the next packet in it.
+static	TArray<BYTE>				g_ReplayData;
+static	ULONG						g_ulReplayPosition = 0;
+
+// Is a capture being replayed? The replay starts with the first tic of the first level.
+static	bool						g_bReplaying = false;
+static	bool						g_bReplayStarted = false;
+static	LONG						g_lReplayStartTic = 0;
+
+// If not empty, the measurements of every tic are written to this file at the end of the replay.
+static	FString						g_ReplayReportFileName;
+
+// Measurements of the replayed tics, and the state at the start of the current one.
+static	TArray<CAPTURETICSTATS_t>	g_ReplayTicStats;
+static	cycle_t						g_ReplayTicCycles;
+static	size_t						g_ReplayTicStartAllocations = 0;
+static	QWORD						g_qwReplayTicStartBytes = 0;
+static	ULONG						g_ulReplayTicPackets = 0;
+
+//*****************************************************************************
+//	PROTOTYPES
+
+static	bool	server_capture_Start( const char *pszFileName );
+static	void	server_capture_Stop( void );
+static	bool	server_capture_LoadReplay( const char *pszFileName );
+static	void	server_capture_FinishReplay( void );
+
+//*****************************************************************************
+//	FUNCTIONS
+
+void SERVER_CAPTURE_Construct( void )
+{
+	const char	*pszFileName;
+
+	// Capture from the start to be able to replay the capture later: the clients that connect
+	// need to be part of it, and the RNG seed only matters for the levels loaded afterwards.
+	pszFileName = Args->CheckValue( "-capturepackets" );
+	if ( pszFileName != NULL )
+		server_capture_Start( pszFileName );
+
+	pszFileName = Args->CheckValue( "-replaycapture" );
+	if ( pszFileName == NULL )
+		return;
+
+#ifdef SERVER_ONLY
+	if ( server_capture_LoadReplay( pszFileName ) == false )
+		return;
+
+	if ( Args->CheckValue( "-replayreport" ) != NULL )
+		g_ReplayReportFileName = Args->CheckValue( "-replayreport" );
+
+	// Nothing leaves the server during the replay, the packets are only encoded and counted.
+	NETWORK_SetDiscardOutboundPackets( true );
+	g_bReplaying = true;
+	Printf( "Replaying %s, waiting for the first level.\n", pszFileName );
+#else
+	Printf( "-replaycapture is only supported by the dedicated server.\n" );
+#endif
+}
+
+//*****************************************************************************
+//
+void SERVER_CAPTURE_Destruct( void )
+{
+	server_capture_Stop( );
+}
+
+//*****************************************************************************
+//
+static void server_capture_WriteLong( BYTE *pbData, LONG lValue )
+{
+	pbData[0] = lValue & 0xff;
+	pbData[1] = ( lValue >> 8 ) & 0xff;
+	pbData[2] = ( lValue >> 16 ) & 0xff;
+	pbData[3] = ( lValue >> 24 ) & 0xff;
+}
+
+//*****************************************************************************
+//
+static LONG server_capture_ReadLong( const BYTE *pbData )
+{
+	return ( pbData[0] | ( pbData[1] << 8 ) | ( pbData[2] << 16 ) | ( pbData[3] << 24 ));
+}
+
+//*****************************************************************************
+//
+static bool server_capture_Start( const char *pszFileName )
+{
+	BYTE	abHeader[CAPTURE_FILE_HEADER_SIZE];
+
+	server_capture_Stop( );
+
+	g_CaptureFile = fopen( pszFileName, "wb" );
+	if ( g_CaptureFile == NULL )
+	{
+		Printf( "Couldn't open %s for the packet capture.\n", pszFileName );
+		return ( false );
+	}
+
+	memcpy( abHeader, CAPTURE_MAGIC, 4 );
+	server_capture_WriteLong( abHeader + 4, CAPTURE_VERSION );
+	server_capture_WriteLong( abHeader + 8, rngseed );
+	fwrite( abHeader, 1, sizeof( abHeader ), g_CaptureFile );
+
+	g_lCaptureStartTic = gametic;
+	g_ulCaptureStartTime = I_MSTime( );
+	g_ulNumCapturedPackets = 0;
+	Printf( "Capturing the inbound packets to %s.\n", pszFileName );
+	return ( true );
+}
+
+//*****************************************************************************
+//
+static void server_capture_Stop( void )
+{
+	if ( g_CaptureFile == NULL )
+		return;
+
+	fclose( g_CaptureFile );
+	g_CaptureFile = NULL;
+	Printf( "Packet capture stopped after %u packets.\n", static_cast<unsigned int>( g_ulNumCapturedPackets ));
+}
+
+//*****************************************************************************
+//
+// Appends the packet in the network message buffer to the capture.
+void SERVER_CAPTURE_RecordPacket( void )
+{
+	BYTE				abHeader[CAPTURE_PACKET_HEADER_SIZE];
+	const NETBUFFER_s	*pBuffer = NETWORK_GetNetworkMessageBuffer( );
+	const NETADDRESS_s	Address = NETWORK_GetFromAddress( );
+
+	if (( g_CaptureFile == NULL ) || ( pBuffer->ulCurrentSize > 0xffff ))
+		return;
+
+	server_capture_WriteLong( abHeader, gametic - g_lCaptureStartTic );
+	server_capture_WriteLong( abHeader + 4, I_MSTime( ) - g_ulCaptureStartTime );
+	memcpy( abHeader + 8, Address.abIP, 4 );
+	memcpy( abHeader + 12, &Address.usPort, 2 );
+	abHeader[14] = pBuffer->ulCurrentSize & 0xff;
+	abHeader[15] = ( pBuffer->ulCurrentSize >> 8 ) & 0xff;
+
+	if (( fwrite( abHeader, 1, sizeof( abHeader ), g_CaptureFile ) != sizeof( abHeader )) ||
+		( fwrite( pBuffer->pbData, 1, pBuffer->ulCurrentSize, g_CaptureFile ) != pBuffer->ulCurrentSize ))
+	{
+		Printf( "Couldn't write to the packet capture.\n" );
+		server_capture_Stop( );
+		return;
+	}
+
+	g_ulNumCapturedPackets++;
+}
+
+//*****************************************************************************
+//
+static bool server_capture_LoadReplay( const char *pszFileName )
+{
+	FILE	*pFile = fopen( pszFileName, "rb" );
+	long	lSize;
+
+	if ( pFile == NULL )
+	{
+		Printf( "Couldn't open the capture %s.\n", pszFileName );
+		return ( false );
+	}
+
+	fseek( pFile, 0, SEEK_END );
+	lSize = ftell( pFile );
+	fseek( pFile, 0, SEEK_SET );
+
+	g_ReplayData.Resize( MAX<long>( lSize, 0 ));
+	if (( lSize < CAPTURE_FILE_HEADER_SIZE ) || ( fread( &g_ReplayData[0], 1, lSize, pFile ) != static_cast<size_t>( lSize )))
+	{
+		fclose( pFile );
+		g_ReplayData.Clear( );
+		Printf( "Couldn't read the capture %s.\n", pszFileName );
+		return ( false );
+	}
+	fclose( pFile );
+
+	if (( memcmp( &g_ReplayData[0], CAPTURE_MAGIC, 4 ) != 0 ) || ( server_capture_ReadLong( &g_ReplayData[4] ) != CAPTURE_VERSION ))
+	{
+		g_ReplayData.Clear( );
+		Printf( "%s is not a packet capture of this version.\n", pszFileName );
+		return ( false );
+	}
+
+	// The levels have to be set up with the same RNG seed as during the capture for the replay to be deterministic.
+	rngseed = server_capture_ReadLong( &g_ReplayData[8] );
+	g_ulReplayPosition = CAPTURE_FILE_HEADER_SIZE;
+	return ( true );
+}
+
+//*****************************************************************************
+//
+bool SERVER_CAPTURE_IsReplaying( void )
+{
+	return ( g_bReplaying );
+}
+
+//*****************************************************************************
+//
+// Puts the next captured packet into the network message buffer if it arrived by the current tic.
+// Returns its size like NETWORK_GetPackets, or 0 if there is none.
+int SERVER_CAPTURE_GetReplayPacket( void )
+{
+	if (( g_bReplayStarted == false ) || (( g_ulReplayPosition + CAPTURE_PACKET_HEADER_SIZE ) > g_ReplayData.Size( )))
+		return ( 0 );
+
+	const BYTE	*pbRecord = &g_ReplayData[g_ulReplayPosition];
+	if ( server_capture_ReadLong( pbRecord ) > ( gametic - g_lReplayStartTic ))
+		return ( 0 );
+
+	NETADDRESS_s	Address;
+	const ULONG		ulSize = pbRecord[14] | ( pbRecord[15] << 8 );
+
+	memset( &Address, 0, sizeof( Address ));
+	memcpy( Address.abIP, pbRecord + 8, 4 );
+	memcpy( &Address.usPort, pbRecord + 12, 2 );
+
+	// A truncated capture ends the replay.
+	if (( g_ulReplayPosition + CAPTURE_PACKET_HEADER_SIZE + ulSize ) > g_ReplayData.Size( ))
+	{
+		g_ulReplayPosition = g_ReplayData.Size( );
+		return ( 0 );
+	}
+
+	g_ulReplayPosition += CAPTURE_PACKET_HEADER_SIZE + ulSize;
+	g_ulReplayTicPackets++;
+	return ( NETWORK_InjectPacket( pbRecord + CAPTURE_PACKET_HEADER_SIZE, ulSize, Address ));
+}
+
+//*****************************************************************************
+//
+// Called at the start of every tic SERVER_Tick runs.
+void SERVER_CAPTURE_BeginTic( void )
+{
+	if ( g_bReplaying == false )
+		return;
+
+	if ( g_bReplayStarted == false )
+	{
+		if ( gamestate != GS_LEVEL )
+			return;
+
+		g_bReplayStarted = true;
+		g_lReplayStartTic = gametic;
+	}
+
+	g_ReplayTicStartAllocations = GC::AllocCount;
+	g_qwReplayTicStartBytes = NETWORK_GetNumDiscardedBytes( );
+	g_ulReplayTicPackets = 0;
+	g_ReplayTicCycles.Reset( );
+	g_ReplayTicCycles.Clock( );
+}
+
+//*****************************************************************************
+//
+// Called at the end of every tic SERVER_Tick runs, after the packets were sent out.
+void SERVER_CAPTURE_EndTic( void )
+{
+	if (( g_bReplaying == false ) || ( g_bReplayStarted == false ))
+		return;
+
+	g_ReplayTicCycles.Unclock( );
+
+	CAPTURETICSTATS_t	Stats;
+	Stats.dCPUMS = g_ReplayTicCycles.TimeMS( );
+	Stats.ulNumAllocations = static_cast<ULONG>( GC::AllocCount - g_ReplayTicStartAllocations );
+	Stats.ulOutboundBytes = static_cast<ULONG>( NETWORK_GetNumDiscardedBytes( ) - g_qwReplayTicStartBytes );
+	Stats.ulNumPackets = g_ulReplayTicPackets;
+	g_ReplayTicStats.Push( Stats );
+
+	if ( g_ulReplayPosition >= g_ReplayData.Size( ))
+		server_capture_FinishReplay( );
+}
+
+//*****************************************************************************
+//
+// Prints what the replayed tics cost, writes the measurements of each tic to the report file and quits.
+static void server_capture_FinishReplay( void )
+{
+	const ULONG			ulNumTics = g_ReplayTicStats.Size( );
+	TArray<double>		CPUTimes;
+	double				dTotalCPUMS = 0;
+	QWORD				qwTotalAllocations = 0;
+	QWORD				qwTotalOutboundBytes = 0;
+	ULONG				ulTotalPackets = 0;
+	ULONG				ulMaxAllocations = 0;
+	ULONG				ulMaxOutboundBytes = 0;
+	ULONG				ulSlowestTic = 0;
+
+	for ( ULONG ulIdx = 0; ulIdx < ulNumTics; ulIdx++ )
+	{
+		const CAPTURETICSTATS_t &Stats = g_ReplayTicStats[ulIdx];
+
+		CPUTimes.Push( Stats.dCPUMS );
+		dTotalCPUMS += Stats.dCPUMS;
+		qwTotalAllocations += Stats.ulNumAllocations;
+		qwTotalOutboundBytes += Stats.ulOutboundBytes;
+		ulTotalPackets += Stats.ulNumPackets;
+		ulMaxAllocations = MAX( ulMaxAllocations, Stats.ulNumAllocations );
+		ulMaxOutboundBytes = MAX( ulMaxOutboundBytes, Stats.ulOutboundBytes );
+		if ( Stats.dCPUMS > g_ReplayTicStats[ulSlowestTic].dCPUMS )
+			ulSlowestTic = ulIdx;
+	}
+
+	Printf( "Replayed %u packets in %u tics.\n", static_cast<unsigned int>( ulTotalPackets ), static_cast<unsigned int>( ulNumTics ));
+	if ( ulNumTics > 0 )
+	{
+		std::sort( &CPUTimes[0], &CPUTimes[0] + ulNumTics );
+
+		Printf( "CPU time per tic: %.3f ms average, %.3f ms median, %.3f ms 99th percentile, %.3f ms maximum (tic %u).\n",
+			dTotalCPUMS / ulNumTics, CPUTimes[ulNumTics / 2], CPUTimes[( ulNumTics * 99 ) / 100], CPUTimes[ulNumTics - 1],
+			static_cast<unsigned int>( ulSlowestTic ));
+		Printf( "Allocations per tic: %.1f average, %u maximum.\n",
+			static_cast<double>( qwTotalAllocations ) / ulNumTics, static_cast<unsigned int>( ulMaxAllocations ));
+		Printf( "Outbound bytes per tic: %.1f average, %u maximum, %llu total.\n",
+			static_cast<double>( qwTotalOutboundBytes ) / ulNumTics, static_cast<unsigned int>( ulMaxOutboundBytes ),
+			static_cast<unsigned long long>( qwTotalOutboundBytes ));
+	}
+
+	if ( g_ReplayReportFileName.IsNotEmpty( ))
+	{
+		FILE *pFile = fopen( g_ReplayReportFileName.GetChars( ), "w" );
+		if ( pFile != NULL )
+		{
+			fputs( "tic,cpums,allocations,outboundbytes,packets\n", pFile );
+			for ( ULONG ulIdx = 0; ulIdx < ulNumTics; ulIdx++ )
+			{
+				const CAPTURETICSTATS_t &Stats = g_ReplayTicStats[ulIdx];
+				fprintf( pFile, "%u,%.4f,%u,%u,%u\n", static_cast<unsigned int>( ulIdx ), Stats.dCPUMS,
+					static_cast<unsigned int>( Stats.ulNumAllocations ), static_cast<unsigned int>( Stats.ulOutboundBytes ),
+					static_cast<unsigned int>( Stats.ulNumPackets ));
+			}
+			fclose( pFile );
+			Printf( "Wrote the measurements of each tic to %s.\n", g_ReplayReportFileName.GetChars( ));
+		}
+		else
+			Printf( "Couldn't open %s for the replay report.\n", g_ReplayReportFileName.GetChars( ));
+	}
+
+	// Quit the same way the server console does, so that everything is shut down properly.
+	C_DoCommand( "quit" );
+}
+
+//*****************************************************************************
+//	CONSOLE COMMANDS
+
+CCMD( capturepackets )
+{
+	if ( NETWORK_GetState( ) != NETSTATE_SERVER )
+		return;
+
+	if ( argv.argc( ) < 2 )
+	{
+		Printf( "Usage: capturepackets <file>\nWrites every inbound packet to the file. Only a capture started with -capturepackets can be replayed deterministically.\n" );
+		return;
+	}
+
+	server_capture_Start( argv[1] );
+}
+
+//*****************************************************************************
+//
+CCMD( stopcapture )
+{
+	server_capture_Stop( );
+}
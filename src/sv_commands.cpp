@@ -78,9 +78,14 @@
 #include "po_man.h"
 #include "i_system.h"
 #include "r_data/colormaps.h"
+#include "c_dispatch.h"
+#include "network/nettraffic.h"
 
 CVAR (Bool, sv_showwarnings, false, CVAR_GLOBALCONFIG|CVAR_ARCHIVE)
 
+// Send the movement of other players as difference to a keyframe the client already has.
+CVAR( Bool, sv_deltaplayermovement, true, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+
 EXTERN_CVAR( Float, sv_aircontrol )
 
 //*****************************************************************************
@@ -144,6 +149,95 @@ public:
 	}
 };
 
+/**
+ * \brief Free lists of the buffers NetCommand writes into.
+ *
+ * Commands are created and destroyed thousands of times per second on busy servers.
+ * Recycling their buffers saves a heap allocation per command. Buffers come in a few
+ * sizes, a command starts with the smallest one and moves to a larger one when it runs
+ * out of room.
+ */
+class NetCommandBufferPool {
+public:
+	enum { NUM_SIZE_CLASSES = 3 };
+
+private:
+	static const ULONG	_sizes[NUM_SIZE_CLASSES];
+	TArray<BYTE*>		_freeBuffers[NUM_SIZE_CLASSES];
+	ULONG				_numAllocated;
+
+public:
+	NetCommandBufferPool ( ) : _numAllocated( 0 ) { }
+
+	~NetCommandBufferPool ( )
+	{
+		for ( int i = 0; i < NUM_SIZE_CLASSES; ++i )
+		{
+			for ( unsigned int j = 0; j < _freeBuffers[i].Size(); ++j )
+				delete[] _freeBuffers[i][j];
+		}
+	}
+
+	static ULONG getSize ( const ULONG ulSizeClass )
+	{
+		return _sizes[ulSizeClass];
+	}
+
+	BYTE *acquire ( const ULONG ulSizeClass )
+	{
+		BYTE *pbData;
+		if ( _freeBuffers[ulSizeClass].Pop( pbData ))
+			return pbData;
+
+		++_numAllocated;
+		return new BYTE[_sizes[ulSizeClass]];
+	}
+
+	void release ( BYTE *pbData, const ULONG ulSizeClass )
+	{
+		_freeBuffers[ulSizeClass].Push( pbData );
+	}
+
+	// Number of buffers allocated so far, i.e. the ones in use plus the free ones.
+	ULONG getNumAllocated ( ) const
+	{
+		return _numAllocated;
+	}
+};
+
+// Almost all commands fit into the smallest size, only long strings need the largest one.
+const ULONG NetCommandBufferPool::_sizes[NUM_SIZE_CLASSES] = { 64, 512, MAX_UDP_PACKET };
+
+static NetCommandBufferPool g_NetCommandBufferPool;
+
+// Number of commands created and number of bytes written to the clients' buffers this tic.
+static ULONG g_ulNumCommandsThisTic = 0;
+static ULONG g_ulNumCommandBytesThisTic = 0;
+
+// The same for the previous tic, and the highest values of any tic.
+static ULONG g_ulNumCommandsLastTic = 0;
+static ULONG g_ulNumCommandBytesLastTic = 0;
+static ULONG g_ulMaxNumCommandsPerTic = 0;
+static ULONG g_ulMaxNumCommandBytesPerTic = 0;
+
+// A keyframe of a player's movement that was sent to a client.
+typedef struct
+{
+	PLAYERMOVESTATE_s	State;
+
+	// The sequence number the keyframe was sent with and whether the client acknowledged it.
+	USHORT				usSequence;
+	bool				bAcknowledged;
+
+} PLAYERMOVEKEYFRAME_s;
+
+// The keyframes of the movement of each player that were sent to each client, see servercommands_MovePlayerDelta.
+static PLAYERMOVEKEYFRAME_s g_PlayerMoveKeyframes[MAXPLAYERS][MAXPLAYERS][NUM_PLAYER_MOVE_KEYFRAMES];
+static ULONG g_ulNextPlayerMoveKeyframe[MAXPLAYERS][MAXPLAYERS];
+
+// The sequence number of the next keyframe sent to each client.
+static USHORT g_usNextPlayerMoveKeyframeSequence[MAXPLAYERS];
+
 /**
  * \brief Creates and sends network commands to the clients.
  *
@@ -151,29 +245,61 @@ public:
  */
 class NetCommand {
 	NETBUFFER_s	_buffer;
+	ULONG		_sizeClass;
 	bool		_unreliable;
+	// Length of the Huffman codes of the command, computed by the traffic profile when first needed.
+	int			_encodedBits;
+
+	void initBuffer ( )
+	{
+		memset( &_buffer, 0, sizeof( _buffer ));
+		_sizeClass = 0;
+		_encodedBits = -1;
+		_buffer.pbData = g_NetCommandBufferPool.acquire( _sizeClass );
+		_buffer.ulMaxSize = NetCommandBufferPool::getSize( _sizeClass );
+		_buffer.BufferType = BUFFERTYPE_WRITE;
+		NETWORK_ClearBuffer( &_buffer );
+		++g_ulNumCommandsThisTic;
+	}
+
+	// Moves the command to the next larger buffer. Returns false if it already uses the largest one.
+	bool growBuffer ( )
+	{
+		if ( _sizeClass + 1 >= NetCommandBufferPool::NUM_SIZE_CLASSES )
+			return false;
+
+		const ULONG ulSize = _buffer.ByteStream.pbStream - _buffer.pbData;
+		BYTE *pbData = g_NetCommandBufferPool.acquire( _sizeClass + 1 );
+		memcpy( pbData, _buffer.pbData, ulSize );
+		g_NetCommandBufferPool.release( _buffer.pbData, _sizeClass );
+
+		++_sizeClass;
+		_buffer.pbData = pbData;
+		_buffer.ulMaxSize = NetCommandBufferPool::getSize( _sizeClass );
+		_buffer.ByteStream.pbStream = pbData + ulSize;
+		_buffer.ByteStream.pbStreamEnd = pbData + _buffer.ulMaxSize;
+		return true;
+	}
 
 public:
 	NetCommand ( const SVC Header ) :
 		_unreliable( false )
 	{
-		NETWORK_InitBuffer( &_buffer, MAX_UDP_PACKET, BUFFERTYPE_WRITE );
-		NETWORK_ClearBuffer( &_buffer );
+		initBuffer();
 		addInteger<BYTE>( Header );
 	}
 
 	NetCommand ( const SVC2 Header2 ) :
 		_unreliable( false )
 	{
-		NETWORK_InitBuffer( &_buffer, MAX_UDP_PACKET, BUFFERTYPE_WRITE );
-		NETWORK_ClearBuffer( &_buffer );
+		initBuffer();
 		addInteger<BYTE>( SVC_EXTENDEDCOMMAND );
 		addInteger<BYTE>( Header2 );
 	}
 
 	~NetCommand ( )
 	{
-		NETWORK_FreeBuffer ( &_buffer );
+		g_NetCommandBufferPool.release( _buffer.pbData, _sizeClass );
 	}
 
 	const char *getHeaderAsString() const
@@ -188,7 +314,7 @@ public:
 	template <typename IntType>
 	void addInteger( const IntType IntValue )
 	{
-		if ( ( _buffer.ByteStream.pbStream + sizeof ( IntType ) ) > _buffer.ByteStream.pbStreamEnd )
+		if ( ( ( _buffer.ByteStream.pbStream + sizeof ( IntType ) ) > _buffer.ByteStream.pbStreamEnd ) && ( growBuffer() == false ) )
 		{
 			Printf( "NetCommand::AddInteger: Overflow! Header: %s\n", getHeaderAsString() );
 			return;
@@ -245,6 +371,7 @@ public:
 	void writeCommandToStream ( BYTESTREAM_s &ByteStream ) const {
 		// [BB] This also handles the traffic counting (NETWORK_StartTrafficMeasurement/NETWORK_StopTrafficMeasurement).
 		NETWORK_WriteBuffer( &ByteStream, _buffer.pbData, _buffer.ulCurrentSize );
+		g_ulNumCommandBytesThisTic += _buffer.ulCurrentSize;
 	}
 
 	// [Dusk]
@@ -256,13 +383,25 @@ public:
 	}
 
 	void sendCommandToClients ( ULONG ulPlayerExtra = MAXPLAYERS, ServerCommandFlags flags = 0 ) {
+		// If the command goes to more than one client, put it into the broadcast segment,
+		// so that it's only Huffman-encoded once.
+		ULONG ulNumClients = 0;
+		for ( ClientIterator it ( ulPlayerExtra, flags ); it.notAtEnd() && ( ulNumClients < 2 ); ++it )
+			++ulNumClients;
+
+		const LONG lSegmentOffset = ( ulNumClients > 1 ) ? SERVER_AddToBroadcastSegment( _buffer.pbData, _buffer.ulCurrentSize ) : -1;
+
 		for ( ClientIterator it ( ulPlayerExtra, flags ); it.notAtEnd(); ++it )
-			sendCommandToOneClient( *it );
+			sendCommandToOneClient( *it, lSegmentOffset );
 	}
 
-	void sendCommandToOneClient( ULONG i ) {
+	void sendCommandToOneClient( ULONG i, LONG lSegmentOffset = -1 ) {
 		SERVER_CheckClientBuffer( i, _buffer.ulCurrentSize, _unreliable == false );
+		SERVER_MarkBroadcastRun( i, _unreliable == false, lSegmentOffset, _buffer.ulCurrentSize );
 		writeCommandToStream( getBytestreamForClient( i ));
+
+		if ( NETTRAFFIC_IsProfiling( ))
+			NETTRAFFIC_AddCommandTraffic( i, _buffer.pbData, _buffer.ulCurrentSize, _encodedBits );
 	}
 
 	// [Dusk]
@@ -279,6 +418,35 @@ public:
 //*****************************************************************************
 //	FUNCTIONS
 
+//*****************************************************************************
+//
+// Called once per tic after the packets were sent out.
+void SERVERCOMMANDS_EndTic( void )
+{
+	g_ulNumCommandsLastTic = g_ulNumCommandsThisTic;
+	g_ulNumCommandBytesLastTic = g_ulNumCommandBytesThisTic;
+	g_ulMaxNumCommandsPerTic = MAX( g_ulMaxNumCommandsPerTic, g_ulNumCommandsThisTic );
+	g_ulMaxNumCommandBytesPerTic = MAX( g_ulMaxNumCommandBytesPerTic, g_ulNumCommandBytesThisTic );
+	g_ulNumCommandsThisTic = 0;
+	g_ulNumCommandBytesThisTic = 0;
+}
+
+//*****************************************************************************
+//
+ULONG SERVERCOMMANDS_GetNumCommandsLastTic( void )
+{
+	return ( g_ulNumCommandsLastTic );
+}
+
+//*****************************************************************************
+//
+ULONG SERVERCOMMANDS_GetNumCommandBytesLastTic( void )
+{
+	return ( g_ulNumCommandBytesLastTic );
+}
+
+//*****************************************************************************
+//
 // [BB] Check if the actor has a valid net ID. Returns true if it does, returns false and prints a warning if not.
 bool EnsureActorHasNetID( const AActor *pActor )
 {
@@ -565,6 +733,195 @@ void SERVERCOMMANDS_SpawnPlayer( ULONG ulPlayer, LONG lPlayerState, ULONG ulPlay
 		SERVERCOMMANDS_SetPlayerCheats( ulPlayer, ulPlayer, SVCF_ONLYTHISCLIENT );
 }
 
+//*****************************************************************************
+//
+// Forgets the keyframes that were sent to ulClient, e.g. because a new client uses the slot.
+void SERVERCOMMANDS_ClearPlayerMoveKeyframes( ULONG ulClient )
+{
+	for ( ULONG ulPlayer = 0; ulPlayer < MAXPLAYERS; ulPlayer++ )
+	{
+		for ( ULONG ulIdx = 0; ulIdx < NUM_PLAYER_MOVE_KEYFRAMES; ulIdx++ )
+		{
+			g_PlayerMoveKeyframes[ulClient][ulPlayer][ulIdx].State.lTic = -1;
+			g_PlayerMoveKeyframes[ulClient][ulPlayer][ulIdx].bAcknowledged = false;
+		}
+
+		g_ulNextPlayerMoveKeyframe[ulClient][ulPlayer] = 0;
+	}
+
+	g_usNextPlayerMoveKeyframeSequence[ulClient] = 0;
+}
+
+//*****************************************************************************
+//
+// Marks the keyframes ulClient received as acknowledged. Bit n of ulBits is set if the client
+// received the keyframe with the sequence number usNewestSequence - n.
+void SERVERCOMMANDS_AcknowledgePlayerMoveKeyframes( ULONG ulClient, USHORT usNewestSequence, ULONG ulBits )
+{
+	if (( ulClient >= MAXPLAYERS ) || ( ulBits == 0 ))
+		return;
+
+	for ( ULONG ulPlayer = 0; ulPlayer < MAXPLAYERS; ulPlayer++ )
+	{
+		for ( ULONG ulIdx = 0; ulIdx < NUM_PLAYER_MOVE_KEYFRAMES; ulIdx++ )
+		{
+			PLAYERMOVEKEYFRAME_s &Keyframe = g_PlayerMoveKeyframes[ulClient][ulPlayer][ulIdx];
+			const USHORT usAge = static_cast<USHORT>( usNewestSequence - Keyframe.usSequence );
+
+			if (( Keyframe.State.lTic >= 0 ) && ( usAge < 32 ) && ( ulBits & ( static_cast<ULONG>( 1 ) << usAge )))
+				Keyframe.bAcknowledged = true;
+		}
+	}
+}
+
+//*****************************************************************************
+//
+// Sends the movement of ulPlayer to ulClient as difference to the newest keyframe the client
+// acknowledged having received. Once that keyframe is a second old, or if there is none, the
+// movement is sent as new keyframe instead, i.e. as difference to a state where everything is
+// zero. A keyframe that wasn't acknowledged is sent again after half a second. Until then the
+// older baseline is used, or, if there is none, SVC_MOVEPLAYER. Returns false if the client
+// has to be sent SVC_MOVEPLAYER.
+static bool servercommands_MovePlayerDelta( ULONG ulClient, ULONG ulPlayer, ULONG ulPlayerAttackFlags, const PLAYERMOVESTATE_s &State )
+{
+	static const PLAYERMOVESTATE_s ZeroState = { 0 };
+
+	if ( sv_deltaplayermovement == false )
+		return ( false );
+
+	PLAYERMOVEKEYFRAME_s *pKeyframes = g_PlayerMoveKeyframes[ulClient][ulPlayer];
+	const PLAYERMOVESTATE_s *pBaseline = NULL;
+	LONG lNewestKeyframeTic = -1;
+
+	for ( ULONG ulIdx = 0; ulIdx < NUM_PLAYER_MOVE_KEYFRAMES; ulIdx++ )
+	{
+		const PLAYERMOVESTATE_s &Keyframe = pKeyframes[ulIdx].State;
+		if ( Keyframe.lTic < 0 )
+			continue;
+
+		lNewestKeyframeTic = MAX( lNewestKeyframeTic, Keyframe.lTic );
+
+		// The distance to the baseline is sent as byte.
+		if ( pKeyframes[ulIdx].bAcknowledged &&
+			( gametic - Keyframe.lTic <= 255 ) &&
+			(( pBaseline == NULL ) || ( Keyframe.lTic > pBaseline->lTic )))
+		{
+			pBaseline = &Keyframe;
+		}
+	}
+
+	const bool bKeyframe = (( pBaseline == NULL ) || ( gametic - pBaseline->lTic >= TICRATE ))
+		&& (( lNewestKeyframeTic < 0 ) || ( gametic - lNewestKeyframeTic >= TICRATE / 2 ));
+
+	if ( bKeyframe )
+		pBaseline = &ZeroState;
+	else if ( pBaseline == NULL )
+		return ( false );
+
+	// The x/y position has to be sent at full precision (see SERVERCOMMANDS_MovePlayer). Small x/y
+	// differences are sent as 24 bit fixed point number, which covers 128 map units in each direction.
+	const SQWORD qwDeltaX = static_cast<SQWORD>( State.X ) - pBaseline->X;
+	const SQWORD qwDeltaY = static_cast<SQWORD>( State.Y ) - pBaseline->Y;
+	const LONG lDeltaZ = State.sZ - pBaseline->sZ;
+	const LONG lDeltaMomX = State.sMomX - pBaseline->sMomX;
+	const LONG lDeltaMomY = State.sMomY - pBaseline->sMomY;
+	const LONG lDeltaMomZ = State.sMomZ - pBaseline->sMomZ;
+	ULONG ulBits = State.bCrouching ? PMD_CROUCHING : 0;
+
+	if ( qwDeltaX != 0 )
+		ulBits |= (( bKeyframe == false ) && ( qwDeltaX >= -0x800000 ) && ( qwDeltaX <= 0x7FFFFF )) ? ( PMD_X | PMD_SMALL_X ) : PMD_X;
+	if ( qwDeltaY != 0 )
+		ulBits |= (( bKeyframe == false ) && ( qwDeltaY >= -0x800000 ) && ( qwDeltaY <= 0x7FFFFF )) ? ( PMD_Y | PMD_SMALL_Y ) : PMD_Y;
+	if ( lDeltaZ != 0 )
+		ulBits |= (( lDeltaZ >= -128 ) && ( lDeltaZ <= 127 )) ? ( PMD_Z | PMD_SMALL_Z ) : PMD_Z;
+	if ( State.Angle != pBaseline->Angle )
+		ulBits |= PMD_ANGLE;
+	if ( lDeltaMomX != 0 )
+		ulBits |= (( lDeltaMomX >= -128 ) && ( lDeltaMomX <= 127 )) ? ( PMD_MOMX | PMD_SMALL_MOMX ) : PMD_MOMX;
+	if ( lDeltaMomY != 0 )
+		ulBits |= (( lDeltaMomY >= -128 ) && ( lDeltaMomY <= 127 )) ? ( PMD_MOMY | PMD_SMALL_MOMY ) : PMD_MOMY;
+	if ( lDeltaMomZ != 0 )
+		ulBits |= (( lDeltaMomZ >= -128 ) && ( lDeltaMomZ <= 127 )) ? ( PMD_MOMZ | PMD_SMALL_MOMZ ) : PMD_MOMZ;
+
+	NetCommand command( SVC_MOVEPLAYERDELTA );
+	command.setUnreliable( true );
+	command.addByte( ulPlayer );
+	command.addByte( PLAYER_VISIBLE | ulPlayerAttackFlags );
+	command.addShort( gametic & 0xFFFF );
+	command.addByte( bKeyframe ? 0 : gametic - pBaseline->lTic );
+
+	// The client acknowledges keyframes by their sequence number.
+	if ( bKeyframe )
+		command.addShort( g_usNextPlayerMoveKeyframeSequence[ulClient] );
+
+	command.addShort( ulBits );
+
+	if ( ulBits & PMD_X )
+	{
+		if ( ulBits & PMD_SMALL_X )
+		{
+			command.addShort( static_cast<LONG>( qwDeltaX ) & 0xFFFF );
+			command.addByte( static_cast<LONG>( qwDeltaX ) >> 16 );
+		}
+		else
+			command.addLong( State.X );
+	}
+	if ( ulBits & PMD_Y )
+	{
+		if ( ulBits & PMD_SMALL_Y )
+		{
+			command.addShort( static_cast<LONG>( qwDeltaY ) & 0xFFFF );
+			command.addByte( static_cast<LONG>( qwDeltaY ) >> 16 );
+		}
+		else
+			command.addLong( State.Y );
+	}
+	if ( ulBits & PMD_Z )
+	{
+		if ( ulBits & PMD_SMALL_Z )
+			command.addByte( lDeltaZ );
+		else
+			command.addShort( State.sZ );
+	}
+	if ( ulBits & PMD_ANGLE )
+		command.addLong( State.Angle );
+	if ( ulBits & PMD_MOMX )
+	{
+		if ( ulBits & PMD_SMALL_MOMX )
+			command.addByte( lDeltaMomX );
+		else
+			command.addShort( State.sMomX );
+	}
+	if ( ulBits & PMD_MOMY )
+	{
+		if ( ulBits & PMD_SMALL_MOMY )
+			command.addByte( lDeltaMomY );
+		else
+			command.addShort( State.sMomY );
+	}
+	if ( ulBits & PMD_MOMZ )
+	{
+		if ( ulBits & PMD_SMALL_MOMZ )
+			command.addByte( lDeltaMomZ );
+		else
+			command.addShort( State.sMomZ );
+	}
+
+	command.sendCommandToOneClient( ulClient );
+
+	if ( bKeyframe )
+	{
+		ULONG &ulNext = g_ulNextPlayerMoveKeyframe[ulClient][ulPlayer];
+		pKeyframes[ulNext].State = State;
+		pKeyframes[ulNext].State.lTic = gametic;
+		pKeyframes[ulNext].usSequence = g_usNextPlayerMoveKeyframeSequence[ulClient]++;
+		pKeyframes[ulNext].bAcknowledged = false;
+		ulNext = ( ulNext + 1 ) % NUM_PLAYER_MOVE_KEYFRAMES;
+	}
+
+	return ( true );
+}
+
 //*****************************************************************************
 //
 void SERVERCOMMANDS_MovePlayer( ULONG ulPlayer, ULONG ulPlayerExtra, ServerCommandFlags flags )
@@ -600,12 +957,23 @@ void SERVERCOMMANDS_MovePlayer( ULONG ulPlayer, ULONG ulPlayerExtra, ServerComma
 	stubCommand.addByte( ulPlayer );
 	stubCommand.addByte( ulPlayerAttackFlags );
 
+	PLAYERMOVESTATE_s State;
+	State.lTic = gametic;
+	State.X = players[ulPlayer].mo->x;
+	State.Y = players[ulPlayer].mo->y;
+	State.sZ = players[ulPlayer].mo->z >> FRACBITS;
+	State.Angle = players[ulPlayer].mo->angle;
+	State.sMomX = players[ulPlayer].mo->velx >> FRACBITS;
+	State.sMomY = players[ulPlayer].mo->vely >> FRACBITS;
+	State.sMomZ = players[ulPlayer].mo->velz >> FRACBITS;
+	State.bCrouching = ( players[ulPlayer].crouchdir >= 0 );
+
 	for ( ClientIterator it ( ulPlayerExtra, flags ); it.notAtEnd(); ++it )
 	{
-		if ( SERVER_IsPlayerVisible( *it, ulPlayer ))
-			fullCommand.sendCommandToOneClient( *it );
-		else
+		if ( SERVER_IsPlayerVisible( *it, ulPlayer ) == false )
 			stubCommand.sendCommandToOneClient( *it );
+		else if ( servercommands_MovePlayerDelta( *it, ulPlayer, ulPlayerAttackFlags, State ) == false )
+			fullCommand.sendCommandToOneClient( *it );
 	}
 }
 
@@ -4858,3 +5226,15 @@ void APathFollower::SyncWithClient ( const ULONG ulClient )
 	command.addFloat( this->Time );
 	command.sendCommandToOneClient( ulClient );
 }
+
+//*****************************************************************************
+//
+CCMD( netcommandstats )
+{
+	if ( NETWORK_GetState( ) != NETSTATE_SERVER )
+		return;
+
+	Printf( "Commands last tic: %u (%u bytes sent to clients)\n", static_cast<unsigned int>( g_ulNumCommandsLastTic ), static_cast<unsigned int>( g_ulNumCommandBytesLastTic ));
+	Printf( "Peak per tic: %u commands, %u bytes\n", static_cast<unsigned int>( g_ulMaxNumCommandsPerTic ), static_cast<unsigned int>( g_ulMaxNumCommandBytesPerTic ));
+	Printf( "Command buffers allocated: %u\n", static_cast<unsigned int>( g_NetCommandBufferPool.getNumAllocated( )));
+}
@@ -77,6 +77,11 @@ DEFINE_TFLAGS_OPERATORS (ServerCommandFlags)
 //*****************************************************************************
 //	PROTOTYPES
 
+// Statistics of the commands sent out.
+void	SERVERCOMMANDS_EndTic( void );
+ULONG	SERVERCOMMANDS_GetNumCommandsLastTic( void );
+ULONG	SERVERCOMMANDS_GetNumCommandBytesLastTic( void );
+
 // General protocol commands. These handle connecting to and being part of the server.
 void	SERVERCOMMANDS_Ping( ULONG ulTime );
 void	SERVERCOMMANDS_Nothing( ULONG ulPlayer, bool bReliable = false );
@@ -86,6 +91,8 @@ void	SERVERCOMMANDS_EndSnapshot( ULONG ulPlayer );
 // Player commands. These involve manipulating a player in some way.
 void	SERVERCOMMANDS_SpawnPlayer( ULONG ulPlayer, LONG lPlayerState, ULONG ulPlayerExtra = MAXPLAYERS, ServerCommandFlags flags = 0, bool bMorph = false );
 void	SERVERCOMMANDS_MovePlayer( ULONG ulPlayer, ULONG ulPlayerExtra = MAXPLAYERS, ServerCommandFlags flags = 0 );
+void	SERVERCOMMANDS_ClearPlayerMoveKeyframes( ULONG ulClient );
+void	SERVERCOMMANDS_AcknowledgePlayerMoveKeyframes( ULONG ulClient, USHORT usNewestSequence, ULONG ulBits );
 void	SERVERCOMMANDS_DamagePlayer( ULONG ulPlayer );
 void	SERVERCOMMANDS_KillPlayer( ULONG ulPlayer, AActor *pSource, AActor *pInflictor, FName MOD );
 void	SERVERCOMMANDS_SetPlayerHealth( ULONG ulPlayer, ULONG ulPlayerExtra = MAXPLAYERS, ServerCommandFlags flags = 0 );
@@ -116,6 +116,8 @@
 #include "po_man.h"
 #include "network/cl_auth.h"
 #include "network/sv_auth.h"
+#include "network/nettraffic.h"
+#include "sv_capture.h"
 #include "unlagged.h" // [CK]
 #include "r_data/colormaps.h"
 
@@ -165,6 +167,20 @@ static	bool	server_CheckForClientMinorCommandFlood( ULONG ulClient );
 static	bool	server_CheckJoinPassword( const FString& clientPassword );
 static	bool	server_InfoCheat( BYTESTREAM_s* pByteStream );
 static	bool	server_CheckLogin( const ULONG ulClient );
+static	bool	server_IsPlayerRelevant( ULONG ulClient, ULONG ulPlayer );
+static	void	server_QueuePacedPacket( CLIENT_s *pClient, const BYTE *pbData, ULONG ulSize );
+static	void	server_SendPacedPackets( ULONG ulClient );
+static	void	server_ClearPacedPackets( CLIENT_s *pClient );
+static	ULONG	server_GetClientRate( ULONG ulClient );
+static	void	server_RefillRateTokens( ULONG ulClient );
+static	bool	server_HasRateBudget( ULONG ulClient );
+static	void	server_WritePlayerUpdates( ULONG ulClient, bool bUpdateTic );
+static	bool	server_IsLoadTestAddress( const NETADDRESS_s &Address );
+static	bool	server_BufferCommand( const CLIENT_BUFFERED_COMMAND_s &Command );
+static	bool	server_ProcessBufferedCommand( ULONG ulClient, const CLIENT_BUFFERED_COMMAND_s &Command );
+static	void	server_ReadClientMove( BYTESTREAM_s *pByteStream, CLIENT_MOVE_COMMAND_s &moveCmd );
+static	bool	server_ProcessClientMove( ULONG ulClient, const CLIENT_MOVE_COMMAND_s &moveCmd );
+static	bool	server_ProcessWeaponSelect( ULONG ulClient, USHORT usActorNetworkIndex );
 
 // [RC]
 #ifdef CREATE_PACKET_LOG
@@ -228,6 +244,34 @@ static	int			g_MapMusicOrder;
 // Maximum packet size.
 static	ULONG		g_ulMaxPacketSize = 0;
 
+// Slots of all clients that aren't CLS_FREE, by address (see SERVER_GetAddressKey).
+static	TMap<QWORD, LONG, AddressKeyHashTraits>	g_ClientSlotsByAddress;
+
+// Commands sent to several clients during this tic. Their Huffman codes are only computed once.
+static	HuffmanSegment	g_BroadcastSegment;
+
+// Time in microseconds the previous batch of tics started at.
+static	QWORD		g_qwLastTicStartTime = 0;
+
+// Deviation of the tic start times from the tic rate in microseconds, see server_RecordTicStart.
+static	LONG		g_lNumTicStartsThisSecond = 0;
+static	LONG		g_lTicJitterSumThisSecond = 0;
+static	LONG		g_lMaxTicJitterThisSecond = 0;
+static	LONG		g_lAverageTicJitterLastSecond = 0;
+static	LONG		g_lMaxTicJitterLastSecond = 0;
+static	LONG		g_lMaxTicJitter = 0;
+
+// Statistics about the bursts of reliable packets that were paced out.
+static	ULONG		g_ulNumPacedBursts = 0;
+static	ULONG		g_ulLastPacedBurstBytes = 0;
+static	LONG		g_lLastPacedBurstTics = 0;
+static	LONG		g_lMaxPacedBurstTics = 0;
+
+// Whether the player whose view a client is using could see a player at the last sight check,
+// and the tic when that check has to be done again.
+static	bool		g_abPlayerInSight[MAXPLAYERS][MAXPLAYERS];
+static	LONG		g_alPlayerSightExpiration[MAXPLAYERS][MAXPLAYERS];
+
 // List of all translations edited by level scripts.
 static	TArray<EDITEDTRANSLATION_s>		g_EditedTranslationList;
 
@@ -272,6 +316,28 @@ CVAR( Int, sv_maxclientsperip, 2, CVAR_ARCHIVE )
 CVAR( Int, sv_afk2spec, 0, CVAR_ARCHIVE ) // [K6]
 CVAR( Bool, sv_forcelogintojoin, false, CVAR_ARCHIVE|CVAR_NOSETBYACS )
 CVAR( Bool, sv_useticbuffer, true, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+CVAR( Bool, sv_sharebroadcastencoding, true, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+
+// Wait for packets and the next tic with epoll (Linux only) instead of sleeping 1 ms at a time.
+CVAR( Bool, sv_eventdrivenloop, true, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+
+// Send the positions of players that are far away from a client and can't be seen by it
+// only on every sv_interestupdatedivisor-th update of the client.
+CVAR( Bool, sv_interestmanagement, true, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+CVAR( Int, sv_interestradius, 1024, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+CVAR( Int, sv_interestupdatedivisor, 4, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+
+// Reliable packets that would exceed this many bytes to a client in one tic, like the burst of a
+// full update, are sent on the next tics instead. 0 sends everything right away.
+CVAR( Int, sv_pacedbytespertic, 8192, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+
+// Upper limit for the bytes per second sent to each client, regardless of the client's cl_rate.
+// 0 only limits the clients that set cl_rate themselves.
+CVAR( Int, sv_maxclientrate, 0, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+
+// Lets clients connecting from the loopback address skip the lump and level authentication and
+// the per IP connection limit, so that the load generator can connect without any WADs.
+CVAR( Bool, sv_allowloadtestclients, false, CVAR_NOSETBYACS )
 
 CUSTOM_CVAR( String, sv_adminlistfile, "adminlist.txt", CVAR_ARCHIVE|CVAR_NOSETBYACS )
 {
@@ -442,6 +508,7 @@ void SERVER_Construct( void )
 		// This is currently an open slot.
 		g_aClients[ulIdx].State = CLS_FREE;
 	}
+	g_ClientSlotsByAddress.Clear( );
 
 	// If they used "-host <#>", make <#> the max number of players.
 	pszMaxClients = Args->CheckValue( "-host" );
@@ -500,6 +567,7 @@ void SERVER_Construct( void )
 	SERVER_MASTER_Construct( );
 	SERVER_SAVE_Construct( );
 	SERVER_RCON_Construct( );
+	SERVER_CAPTURE_Construct( );
 
 	for (int i = 0; i < MAXPLAYERS; i++)
 	{
@@ -535,12 +603,50 @@ void SERVER_Destruct( void )
 	if ( PacketLogFile )
 		fclose( PacketLogFile );
 #endif
+
+	SERVER_CAPTURE_Destruct( );
 }
 
 //DWORD	g_LastMS, g_LastSec, g_FrameCount, g_LastCount, g_LastTic;
 
 void			SERVERCONSOLE_UpdateStatistics( void );
 
+//*****************************************************************************
+//
+static QWORD server_GetMicroseconds( void )
+{
+#ifdef __linux__
+	struct timespec	Now;
+
+	clock_gettime( CLOCK_MONOTONIC, &Now );
+	return ( static_cast<QWORD>( Now.tv_sec ) * 1000000 + Now.tv_nsec / 1000 );
+#else
+	return ( static_cast<QWORD>( I_MSTime( )) * 1000 );
+#endif
+}
+
+//*****************************************************************************
+//
+// Measures how much the time since the previous batch of tics differs from the time
+// the lNumTics tics that are due now should take.
+static void server_RecordTicStart( LONG lNumTics )
+{
+	const QWORD	qwNow = server_GetMicroseconds( );
+
+	if ( g_qwLastTicStartTime != 0 )
+	{
+		const LONG lExpected = static_cast<LONG>( lNumTics * ( 1000000.0 / 35.75 ));
+		const LONG lJitter = labs( static_cast<LONG>( qwNow - g_qwLastTicStartTime ) - lExpected );
+
+		g_lNumTicStartsThisSecond++;
+		g_lTicJitterSumThisSecond += lJitter;
+		g_lMaxTicJitterThisSecond = MAX( g_lMaxTicJitterThisSecond, lJitter );
+		g_lMaxTicJitter = MAX( g_lMaxTicJitter, lJitter );
+	}
+
+	g_qwLastTicStartTime = qwNow;
+}
+
 //*****************************************************************************
 //
 void SERVERCONSOLE_UpdateScoreboard( void );
@@ -552,25 +658,44 @@ void SERVER_Tick( void )
 	LONG			lCurTics;
 	ULONG			ulIdx;
 
-	I_DoSelect();
+	// In event-driven mode, NETWORK_WaitForInput also watches the console.
+	const bool bEventDriven = sv_eventdrivenloop && NETWORK_WaitForInput( 0 );
+	if ( bEventDriven == false )
+		I_DoSelect();
 	lPreviousTics = g_lGameTime / (( 1.0 / (double)35.75 ) * 1000.0 );
 
 	lNowTime = I_MSTime( );
 	lNewTics = lNowTime / (( 1.0 / (double)35.75 ) * 1000.0 );
 
 	lCurTics = lNewTics - lPreviousTics;
+
+	// A replay runs the tics back to back, the captured packets arrive at the tics they were received at.
+	if ( SERVER_CAPTURE_IsReplaying( ))
+		lCurTics = 1;
+
 	while ( lCurTics <= 0 )
 	{
 		// [BB] Recieve packets whenever possible (not only once each tic) to allow
 		// for an accurate ping measurement.
 		SERVER_GetPackets( );
 
-		I_Sleep( 1 );
+		if ( bEventDriven )
+		{
+			// Sleep until a packet arrives or the next tic is due. I_MSTime only counts whole
+			// milliseconds, so wake up shortly after the millisecond before the tic's start began.
+			const LONG lNextTicTime = static_cast<LONG>( ceil(( lPreviousTics + 1 ) * (( 1.0 / (double)35.75 ) * 1000.0 )));
+			NETWORK_WaitForInput( MAX<LONG>( lNextTicTime - lNowTime - 1, 0 ) * 1000 + 100 );
+		}
+		else
+			I_Sleep( 1 );
+
 		lNowTime = I_MSTime( );
 		lNewTics = lNowTime / (( 1.0 / (double)35.75 ) * 1000.0 );
 		lCurTics = lNewTics - lPreviousTics;
 	}
 
+	server_RecordTicStart( lCurTics );
+
 #ifdef NO_SERVER_GUI
 	// console input
 	char *cmd = I_ConsoleInput();
@@ -587,6 +712,7 @@ void SERVER_Tick( void )
 	while ( lCurTics-- )
 	{
 		//DObject::BeginFrame ();
+		SERVER_CAPTURE_BeginTic( );
 
 		// Recieve packets.
 		SERVER_GetPackets( );
@@ -597,19 +723,21 @@ void SERVER_Tick( void )
 			if ( SERVER_IsValidClient( ulIdx ) == false )
 				continue;
 
+			CLIENT_s *pClient = &g_aClients[ulIdx];
 			int numMoveCMDs = 0;
-			for ( unsigned int i = 0; i < g_aClients[ulIdx].MoveCMDs.Size(); ++i )
+			while (( pClient->ulNumBufferedCommands > 0 ) && ( numMoveCMDs < 2 ))
 			{
-				g_aClients[ulIdx].MoveCMDs[0]->process ( ulIdx );
+				const CLIENT_BUFFERED_COMMAND_s &Command = pClient->BufferedCommands[pClient->ulFirstBufferedCommand];
+
+				pClient->ulFirstBufferedCommand = ( pClient->ulFirstBufferedCommand + 1 ) % MAX_BUFFERED_COMMANDS;
+				pClient->ulNumBufferedCommands--;
 
 				// [BB] Only limit the amount of movement commands.
-				if ( g_aClients[ulIdx].MoveCMDs[0]->isMoveCmd() )
+				if ( Command.Type == CLIENTCOMMAND_MOVE )
 					++numMoveCMDs;
 
-				delete g_aClients[ulIdx].MoveCMDs[0];
-				g_aClients[ulIdx].MoveCMDs.Delete(0);
-
-				if ( numMoveCMDs == 2 )
+				// Processing the command may kick the client.
+				if ( server_ProcessBufferedCommand( ulIdx, Command ))
 					break;
 			}
 		}
@@ -653,6 +781,10 @@ void SERVER_Tick( void )
 
 		// Check everyone's PacketBuffer for anything that needs to be sent.
 		SERVER_SendOutPackets( );
+		SERVERCOMMANDS_EndTic( );
+
+		// Write the traffic profile to sv_trafficprofilefile if it's time to.
+		NETTRAFFIC_Tick( );
 
 		// Potentially send an update to the master server.
 		SERVER_MASTER_Tick( );
@@ -720,11 +852,19 @@ void SERVER_Tick( void )
 			g_lInboundDataTransferLastSecond = g_lCurrentInboundDataTransfer;
 			g_lCurrentInboundDataTransfer = 0;
 
+			// Update the tic jitter of the last second.
+			g_lAverageTicJitterLastSecond = ( g_lNumTicStartsThisSecond > 0 ) ? ( g_lTicJitterSumThisSecond / g_lNumTicStartsThisSecond ) : 0;
+			g_lMaxTicJitterLastSecond = g_lMaxTicJitterThisSecond;
+			g_lNumTicStartsThisSecond = 0;
+			g_lTicJitterSumThisSecond = 0;
+			g_lMaxTicJitterThisSecond = 0;
+
 			// Update the form.
 			SERVERCONSOLE_UpdateStatistics( );
 		}
 
 		//DObject::EndFrame ();
+		SERVER_CAPTURE_EndTic( );
 	}
 /*
 	if ( 1 )
@@ -770,17 +910,39 @@ void SERVER_SendOutPackets( void )
 {
 	ULONG	ulIdx;
 
+	// Send the packets of all clients together if possible.
+	NETWORK_BeginBatchedSend( );
+
 	for ( ulIdx = 0; ulIdx < MAXPLAYERS; ulIdx++ )
 	{
 		if ( SERVER_IsValidClient( ulIdx ) == false )
 			continue;
 
+		// The packets that were held back on the previous tics go first.
+		server_SendPacedPackets( ulIdx );
+
 		if ( NETWORK_CalcBufferSize( &g_aClients[ulIdx].PacketBuffer ) > 0 )
 			SERVER_SendClientPacket( ulIdx, true );
 
 		if ( NETWORK_CalcBufferSize( &g_aClients[ulIdx].UnreliablePacketBuffer ) > 0 )
 			SERVER_SendClientPacket( ulIdx, false );
 	}
+
+	NETWORK_FlushBatchedSend( );
+
+	for ( ulIdx = 0; ulIdx < MAXPLAYERS; ulIdx++ )
+	{
+		g_aClients[ulIdx].ulReliableBytesThisTic = 0;
+		server_RefillRateTokens( ulIdx );
+	}
+
+	// All buffers that could refer to the broadcast segment are empty now, start a new one.
+	for ( ulIdx = 0; ulIdx < MAXPLAYERS; ulIdx++ )
+	{
+		g_aClients[ulIdx].PacketBufferRuns.Clear( );
+		g_aClients[ulIdx].UnreliablePacketBufferRuns.Clear( );
+	}
+	g_BroadcastSegment.clear( );
 }
 
 //*****************************************************************************
@@ -791,6 +953,10 @@ void SERVER_SendClientPacket( ULONG ulClient, bool bReliable )
     NETBUFFER_s		TempBuffer;
 	BYTE			abData[MAX_UDP_PACKET];
 	CLIENT_s		*pClient;
+	TArray<HuffmanSegmentRun>	*pRuns;
+	ULONG			ulHeaderSize;
+	ULONG			ulIdx;
+	LONG			lEncodedSize;
 
 	pClient = SERVER_GetClient( ulClient );
 	if ( pClient == NULL )
@@ -804,32 +970,43 @@ void SERVER_SendClientPacket( ULONG ulClient, bool bReliable )
 	TempBuffer.ByteStream.pbStreamEnd = TempBuffer.ByteStream.pbStream + TempBuffer.ulMaxSize;
 
 	if ( bReliable )
+	{
 		pBuffer = &pClient->PacketBuffer;
+		pRuns = &pClient->PacketBufferRuns;
+	}
 	else
+	{
 		pBuffer = &pClient->UnreliablePacketBuffer;
+		pRuns = &pClient->UnreliablePacketBufferRuns;
+	}
 
 	pBuffer->ulCurrentSize = NETWORK_CalcBufferSize( pBuffer );
 	if ( bReliable )
 	{
-		pClient->SavedPacketBuffer.ulCurrentSize = NETWORK_CalcBufferSize( &pClient->SavedPacketBuffer );
+		const ULONG ulSlot = pClient->ulPacketSequence % PACKET_BUFFER_SIZE;
+		ULONG ulPosition = static_cast<ULONG>( pClient->qwSavedPacketBufferEnd % pClient->SavedPacketBuffer.ulMaxSize );
 
 		// If we've reached the end of our reliable packets buffer, start writing at the beginning.
-		if (( pClient->SavedPacketBuffer.ulCurrentSize + pClient->PacketBuffer.ulCurrentSize ) >= pClient->SavedPacketBuffer.ulMaxSize )
+		if (( ulPosition + pClient->PacketBuffer.ulCurrentSize ) > pClient->SavedPacketBuffer.ulMaxSize )
 		{
-			pClient->SavedPacketBuffer.ByteStream.pbStream = pClient->SavedPacketBuffer.pbData;
-			pClient->SavedPacketBuffer.ulCurrentSize = 0;
+			pClient->qwSavedPacketBufferEnd += pClient->SavedPacketBuffer.ulMaxSize - ulPosition;
+			ulPosition = 0;
 		}
 
 		// Save where the beginning is and the size of each packet within the reliable packets
 		// buffer.
-		pClient->lPacketBeginning[( pClient->ulPacketSequence ) % PACKET_BUFFER_SIZE] = pClient->SavedPacketBuffer.ulCurrentSize;
-		pClient->lPacketSize[( pClient->ulPacketSequence ) % PACKET_BUFFER_SIZE] = pClient->PacketBuffer.ulCurrentSize;
-		pClient->lPacketSequence[( pClient->ulPacketSequence ) % PACKET_BUFFER_SIZE] = pClient->ulPacketSequence;
+		pClient->qwPacketBeginning[ulSlot] = pClient->qwSavedPacketBufferEnd;
+		pClient->lPacketSize[ulSlot] = pClient->PacketBuffer.ulCurrentSize;
+		pClient->lPacketSequence[ulSlot] = pClient->ulPacketSequence;
 
 		// Write what we want to send out to our reliable packets buffer, so that it can be
 		// retransmitted later if necessary.
 		if ( pClient->PacketBuffer.ulCurrentSize )
+		{
+			pClient->SavedPacketBuffer.ByteStream.pbStream = pClient->SavedPacketBuffer.pbData + ulPosition;
 			NETWORK_WriteBuffer( &pClient->SavedPacketBuffer.ByteStream, pClient->PacketBuffer.pbData, pClient->PacketBuffer.ulCurrentSize );
+			pClient->qwSavedPacketBufferEnd += pClient->PacketBuffer.ulCurrentSize;
+		}
 
 		// Write the header to our temporary buffer.
 		NETWORK_WriteByte( &TempBuffer.ByteStream, SVC_HEADER );
@@ -844,15 +1021,160 @@ void SERVER_SendClientPacket( ULONG ulClient, bool bReliable )
 	}
 
 	// Write the body of the message to our temporary buffer.
+	ulHeaderSize = TempBuffer.ByteStream.pbStream - TempBuffer.pbData;
 	pBuffer->ulCurrentSize = pBuffer->ByteStream.pbStream - pBuffer->pbData;
 	if ( pBuffer->ulCurrentSize != 0 )
 		NETWORK_WriteBuffer( &TempBuffer.ByteStream, pBuffer->pbData, pBuffer->ulCurrentSize );
 
-	// Finally, send the packet, and clear the buffer.
-	NETWORK_LaunchPacket( &TempBuffer, pClient->Address );
+	const ULONG ulPacketSize = TempBuffer.ByteStream.pbStream - TempBuffer.pbData;
+
+	// While reliable packets are held back, the new ones have to wait behind them. Unreliable
+	// packets are dropped, they would arrive before the reliable packets they depend on.
+	if (( pClient->PacedPacketSizes.Size( ) > 0 ) ||
+		( bReliable && ( sv_pacedbytespertic > 0 ) && (( pClient->ulReliableBytesThisTic + ulPacketSize ) > static_cast<ULONG>( sv_pacedbytespertic ))))
+	{
+		if ( bReliable )
+			server_QueuePacedPacket( pClient, abData, ulPacketSize );
+		else
+			pClient->ulNumDroppedUpdates++;
+
+		pRuns->Clear( );
+		NETWORK_ClearBuffer( pBuffer );
+		return;
+	}
+
+	if ( bReliable )
+		pClient->ulReliableBytesThisTic += ulPacketSize;
+	pClient->lRateTokens -= ulPacketSize;
+
+	// Finally, send the packet, and clear the buffer. If parts of the body were copied from
+	// the broadcast segment, their Huffman codes don't need to be computed again.
+	if ( pRuns->Size( ) > 0 )
+	{
+		for ( ulIdx = 0; ulIdx < pRuns->Size( ); ulIdx++ )
+			(*pRuns)[ulIdx].offset += ulHeaderSize;
+
+		lEncodedSize = NETWORK_LaunchPacket( &TempBuffer, pClient->Address, &g_BroadcastSegment, &(*pRuns)[0], pRuns->Size( ));
+		pRuns->Clear( );
+	}
+	else
+		lEncodedSize = NETWORK_LaunchPacket( &TempBuffer, pClient->Address );
+	NETTRAFFIC_AddPacketTraffic( ulClient, ulPacketSize, lEncodedSize );
 	NETWORK_ClearBuffer( pBuffer );
 }
 
+//*****************************************************************************
+//
+static void server_QueuePacedPacket( CLIENT_s *pClient, const BYTE *pbData, ULONG ulSize )
+{
+	if ( pClient->PacedPacketSizes.Size( ) == 0 )
+		pClient->lPacingStartTic = gametic;
+
+	const unsigned int uiIdx = pClient->PacedPacketData.Reserve( ulSize );
+	memcpy( &pClient->PacedPacketData[uiIdx], pbData, ulSize );
+	pClient->PacedPacketSizes.Push( ulSize );
+}
+
+//*****************************************************************************
+//
+// Sends as many of the held back packets as fit into this tic's budget, but at least one.
+static void server_SendPacedPackets( ULONG ulClient )
+{
+	CLIENT_s	*pClient = &g_aClients[ulClient];
+	NETBUFFER_s	Buffer;
+
+	while ( pClient->ulNumPacedPacketsSent < pClient->PacedPacketSizes.Size( ))
+	{
+		const ULONG ulSize = pClient->PacedPacketSizes[pClient->ulNumPacedPacketsSent];
+
+		if (( pClient->ulReliableBytesThisTic > 0 ) &&
+			( sv_pacedbytespertic > 0 ) &&
+			(( pClient->ulReliableBytesThisTic + ulSize ) > static_cast<ULONG>( sv_pacedbytespertic )))
+		{
+			return;
+		}
+
+		Buffer.pbData = &pClient->PacedPacketData[pClient->ulNumPacedBytesSent];
+		Buffer.ulMaxSize = ulSize;
+		Buffer.ulCurrentSize = ulSize;
+		Buffer.BufferType = BUFFERTYPE_WRITE;
+		Buffer.ByteStream.pbStream = Buffer.pbData + ulSize;
+		Buffer.ByteStream.pbStreamEnd = Buffer.ByteStream.pbStream;
+		NETTRAFFIC_AddPacketTraffic( ulClient, ulSize, NETWORK_LaunchPacket( &Buffer, pClient->Address ));
+
+		pClient->ulReliableBytesThisTic += ulSize;
+		pClient->lRateTokens -= ulSize;
+		pClient->ulNumPacedBytesSent += ulSize;
+		pClient->ulNumPacedPacketsSent++;
+	}
+
+	if ( pClient->PacedPacketSizes.Size( ) > 0 )
+	{
+		g_ulNumPacedBursts++;
+		g_ulLastPacedBurstBytes = pClient->ulNumPacedBytesSent;
+		g_lLastPacedBurstTics = gametic - pClient->lPacingStartTic;
+		g_lMaxPacedBurstTics = MAX( g_lMaxPacedBurstTics, g_lLastPacedBurstTics );
+		server_ClearPacedPackets( pClient );
+	}
+}
+
+//*****************************************************************************
+//
+static void server_ClearPacedPackets( CLIENT_s *pClient )
+{
+	pClient->PacedPacketData.Clear( );
+	pClient->PacedPacketSizes.Clear( );
+	pClient->ulNumPacedPacketsSent = 0;
+	pClient->ulNumPacedBytesSent = 0;
+}
+
+//*****************************************************************************
+//
+// Returns how many bytes per second may be sent to the client, 0 means no limit.
+static ULONG server_GetClientRate( ULONG ulClient )
+{
+	ULONG ulRate = MAX( players[ulClient].userinfo.GetRate( ), 0 );
+
+	if (( sv_maxclientrate > 0 ) && (( ulRate == 0 ) || ( ulRate > static_cast<ULONG>( sv_maxclientrate ))))
+		ulRate = sv_maxclientrate;
+
+	return ( ulRate );
+}
+
+//*****************************************************************************
+//
+// Adds one tic worth of the client's rate to his token bucket. Up to a quarter of a second
+// can be saved up, but at least one full packet.
+static void server_RefillRateTokens( ULONG ulClient )
+{
+	CLIENT_s	*pClient = &g_aClients[ulClient];
+	const ULONG	ulRate = server_GetClientRate( ulClient );
+
+	if ( ulRate == 0 )
+	{
+		pClient->lRateTokens = 0;
+		return;
+	}
+
+	const LONG lMaxTokens = MAX( static_cast<LONG>( ulRate / 4 ), static_cast<LONG>( SERVER_GetMaxPacketSize( )));
+	pClient->lRateTokens = MIN( pClient->lRateTokens + static_cast<LONG>( ulRate / TICRATE ), lMaxTokens );
+}
+
+//*****************************************************************************
+//
+// Returns whether more unreliable updates may be written to the client in this tic. The
+// commands that are still in the client's buffers already count against his rate.
+static bool server_HasRateBudget( ULONG ulClient )
+{
+	CLIENT_s	*pClient = &g_aClients[ulClient];
+
+	if ( server_GetClientRate( ulClient ) == 0 )
+		return ( true );
+
+	const LONG lPendingBytes = NETWORK_CalcBufferSize( &pClient->PacketBuffer ) + NETWORK_CalcBufferSize( &pClient->UnreliablePacketBuffer );
+	return ( pClient->lRateTokens > lPendingBytes );
+}
+
 //*****************************************************************************
 //
 void SERVER_CheckClientBuffer( ULONG ulClient, ULONG ulSize, bool bReliable )
@@ -882,6 +1204,67 @@ void SERVER_CheckClientBuffer( ULONG ulClient, ULONG ulSize, bool bReliable )
 	}
 }
 
+//*****************************************************************************
+//
+// Stores a command that is about to be sent to several clients in the broadcast segment,
+// so that its Huffman codes are only computed once. Returns the position of the command in
+// the segment or -1 if it is not shared.
+LONG SERVER_AddToBroadcastSegment( const BYTE *pbData, ULONG ulSize )
+{
+	if ( sv_sharebroadcastencoding == false )
+		return ( -1 );
+
+	return ( g_BroadcastSegment.append( pbData, ulSize ));
+}
+
+//*****************************************************************************
+//
+// Remembers that the next ulSize bytes written to the client's buffer are a copy of the
+// broadcast segment. Must be called after SERVER_CheckClientBuffer.
+void SERVER_MarkBroadcastRun( ULONG ulClient, bool bReliable, LONG lSegmentOffset, ULONG ulSize )
+{
+	NETBUFFER_s					*pBuffer;
+	TArray<HuffmanSegmentRun>	*pRuns;
+	HuffmanSegmentRun			Run;
+	CLIENT_s					*pClient;
+
+	pClient = SERVER_GetClient( ulClient );
+	if (( pClient == NULL ) || ( lSegmentOffset < 0 ))
+		return;
+
+	if ( bReliable )
+	{
+		pBuffer = &pClient->PacketBuffer;
+		pRuns = &pClient->PacketBufferRuns;
+	}
+	else
+	{
+		pBuffer = &pClient->UnreliablePacketBuffer;
+		pRuns = &pClient->UnreliablePacketBufferRuns;
+	}
+
+	Run.offset = pBuffer->ByteStream.pbStream - pBuffer->pbData;
+	Run.segmentOffset = lSegmentOffset;
+	Run.length = ulSize;
+
+	// Consecutive broadcasts are usually consecutive in the segment, too.
+	if ( pRuns->Size( ) > 0 )
+	{
+		HuffmanSegmentRun &Last = (*pRuns)[pRuns->Size( ) - 1];
+		if (( Last.offset + Last.length == Run.offset ) && ( Last.segmentOffset + Last.length == Run.segmentOffset ))
+		{
+			Last.length += Run.length;
+			return;
+		}
+
+		// The buffer was cleared without being sent (e.g. the client reconnected), the old runs are stale.
+		if ( Last.offset + Last.length > Run.offset )
+			pRuns->Clear( );
+	}
+
+	pRuns->Push( Run );
+}
+
 //*****************************************************************************
 //
 LONG SERVER_FindFreeClientSlot( void )
@@ -914,16 +1297,15 @@ LONG SERVER_FindFreeClientSlot( void )
 //
 LONG SERVER_FindClientByAddress( NETADDRESS_s Address )
 {
-	for ( ULONG ulIdx = 0; ulIdx < MAXPLAYERS; ulIdx++ )
-	{
-	   if ( g_aClients[ulIdx].State == CLS_FREE )
-	       continue;
+	const LONG *plSlot = g_ClientSlotsByAddress.CheckKey( SERVER_GetAddressKey( Address ));
+
+	if ( plSlot == NULL )
+		return ( -1 );
+
+	// If the client's address matches the given IP, return the client's index.
+	if (( g_aClients[*plSlot].State != CLS_FREE ) && NETWORK_CompareAddress( g_aClients[*plSlot].Address, Address, false ))
+		return ( *plSlot );
 
-	   // If the client's address matches the given IP, return the client's index.
-	   if ( NETWORK_CompareAddress( g_aClients[ulIdx].Address, Address, false ))
-	       return ( ulIdx );
-	}
-	
 	return ( -1 );
 }
 
@@ -1061,8 +1443,12 @@ void SERVER_GetPackets( void )
 {
 	BYTESTREAM_s	*pByteStream;
 
-	while ( NETWORK_GetPackets( ) > 0 )
+	// During a replay, the packets only come from the capture.
+	while (( SERVER_CAPTURE_IsReplaying( ) ? SERVER_CAPTURE_GetReplayPacket( ) : NETWORK_GetPackets( )) > 0 )
 	{
+		if ( SERVER_CAPTURE_IsReplaying( ) == false )
+			SERVER_CAPTURE_RecordPacket( );
+
 		// Set up our byte stream.
 		pByteStream = &NETWORK_GetNetworkMessageBuffer( )->ByteStream;
 		pByteStream->pbStream = NETWORK_GetNetworkMessageBuffer( )->pbData;
@@ -1282,6 +1668,10 @@ bool SERVER_PerformAuthenticationChecksum( BYTESTREAM_s *pByteStream )
 		( serverBehaviorString.Compare( clientBehaviorString ) != 0 ) ||
 		( serverTextmapString.Compare( clientTextmapString ) != 0 ))
 	{
+		// The load generator doesn't have the map, it only sends empty checksums.
+		if ( server_IsLoadTestAddress( g_aClients[g_lCurrentClient].Address ))
+			return ( true );
+
 		return ( false );
 	}
 
@@ -1626,7 +2016,10 @@ void SERVER_ConnectNewPlayer( BYTESTREAM_s *pByteStream )
 	}
 
 	if ( g_aClients[g_lCurrentClient].State != CLS_SPAWNED )
+	{
 		SERVERCONSOLE_ReListPlayers( );
+		SERVER_MASTER_InvalidateServerInfo( );
+	}
 
 	// Update this client's state. He's in the game now!
 	g_aClients[g_lCurrentClient].State = CLS_SPAWNED;
@@ -1778,7 +2171,7 @@ void SERVER_DetermineConnectionType( BYTESTREAM_s *pByteStream )
 		case 200: 
 			Printf( "Challenge (%d) from (%s). Likely an old client (97d-beta4.3 or older) trying to connect. Informing the client and ignoring IP for 10 seconds.\n", static_cast<int> (lCommand), NETWORK_AddressToString( NETWORK_GetFromAddress( )));
 			// [BB] Block all further challenges of this IP for ten seconds to prevent log flooding.
-			g_floodProtectionIPQueue.addAddress ( NETWORK_GetFromAddress( ), g_lGameTime / 1000 );
+			SERVER_IgnoreIP( NETWORK_GetFromAddress( ));
 			// [BB] Try to tell the client in a 97d-beta4.3 compatible way, that his version is too old.
 			{
 				NETBUFFER_s	TempBuffer;
@@ -1805,7 +2198,7 @@ void SERVER_DetermineConnectionType( BYTESTREAM_s *pByteStream )
 
 			Printf( "Unknown challenge (%d) from %s. Ignoring IP for 10 seconds.\n", static_cast<int> (lCommand), NETWORK_AddressToString( NETWORK_GetFromAddress( )));
 			// [BB] Block all further challenges of this IP for ten seconds to prevent log flooding.
-			g_floodProtectionIPQueue.addAddress ( NETWORK_GetFromAddress( ), g_lGameTime / 1000 );
+			SERVER_IgnoreIP( NETWORK_GetFromAddress( ));
 
 #ifdef CREATE_PACKET_LOG
 			server_LogPacket(pByteStream,  NETWORK_GetFromAddress( ), "Unknown connection challenge.");
@@ -1851,7 +2244,7 @@ void SERVER_SetupNewConnection( BYTESTREAM_s *pByteStream, bool bNewPlayer )
 		}
 
 		// [RC] Kick if necessary.
-		if ( sv_maxclientsperip > 0 && (static_cast<LONG>(ulOtherClientsFromIP) >= sv_maxclientsperip) )
+		if ( sv_maxclientsperip > 0 && (static_cast<LONG>(ulOtherClientsFromIP) >= sv_maxclientsperip) && ( server_IsLoadTestAddress( AddressFrom ) == false ))
 		{
 			// Printf( "Connection from %s refused: too many connections from that IP. (sv_maxclientsperip is %d.)", NETWORK_AddressToString( AddressFrom ),  sv_maxclientsperip );
 			SERVER_ConnectionError( AddressFrom, "Too many connections from this IP.", NETWORK_ERRORCODE_TOOMANYCONNECTIONSFROMIP );
@@ -1927,11 +2320,23 @@ void SERVER_SetupNewConnection( BYTESTREAM_s *pByteStream, bool bNewPlayer )
 	NETWORK_ClearBuffer( &g_aClients[lClient].UnreliablePacketBuffer );
 	for ( ulIdx = 0; ulIdx < PACKET_BUFFER_SIZE; ulIdx++ )
 	{
-		g_aClients[lClient].lPacketBeginning[ulIdx] = 0;
+		g_aClients[lClient].qwPacketBeginning[ulIdx] = 0;
 		g_aClients[lClient].lPacketSize[ulIdx] = 0;
-		g_aClients[lClient].lPacketSequence[ulIdx] = 0;
+		g_aClients[lClient].lPacketSequence[ulIdx] = -1;
 	}
+	g_aClients[lClient].qwSavedPacketBufferEnd = 0;
 	g_aClients[lClient].ulPacketSequence = 0;
+	g_aClients[lClient].ulNumRetransmittedPackets = 0;
+	server_ClearPacedPackets( &g_aClients[lClient] );
+	g_aClients[lClient].lRateTokens = 0;
+	g_aClients[lClient].qwDeferredPlayerUpdates = 0;
+	g_aClients[lClient].ulNumDeferredUpdates = 0;
+	g_aClients[lClient].ulNumDroppedUpdates = 0;
+	g_aClients[lClient].ulFirstBufferedCommand = 0;
+	g_aClients[lClient].ulNumBufferedCommands = 0;
+	g_aClients[lClient].ulMaxBufferedCommands = 0;
+	g_aClients[lClient].ulNumDroppedCommands = 0;
+	NETTRAFFIC_ResetClient( lClient );
 
 	// Who is connecting?
 	Printf( "Connect (v%s): %s\n", clientVersion.GetChars(), NETWORK_AddressToString( NETWORK_GetFromAddress( )));
@@ -1939,6 +2344,11 @@ void SERVER_SetupNewConnection( BYTESTREAM_s *pByteStream, bool bNewPlayer )
 	// Setup the client.
 	g_aClients[lClient].State = CLS_CHALLENGE;
 	g_aClients[lClient].Address = AddressFrom;
+	// Clients resend their connection attempts, but the address may only be exempted once,
+	// since SERVER_DisconnectClient only removes the exemption once.
+	if ( g_ClientSlotsByAddress.CheckKey( SERVER_GetAddressKey( AddressFrom )) == NULL )
+		NETWORK_AddIngressExemption( AddressFrom );
+	g_ClientSlotsByAddress[SERVER_GetAddressKey( AddressFrom )] = lClient;
 
 	{
 		// Make sure the version matches.
@@ -1994,7 +2404,7 @@ void SERVER_SetupNewConnection( BYTESTREAM_s *pByteStream, bool bNewPlayer )
 		return;
 	}
 
-	if ( sv_pure && strcmp ( NETWORK_ReadString( pByteStream ), g_lumpsAuthenticationChecksum.GetChars() ) )
+	if ( sv_pure && strcmp ( NETWORK_ReadString( pByteStream ), g_lumpsAuthenticationChecksum.GetChars() ) && ( server_IsLoadTestAddress( g_aClients[lClient].Address ) == false ))
 	{
 		// Client fails the lump authentication.
 		SERVER_ClientError( lClient, NETWORK_ERRORCODE_PROTECTED_LUMP_AUTHENTICATIONFAILED );
@@ -2041,6 +2451,7 @@ void SERVER_SetupNewConnection( BYTESTREAM_s *pByteStream, bool bNewPlayer )
 	// [CK] Since the client is not up to date at all, the farthest the client
 	// should be able to go back is the gametic they connected with.
 	g_aClients[lClient].lLastServerGametic = gametic;
+	SERVERCOMMANDS_ClearPlayerMoveKeyframes( lClient );
 
 	SERVER_InitClientSRPData ( lClient );
 
@@ -2198,6 +2609,10 @@ bool SERVER_GetUserInfo( BYTESTREAM_s *pByteStream, bool bAllowKick )
 	if ( ulFlags & USERINFO_CLIENTFLAGS )
 		pPlayer->userinfo.ClientFlagsChanged ( NETWORK_ReadByte( pByteStream ) );
 
+	// Read in how many bytes per second the client wants to receive at most.
+	if ( ulFlags & USERINFO_RATE )
+		pPlayer->userinfo.RateChanged ( NETWORK_ReadLong( pByteStream ));
+
 	// If this is a Hexen game, read in the player's class.
 	if ( ulFlags & USERINFO_PLAYERCLASS )
 		strncpy( szClass, NETWORK_ReadString( pByteStream ), 63 );
@@ -2246,6 +2661,7 @@ bool SERVER_GetUserInfo( BYTESTREAM_s *pByteStream, bool bAllowKick )
 
 	// Also, update the scoreboard.
 	SERVERCONSOLE_UpdatePlayerInfo( g_lCurrentClient, UDF_NAME );
+	SERVER_MASTER_InvalidateServerInfo( );
 
 	// Success!
 	return ( true );
@@ -2338,7 +2754,7 @@ void SERVER_ClientError( ULONG ulClient, ULONG ulErrorCode )
 	Printf( "%s \\c-disconnected. Ignoring IP for 10 seconds.\n", NETWORK_AddressToString( g_aClients[ulClient].Address ));
 
 	// [BB] Block this IP for ten seconds to prevent log flooding.
-	g_floodProtectionIPQueue.addAddress ( g_aClients[ulClient].Address, g_lGameTime / 1000 );
+	SERVER_IgnoreIP( g_aClients[ulClient].Address );
 
 	// [BB] Be sure to properly disconnect the client.
 	SERVER_DisconnectClient( ulClient, false, false );
@@ -2719,6 +3135,140 @@ void SERVER_SendFullUpdate( ULONG ulClient )
 	SERVER_GetClient ( ulClient )->bFullUpdateIncomplete = true;
 }
 
+//*****************************************************************************
+//
+// Decides if the position of ulPlayer has to be sent to ulClient on each of the client's updates.
+// That's the case for the player the client is watching, his teammates and players that are
+// close to or in sight of the player the client is watching.
+static bool server_IsPlayerRelevant( ULONG ulClient, ULONG ulPlayer )
+{
+	if (( sv_interestmanagement == false ) || ( sv_interestupdatedivisor <= 1 ))
+		return ( true );
+
+	const ULONG ulDisplayPlayer = ( PLAYER_IsValidPlayerWithMo( g_aClients[ulClient].ulDisplayPlayer )) ? g_aClients[ulClient].ulDisplayPlayer : ulClient;
+	AActor *pViewer = players[ulDisplayPlayer].mo;
+	AActor *pTarget = players[ulPlayer].mo;
+
+	if (( ulPlayer == ulDisplayPlayer ) || ( pViewer == NULL ) || ( pTarget == NULL ))
+		return ( true );
+
+	if (( GAMEMODE_GetFlags( GAMEMODE_GetCurrentMode( )) & GMF_PLAYERSONTEAMS ) &&
+		( players[ulClient].bOnTeam ) &&
+		( players[ulPlayer].bOnTeam ) &&
+		( players[ulClient].ulTeam == players[ulPlayer].ulTeam ))
+	{
+		return ( true );
+	}
+
+	if ( P_AproxDistance( pViewer->x - pTarget->x, pViewer->y - pTarget->y ) < ( sv_interestradius << FRACBITS ))
+		return ( true );
+
+	// Sight checks are expensive, so their result is reused for a quarter of a second. P_CheckSight
+	// looks at the REJECT table first, so players in sectors that can't see each other are cheap.
+	if (( gametic >= g_alPlayerSightExpiration[ulClient][ulPlayer] ) ||
+		( g_alPlayerSightExpiration[ulClient][ulPlayer] > gametic + TICRATE / 4 ))
+	{
+		g_abPlayerInSight[ulClient][ulPlayer] = P_CheckSight( pViewer, pTarget, SF_IGNOREVISIBILITY );
+		g_alPlayerSightExpiration[ulClient][ulPlayer] = gametic + TICRATE / 4;
+	}
+
+	return ( g_abPlayerInSight[ulClient][ulPlayer] );
+}
+
+//*****************************************************************************
+//
+// Writes the positions of the other players to the client. On tics that aren't one of the
+// client's updates, only the updates deferred on the previous tic are written. The updates are
+// ordered by priority: deferred ones first, so that nobody is starved, then the players the
+// client is interested in, then the rest, each closest first. Whatever doesn't fit into the
+// client's rate anymore is deferred to the next tic.
+static void server_WritePlayerUpdates( ULONG ulClient, bool bUpdateTic )
+{
+	CLIENT_s	*pClient = &g_aClients[ulClient];
+	ULONG		aulPlayers[MAXPLAYERS];
+	ULONG		aulTiers[MAXPLAYERS];
+	fixed_t		aDistances[MAXPLAYERS];
+	ULONG		ulNumPlayers = 0;
+
+	const ULONG ulDisplayPlayer = ( PLAYER_IsValidPlayerWithMo( pClient->ulDisplayPlayer )) ? pClient->ulDisplayPlayer : ulClient;
+	const bool bRateLimited = ( server_GetClientRate( ulClient ) > 0 );
+
+	for ( ULONG ulPlayer = 0; ulPlayer < MAXPLAYERS; ulPlayer++ )
+	{
+		const QWORD qwBit = static_cast<QWORD>( 1 ) << ulPlayer;
+		const bool bDeferred = !!( pClient->qwDeferredPlayerUpdates & qwBit );
+		pClient->qwDeferredPlayerUpdates &= ~qwBit;
+
+		if ( ( playeringame[ulPlayer] == false ) || players[ulPlayer].bSpectating )
+			continue;
+
+		// [BB] The consoleplayer on a client has to be moved differently.
+		if ( ulPlayer == ulClient )
+			continue;
+
+		const bool bRelevant = server_IsPlayerRelevant( ulClient, ulPlayer );
+
+		if ( bDeferred == false )
+		{
+			if ( bUpdateTic == false )
+				continue;
+
+			// Players the client isn't interested in are updated less often. The player
+			// index staggers these updates, so they are spread over all of the client's updates.
+			if (( bRelevant == false ) &&
+				((( gametic / players[ulClient].userinfo.GetTicsPerUpdate() ) + ulPlayer ) % sv_interestupdatedivisor ) != 0 )
+			{
+				continue;
+			}
+		}
+
+		// Without a rate limit everything is sent, so the order doesn't matter.
+		if ( bRateLimited == false )
+		{
+			SERVERCOMMANDS_MovePlayer( ulPlayer, ulClient, SVCF_ONLYTHISCLIENT );
+			continue;
+		}
+
+		const ULONG ulTier = bDeferred ? 0 : ( bRelevant ? 1 : 2 );
+		fixed_t Distance = 0;
+		if (( players[ulDisplayPlayer].mo != NULL ) && ( players[ulPlayer].mo != NULL ))
+			Distance = P_AproxDistance( players[ulDisplayPlayer].mo->x - players[ulPlayer].mo->x, players[ulDisplayPlayer].mo->y - players[ulPlayer].mo->y );
+
+		// There are at most MAXPLAYERS entries, a simple insertion sort does the job.
+		ULONG ulPos = ulNumPlayers++;
+		while (( ulPos > 0 ) &&
+			(( aulTiers[ulPos - 1] > ulTier ) || (( aulTiers[ulPos - 1] == ulTier ) && ( aDistances[ulPos - 1] > Distance ))))
+		{
+			aulPlayers[ulPos] = aulPlayers[ulPos - 1];
+			aulTiers[ulPos] = aulTiers[ulPos - 1];
+			aDistances[ulPos] = aDistances[ulPos - 1];
+			ulPos--;
+		}
+		aulPlayers[ulPos] = ulPlayer;
+		aulTiers[ulPos] = ulTier;
+		aDistances[ulPos] = Distance;
+	}
+
+	for ( ULONG ulIdx = 0; ulIdx < ulNumPlayers; ulIdx++ )
+	{
+		if ( server_HasRateBudget( ulClient ) == false )
+		{
+			pClient->qwDeferredPlayerUpdates |= static_cast<QWORD>( 1 ) << aulPlayers[ulIdx];
+			pClient->ulNumDeferredUpdates++;
+			continue;
+		}
+
+		SERVERCOMMANDS_MovePlayer( aulPlayers[ulIdx], ulClient, SVCF_ONLYTHISCLIENT );
+	}
+}
+
+//*****************************************************************************
+//
+static bool server_IsLoadTestAddress( const NETADDRESS_s &Address )
+{
+	return ( sv_allowloadtestclients && ( Address.abIP[0] == 127 ));
+}
+
 //*****************************************************************************
 //
 void SERVER_WriteCommands( void )
@@ -2744,7 +3294,14 @@ void SERVER_WriteCommands( void )
 		// The server sends origin and velocity of a 
 		// player and the client always knows origin on the next tic.
 		if (( gametic % players[ulIdx].userinfo.GetTicsPerUpdate() ) != 0 )
+		{
+			// Updates that didn't fit into the client's rate on the previous tic shouldn't
+			// have to wait for his next update.
+			if ( g_aClients[ulIdx].qwDeferredPlayerUpdates != 0 )
+				server_WritePlayerUpdates( ulIdx, false );
+
 			continue;
+		}
 
 		// [BB] You can be watching through the eyes of someone, even if you are not a spectator.
 		// If this player is watching through the eyes of another player, send this
@@ -2758,17 +3315,7 @@ void SERVER_WriteCommands( void )
 		}
 
 		// See if any players need to be updated to clients.
-		for ( ULONG ulPlayer = 0; ulPlayer < MAXPLAYERS; ulPlayer++ )
-		{
-			if ( ( playeringame[ulPlayer] == false ) || players[ulPlayer].bSpectating )
-				continue;
-
-			// [BB] The consoleplayer on a client has to be moved differently.
-			if ( ulPlayer == ulIdx )
-				continue;
-
-			SERVERCOMMANDS_MovePlayer( ulPlayer, ulIdx, SVCF_ONLYTHISCLIENT );
-		}
+		server_WritePlayerUpdates( ulIdx, true );
 
 		// Spectators can move around freely, without us telling it what to do (lag-less).
 		// [BB] We have to bug all clients who didn't finish receiving their full update with
@@ -2946,6 +3493,12 @@ void SERVER_DisconnectClient( ULONG ulClient, bool bBroadcast, bool bSaveInfo )
 	// [BB] Clear any cheats the player had. Note: This may not be done before the player dropped the important items!
 	players[ulClient].cheats = players[ulClient].cheats2 = 0;
 
+	const LONG *plSlot = g_ClientSlotsByAddress.CheckKey( SERVER_GetAddressKey( g_aClients[ulClient].Address ));
+	if (( plSlot != NULL ) && ( *plSlot == static_cast<LONG>( ulClient )))
+	{
+		g_ClientSlotsByAddress.Remove( SERVER_GetAddressKey( g_aClients[ulClient].Address ));
+		NETWORK_RemoveIngressExemption( g_aClients[ulClient].Address );
+	}
 	memset( &g_aClients[ulClient].Address, 0, sizeof( g_aClients[ulClient].Address ));
 	g_aClients[ulClient].State = CLS_FREE;
 	g_aClients[ulClient].ulLastGameTic = 0;
@@ -2960,6 +3513,7 @@ void SERVER_DisconnectClient( ULONG ulClient, bool bBroadcast, bool bSaveInfo )
 
 	// Redo the scoreboard.
 	SERVERCONSOLE_ReListPlayers( );
+	SERVER_MASTER_InvalidateServerInfo( );
 
 	// [RC] Update clients using the RCON utility.
 	SERVER_RCON_UpdateInfo( SVRCU_PLAYERDATA );
@@ -2968,6 +3522,8 @@ void SERVER_DisconnectClient( ULONG ulClient, bool bBroadcast, bool bSaveInfo )
 	NETWORK_ClearBuffer( &g_aClients[ulClient].PacketBuffer );
 	NETWORK_ClearBuffer( &g_aClients[ulClient].UnreliablePacketBuffer );
 	NETWORK_ClearBuffer( &g_aClients[ulClient].SavedPacketBuffer );
+	server_ClearPacedPackets( &g_aClients[ulClient] );
+	g_aClients[ulClient].ulNumBufferedCommands = 0;
 
 	// Tell the join queue module that a player has left the game.
 	if ( PLAYER_IsTrueSpectator( &players[ulClient] ) == false )
@@ -4114,6 +4670,9 @@ void SERVER_SyncServerModCVars ( const int PlayerToSync )
 void SERVER_IgnoreIP( NETADDRESS_s Address )
 {
 	g_floodProtectionIPQueue.addAddress( Address, g_lGameTime / 1000 );
+
+	// Don't even let these packets reach the game thread, unless they come from a client or an RCON session.
+	NETWORK_IgnoreAddressOnIngress( Address );
 }
 
 //*****************************************************************************
@@ -4634,20 +5193,45 @@ void SERVER_UpdateThingMomentum( AActor *pActor, bool updateZ, bool updateXY )
 
 //*****************************************************************************
 //
-template <typename CommandType>
-static bool server_ParseBufferedCommand ( BYTESTREAM_s *pByteStream )
+// Stores the command in the current client's command buffer or executes it right away if
+// sv_useticbuffer is off.
+static bool server_BufferCommand ( const CLIENT_BUFFERED_COMMAND_s &Command )
 {
-	CommandType *cmd = new CommandType ( pByteStream );
+	if ( sv_useticbuffer == false )
+		return server_ProcessBufferedCommand( g_lCurrentClient, Command );
+
+	CLIENT_s *pClient = &g_aClients[g_lCurrentClient];
 
-	if ( sv_useticbuffer )
+	// If the client sends commands a lot faster than we can process them, the oldest ones
+	// are dropped.
+	if ( pClient->ulNumBufferedCommands == MAX_BUFFERED_COMMANDS )
 	{
-		g_aClients[g_lCurrentClient].MoveCMDs.Push ( cmd );
-		return false;
+		pClient->ulFirstBufferedCommand = ( pClient->ulFirstBufferedCommand + 1 ) % MAX_BUFFERED_COMMANDS;
+		pClient->ulNumBufferedCommands--;
+		pClient->ulNumDroppedCommands++;
+	}
+
+	pClient->BufferedCommands[( pClient->ulFirstBufferedCommand + pClient->ulNumBufferedCommands ) % MAX_BUFFERED_COMMANDS] = Command;
+	pClient->ulNumBufferedCommands++;
+	pClient->ulMaxBufferedCommands = MAX( pClient->ulMaxBufferedCommands, pClient->ulNumBufferedCommands );
+	return false;
+}
+
+//*****************************************************************************
+//
+static bool server_ProcessBufferedCommand ( ULONG ulClient, const CLIENT_BUFFERED_COMMAND_s &Command )
+{
+	switch ( Command.Type )
+	{
+	case CLIENTCOMMAND_MOVE:
+
+		return server_ProcessClientMove( ulClient, Command.MoveCmd );
+	case CLIENTCOMMAND_WEAPONSELECT:
+
+		return server_ProcessWeaponSelect( ulClient, Command.usWeaponNetworkIndex );
 	}
 
-	const bool retValue = cmd->process ( g_lCurrentClient );
-	delete cmd;
-	return retValue;
+	return ( false );
 }
 
 //*****************************************************************************
@@ -4869,21 +5453,6 @@ static bool server_Say( BYTESTREAM_s *pByteStream )
 	}
 }
 
-//*****************************************************************************
-class ClientMoveCommand : public ClientCommand
-{
-	CLIENT_MOVE_COMMAND_s moveCmd;
-public:
-	ClientMoveCommand ( BYTESTREAM_s *pByteStream );
-
-	bool process ( const ULONG ulClient ) const;
-
-	virtual bool isMoveCmd ( ) const
-	{
-		return true;
-	}
-};
-
 //*****************************************************************************
 //
 static bool server_ClientMove( BYTESTREAM_s *pByteStream )
@@ -4895,10 +5464,22 @@ static bool server_ClientMove( BYTESTREAM_s *pByteStream )
 	// in a buffer. This way we can limit the amount of movement commands
 	// we process for a player in a given tic to prevent the player from
 	// seemingly teleporting in case too many movement commands arrive at once.
-	return server_ParseBufferedCommand<ClientMoveCommand> ( pByteStream );
+	CLIENT_BUFFERED_COMMAND_s Command;
+	Command.Type = CLIENTCOMMAND_MOVE;
+	server_ReadClientMove( pByteStream, Command.MoveCmd );
+
+	// The keyframes of the other players' movement the client received. Unlike the movement,
+	// these can be handled right away.
+	const USHORT usNewestKeyframe = NETWORK_ReadShort( pByteStream );
+	const ULONG ulKeyframeBits = NETWORK_ReadLong( pByteStream );
+	SERVERCOMMANDS_AcknowledgePlayerMoveKeyframes( g_lCurrentClient, usNewestKeyframe, ulKeyframeBits );
+
+	return server_BufferCommand( Command );
 }
 
-ClientMoveCommand::ClientMoveCommand ( BYTESTREAM_s *pByteStream )
+//*****************************************************************************
+//
+static void server_ReadClientMove( BYTESTREAM_s *pByteStream, CLIENT_MOVE_COMMAND_s &moveCmd )
 {
 	ticcmd_t *pCmd = &moveCmd.cmd;
 
@@ -4978,7 +5559,9 @@ ClientMoveCommand::ClientMoveCommand ( BYTESTREAM_s *pByteStream )
 		moveCmd.usWeaponNetworkIndex = 0;
 }
 
-bool ClientMoveCommand::process( const ULONG ulClient ) const
+//*****************************************************************************
+//
+static bool server_ProcessClientMove( ULONG ulClient, const CLIENT_MOVE_COMMAND_s &moveCmd )
 {
 	player_t *pPlayer = &players[ulClient];
 	ticcmd_t *pCmd = &pPlayer->cmd;
@@ -5125,13 +5708,12 @@ bool ClientMoveCommand::process( const ULONG ulClient ) const
 //
 static bool server_MissingPacket( BYTESTREAM_s *pByteStream )
 {
-	ULONG	ulIdx;
-	LONG	lPacket;
-	LONG	lLastPacket;
-	bool	bFullUpdateRequired;
+	CLIENT_s	*pClient = &g_aClients[g_lCurrentClient];
+	LONG		lPacket;
+	LONG		lLastPacket;
 
 	// If this client just requested missing packets, ignore the request.
-	if ( gametic <= ( g_aClients[g_lCurrentClient].lLastPacketLossTick + ( TICRATE / 4 )))
+	if ( gametic <= ( pClient->lLastPacketLossTick + ( TICRATE / 4 )))
 	{
 		while ( NETWORK_ReadLong( pByteStream ) != -1 )
 			;
@@ -5139,6 +5721,9 @@ static bool server_MissingPacket( BYTESTREAM_s *pByteStream )
 		return ( false );
 	}
 
+	// The missing packets are sent together in as few datagrams as possible.
+	NETWORK_ClearBuffer( &g_PacketLossBuffer );
+
 	// Keep reading in packets until we hit -1.
 	lLastPacket = -1;
 	while (( lPacket = NETWORK_ReadLong( pByteStream )) != -1 )
@@ -5155,22 +5740,11 @@ static bool server_MissingPacket( BYTESTREAM_s *pByteStream )
 		}
 		lLastPacket = lPacket;
 
-		// Search through all PACKET_BUFFER_SIZE of the stored packets. We're looking for the packet that
-		// that we want to send to the client by matching the sequences. If we cannot find
-		// the packet, then we much send a full update to the client.
-		bFullUpdateRequired = true;
-		for ( ulIdx = 0; ulIdx < PACKET_BUFFER_SIZE; ulIdx++ )
-		{
-			if ( g_aClients[g_lCurrentClient].lPacketSequence[ulIdx] == lPacket )
-			{
-				bFullUpdateRequired = false;
-				break;
-			}
-		}
-
-		// We could not find the correct packet to resend to the client. We must send him
-		// a full update.
-		if  ( bFullUpdateRequired )
+		// Packet number lPacket can only be stored at one index. It's gone if a later packet
+		// took its place, or if the packets written after it overwrote its data.
+		const ULONG ulIdx = lPacket % PACKET_BUFFER_SIZE;
+		if (( pClient->lPacketSequence[ulIdx] != lPacket ) ||
+			(( pClient->qwSavedPacketBufferEnd - pClient->qwPacketBeginning[ulIdx] ) > pClient->SavedPacketBuffer.ulMaxSize ))
 		{
 			// Do we really need to print this? Nah.
 //			Printf( "*** Sequence screwed for client %d, %s!\n", g_lCurrentClient, players[g_lCurrentClient].userinfo.GetName() );
@@ -5178,24 +5752,36 @@ static bool server_MissingPacket( BYTESTREAM_s *pByteStream )
 			return ( true );
 		}
 
+		const ULONG ulSize = pClient->lPacketSize[ulIdx];
+
+		// If the packet doesn't fit into the current datagram anymore, send that first.
+		if (( g_PacketLossBuffer.ByteStream.pbStream != g_PacketLossBuffer.pbData ) &&
+			(( g_PacketLossBuffer.ByteStream.pbStream - g_PacketLossBuffer.pbData + 6 + ulSize ) > SERVER_GetMaxPacketSize( )))
+		{
+			NETWORK_LaunchPacket( &g_PacketLossBuffer, pClient->Address );
+			NETWORK_ClearBuffer( &g_PacketLossBuffer );
+		}
+
 		// Now that we've found the missed packet that we need to send to the client,
-		// send it.
-		NETWORK_ClearBuffer( &g_PacketLossBuffer );
-		NETWORK_WriteHeader( &g_PacketLossBuffer.ByteStream, SVC_HEADER );
+		// add it to the datagram.
+		if ( g_PacketLossBuffer.ByteStream.pbStream == g_PacketLossBuffer.pbData )
+			NETWORK_WriteHeader( &g_PacketLossBuffer.ByteStream, SVC_RETRANSMITTEDPACKETS );
 		NETWORK_WriteLong( &g_PacketLossBuffer.ByteStream, lPacket );
-		if ( g_aClients[g_lCurrentClient].lPacketSize[ulIdx] )
+		NETWORK_WriteShort( &g_PacketLossBuffer.ByteStream, ulSize );
+		if ( ulSize )
 		{
 			NETWORK_WriteBuffer( &g_PacketLossBuffer.ByteStream,
-				g_aClients[g_lCurrentClient].SavedPacketBuffer.pbData + g_aClients[g_lCurrentClient].lPacketBeginning[ulIdx],
-				g_aClients[g_lCurrentClient].lPacketSize[ulIdx] );
+				pClient->SavedPacketBuffer.pbData + ( pClient->qwPacketBeginning[ulIdx] % pClient->SavedPacketBuffer.ulMaxSize ),
+				ulSize );
 		}
-//		else
-//			Printf( "server_MissingPacket: WARNING! Packet %d has no size!\n", ulIdx );
-		NETWORK_LaunchPacket( &g_PacketLossBuffer, g_aClients[g_lCurrentClient].Address );
+		pClient->ulNumRetransmittedPackets++;
 	}
 
+	if ( g_PacketLossBuffer.ByteStream.pbStream != g_PacketLossBuffer.pbData )
+		NETWORK_LaunchPacket( &g_PacketLossBuffer, pClient->Address );
+
 	// Mark this client as having requested missing packets.
-	g_aClients[g_lCurrentClient].lLastPacketLossTick = gametic;
+	pClient->lLastPacketLossTick = gametic;
 
 	return ( false );
 }
@@ -5235,16 +5821,6 @@ static bool server_UpdateClientPing( BYTESTREAM_s *pByteStream )
 	return ( false );
 }
 
-//*****************************************************************************
-class ClientWeaponSelectCommand : public ClientCommand
-{
-	const USHORT usActorNetworkIndex;
-public:
-	ClientWeaponSelectCommand ( BYTESTREAM_s *pByteStream );
-
-	bool process ( const ULONG ulClient ) const;
-};
-
 //*****************************************************************************
 //
 static bool server_WeaponSelect( BYTESTREAM_s *pByteStream )
@@ -5252,14 +5828,17 @@ static bool server_WeaponSelect( BYTESTREAM_s *pByteStream )
 	// [BB] To keep weapon sync when buffering movement commands, the weapon 
 	// select commands also need to be stored in the same buffer the keep
 	// the proper order of the commands.
-	return server_ParseBufferedCommand<ClientWeaponSelectCommand> ( pByteStream );
-}
+	CLIENT_BUFFERED_COMMAND_s Command;
+	Command.Type = CLIENTCOMMAND_WEAPONSELECT;
 
-ClientWeaponSelectCommand::ClientWeaponSelectCommand ( BYTESTREAM_s *pByteStream )
 	// Read in the identification of the weapon the player is selecting.
-	: usActorNetworkIndex ( NETWORK_ReadShort( pByteStream ) ) { }
+	Command.usWeaponNetworkIndex = NETWORK_ReadShort( pByteStream );
+	return server_BufferCommand( Command );
+}
 
-bool ClientWeaponSelectCommand::process( const ULONG ulClient ) const
+//*****************************************************************************
+//
+static bool server_ProcessWeaponSelect( ULONG ulClient, USHORT usActorNetworkIndex )
 {
 	const PClass	*pType;
 	AInventory		*pInventory;
@@ -6814,3 +7393,115 @@ static void	server_LogPacket( BYTESTREAM_s *pByteStream, NETADDRESS_s Address, c
 	fflush (PacketLogFile);
 }
 #endif
+
+//*****************************************************************************
+//
+CCMD( fullupdatestats )
+{
+	if ( NETWORK_GetState( ) != NETSTATE_SERVER )
+		return;
+
+	for ( ULONG ulIdx = 0; ulIdx < MAXPLAYERS; ulIdx++ )
+	{
+		if (( SERVER_IsValidClient( ulIdx ) == false ) || ( g_aClients[ulIdx].PacedPacketSizes.Size( ) == 0 ))
+			continue;
+
+		const ULONG ulNumBytes = g_aClients[ulIdx].PacedPacketData.Size( );
+		Printf( "%s: %u of %u bytes sent (%.0f%%) in %d tics\n", players[ulIdx].userinfo.GetName(),
+			static_cast<unsigned int> ( g_aClients[ulIdx].ulNumPacedBytesSent ), static_cast<unsigned int> ( ulNumBytes ),
+			100.0 * g_aClients[ulIdx].ulNumPacedBytesSent / ulNumBytes, static_cast<int> ( gametic - g_aClients[ulIdx].lPacingStartTic ));
+	}
+
+	Printf( "Paced bursts: %u (sv_pacedbytespertic %d)\n", static_cast<unsigned int> ( g_ulNumPacedBursts ), *sv_pacedbytespertic );
+	if ( g_ulNumPacedBursts > 0 )
+	{
+		Printf( "Last burst: %u bytes in %d tics\n", static_cast<unsigned int> ( g_ulLastPacedBurstBytes ), static_cast<int> ( g_lLastPacedBurstTics ));
+		Printf( "Longest burst: %d tics\n", static_cast<int> ( g_lMaxPacedBurstTics ));
+	}
+}
+
+//*****************************************************************************
+//
+CCMD( ratestats )
+{
+	if ( NETWORK_GetState( ) != NETSTATE_SERVER )
+		return;
+
+	for ( ULONG ulIdx = 0; ulIdx < MAXPLAYERS; ulIdx++ )
+	{
+		if ( SERVER_IsValidClient( ulIdx ) == false )
+			continue;
+
+		const CLIENT_s *pClient = &g_aClients[ulIdx];
+		const ULONG ulRate = server_GetClientRate( ulIdx );
+
+		// The queue consists of the deferred position updates and the held back reliable packets.
+		ULONG ulQueueDepth = pClient->PacedPacketSizes.Size( ) - pClient->ulNumPacedPacketsSent;
+		for ( ULONG ulPlayer = 0; ulPlayer < MAXPLAYERS; ulPlayer++ )
+		{
+			if ( pClient->qwDeferredPlayerUpdates & ( static_cast<QWORD>( 1 ) << ulPlayer ))
+				ulQueueDepth++;
+		}
+
+		if ( ulRate > 0 )
+			Printf( "%s: rate %u, %d bytes left", players[ulIdx].userinfo.GetName(), static_cast<unsigned int> ( ulRate ), static_cast<int> ( pClient->lRateTokens ));
+		else
+			Printf( "%s: unlimited rate", players[ulIdx].userinfo.GetName() );
+
+		Printf( ", queue depth %u, %u updates deferred, %u dropped\n", static_cast<unsigned int> ( ulQueueDepth ),
+			static_cast<unsigned int> ( pClient->ulNumDeferredUpdates ), static_cast<unsigned int> ( pClient->ulNumDroppedUpdates ));
+	}
+}
+
+//*****************************************************************************
+//
+CCMD( commandbufferstats )
+{
+	if ( NETWORK_GetState( ) != NETSTATE_SERVER )
+		return;
+
+	Printf( "sv_useticbuffer is %s\n", sv_useticbuffer ? "on" : "off" );
+
+	for ( ULONG ulIdx = 0; ulIdx < MAXPLAYERS; ulIdx++ )
+	{
+		if ( SERVER_IsValidClient( ulIdx ) == false )
+			continue;
+
+		Printf( "%s: %u commands buffered (at most %u of %d), %u dropped\n", players[ulIdx].userinfo.GetName(),
+			static_cast<unsigned int> ( g_aClients[ulIdx].ulNumBufferedCommands ), static_cast<unsigned int> ( g_aClients[ulIdx].ulMaxBufferedCommands ),
+			MAX_BUFFERED_COMMANDS, static_cast<unsigned int> ( g_aClients[ulIdx].ulNumDroppedCommands ));
+	}
+}
+
+//*****************************************************************************
+//
+CCMD( retransmitstats )
+{
+	if ( NETWORK_GetState( ) != NETSTATE_SERVER )
+		return;
+
+	for ( ULONG ulIdx = 0; ulIdx < MAXPLAYERS; ulIdx++ )
+	{
+		if ( SERVER_IsValidClient( ulIdx ) == false )
+			continue;
+
+		const ULONG ulNumSent = g_aClients[ulIdx].ulPacketSequence;
+		const ULONG ulNumRetransmitted = g_aClients[ulIdx].ulNumRetransmittedPackets;
+
+		Printf( "%s: %u of %u reliable packets retransmitted (%.2f%%)\n", players[ulIdx].userinfo.GetName(),
+			static_cast<unsigned int> ( ulNumRetransmitted ), static_cast<unsigned int> ( ulNumSent ),
+			( ulNumSent > 0 ) ? ( 100.0 * ulNumRetransmitted / ulNumSent ) : 0.0 );
+	}
+}
+
+//*****************************************************************************
+//
+CCMD( ticjitter )
+{
+	if ( NETWORK_GetState( ) != NETSTATE_SERVER )
+		return;
+
+	Printf( "Main loop: %s\n", ( sv_eventdrivenloop && NETWORK_WaitForInput( 0 )) ? "event-driven" : "sleep polling" );
+	Printf( "Tic start jitter during the last second: %.2f ms average, %.2f ms max\n", g_lAverageTicJitterLastSecond / 1000.0, g_lMaxTicJitterLastSecond / 1000.0 );
+	Printf( "Highest tic start jitter so far: %.2f ms\n", g_lMaxTicJitter / 1000.0 );
+}
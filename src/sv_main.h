@@ -53,6 +53,7 @@
 
 #include "actor.h"
 #include "d_player.h"
+#include "huffman.h"
 #include "i_net.h"
 #include "networkshared.h"
 #include "s_sndseq.h"
@@ -72,6 +73,10 @@
 // Maximum amount of user info change instance times we store.
 #define	MAX_USERINFOINSTANCE_STORAGE	4
 
+// Maximum amount of commands we buffer for a client (see sv_useticbuffer). If more arrive,
+// the oldest ones are dropped.
+#define	MAX_BUFFERED_COMMANDS		128
+
 // Number of seconds before a client times out.
 #define CLIENT_TIMEOUT				40
 
@@ -177,6 +182,29 @@ typedef struct
 
 } STORED_QUERY_IP_s;
 
+//*****************************************************************************
+// Packs an IP address and its port into one integer, so that it can be used as a TMap key.
+inline QWORD SERVER_GetAddressKey( const NETADDRESS_s &Address )
+{
+	return (( static_cast<QWORD>( Address.abIP[0] ) << 40 ) | ( static_cast<QWORD>( Address.abIP[1] ) << 32 )
+		| ( static_cast<QWORD>( Address.abIP[2] ) << 24 ) | ( static_cast<QWORD>( Address.abIP[3] ) << 16 ) | Address.usPort );
+}
+
+//*****************************************************************************
+// Hash traits for TMaps keyed by SERVER_GetAddressKey. TMap only uses the lowest bits of
+// the hash, so all parts of the address are mixed into them.
+struct AddressKeyHashTraits
+{
+	hash_t Hash( const QWORD key )
+	{
+		hash_t hash = static_cast<hash_t>( key ^ ( key >> 32 ));
+		hash = ( hash ^ ( hash >> 16 )) * 0x45d9f3b;
+		return ( hash ^ ( hash >> 16 ));
+	}
+
+	int Compare( const QWORD left, const QWORD right ) { return left != right; }
+};
+
 //*****************************************************************************
 struct CLIENT_MOVE_COMMAND_s
 {
@@ -195,19 +223,69 @@ struct CLIENT_MOVE_COMMAND_s
 };
 
 //*****************************************************************************
-class ClientCommand
+// Replies to launcher queries prepared by the game thread, so that they can be sent without
+// touching the game state (e.g. from the ingress thread). The time the launcher sent is patched
+// into the replies when they are written.
+class ServerInfoSnapshot
 {
+	typedef struct
+	{
+		// The addresses in Bans are banned, unless they are in Exemptions.
+		IPMatcher			Bans;
+		IPMatcher			Exemptions;
+
+		// The revisions of the IPLists these were copied from.
+		unsigned int		uiBansRevision;
+		unsigned int		uiExemptionsRevision;
+
+	} BANLIST_t;
+
+	// The flags each reply answers and where the reply is stored in _Data.
+	TArray<ULONG>			_Flags;
+	TArray<unsigned int>	_Offsets;
+	TArray<unsigned int>	_Sizes;
+	TArray<BYTE>			_Data;
+
+	std::vector<BANLIST_t>	_BanLists;
+
+//*************************************************************************
 public:
-	ClientCommand () {};
+	void	clearReplies( void );
+	void	copyReplies( const ServerInfoSnapshot &Other );
+	void	addReply( ULONG ulFlags, const BYTE *pbReply, unsigned int uiNumBytes );
+	void	clearBanLists( void );
+	void	copyBanLists( const ServerInfoSnapshot &Other );
+	void	swapBanLists( ServerInfoSnapshot &Other );
+	void	addBanList( const IPList &Bans, const IPList &Exemptions );
+	bool	isBanListCurrent( unsigned int uiIndex, const IPList &Bans, const IPList &Exemptions ) const;
+	bool	haveSameBanLists( const ServerInfoSnapshot &Other ) const;
+	unsigned int	getNumBanLists( void ) const { return static_cast<unsigned int>( _BanLists.size( )); }
+	bool	isIPBanned( const NETADDRESS_s &Address ) const;
+	bool	writeReply( ULONG ulFlags, ULONG ulTime, BYTE *pbReply, LONG &lNumBytes ) const;
+};
 
-	virtual ~ClientCommand () {};
+//*****************************************************************************
+// The commands that are buffered to be executed in the order they were received in, see
+// sv_useticbuffer.
+enum CLIENTCOMMAND_e
+{
+	CLIENTCOMMAND_MOVE,
+	CLIENTCOMMAND_WEAPONSELECT,
+};
 
-	virtual bool process ( const ULONG ulClient ) const = 0;
+//*****************************************************************************
+struct CLIENT_BUFFERED_COMMAND_s
+{
+	CLIENTCOMMAND_e		Type;
 
-	virtual bool isMoveCmd ( ) const
+	union
 	{
-		return false;
-	}
+		// CLIENTCOMMAND_MOVE
+		CLIENT_MOVE_COMMAND_s	MoveCmd;
+
+		// CLIENTCOMMAND_WEAPONSELECT
+		USHORT					usWeaponNetworkIndex;
+	};
 };
 
 //*****************************************************************************
@@ -229,15 +307,50 @@ typedef struct
 	// retransmit them if necessary.
 	NETBUFFER_s		SavedPacketBuffer;
 
-	// This is the position of each saved packet within SavedPacketBuffer.
-	LONG			lPacketBeginning[PACKET_BUFFER_SIZE];
+	// Number of bytes written to SavedPacketBuffer since the client connected, including the
+	// bytes that were skipped at its end when the writing wrapped around to its beginning.
+	QWORD			qwSavedPacketBufferEnd;
+
+	// This is the position of each saved packet, counted like qwSavedPacketBufferEnd. The packet
+	// was overwritten if more than the size of SavedPacketBuffer was written after it.
+	QWORD			qwPacketBeginning[PACKET_BUFFER_SIZE];
 
 	// This is the packet size for each of the PACKET_BUFFER_SIZE stored packets.
 	LONG			lPacketSize[PACKET_BUFFER_SIZE];
 
-	// This is the packet sequence for each of the PACKET_BUFFER_SIZE stored packets.
+	// This is the packet sequence for each of the PACKET_BUFFER_SIZE stored packets. Packet
+	// number ulSequence is stored at index ulSequence % PACKET_BUFFER_SIZE, -1 if that's empty.
 	LONG			lPacketSequence[PACKET_BUFFER_SIZE];
 
+	// How many reliable packets had to be sent again since the client connected.
+	ULONG			ulNumRetransmittedPackets;
+
+	// Reliable packets that didn't fit into sv_pacedbytespertic, e.g. the burst of a full update.
+	// They are sent in order on the next tics, see server_SendPacedPackets.
+	TArray<BYTE>	PacedPacketData;
+	TArray<ULONG>	PacedPacketSizes;
+	ULONG			ulNumPacedPacketsSent;
+	ULONG			ulNumPacedBytesSent;
+
+	// The tic the first of the current paced packets was queued.
+	LONG			lPacingStartTic;
+
+	// Size of the reliable packets sent to the client in this tic.
+	ULONG			ulReliableBytesThisTic;
+
+	// Bytes the client's rate still allows us to send, see server_RefillRateTokens. Reliable
+	// packets are always sent and may take this below zero.
+	LONG			lRateTokens;
+
+	// Players whose position update to this client didn't fit into the rate. They go first
+	// on the next tic.
+	QWORD			qwDeferredPlayerUpdates;
+
+	// How many position updates were held back for a later tic and how many unreliable packets
+	// were dropped since the client connected.
+	ULONG			ulNumDeferredUpdates;
+	ULONG			ulNumDroppedUpdates;
+
 	// Last packet number sent to this client.
 	ULONG			ulPacketSequence;
 
@@ -328,7 +441,20 @@ typedef struct
 	LONG			lLastActionTic;
 
 	// [BB] Buffer storing all movement commands received from the client we haven't executed yet.
-	TArray<ClientCommand*>	MoveCMDs;
+	// It's a ring buffer, the oldest command is at index ulFirstBufferedCommand.
+	CLIENT_BUFFERED_COMMAND_s	BufferedCommands[MAX_BUFFERED_COMMANDS];
+	ULONG			ulFirstBufferedCommand;
+	ULONG			ulNumBufferedCommands;
+
+	// The most commands that were buffered at once and how many commands had to be dropped
+	// because the buffer was full, since the client connected.
+	ULONG			ulMaxBufferedCommands;
+	ULONG			ulNumDroppedCommands;
+
+	// Parts of PacketBuffer and UnreliablePacketBuffer that are copies of the broadcast segment
+	// of this tic. Their Huffman codes are shared with the other clients that received them.
+	TArray<HuffmanSegmentRun>	PacketBufferRuns;
+	TArray<HuffmanSegmentRun>	UnreliablePacketBufferRuns;
 
 	// [BB] Variables for the account system
 	FString username;
@@ -396,6 +522,8 @@ void		SERVER_Tick( void );
 void		SERVER_SendOutPackets( void );
 void		SERVER_SendClientPacket( ULONG ulClient, bool bReliable );
 void		SERVER_CheckClientBuffer( ULONG ulClient, ULONG ulSize, bool bReliable );
+LONG		SERVER_AddToBroadcastSegment( const BYTE *pbData, ULONG ulSize );
+void		SERVER_MarkBroadcastRun( ULONG ulClient, bool bReliable, LONG lSegmentOffset, ULONG ulSize );
 LONG		SERVER_FindFreeClientSlot( void );
 LONG		SERVER_FindClientByAddress( NETADDRESS_s Address );
 CLIENT_s	*SERVER_GetClient( ULONG ulIdx );
@@ -478,6 +606,7 @@ void		SERVER_MASTER_Destruct( void );
 void		SERVER_MASTER_Tick( void );
 void		SERVER_MASTER_Broadcast( void );
 void		SERVER_MASTER_SendServerInfo( NETADDRESS_s Address, ULONG ulFlags, ULONG ulTime, bool bBroadcasting );
+void		SERVER_MASTER_InvalidateServerInfo( void );
 const char	*SERVER_MASTER_GetGameName( void );
 NETADDRESS_s SERVER_MASTER_GetMasterAddress( void );
 void		SERVER_MASTER_HandleVerificationRequest( BYTESTREAM_s *pByteStream );
@@ -91,10 +91,29 @@ static	LONG				g_lStoredQueryIPHead;
 static	LONG				g_lStoredQueryIPTail;
 static	TArray<int>			g_OptionalWadIndices;
 
+// Prepared replies for the flag sets launchers have asked for, so that they don't have to be
+// written for every query. They are rebuilt at least once a second while launchers are querying us.
+static	ServerInfoSnapshot	g_ServerInfoSnapshot;
+static	TArray<ULONG>		g_ServerInfoFlagSets;
+static	bool				g_bServerInfoSnapshotValid = false;
+static	LONG				g_lServerInfoSnapshotExpiration = 0;
+
+// Replies are only prepared for this many different flag sets.
+static	const unsigned int	MAX_SERVERINFO_FLAG_SETS = 16;
+
+// Gametic of the last launcher query (that wasn't ignored).
+static	LONG				g_lLastLauncherQueryTic = 0;
+
 extern	NETADDRESS_s		g_LocalAddress;
 
 FString g_VersionWithOS;
 
+//*****************************************************************************
+//	PROTOTYPES
+
+static	void	server_master_WriteServerInfo( BYTESTREAM_s *pByteStream, ULONG ulFlags, ULONG ulTime );
+static	void	server_master_UpdateServerInfoSnapshot( void );
+
 //*****************************************************************************
 //	CONSOLE VARIABLES
 
@@ -164,6 +183,8 @@ void SERVER_MASTER_Tick( void )
 		g_lStoredQueryIPHead = g_lStoredQueryIPHead % MAX_STORED_QUERY_IPS;
 	}
 
+	server_master_UpdateServerInfoSnapshot( );
+
 	// Send an update to the master server every 30 seconds.
 	if ( gametic % ( TICRATE * 30 ))
 		return;
@@ -263,10 +284,8 @@ void SERVER_MASTER_Broadcast( void )
 //
 void SERVER_MASTER_SendServerInfo( NETADDRESS_s Address, ULONG ulFlags, ULONG ulTime, bool bBroadcasting )
 {
-	UCVarValue	Val;
 	char		szAddress[4][4];
 	ULONG		ulIdx;
-	ULONG		ulBits;
 
 	// Let's just use the master server buffer! It gets cleared again when we need it anyway!
 	NETWORK_ClearBuffer( &g_MasterServerBuffer );
@@ -334,16 +353,58 @@ void SERVER_MASTER_SendServerInfo( NETADDRESS_s Address, ULONG ulFlags, ULONG ul
 		g_lStoredQueryIPTail = g_lStoredQueryIPTail % MAX_STORED_QUERY_IPS;
 		if ( g_lStoredQueryIPTail == g_lStoredQueryIPHead )
 			Printf( "SERVER_MASTER_SendServerInfo: WARNING! g_lStoredQueryIPTail == g_lStoredQueryIPHead\n" );
+
+		g_lLastLauncherQueryTic = gametic;
+	}
+
+	// Most of the time, the reply was already prepared.
+	const ULONG ulRequestedFlags = ulFlags & SQF_ALL;
+	LONG lNumBytes = g_MasterServerBuffer.ulMaxSize;
+	if ( g_bServerInfoSnapshotValid && g_ServerInfoSnapshot.writeReply( ulRequestedFlags, ulTime, g_MasterServerBuffer.pbData, lNumBytes ))
+	{
+		g_MasterServerBuffer.ByteStream.pbStream = g_MasterServerBuffer.pbData + lNumBytes;
+	}
+	else
+	{
+		// Either the reply wasn't prepared yet or it doesn't fit, so write it from scratch.
+		NETWORK_ClearBuffer( &g_MasterServerBuffer );
+		server_master_WriteServerInfo( &g_MasterServerBuffer.ByteStream, ulFlags, ulTime );
+
+		// Prepare the reply to these flags from now on.
+		for ( ulIdx = 0; ulIdx < g_ServerInfoFlagSets.Size( ); ulIdx++ )
+		{
+			if ( g_ServerInfoFlagSets[ulIdx] == ulRequestedFlags )
+				break;
+		}
+
+		if (( ulIdx == g_ServerInfoFlagSets.Size( )) && ( ulIdx < MAX_SERVERINFO_FLAG_SETS ))
+		{
+			g_ServerInfoFlagSets.Push( ulRequestedFlags );
+			g_lServerInfoSnapshotExpiration = gametic;
+		}
 	}
 
+//	NETWORK_LaunchPacket( &g_MasterServerBuffer, Address, true );
+	NETWORK_LaunchPacket( &g_MasterServerBuffer, Address );
+}
+
+//*****************************************************************************
+//
+// Writes the reply to a launcher query for ulFlags.
+static void server_master_WriteServerInfo( BYTESTREAM_s *pByteStream, ULONG ulFlags, ULONG ulTime )
+{
+	UCVarValue	Val;
+	ULONG		ulIdx;
+	ULONG		ulBits;
+
 	// Write our header.
-	NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, SERVER_LAUNCHER_CHALLENGE );
+	NETWORK_WriteLong( pByteStream, SERVER_LAUNCHER_CHALLENGE );
 
 	// Send the time the launcher sent to us.
-	NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, ulTime );
+	NETWORK_WriteLong( pByteStream, ulTime );
 
 	// Send our version. [K6] ...with OS
-	NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, g_VersionWithOS.GetChars() );
+	NETWORK_WriteString( pByteStream, g_VersionWithOS.GetChars() );
 
 	// Send the information about the data that will be sent.
 	ulBits = ulFlags;
@@ -392,83 +453,83 @@ void SERVER_MASTER_SendServerInfo( NETADDRESS_s Address, ULONG ulFlags, ULONG ul
 	if ( D_GetDehFileNames().Size() == 0 )
 		ulBits &= ~SQF_DEH;
 
-	NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, ulBits );
+	NETWORK_WriteLong( pByteStream, ulBits );
 
 	// Send the server name.
 	if ( ulBits & SQF_NAME )
 	{
 		Val = sv_hostname.GetGenericRep( CVAR_String );
-		NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, Val.String );
+		NETWORK_WriteString( pByteStream, Val.String );
 	}
 
 	// Send the website URL.
 	if ( ulBits & SQF_URL )
 	{
 		Val = sv_website.GetGenericRep( CVAR_String );
-		NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, Val.String );
+		NETWORK_WriteString( pByteStream, Val.String );
 	}
 
 	// Send the host's e-mail address.
 	if ( ulBits & SQF_EMAIL )
 	{
 		Val = sv_hostemail.GetGenericRep( CVAR_String );
-		NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, Val.String );
+		NETWORK_WriteString( pByteStream, Val.String );
 	}
 
 	if ( ulBits & SQF_MAPNAME )
-		NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, level.mapname );
+		NETWORK_WriteString( pByteStream, level.mapname );
 
 	if ( ulBits & SQF_MAXCLIENTS )
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, sv_maxclients );
+		NETWORK_WriteByte( pByteStream, sv_maxclients );
 
 	if ( ulBits & SQF_MAXPLAYERS )
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, sv_maxplayers );
+		NETWORK_WriteByte( pByteStream, sv_maxplayers );
 
 	// Send out the PWAD information.
 	if ( ulBits & SQF_PWADS )
 	{
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, NETWORK_GetPWADList().Size( ));
+		NETWORK_WriteByte( pByteStream, NETWORK_GetPWADList().Size( ));
 
 		for ( unsigned i = 0; i < NETWORK_GetPWADList().Size(); ++i )
-			NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, NETWORK_GetPWADList()[i].name );
+			NETWORK_WriteString( pByteStream, NETWORK_GetPWADList()[i].name );
 	}
 
 	if ( ulBits & SQF_GAMETYPE )
 	{
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, GAMEMODE_GetCurrentMode( ));
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, instagib );
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, buckshot );
+		NETWORK_WriteByte( pByteStream, GAMEMODE_GetCurrentMode( ));
+		NETWORK_WriteByte( pByteStream, instagib );
+		NETWORK_WriteByte( pByteStream, buckshot );
 	}
 
 	if ( ulBits & SQF_GAMENAME )
-		NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, SERVER_MASTER_GetGameName( ));
+		NETWORK_WriteString( pByteStream, SERVER_MASTER_GetGameName( ));
 
 	if ( ulBits & SQF_IWAD )
-		NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, NETWORK_GetIWAD( ));
+		NETWORK_WriteString( pByteStream, NETWORK_GetIWAD( ));
 
 	if ( ulBits & SQF_FORCEPASSWORD )
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, sv_forcepassword );
+		NETWORK_WriteByte( pByteStream, sv_forcepassword );
 
 	if ( ulBits & SQF_FORCEJOINPASSWORD )
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, sv_forcejoinpassword );
+		NETWORK_WriteByte( pByteStream, sv_forcejoinpassword );
 
 	if ( ulBits & SQF_GAMESKILL )
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, gameskill );
+		NETWORK_WriteByte( pByteStream, gameskill );
 
 	if ( ulBits & SQF_BOTSKILL )
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, botskill );
+		NETWORK_WriteByte( pByteStream, botskill );
 
 	if ( ulBits & SQF_DMFLAGS )
 	{
-		NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, dmflags );
-		NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, dmflags2 );
-		NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, compatflags );
+		NETWORK_WriteLong( pByteStream, dmflags );
+		NETWORK_WriteLong( pByteStream, dmflags2 );
+		NETWORK_WriteLong( pByteStream, compatflags );
 	}
 
 	if ( ulBits & SQF_LIMITS )
 	{
-		NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, fraglimit );
-		NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, static_cast<SHORT>(timelimit) );
+		NETWORK_WriteShort( pByteStream, fraglimit );
+		NETWORK_WriteShort( pByteStream, static_cast<SHORT>(timelimit) );
 		// [BB] We have to base the decision on whether to send "time left" on the same rounded
 		// timelimit value we just sent to the client.
 		if ( static_cast<SHORT>(timelimit) )
@@ -478,18 +539,18 @@ void SERVER_MASTER_SendServerInfo( NETADDRESS_s Address, ULONG ulFlags, ULONG ul
 			lTimeLeft = (LONG)( timelimit - ( level.time / ( TICRATE * 60 )));
 			if ( lTimeLeft < 0 )
 				lTimeLeft = 0;
-			NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, lTimeLeft );
+			NETWORK_WriteShort( pByteStream, lTimeLeft );
 		}
-		NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, duellimit );
-		NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, pointlimit );
-		NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, winlimit );
+		NETWORK_WriteShort( pByteStream, duellimit );
+		NETWORK_WriteShort( pByteStream, pointlimit );
+		NETWORK_WriteShort( pByteStream, winlimit );
 	}
 
 	// Send the team damage scale.
 	if ( teamplay || teamgame || teamlms || teampossession || (( deathmatch == false ) && ( teamgame == false )))
 	{
 		if ( ulBits & SQF_TEAMDAMAGE )
-			NETWORK_WriteFloat( &g_MasterServerBuffer.ByteStream, teamdamage );
+			NETWORK_WriteFloat( pByteStream, teamdamage );
 	}
 
 	if ( GAMEMODE_GetFlags( GAMEMODE_GetCurrentMode( )) & GMF_PLAYERSONTEAMS )
@@ -501,17 +562,17 @@ void SERVER_MASTER_SendServerInfo( NETADDRESS_s Address, ULONG ulFlags, ULONG ul
 			for ( ulIdx = 0; ulIdx < 2; ulIdx++ )
 			{
 				if ( GAMEMODE_GetFlags(GAMEMODE_GetCurrentMode()) & GMF_PLAYERSEARNFRAGS )
-					NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, TEAM_GetFragCount( ulIdx ));
+					NETWORK_WriteShort( pByteStream, TEAM_GetFragCount( ulIdx ));
 				else if ( GAMEMODE_GetFlags(GAMEMODE_GetCurrentMode()) & GMF_PLAYERSEARNWINS )
-					NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, TEAM_GetWinCount( ulIdx ));
+					NETWORK_WriteShort( pByteStream, TEAM_GetWinCount( ulIdx ));
 				else
-					NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, TEAM_GetScore( ulIdx ));
+					NETWORK_WriteShort( pByteStream, TEAM_GetScore( ulIdx ));
 			}
 		}
 	}
 
 	if ( ulBits & SQF_NUMPLAYERS )
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, SERVER_CalcNumPlayers( ));
+		NETWORK_WriteByte( pByteStream, SERVER_CalcNumPlayers( ));
 
 	if ( ulBits & SQF_PLAYERDATA )
 	{
@@ -520,55 +581,55 @@ void SERVER_MASTER_SendServerInfo( NETADDRESS_s Address, ULONG ulFlags, ULONG ul
 			if ( playeringame[ulIdx] == false )
 				continue;
 
-			NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, players[ulIdx].userinfo.GetName() );
+			NETWORK_WriteString( pByteStream, players[ulIdx].userinfo.GetName() );
 			if ( GAMEMODE_GetFlags(GAMEMODE_GetCurrentMode()) & GMF_PLAYERSEARNPOINTS )
-				NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, players[ulIdx].lPointCount );
+				NETWORK_WriteShort( pByteStream, players[ulIdx].lPointCount );
 			else if ( GAMEMODE_GetFlags(GAMEMODE_GetCurrentMode()) & GMF_PLAYERSEARNWINS )
-				NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, players[ulIdx].ulWins );
+				NETWORK_WriteShort( pByteStream, players[ulIdx].ulWins );
 			else if ( GAMEMODE_GetFlags(GAMEMODE_GetCurrentMode()) & GMF_PLAYERSEARNFRAGS )
-				NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, players[ulIdx].fragcount );
+				NETWORK_WriteShort( pByteStream, players[ulIdx].fragcount );
 			else
-				NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, players[ulIdx].killcount );
+				NETWORK_WriteShort( pByteStream, players[ulIdx].killcount );
 
-			NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, players[ulIdx].ulPing );
-			NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, PLAYER_IsTrueSpectator( &players[ulIdx] ));
-			NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, players[ulIdx].bIsBot );
+			NETWORK_WriteShort( pByteStream, players[ulIdx].ulPing );
+			NETWORK_WriteByte( pByteStream, PLAYER_IsTrueSpectator( &players[ulIdx] ));
+			NETWORK_WriteByte( pByteStream, players[ulIdx].bIsBot );
 
 			if ( GAMEMODE_GetFlags( GAMEMODE_GetCurrentMode( )) & GMF_PLAYERSONTEAMS )
 			{
 				if ( players[ulIdx].bOnTeam == false )
-					NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, 255 );
+					NETWORK_WriteByte( pByteStream, 255 );
 				else
-					NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, players[ulIdx].ulTeam );
+					NETWORK_WriteByte( pByteStream, players[ulIdx].ulTeam );
 			}
 
-			NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, players[ulIdx].ulTime / ( TICRATE * 60 ));
+			NETWORK_WriteByte( pByteStream, players[ulIdx].ulTime / ( TICRATE * 60 ));
 		}
 	}
 
 	if ( GAMEMODE_GetFlags( GAMEMODE_GetCurrentMode( )) & GMF_PLAYERSONTEAMS )
 	{
 		if ( ulBits & SQF_TEAMINFO_NUMBER )
-			NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, TEAM_GetNumAvailableTeams( ));
+			NETWORK_WriteByte( pByteStream, TEAM_GetNumAvailableTeams( ));
 
 		if ( ulBits & SQF_TEAMINFO_NAME )
 			for ( ulIdx = 0; ulIdx < TEAM_GetNumAvailableTeams( ); ulIdx++ )
-				NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, TEAM_GetName( ulIdx ));
+				NETWORK_WriteString( pByteStream, TEAM_GetName( ulIdx ));
 
 		if ( ulBits & SQF_TEAMINFO_COLOR )
 			for ( ulIdx = 0; ulIdx < TEAM_GetNumAvailableTeams( ); ulIdx++ )
-				NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, TEAM_GetColor( ulIdx ));
+				NETWORK_WriteLong( pByteStream, TEAM_GetColor( ulIdx ));
 
 		if ( ulBits & SQF_TEAMINFO_SCORE )
 		{
 			for ( ulIdx = 0; ulIdx < TEAM_GetNumAvailableTeams( ); ulIdx++ )
 			{
 				if ( GAMEMODE_GetFlags(GAMEMODE_GetCurrentMode()) & GMF_PLAYERSEARNFRAGS )
-					NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, TEAM_GetFragCount( ulIdx ));
+					NETWORK_WriteShort( pByteStream, TEAM_GetFragCount( ulIdx ));
 				else if ( GAMEMODE_GetFlags(GAMEMODE_GetCurrentMode()) & GMF_PLAYERSEARNWINS )
-					NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, TEAM_GetWinCount( ulIdx ));
+					NETWORK_WriteShort( pByteStream, TEAM_GetWinCount( ulIdx ));
 				else
-					NETWORK_WriteShort( &g_MasterServerBuffer.ByteStream, TEAM_GetScore( ulIdx ));
+					NETWORK_WriteShort( pByteStream, TEAM_GetScore( ulIdx ));
 			}
 		}
 	}
@@ -577,57 +638,103 @@ void SERVER_MASTER_SendServerInfo( NETADDRESS_s Address, ULONG ulFlags, ULONG ul
 	if ( ulBits & SQF_TESTING_SERVER )
 	{
 #if ( BUILD_ID == BUILD_RELEASE )
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, 0 );
-		NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, "" );
+		NETWORK_WriteByte( pByteStream, 0 );
+		NETWORK_WriteString( pByteStream, "" );
 #else
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, 1 );
+		NETWORK_WriteByte( pByteStream, 1 );
 		// [BB] Name of the testing binary archive found in http://zandronum.com/
 		FString testingBinary;
 		testingBinary.Format ( "downloads/testing/%s/ZandroDev%s-%swindows.zip", GAMEVER_STRING, GAMEVER_STRING, GetGitTime() );
-		NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, testingBinary.GetChars() );
+		NETWORK_WriteString( pByteStream, testingBinary.GetChars() );
 #endif
 	}
 
 	// [BB] We don't have a mandatory main data file anymore, so just send an empty string.
 	if ( ulBits & SQF_DATA_MD5SUM )
-		NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, "" );
+		NETWORK_WriteString( pByteStream, "" );
 
 	// [BB] Send all dmflags and compatflags.
 	if ( ulBits & SQF_ALL_DMFLAGS )
 	{
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, 5 );
-		NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, dmflags );
-		NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, dmflags2 );
-		NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, zadmflags );
-		NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, compatflags );
-		NETWORK_WriteLong( &g_MasterServerBuffer.ByteStream, zacompatflags );
+		NETWORK_WriteByte( pByteStream, 5 );
+		NETWORK_WriteLong( pByteStream, dmflags );
+		NETWORK_WriteLong( pByteStream, dmflags2 );
+		NETWORK_WriteLong( pByteStream, zadmflags );
+		NETWORK_WriteLong( pByteStream, compatflags );
+		NETWORK_WriteLong( pByteStream, zacompatflags );
 	}
 
 	// [BB] Send special security settings like sv_enforcemasterbanlist.
 	if ( ulBits & SQF_SECURITY_SETTINGS )
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, sv_enforcemasterbanlist );
+		NETWORK_WriteByte( pByteStream, sv_enforcemasterbanlist );
 
 	// [TP] Send optional wad indices.
 	if ( ulBits & SQF_OPTIONAL_WADS )
 	{
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, g_OptionalWadIndices.Size() );
+		NETWORK_WriteByte( pByteStream, g_OptionalWadIndices.Size() );
 
 		for ( unsigned i = 0; i < g_OptionalWadIndices.Size(); ++i )
-			NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, g_OptionalWadIndices[i] );
+			NETWORK_WriteByte( pByteStream, g_OptionalWadIndices[i] );
 	}
 
 	// [TP] Send deh patches
 	if ( ulBits & SQF_DEH )
 	{
 		const TArray<FString>& names = D_GetDehFileNames();
-		NETWORK_WriteByte( &g_MasterServerBuffer.ByteStream, names.Size() );
+		NETWORK_WriteByte( pByteStream, names.Size() );
 
 		for ( unsigned i = 0; i < names.Size(); ++i )
-			NETWORK_WriteString( &g_MasterServerBuffer.ByteStream, names[i] );
+			NETWORK_WriteString( pByteStream, names[i] );
 	}
+}
 
-//	NETWORK_LaunchPacket( &g_MasterServerBuffer, Address, true );
-	NETWORK_LaunchPacket( &g_MasterServerBuffer, Address );
+//*****************************************************************************
+//
+// Prepares the replies to the flag sets launchers have asked for and hands them to the network
+// module, so that launcher queries can be answered without the game thread.
+static void server_master_UpdateServerInfoSnapshot( void )
+{
+	if ( g_bServerInfoSnapshotValid && ( gametic < g_lServerInfoSnapshotExpiration ))
+		return;
+
+	if ( NETWORK_WasServerInfoSnapshotUsed( ))
+		g_lLastLauncherQueryTic = gametic;
+
+	// Nobody is interested, so don't waste time on keeping the replies up to date.
+	if (( gametic - g_lLastLauncherQueryTic ) > ( 10 * TICRATE ))
+	{
+		if ( g_bServerInfoSnapshotValid )
+			SERVER_MASTER_InvalidateServerInfo( );
+		return;
+	}
+
+	g_ServerInfoSnapshot.clearReplies( );
+	SERVERBAN_UpdateServerInfoSnapshot( g_ServerInfoSnapshot );
+
+	for ( unsigned int i = 0; i < g_ServerInfoFlagSets.Size( ); i++ )
+	{
+		NETWORK_ClearBuffer( &g_MasterServerBuffer );
+		server_master_WriteServerInfo( &g_MasterServerBuffer.ByteStream, g_ServerInfoFlagSets[i], 0 );
+		g_ServerInfoSnapshot.addReply( g_ServerInfoFlagSets[i], g_MasterServerBuffer.pbData, NETWORK_CalcBufferSize( &g_MasterServerBuffer ));
+	}
+
+	// Pings and the time left change all the time, so the replies are only good for a second.
+	g_bServerInfoSnapshotValid = true;
+	g_lServerInfoSnapshotExpiration = gametic + TICRATE;
+	NETWORK_PublishServerInfoSnapshot( &g_ServerInfoSnapshot );
+}
+
+//*****************************************************************************
+//
+// Throws the prepared launcher replies away. Needs to be called when the players, their scores or
+// the map change. The replies are prepared again during the next tic.
+void SERVER_MASTER_InvalidateServerInfo( void )
+{
+	if ( g_bServerInfoSnapshotValid == false )
+		return;
+
+	g_bServerInfoSnapshotValid = false;
+	NETWORK_PublishServerInfoSnapshot( NULL );
 }
 
 //*****************************************************************************
@@ -692,6 +799,198 @@ void SERVER_MASTER_SendBanlistReceipt ( void )
 	NETWORK_LaunchPacket( &g_MasterServerBuffer, SERVER_MASTER_GetMasterAddress () );
 }
 
+//=============================================================================
+// ServerInfoSnapshot
+//=============================================================================
+
+//=============================================================================
+//
+// clearReplies
+//
+// Removes all replies. The ban lists are kept.
+//
+//=============================================================================
+
+void ServerInfoSnapshot::clearReplies( void )
+{
+	_Flags.Clear( );
+	_Offsets.Clear( );
+	_Sizes.Clear( );
+	_Data.Clear( );
+}
+
+//=============================================================================
+//
+// copyReplies
+//
+//=============================================================================
+
+void ServerInfoSnapshot::copyReplies( const ServerInfoSnapshot &Other )
+{
+	_Flags = Other._Flags;
+	_Offsets = Other._Offsets;
+	_Sizes = Other._Sizes;
+	_Data = Other._Data;
+}
+
+//=============================================================================
+//
+// addReply
+//
+// Stores the reply to a query for ulFlags (SQF_* flags the launcher sent, without unknown ones).
+//
+//=============================================================================
+
+void ServerInfoSnapshot::addReply( ULONG ulFlags, const BYTE *pbReply, unsigned int uiNumBytes )
+{
+	_Flags.Push( ulFlags );
+	_Offsets.Push( _Data.Size( ));
+	_Sizes.Push( uiNumBytes );
+
+	const unsigned int uiOffset = _Data.Size( );
+	_Data.Resize( uiOffset + uiNumBytes );
+	memcpy( &_Data[uiOffset], pbReply, uiNumBytes );
+}
+
+//=============================================================================
+//
+// addBanList
+//
+// Stores a copy of a ban list. The addresses in Bans are banned, unless they are in Exemptions.
+//
+//=============================================================================
+
+void ServerInfoSnapshot::addBanList( const IPList &Bans, const IPList &Exemptions )
+{
+	_BanLists.resize( _BanLists.size( ) + 1 );
+	_BanLists.back( ).Bans = Bans.getMatcher( );
+	_BanLists.back( ).Exemptions = Exemptions.getMatcher( );
+	_BanLists.back( ).uiBansRevision = Bans.getRevision( );
+	_BanLists.back( ).uiExemptionsRevision = Exemptions.getRevision( );
+}
+
+//=============================================================================
+//
+// clearBanLists
+//
+//=============================================================================
+
+void ServerInfoSnapshot::clearBanLists( void )
+{
+	_BanLists.clear( );
+}
+
+//=============================================================================
+//
+// copyBanLists
+//
+//=============================================================================
+
+void ServerInfoSnapshot::copyBanLists( const ServerInfoSnapshot &Other )
+{
+	_BanLists = Other._BanLists;
+}
+
+//=============================================================================
+//
+// swapBanLists
+//
+// Exchanges the ban lists of the two snapshots without copying them.
+//
+//=============================================================================
+
+void ServerInfoSnapshot::swapBanLists( ServerInfoSnapshot &Other )
+{
+	_BanLists.swap( Other._BanLists );
+}
+
+//=============================================================================
+//
+// isBanListCurrent
+//
+// Returns whether the ban list at uiIndex was copied from these lists and neither of them changed since.
+//
+//=============================================================================
+
+bool ServerInfoSnapshot::isBanListCurrent( unsigned int uiIndex, const IPList &Bans, const IPList &Exemptions ) const
+{
+	return (( uiIndex < _BanLists.size( ))
+		&& ( _BanLists[uiIndex].uiBansRevision == Bans.getRevision( ))
+		&& ( _BanLists[uiIndex].uiExemptionsRevision == Exemptions.getRevision( )));
+}
+
+//=============================================================================
+//
+// haveSameBanLists
+//
+//=============================================================================
+
+bool ServerInfoSnapshot::haveSameBanLists( const ServerInfoSnapshot &Other ) const
+{
+	if ( _BanLists.size( ) != Other._BanLists.size( ))
+		return ( false );
+
+	for ( unsigned int i = 0; i < _BanLists.size( ); i++ )
+	{
+		if (( _BanLists[i].uiBansRevision != Other._BanLists[i].uiBansRevision )
+			|| ( _BanLists[i].uiExemptionsRevision != Other._BanLists[i].uiExemptionsRevision ))
+			return ( false );
+	}
+
+	return ( true );
+}
+
+//=============================================================================
+//
+// isIPBanned
+//
+// Same as SERVERBAN_IsIPBanned at the time the snapshot was taken.
+//
+//=============================================================================
+
+bool ServerInfoSnapshot::isIPBanned( const NETADDRESS_s &Address ) const
+{
+	ULONG ulIdx;
+
+	for ( unsigned int i = 0; i < _BanLists.size( ); i++ )
+	{
+		if ( _BanLists[i].Bans.findFirstMatch( Address.abIP, ulIdx ) && ( _BanLists[i].Exemptions.findFirstMatch( Address.abIP, ulIdx ) == false ))
+			return ( true );
+	}
+
+	return ( false );
+}
+
+//=============================================================================
+//
+// writeReply
+//
+// Writes the reply to a query for ulFlags, sent by the launcher at ulTime. lNumBytes holds the size
+// of pbReply and receives the size of the reply. Returns false if there is no reply for these flags.
+//
+//=============================================================================
+
+bool ServerInfoSnapshot::writeReply( ULONG ulFlags, ULONG ulTime, BYTE *pbReply, LONG &lNumBytes ) const
+{
+	for ( unsigned int i = 0; i < _Flags.Size( ); i++ )
+	{
+		if (( _Flags[i] != ulFlags ) || ( static_cast<LONG>( _Sizes[i] ) > lNumBytes ) || ( _Sizes[i] < 8 ))
+			continue;
+
+		memcpy( pbReply, &_Data[_Offsets[i]], _Sizes[i] );
+		lNumBytes = _Sizes[i];
+
+		// The time follows the SERVER_LAUNCHER_CHALLENGE header.
+		pbReply[4] = ulTime & 0xff;
+		pbReply[5] = ( ulTime >> 8 ) & 0xff;
+		pbReply[6] = ( ulTime >> 16 ) & 0xff;
+		pbReply[7] = ( ulTime >> 24 ) & 0xff;
+		return ( true );
+	}
+
+	return ( false );
+}
+
 //--------------------------------------------------------------------------------------------------------------------------------------------------
 //-- CONSOLE ---------------------------------------------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------------------------------------------------------
@@ -75,6 +75,10 @@ static	TArray<RCONCANDIDATE_s>			g_Candidates;
 // Authenticated clients who can execute commands.
 static	TArray<RCONCLIENT_s>			g_AuthedClients;
 
+// Indices into g_Candidates and g_AuthedClients by address (see SERVER_GetAddressKey).
+static	TMap<QWORD, LONG, AddressKeyHashTraits>	g_CandidateIndices;
+static	TMap<QWORD, LONG, AddressKeyHashTraits>	g_AuthedClientIndices;
+
 // The last 32 lines that were printed in the console; sent to clients when they connect. (The server doesn't use the c_console buffer.)
 static	std::list<FString>				g_RecentConsoleLines;
 
@@ -92,6 +96,10 @@ static	void							server_rcon_CreateSalt( char *pszBuffer );
 static	LONG							server_rcon_FindClient( NETADDRESS_s Address );
 static	LONG							server_rcon_FindCandidate( NETADDRESS_s Address );
 
+template <typename EntryType> static void	server_rcon_AddEntry( TArray<EntryType> &List, TMap<QWORD, LONG, AddressKeyHashTraits> &Indices, const EntryType &Entry );
+template <typename EntryType> static void	server_rcon_RemoveEntry( TArray<EntryType> &List, TMap<QWORD, LONG, AddressKeyHashTraits> &Indices, unsigned int uIndex );
+template <typename EntryType> static LONG	server_rcon_FindEntry( const TArray<EntryType> &List, const TMap<QWORD, LONG, AddressKeyHashTraits> &Indices, NETADDRESS_s Address );
+
 //--------------------------------------------------------------------------------------------------------------------------------------------------
 //-- FUNCTIONS -------------------------------------------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------------------------------------------------------
@@ -123,7 +131,7 @@ void SERVER_RCON_Tick( )
 	for ( unsigned int i = 0; i < g_Candidates.Size( ); )
 	{
 		if (( gametic - g_Candidates[i].iLastMessageTic ) >= ( RCON_CANDIDATE_TIMEOUT_TIME * TICRATE ))
-			g_Candidates.Delete( i );
+			server_rcon_RemoveEntry( g_Candidates, g_CandidateIndices, i );
 		else
 			i++;
 	}
@@ -134,7 +142,7 @@ void SERVER_RCON_Tick( )
 		if (( gametic - g_AuthedClients[i].iLastMessageTic ) >= ( RCON_CLIENT_TIMEOUT_TIME * TICRATE ))
 		{
 			Printf( "RCON client at %s timed out.\n", NETWORK_AddressToString( g_AuthedClients[i].Address ));
-			g_AuthedClients.Delete( i );
+			server_rcon_RemoveEntry( g_AuthedClients, g_AuthedClientIndices, i );
 			SERVER_RCON_UpdateInfo( SVRCU_ADMINCOUNT );
 		}
 		else
@@ -191,7 +199,7 @@ void SERVER_RCON_ParseMessage( NETADDRESS_s Address, LONG lMessage, BYTESTREAM_s
 		iIndex = server_rcon_FindClient( Address );
 		if ( iIndex != -1 )	
 		{
-			g_AuthedClients.Delete( iIndex );
+			server_rcon_RemoveEntry( g_AuthedClients, g_AuthedClientIndices, iIndex );
 			SERVER_RCON_UpdateInfo( SVRCU_ADMINCOUNT );
 			Printf( "RCON client at %s disconnected.\n", NETWORK_AddressToString( Address ));
 		}
@@ -362,17 +370,17 @@ static void server_rcon_HandleNewConnection( NETADDRESS_s Address,  int iProtoco
 	// This ensures that each address never has more than one entry (since this is the only function that gives out new candidate slots).
 	int iIndex = server_rcon_FindCandidate( Address );
 	if ( iIndex != -1 )
-		g_Candidates.Delete( iIndex );
+		server_rcon_RemoveEntry( g_Candidates, g_CandidateIndices, iIndex );
 	iIndex = server_rcon_FindClient( Address );
 	if ( iIndex != -1 )
-		g_AuthedClients.Delete( iIndex );
+		server_rcon_RemoveEntry( g_AuthedClients, g_AuthedClientIndices, iIndex );
 
 	// Create a slot for him, and request his password.
 	RCONCANDIDATE_s		Candidate;
 	Candidate.iLastMessageTic = gametic;
 	Candidate.Address = Address;
 	server_rcon_CreateSalt( Candidate.szSalt );
-	g_Candidates.Push( Candidate );
+	server_rcon_AddEntry( g_Candidates, g_CandidateIndices, Candidate );
 
 	NETWORK_ClearBuffer( &g_MessageBuffer );
 	NETWORK_WriteByte( &g_MessageBuffer.ByteStream, SVRC_SALT );
@@ -425,7 +433,7 @@ static void server_rcon_HandleLogin( int iCandidateIndex, const char *pszHash )
 		RCONCLIENT_s Client;
 		Client.Address = g_Candidates[iCandidateIndex].Address;
 		Client.iLastMessageTic = gametic;
-		g_AuthedClients.Push( Client );
+		server_rcon_AddEntry( g_AuthedClients, g_AuthedClientIndices, Client );
 
 		NETWORK_ClearBuffer( &g_MessageBuffer );
 		NETWORK_WriteByte( &g_MessageBuffer.ByteStream, SVRC_LOGGEDIN );
@@ -449,7 +457,7 @@ static void server_rcon_HandleLogin( int iCandidateIndex, const char *pszHash )
 	}
 
 	// Remove his temporary slot.	
-	g_Candidates.Delete( iCandidateIndex );
+	server_rcon_RemoveEntry( g_Candidates, g_CandidateIndices, iCandidateIndex );
 }
 
 //==========================================================================
@@ -484,11 +492,7 @@ static void server_rcon_CreateSalt( char *pszBuffer )
 
 static LONG server_rcon_FindCandidate( NETADDRESS_s Address )
 {
-	for ( unsigned int i = 0; i < g_Candidates.Size( ); i++ )
-		if ( NETWORK_CompareAddress( g_Candidates[i].Address, Address, false ))
-			return i;
-
-	return -1;
+	return server_rcon_FindEntry( g_Candidates, g_CandidateIndices, Address );
 }
 
 
@@ -502,9 +506,63 @@ static LONG server_rcon_FindCandidate( NETADDRESS_s Address )
 
 static LONG server_rcon_FindClient( NETADDRESS_s Address )
 {
-	for ( unsigned int i = 0; i < g_AuthedClients.Size( ); i++ )
-		if ( NETWORK_CompareAddress( g_AuthedClients[i].Address, Address, false ))
-			return i;
+	return server_rcon_FindEntry( g_AuthedClients, g_AuthedClientIndices, Address );
+}
+
+//==========================================================================
+//
+// server_rcon_AddEntry
+//
+// Appends an entry to g_Candidates or g_AuthedClients and updates the corresponding index.
+//
+//==========================================================================
+
+template <typename EntryType>
+static void server_rcon_AddEntry( TArray<EntryType> &List, TMap<QWORD, LONG, AddressKeyHashTraits> &Indices, const EntryType &Entry )
+{
+	Indices[SERVER_GetAddressKey( Entry.Address )] = List.Push( Entry );
+	NETWORK_AddIngressExemption( Entry.Address );
+}
+
+//==========================================================================
+//
+// server_rcon_RemoveEntry
+//
+// Removes an entry from g_Candidates or g_AuthedClients by moving the last entry into its place,
+// so that only one index needs to be updated.
+//
+//==========================================================================
+
+template <typename EntryType>
+static void server_rcon_RemoveEntry( TArray<EntryType> &List, TMap<QWORD, LONG, AddressKeyHashTraits> &Indices, unsigned int uIndex )
+{
+	Indices.Remove( SERVER_GetAddressKey( List[uIndex].Address ));
+	NETWORK_RemoveIngressExemption( List[uIndex].Address );
+
+	const unsigned int uLast = List.Size( ) - 1;
+	if ( uIndex != uLast )
+	{
+		List[uIndex] = List[uLast];
+		Indices[SERVER_GetAddressKey( List[uIndex].Address )] = uIndex;
+	}
+	List.Pop( );
+}
+
+//==========================================================================
+//
+// server_rcon_FindEntry
+//
+// Returns the index (or -1 if none) of the entry of g_Candidates or g_AuthedClients with the given address.
+//
+//==========================================================================
+
+template <typename EntryType>
+static LONG server_rcon_FindEntry( const TArray<EntryType> &List, const TMap<QWORD, LONG, AddressKeyHashTraits> &Indices, NETADDRESS_s Address )
+{
+	const LONG *plIndex = Indices.CheckKey( SERVER_GetAddressKey( Address ));
+
+	if (( plIndex != NULL ) && NETWORK_CompareAddress( List[*plIndex].Address, Address, false ))
+		return *plIndex;
 
 	return -1;
 }
@@ -61,6 +61,9 @@
 #include "sv_commands.h"
 #include "templates.h"
 #include "d_netinf.h"
+#include "m_bbox.h"
+#include "stats.h"
+#include "c_dispatch.h"
 
 CVAR(Flag, sv_nounlagged, zadmflags, ZADF_NOUNLAGGED);
 CVAR( Bool, sv_unlagged_debugactors, false, 0 )
@@ -68,6 +71,18 @@ CVAR( Bool, sv_unlagged_debugactors, false, 0 )
 bool reconciledGame = false;
 int reconciliationBlockers = 0;
 
+// Indices of the sectors whose floor or ceiling moved during the last UNLAGGEDTICS
+// tics. All the others are still where they were back then.
+static TArray<int> movingSectors;
+
+// The sectors the level had when they were recorded last
+static const sector_t *recordedSectors = NULL;
+static int numRecordedSectors = 0;
+
+// The sectors and players shifted by the current reconciliation
+static TArray<sector_t *> reconciledSectors;
+static bool reconciledPlayers[MAXPLAYERS];
+
 void UNLAGGED_Tick( void )
 {
 	// [BB] Only the server has to do anything here.
@@ -131,15 +146,33 @@ int UNLAGGED_Gametic( player_t *player )
 	return unlaggedGametic;
 }
 
-// Shift stuff back in time before doing hitscan calculations
-// Call UNLAGGED_Restore afterwards to restore everything
-void UNLAGGED_Reconcile( AActor *actor )
+// Check if the actor at x/y with the given radius touches the box
+static bool unlagged_TouchesBox( const FBoundingBox &box, const fixed_t x, const fixed_t y, const fixed_t radius )
+{
+	return ( static_cast<SQWORD>( x ) + radius >= box.Left() ) && ( static_cast<SQWORD>( x ) - radius <= box.Right() ) &&
+		( static_cast<SQWORD>( y ) + radius >= box.Bottom() ) && ( static_cast<SQWORD>( y ) - radius <= box.Top() );
+}
+
+// The box the trace of a hitscan attack of the actor covers in the xy plane
+static FBoundingBox unlagged_TraceBox( const AActor *actor, const angle_t angle, const fixed_t distance, const fixed_t padding )
+{
+	const SQWORD x2 = actor->x + static_cast<SQWORD>( distance >> FRACBITS ) * finecosine[angle >> ANGLETOFINESHIFT];
+	const SQWORD y2 = actor->y + static_cast<SQWORD>( distance >> FRACBITS ) * finesine[angle >> ANGLETOFINESHIFT];
+
+	return FBoundingBox( static_cast<fixed_t>( clamp<SQWORD>( MIN<SQWORD>( actor->x, x2 ) - padding, FIXED_MIN, FIXED_MAX )),
+						 static_cast<fixed_t>( clamp<SQWORD>( MIN<SQWORD>( actor->y, y2 ) - padding, FIXED_MIN, FIXED_MAX )),
+						 static_cast<fixed_t>( clamp<SQWORD>( MAX<SQWORD>( actor->x, x2 ) + padding, FIXED_MIN, FIXED_MAX )),
+						 static_cast<fixed_t>( clamp<SQWORD>( MAX<SQWORD>( actor->y, y2 ) + padding, FIXED_MIN, FIXED_MAX )));
+}
+
+// Whether the actor's attacks are to be reconciled right now
+static bool unlagged_ShouldReconcile( AActor *actor )
 {
 	//Only do anything if the actor to be reconciled is a player,
 	//it's on a server with unlagged on, and reconciliation is not being blocked
 	if ( !actor->player || (NETWORK_GetState() != NETSTATE_SERVER) || ( zadmflags & ZADF_NOUNLAGGED ) ||
 		 ( ( actor->player->userinfo.GetClientFlags() & CLIENTFLAGS_UNLAGGED ) == 0 ) || ( reconciliationBlockers > 0 ) )
-		return;
+		return false;
 
 	//Something went wrong, reconciliation was attempted when the gamestate
 	//was already reconciled!
@@ -151,33 +184,58 @@ void UNLAGGED_Reconcile( AActor *actor )
 		I_Error("UNLAGGED_Reconcile called while reconciledGame is true");
 	}
 
-	const int unlaggedGametic = UNLAGGED_Gametic( actor->player );
-
 	//Don't reconcile if the unlagged gametic is the same as the current
 	//because unlagged data for this tic may not be completely recorded yet
-	if (unlaggedGametic == gametic)
-		return;
+	return ( UNLAGGED_Gametic( actor->player ) != gametic );
+}
 
+// Shift the given sectors and the players back to unlaggedGametic. If box isn't
+// NULL, only the players touching it, either now or back then, are shifted.
+static void unlagged_Reconcile( AActor *actor, const int unlaggedGametic, const TArray<int> &sectorIndices, const FBoundingBox *box )
+{
 	reconciledGame = true;
 
 	//find the index
 	const int unlaggedIndex = unlaggedGametic % UNLAGGEDTICS;
 
+	// The shooter's sector is checked below whether it was shifted, even if it didn't move recently.
+	actor->Sector->floorplane.restoreD = actor->Sector->floorplane.d;
+	actor->Sector->ceilingplane.restoreD = actor->Sector->ceilingplane.d;
+
 	//reconcile the sectors
-	for (int i = 0; i < numsectors; ++i)
+	reconciledSectors.Clear();
+	for (unsigned int i = 0; i < sectorIndices.Size(); ++i)
+	{
+		if ( sectorIndices[i] < numsectors )
+			reconciledSectors.Push( &sectors[sectorIndices[i]] );
+	}
+
+	for (unsigned int i = 0; i < reconciledSectors.Size(); ++i)
 	{
-		sectors[i].floorplane.restoreD = sectors[i].floorplane.d;
-		sectors[i].ceilingplane.restoreD = sectors[i].ceilingplane.d;
+		sector_t *sector = reconciledSectors[i];
+
+		sector->floorplane.restoreD = sector->floorplane.d;
+		sector->ceilingplane.restoreD = sector->ceilingplane.d;
 
-		sectors[i].floorplane.d = sectors[i].floorplane.unlaggedD[unlaggedIndex];
-		sectors[i].ceilingplane.d = sectors[i].ceilingplane.unlaggedD[unlaggedIndex];
+		sector->floorplane.d = sector->floorplane.unlaggedD[unlaggedIndex];
+		sector->ceilingplane.d = sector->ceilingplane.unlaggedD[unlaggedIndex];
 	}
 
 	//reconcile the players
 	for (int i = 0; i < MAXPLAYERS; ++i)
 	{
+		reconciledPlayers[i] = false;
+
 		if (playeringame[i] && players[i].mo && !players[i].bSpectating)
 		{
+			//Players the trace can't reach aren't touched at all
+			if ( ( box != NULL ) && ( players+i != actor->player ) &&
+				 !unlagged_TouchesBox( *box, players[i].mo->x, players[i].mo->y, players[i].mo->radius ) &&
+				 !unlagged_TouchesBox( *box, players[i].unlaggedX[unlaggedIndex], players[i].unlaggedY[unlaggedIndex], players[i].mo->radius ) )
+				continue;
+
+			reconciledPlayers[i] = true;
+
 			players[i].restoreX = players[i].mo->x;
 			players[i].restoreY = players[i].mo->y;
 			players[i].restoreZ = players[i].mo->z;
@@ -238,15 +296,39 @@ void UNLAGGED_Reconcile( AActor *actor )
 	}	
 }
 
+// Shift stuff back in time before doing the hitscan calculations of a trace
+// starting at the actor. padding accounts for traces not starting at its center.
+// Call UNLAGGED_Restore afterwards to restore everything
+void UNLAGGED_Reconcile( AActor *actor, angle_t angle, fixed_t distance, fixed_t padding )
+{
+	if ( unlagged_ShouldReconcile( actor ) == false )
+		return;
+
+	//only the sectors that moved recently can differ from their unlagged positions
+	const FBoundingBox box = unlagged_TraceBox( actor, angle, distance, padding );
+	unlagged_Reconcile( actor, UNLAGGED_Gametic( actor->player ), movingSectors, &box );
+}
+
+// Same as UNLAGGED_Reconcile for several traces of up to the given
+// distance in arbitrary directions
+void UNLAGGED_ReconcileRange( AActor *actor, fixed_t distance )
+{
+	if ( unlagged_ShouldReconcile( actor ) == false )
+		return;
+
+	const FBoundingBox box = unlagged_TraceBox( actor, 0, 0, distance );
+	unlagged_Reconcile( actor, UNLAGGED_Gametic( actor->player ), movingSectors, &box );
+}
+
 void UNLAGGED_SwapSectorUnlaggedStatus( )
 {
 	if ( reconciledGame == false )
 		return;
 
-	for (int i = 0; i < numsectors; ++i)
+	for (unsigned int i = 0; i < reconciledSectors.Size(); ++i)
 	{
-		swapvalues ( sectors[i].floorplane.d, sectors[i].floorplane.restoreD );
-		swapvalues ( sectors[i].ceilingplane.d, sectors[i].ceilingplane.restoreD );
+		swapvalues ( reconciledSectors[i]->floorplane.d, reconciledSectors[i]->floorplane.restoreD );
+		swapvalues ( reconciledSectors[i]->ceilingplane.d, reconciledSectors[i]->ceilingplane.restoreD );
 	}
 }
 
@@ -262,16 +344,16 @@ void UNLAGGED_Restore( AActor *actor )
 		return;
 
 	//restore the sectors
-	for (int i = 0; i < numsectors; ++i)
+	for (unsigned int i = 0; i < reconciledSectors.Size(); ++i)
 	{
-		sectors[i].floorplane.d = sectors[i].floorplane.restoreD;
-		sectors[i].ceilingplane.d = sectors[i].ceilingplane.restoreD;
+		reconciledSectors[i]->floorplane.d = reconciledSectors[i]->floorplane.restoreD;
+		reconciledSectors[i]->ceilingplane.d = reconciledSectors[i]->ceilingplane.restoreD;
 	}
 
 	//restore the players
 	for (int i = 0; i < MAXPLAYERS; ++i)
 	{
-		if (playeringame[i] && players[i].mo && !players[i].bSpectating)
+		if (reconciledPlayers[i] && playeringame[i] && players[i].mo && !players[i].bSpectating)
 		{
 			players[i].mo->SetOrigin( players[i].restoreX, players[i].restoreY, players[i].restoreZ );
 			players[i].mo->floorz = players[i].restoreFloorZ;
@@ -326,7 +408,9 @@ void UNLAGGED_ResetPlayer( player_t *player )
 }
 
 
-// Record the positions of the sectors
+// Record the positions of the sectors that moved recently. A sector
+// that didn't move for UNLAGGEDTICS tics has its current position
+// in all of its records already.
 void UNLAGGED_RecordSectors( )
 {
 	//Only do anything if it's on a server
@@ -335,15 +419,72 @@ void UNLAGGED_RecordSectors( )
 
 	//find the index
 	const int unlaggedIndex = gametic % UNLAGGEDTICS;
+	const int previousIndex = ( gametic + UNLAGGEDTICS - 1 ) % UNLAGGEDTICS;
+
+	//the records of a new level don't mean anything yet
+	const bool newLevel = ( recordedSectors != sectors ) || ( numRecordedSectors != numsectors );
+	recordedSectors = sectors;
+	numRecordedSectors = numsectors;
+
+	movingSectors.Clear();
 
 	//record the sectors
 	for (int i = 0; i < numsectors; ++i)
 	{
-		sectors[i].floorplane.unlaggedD[unlaggedIndex] = sectors[i].floorplane.d;
-		sectors[i].ceilingplane.unlaggedD[unlaggedIndex] = sectors[i].ceilingplane.d;
+		sector_t *sector = &sectors[i];
+
+		if ( newLevel )
+		{
+			for (int j = 0; j < UNLAGGEDTICS; ++j)
+			{
+				sector->floorplane.unlaggedD[j] = sector->floorplane.d;
+				sector->ceilingplane.unlaggedD[j] = sector->ceilingplane.d;
+			}
+			sector->unlaggedMovedTic = gametic - UNLAGGEDTICS;
+			continue;
+		}
+
+		//catches all movement that isn't reported by UNLAGGED_MarkSectorMoved
+		if ( ( sector->floorplane.d != sector->floorplane.unlaggedD[previousIndex] ) ||
+			 ( sector->ceilingplane.d != sector->ceilingplane.unlaggedD[previousIndex] ) )
+			sector->unlaggedMovedTic = gametic;
+
+		if ( gametic - sector->unlaggedMovedTic >= UNLAGGEDTICS )
+			continue;
+
+		sector->floorplane.unlaggedD[unlaggedIndex] = sector->floorplane.d;
+		sector->ceilingplane.unlaggedD[unlaggedIndex] = sector->ceilingplane.d;
+		movingSectors.Push( i );
 	}
 }
 
+// A floor or ceiling of the sector is about to move. Hitscan attacks
+// later in this tic need to shift it back, too.
+void UNLAGGED_MarkSectorMoved( sector_t *sector )
+{
+	//Only do anything if it's on a server
+	if (NETWORK_GetState() != NETSTATE_SERVER)
+		return;
+
+	if ( ( sector == NULL ) || ( recordedSectors != sectors ) )
+		return;
+
+	//the sector is only in the list if it moved recently
+	if ( gametic - sector->unlaggedMovedTic >= UNLAGGEDTICS )
+		movingSectors.Push( static_cast<int>( sector - sectors ));
+
+	sector->unlaggedMovedTic = gametic;
+}
+
+// The sectors are about to be freed. Until UNLAGGED_RecordSectors is called
+// on the new level, no sectors are shifted by a reconciliation.
+void UNLAGGED_ClearSectors( )
+{
+	movingSectors.Clear();
+	recordedSectors = NULL;
+	numRecordedSectors = 0;
+}
+
 bool UNLAGGED_DrawRailClientside ( AActor *attacker )
 {
 	if ( ( attacker == NULL ) || ( attacker->player == NULL ) )
@@ -375,7 +516,8 @@ void UNLAGGED_GetHitOffset ( const AActor *attacker, const FTraceResults &trace,
 	if ( unlaggedGametic == gametic )
 		return;
 
-	if ( ( trace.HitType == TRACE_HitActor ) && trace.Actor && trace.Actor->player )
+	// Players that weren't shifted have no offset either.
+	if ( ( trace.HitType == TRACE_HitActor ) && trace.Actor && trace.Actor->player && reconciledPlayers[trace.Actor->player - players] )
 	{
 		const int unlaggedIndex = unlaggedGametic % UNLAGGEDTICS;
 
@@ -446,3 +588,75 @@ void UNLAGGED_SpawnDebugActors ( )
 		pActor->Destroy();
 	}
 }
+
+// Measure how long the reconciliation for a hitscan attack takes on the current
+// map, shot by the first player in all directions, compared to shifting
+// every sector and player like it was done originally.
+CCMD( unlagged_benchmark )
+{
+	if ( ( NETWORK_GetState() != NETSTATE_SERVER ) || ( gamestate != GS_LEVEL ) || reconciledGame || ( gametic == 0 ) )
+		return;
+
+	AActor *shooter = NULL;
+	for ( ULONG ulIdx = 0; ulIdx < MAXPLAYERS; ++ulIdx )
+	{
+		if ( PLAYER_IsValidPlayerWithMo( ulIdx ) && ( players[ulIdx].bSpectating == false ) )
+		{
+			shooter = players[ulIdx].mo;
+			break;
+		}
+	}
+
+	if ( shooter == NULL )
+	{
+		Printf( "There has to be a player in the game.\n" );
+		return;
+	}
+
+	const int numShots = ( argv.argc() > 1 ) ? clamp( atoi( argv[1] ), 1, 100000 ) : 1000;
+	const int unlaggedGametic = MAX( gametic - UNLAGGEDTICS / 2, 0 );
+	cycle_t scopedTime, fullTime;
+	ULONG numScopedPlayers = 0;
+	ULONG numPlayers = 0;
+
+	TArray<int> allSectors;
+	allSectors.Resize( numsectors );
+	for ( int i = 0; i < numsectors; ++i )
+		allSectors[i] = i;
+
+	scopedTime.Reset();
+	fullTime.Reset();
+
+	for ( int shot = 0; shot < numShots; ++shot )
+	{
+		const angle_t angle = static_cast<angle_t>( shot ) * ( 0xFFFFFFFFu / numShots );
+		const FBoundingBox box = unlagged_TraceBox( shooter, angle, PLAYERMISSILERANGE, 0 );
+
+		scopedTime.Clock();
+		unlagged_Reconcile( shooter, unlaggedGametic, movingSectors, &box );
+		UNLAGGED_Restore( shooter );
+		scopedTime.Unclock();
+
+		for ( int i = 0; i < MAXPLAYERS; ++i )
+		{
+			if ( reconciledPlayers[i] )
+				numScopedPlayers++;
+		}
+
+		// The original reconciliation shifted all sectors and players.
+		fullTime.Clock();
+		unlagged_Reconcile( shooter, unlaggedGametic, allSectors, NULL );
+		UNLAGGED_Restore( shooter );
+		fullTime.Unclock();
+
+		for ( int i = 0; i < MAXPLAYERS; ++i )
+		{
+			if ( reconciledPlayers[i] )
+				numPlayers++;
+		}
+	}
+
+	Printf( "%d shots, %d sectors, %u of them moved recently\n", numShots, numsectors, movingSectors.Size() );
+	Printf( "Scoped: %.3f us per shot, %.1f players shifted on average\n", scopedTime.TimeMS() * 1000 / numShots, static_cast<double>( numScopedPlayers ) / numShots );
+	Printf( "All: %.3f us per shot, %.1f players shifted on average\n", fullTime.TimeMS() * 1000 / numShots, static_cast<double>( numPlayers ) / numShots );
+}
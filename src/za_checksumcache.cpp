@@ -0,0 +1,553 @@
+//-----------------------------------------------------------------------------
+//
+// Zandronum Source
+// Copyright (C) 2015 Zandronum Development Team
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the Zandronum Development Team nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+// 4. Redistributions in any form must be accompanied by information on how to
+//    obtain complete source code for the software and any accompanying
+//    software that uses the software. The source code must either be included
+//    in the distribution or be available for no more than the cost of
+//    distribution plus a nominal fee, and must be freely redistributable
+//    under reasonable conditions. For an executable file, complete source
+//    code means the source code for all modules it contains. It does not
+//    include source code for modules or files that typically accompany the
+//    major components of the operating system on which the executable file
+//    runs.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//
+// Filename: za_checksumcache.cpp
+//
+// Computing the MD5 sums of large PWADs and the checksum of all maps takes long,
+// so the results are stored in a file. An entry is only used as long as size,
+// modification time and inode of all files it depends on are unchanged.
+//
+//-----------------------------------------------------------------------------
+
+#include "za_checksumcache.h"
+#include "c_cvars.h"
+#include "cmdlib.h"
+#include "m_misc.h"
+#include "md5.h"
+#include "templates.h"
+#include <sys/stat.h>
+#include <errno.h>
+
+// Missing checksums are computed in parallel by worker threads, which need pthreads.
+#ifndef _WIN32
+#define CHECKSUMCACHE_WORKERTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+//*****************************************************************************
+//	DEFINES
+
+#define CHECKSUMCACHE_FILENAME "checksums.cache"
+
+// The first line of the cache file. Files with a different header are ignored.
+#define CHECKSUMCACHE_HEADER "ZACHECKSUMCACHE 1"
+
+// How many checksums that depend on several files are kept.
+#define MAX_CACHED_CHECKSUMS 32
+
+// Maximum number of worker threads that hash files at the same time.
+#define MAX_WORKER_THREADS 8
+
+// Size of the buffer files are hashed through.
+#define HASH_BUFFER_SIZE 65536
+
+//*****************************************************************************
+//	TYPES
+
+// The MD5 sum of a file, valid as long as the identity of the file (size, modification time and inode) doesn't change.
+typedef struct
+{
+	FString		Identity;
+	FString		MD5Sum;
+
+} CACHEDFILE_t;
+
+// A checksum that depends on several files, see CHECKSUMCACHE_FindChecksum.
+typedef struct
+{
+	FString		Key;
+	FString		Checksum;
+
+} CACHEDCHECKSUM_t;
+
+// A file the worker threads need to hash. Only uses plain char arrays, since the
+// reference counting of FString isn't thread safe.
+typedef struct
+{
+	const char	*pszPath;
+	char		szMD5Sum[33];
+	bool		bSuccess;
+	int			iError;
+
+} HASHJOB_t;
+
+//*****************************************************************************
+//	VARIABLES
+
+static	TMap<FString, CACHEDFILE_t>	g_CachedFiles;
+static	TArray<CACHEDCHECKSUM_t>	g_CachedChecksums;
+static	bool						g_bCacheLoaded = false;
+
+#ifdef CHECKSUMCACHE_WORKERTHREADS
+// The worker threads take the jobs in order, g_uiNextHashJob is the first one not taken yet.
+static	pthread_mutex_t				g_HashJobMutex = PTHREAD_MUTEX_INITIALIZER;
+static	HASHJOB_t					*g_pHashJobs = NULL;
+static	unsigned int				g_uiNumHashJobs = 0;
+static	unsigned int				g_uiNextHashJob = 0;
+#endif
+
+//*****************************************************************************
+//	PROTOTYPES
+
+static	FString		checksumcache_GetPath ( void );
+static	bool		checksumcache_GetFileIdentity ( const char *Path, FString &Identity );
+static	FString		checksumcache_GetChecksumKey ( const char *Description, const TArray<FString> &Files );
+static	void		checksumcache_Load ( void );
+static	void		checksumcache_ReadFile ( const char *Path, TMap<FString, CACHEDFILE_t> &Files, TArray<CACHEDCHECKSUM_t> &Checksums );
+static	void		checksumcache_Save ( void );
+static	void		checksumcache_HashFile ( HASHJOB_t &Job );
+static	void		checksumcache_RunHashJobs ( HASHJOB_t *Jobs, const unsigned int NumJobs );
+
+//*****************************************************************************
+//	CONSOLE VARIABLES
+
+CVAR( Bool, checksum_cache, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG )
+
+//*****************************************************************************
+//	FUNCTIONS
+
+// Computes the MD5 sums of the files, as lowercase hex strings. Files that can't be read get an empty sum.
+void CHECKSUMCACHE_GetFileMD5Sums ( const TArray<FString> &Files, TArray<FString> &MD5Sums )
+{
+	TArray<FString> identities;
+	TArray<HASHJOB_t> jobs;
+	TArray<unsigned int> jobFiles;
+
+	// Without the cache, all files are hashed and the cache file is neither read nor written.
+	const bool useCache = checksum_cache;
+	if ( useCache )
+		checksumcache_Load();
+
+	MD5Sums.Clear();
+	MD5Sums.Resize( Files.Size() );
+	identities.Resize( Files.Size() );
+
+	for ( unsigned int i = 0; i < Files.Size(); ++i )
+	{
+		// Files whose identity can't be determined are hashed, but not cached.
+		if ( useCache && checksumcache_GetFileIdentity( Files[i], identities[i] ))
+		{
+			const CACHEDFILE_t *cachedFile = g_CachedFiles.CheckKey( Files[i] );
+			if (( cachedFile != NULL ) && ( cachedFile->Identity.Compare( identities[i] ) == 0 ))
+			{
+				MD5Sums[i] = cachedFile->MD5Sum;
+				continue;
+			}
+		}
+
+		HASHJOB_t job;
+		job.pszPath = Files[i].GetChars();
+		job.szMD5Sum[0] = 0;
+		job.bSuccess = false;
+		job.iError = 0;
+		jobs.Push( job );
+		jobFiles.Push( i );
+	}
+
+	if ( jobs.Size() == 0 )
+		return;
+
+	checksumcache_RunHashJobs( &jobs[0], jobs.Size() );
+
+	for ( unsigned int i = 0; i < jobs.Size(); ++i )
+	{
+		const unsigned int fileIdx = jobFiles[i];
+
+		if ( jobs[i].bSuccess == false )
+		{
+			Printf( "%s: %s\n", Files[fileIdx].GetChars(), strerror( jobs[i].iError ));
+			continue;
+		}
+
+		MD5Sums[fileIdx] = jobs[i].szMD5Sum;
+
+		if ( identities[fileIdx].IsNotEmpty() )
+		{
+			CACHEDFILE_t &cachedFile = g_CachedFiles[Files[fileIdx]];
+			cachedFile.Identity = identities[fileIdx];
+			cachedFile.MD5Sum = MD5Sums[fileIdx];
+		}
+	}
+
+	if ( useCache )
+		checksumcache_Save();
+}
+
+//*****************************************************************************
+//
+// Looks for a checksum stored by CHECKSUMCACHE_StoreChecksum with the same description and files,
+// none of which may have changed since.
+bool CHECKSUMCACHE_FindChecksum ( const char *Description, const TArray<FString> &Files, FString &Checksum )
+{
+	if ( checksum_cache == false )
+		return false;
+
+	checksumcache_Load();
+
+	const FString key = checksumcache_GetChecksumKey( Description, Files );
+	for ( unsigned int i = 0; i < g_CachedChecksums.Size(); ++i )
+	{
+		if ( g_CachedChecksums[i].Key.Compare( key ) == 0 )
+		{
+			Checksum = g_CachedChecksums[i].Checksum;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//*****************************************************************************
+//
+void CHECKSUMCACHE_StoreChecksum ( const char *Description, const TArray<FString> &Files, const FString &Checksum )
+{
+	if ( checksum_cache == false )
+		return;
+
+	checksumcache_Load();
+
+	const FString key = checksumcache_GetChecksumKey( Description, Files );
+	for ( unsigned int i = 0; i < g_CachedChecksums.Size(); ++i )
+	{
+		if ( g_CachedChecksums[i].Key.Compare( key ) == 0 )
+		{
+			g_CachedChecksums.Delete( i );
+			break;
+		}
+	}
+
+	// The most recent checksums are at the end, the oldest are dropped first.
+	if ( g_CachedChecksums.Size() >= MAX_CACHED_CHECKSUMS )
+		g_CachedChecksums.Delete( 0 );
+
+	CACHEDCHECKSUM_t cachedChecksum;
+	cachedChecksum.Key = key;
+	cachedChecksum.Checksum = Checksum;
+	g_CachedChecksums.Push( cachedChecksum );
+
+	checksumcache_Save();
+}
+
+//*****************************************************************************
+//
+static FString checksumcache_GetPath ( void )
+{
+#ifdef unix
+	return GetUserFile( CHECKSUMCACHE_FILENAME );
+#else
+	return progdir + CHECKSUMCACHE_FILENAME;
+#endif
+}
+
+//*****************************************************************************
+//
+static bool checksumcache_GetFileIdentity ( const char *Path, FString &Identity )
+{
+	struct stat info;
+
+	Identity = "";
+
+	// Tabs and line breaks would break the format of the cache file.
+	if ( strpbrk( Path, "\t\r\n" ) != NULL )
+		return false;
+
+	if (( stat( Path, &info ) != 0 ) || (( info.st_mode & S_IFMT ) != S_IFREG ))
+		return false;
+
+	Identity.Format( "%llu\t%llu\t%llu", static_cast<unsigned long long>( info.st_size ),
+		static_cast<unsigned long long>( info.st_mtime ), static_cast<unsigned long long>( info.st_ino ));
+	return true;
+}
+
+//*****************************************************************************
+//
+// The description and the identities of all files, hashed to keep the cache file small.
+// Files that don't exist on their own (e.g. WADs inside a PK3) only contribute their name.
+static FString checksumcache_GetChecksumKey ( const char *Description, const TArray<FString> &Files )
+{
+	FString keySource = Description;
+	FString identity;
+	MD5Context md5;
+	BYTE digest[16];
+	FString key;
+
+	for ( unsigned int i = 0; i < Files.Size(); ++i )
+	{
+		checksumcache_GetFileIdentity( Files[i], identity );
+		keySource.AppendFormat( "\n%s\t%s", Files[i].GetChars(), identity.GetChars() );
+	}
+
+	md5.Update( reinterpret_cast<const BYTE *>( keySource.GetChars() ), keySource.Len() );
+	md5.Final( digest );
+	for ( unsigned int i = 0; i < sizeof( digest ); ++i )
+		key.AppendFormat( "%02x", digest[i] );
+
+	return key;
+}
+
+//*****************************************************************************
+//
+static void checksumcache_Load ( void )
+{
+	if ( g_bCacheLoaded )
+		return;
+
+	g_bCacheLoaded = true;
+	checksumcache_ReadFile( checksumcache_GetPath(), g_CachedFiles, g_CachedChecksums );
+}
+
+//*****************************************************************************
+//
+static void checksumcache_ReadFile ( const char *Path, TMap<FString, CACHEDFILE_t> &Files, TArray<CACHEDCHECKSUM_t> &Checksums )
+{
+	FILE *file = fopen( Path, "r" );
+	if ( file == NULL )
+		return;
+
+	char line[4096];
+	if (( fgets( line, sizeof( line ), file ) == NULL ) || ( strncmp( line, CHECKSUMCACHE_HEADER, strlen( CHECKSUMCACHE_HEADER )) != 0 ))
+	{
+		fclose( file );
+		return;
+	}
+
+	while ( fgets( line, sizeof( line ), file ) != NULL )
+	{
+		// Split the line at the tabs.
+		TArray<char *> fields;
+		char *field = line;
+		line[strcspn( line, "\r\n" )] = 0;
+		fields.Push( field );
+		while (( field = strchr( field, '\t' )) != NULL )
+		{
+			*field++ = 0;
+			fields.Push( field );
+		}
+
+		// F <size> <modification time> <inode> <MD5 sum> <path>
+		if (( strcmp( fields[0], "F" ) == 0 ) && ( fields.Size() == 6 ))
+		{
+			CACHEDFILE_t &cachedFile = Files[fields[5]];
+			cachedFile.Identity.Format( "%s\t%s\t%s", fields[1], fields[2], fields[3] );
+			cachedFile.MD5Sum = fields[4];
+		}
+		// C <key> <checksum>
+		else if (( strcmp( fields[0], "C" ) == 0 ) && ( fields.Size() == 3 ) && ( Checksums.Size() < MAX_CACHED_CHECKSUMS ))
+		{
+			CACHEDCHECKSUM_t cachedChecksum;
+			cachedChecksum.Key = fields[1];
+			cachedChecksum.Checksum = fields[2];
+			Checksums.Push( cachedChecksum );
+		}
+	}
+
+	fclose( file );
+}
+
+//*****************************************************************************
+//
+// Several servers may share the cache, so the entries other processes wrote since it was loaded
+// are merged in first. The cache is then written to a temporary file of this process and renamed,
+// so that neither an interrupted write nor a concurrent one leaves a broken cache behind.
+// Files that no longer exist or have changed since they were hashed are dropped.
+static void checksumcache_Save ( void )
+{
+	const FString path = checksumcache_GetPath();
+	FString tempPath;
+
+	TMap<FString, CACHEDFILE_t> diskFiles;
+	TArray<CACHEDCHECKSUM_t> diskChecksums;
+	checksumcache_ReadFile( path, diskFiles, diskChecksums );
+
+	// Take over the files this process has no up-to-date sum of.
+	TMap<FString, CACHEDFILE_t>::Iterator diskIt( diskFiles );
+	TMap<FString, CACHEDFILE_t>::Pair *pair;
+	FString identity;
+	while ( diskIt.NextPair( pair ))
+	{
+		if (( checksumcache_GetFileIdentity( pair->Key, identity ) == false ) || ( pair->Value.Identity.Compare( identity ) != 0 ))
+			continue;
+
+		const CACHEDFILE_t *cachedFile = g_CachedFiles.CheckKey( pair->Key );
+		if (( cachedFile == NULL ) || ( cachedFile->Identity.Compare( identity ) != 0 ))
+			g_CachedFiles[pair->Key] = pair->Value;
+	}
+
+	// The checksums only found on disk are considered older than the ones of this process.
+	for ( unsigned int i = 0; i < diskChecksums.Size(); ++i )
+	{
+		bool bKnown = false;
+		for ( unsigned int j = 0; j < g_CachedChecksums.Size(); ++j )
+		{
+			if ( g_CachedChecksums[j].Key.Compare( diskChecksums[i].Key ) == 0 )
+			{
+				bKnown = true;
+				break;
+			}
+		}
+
+		if ( bKnown )
+		{
+			diskChecksums.Delete( i );
+			--i;
+		}
+	}
+	for ( unsigned int i = 0; i < g_CachedChecksums.Size(); ++i )
+		diskChecksums.Push( g_CachedChecksums[i] );
+	if ( diskChecksums.Size() > MAX_CACHED_CHECKSUMS )
+		diskChecksums.Delete( 0, diskChecksums.Size() - MAX_CACHED_CHECKSUMS );
+	g_CachedChecksums = diskChecksums;
+
+	FILE *file = OpenTempFile( path, tempPath, "w" );
+	if ( file == NULL )
+	{
+		Printf( "Can't write the checksum cache %s: %s\n", tempPath.GetChars(), strerror( errno ));
+		return;
+	}
+
+	fprintf( file, "%s\n", CHECKSUMCACHE_HEADER );
+
+	TMap<FString, CACHEDFILE_t>::Iterator it( g_CachedFiles );
+	while ( it.NextPair( pair ))
+	{
+		if (( checksumcache_GetFileIdentity( pair->Key, identity ) == false ) || ( pair->Value.Identity.Compare( identity ) != 0 ))
+			continue;
+
+		fprintf( file, "F\t%s\t%s\t%s\n", pair->Value.Identity.GetChars(), pair->Value.MD5Sum.GetChars(), pair->Key.GetChars() );
+	}
+
+	for ( unsigned int i = 0; i < g_CachedChecksums.Size(); ++i )
+		fprintf( file, "C\t%s\t%s\n", g_CachedChecksums[i].Key.GetChars(), g_CachedChecksums[i].Checksum.GetChars() );
+
+	if ( CommitTempFile( file, tempPath, path ) == false )
+		Printf( "Can't write the checksum cache %s: %s\n", path.GetChars(), strerror( errno ));
+}
+
+//*****************************************************************************
+//
+// Streams the file through a fixed buffer. Called by the worker threads, so it must not use Printf or FString.
+static void checksumcache_HashFile ( HASHJOB_t &Job )
+{
+	FILE *file = fopen( Job.pszPath, "rb" );
+	if ( file == NULL )
+	{
+		Job.iError = errno;
+		return;
+	}
+
+	BYTE *buffer = new BYTE[HASH_BUFFER_SIZE];
+	MD5Context md5;
+	size_t len;
+
+	while (( len = fread( buffer, 1, HASH_BUFFER_SIZE, file )) > 0 )
+		md5.Update( buffer, static_cast<unsigned int>( len ));
+
+	Job.bSuccess = ( ferror( file ) == 0 );
+	Job.iError = Job.bSuccess ? 0 : EIO;
+	fclose( file );
+
+	md5.Final( buffer );
+	for ( int i = 0; i < 16; ++i )
+		mysnprintf( Job.szMD5Sum + 2 * i, 3, "%02x", buffer[i] );
+
+	delete[] buffer;
+}
+
+#ifdef CHECKSUMCACHE_WORKERTHREADS
+//*****************************************************************************
+//
+static void *checksumcache_WorkerThread ( void * )
+{
+	while ( true )
+	{
+		pthread_mutex_lock( &g_HashJobMutex );
+		const unsigned int jobIdx = g_uiNextHashJob++;
+		pthread_mutex_unlock( &g_HashJobMutex );
+
+		if ( jobIdx >= g_uiNumHashJobs )
+			return NULL;
+
+		checksumcache_HashFile( g_pHashJobs[jobIdx] );
+	}
+}
+#endif
+
+//*****************************************************************************
+//
+static void checksumcache_RunHashJobs ( HASHJOB_t *Jobs, const unsigned int NumJobs )
+{
+#ifdef CHECKSUMCACHE_WORKERTHREADS
+	long numProcessors = sysconf( _SC_NPROCESSORS_ONLN );
+	const unsigned int numThreads = MIN<unsigned int>( MIN<unsigned int>( MAX<long>( numProcessors, 1 ), MAX_WORKER_THREADS ), NumJobs );
+
+	// With a single job or processor, the threads would only add overhead.
+	if ( numThreads > 1 )
+	{
+		pthread_t threads[MAX_WORKER_THREADS];
+		unsigned int numStarted = 0;
+
+		g_pHashJobs = Jobs;
+		g_uiNumHashJobs = NumJobs;
+		g_uiNextHashJob = 0;
+
+		for ( unsigned int i = 0; i < numThreads; ++i )
+		{
+			if ( pthread_create( &threads[numStarted], NULL, checksumcache_WorkerThread, NULL ) == 0 )
+				++numStarted;
+		}
+
+		// This thread helps, which also makes sure that all jobs are done if no thread could be started.
+		checksumcache_WorkerThread( NULL );
+
+		for ( unsigned int i = 0; i < numStarted; ++i )
+			pthread_join( threads[i], NULL );
+
+		g_pHashJobs = NULL;
+		g_uiNumHashJobs = 0;
+		return;
+	}
+#endif
+
+	for ( unsigned int i = 0; i < NumJobs; ++i )
+		checksumcache_HashFile( Jobs[i] );
+}
@@ -46,8 +46,19 @@
 //-----------------------------------------------------------------------------
 
 #include "za_database.h"
+#include "za_ranktree.h"
 #include "i_system.h"
 #include <sqlite3.h>
+#include <string>
+#include <vector>
+
+// Queued writes are committed by a separate thread, which needs pthreads.
+#ifndef _WIN32
+#define DATABASE_WRITERTHREAD
+#include <pthread.h>
+#include <errno.h>
+#include <sys/time.h>
+#endif
 
 //*****************************************************************************
 //	DEFINES
@@ -56,12 +67,116 @@
 
 #define TIMEQUERY "SELECT (julianday('now') - 2440587.5)*86400.0"
 
+// Ranks are determined through an index on this expression, so all queries have to use exactly the same one.
+#define INTVALUE "CAST(Value AS INTEGER)"
+
+#define ADDENTRYQUERY "INSERT INTO "TABLENAME" VALUES(?1,?2,?3,("TIMEQUERY"))"
+#define SETENTRYQUERY "UPDATE "TABLENAME" SET Value=?3,Timestamp=("TIMEQUERY") WHERE Namespace=?1 AND KeyName=?2"
+#define DELETEENTRYQUERY "DELETE FROM "TABLENAME" WHERE Namespace=?1 AND KeyName=?2"
+
+// Maximum number of unused prepared statements kept in g_StatementCache.
+#define MAX_CACHED_STATEMENTS 64
+
+// How long the writer thread waits for more writes before it commits them in a single transaction.
+#define WRITEBEHIND_BATCH_MSECS 100
+
+// How long a connection waits for the other one to release its lock on the database file.
+#define BUSY_TIMEOUT_MSECS 1000
+
+//*****************************************************************************
+//	TYPES
+
+// The writes that can be queued for the writer thread.
+enum DATABASEWRITE_e
+{
+	DBW_ADDENTRY,
+	DBW_SETENTRY,
+	DBW_DELETEENTRY,
+
+	NUM_DATABASEWRITES
+};
+
+// A write the game thread queued for the writer thread. Uses std::string, since the
+// reference counting of FString isn't thread safe.
+typedef struct
+{
+	DATABASEWRITE_e		Type;
+	std::string			Namespace;
+	std::string			EntryName;
+	std::string			EntryValue;
+
+} DATABASEWRITE_t;
+
+// How an entry will look like once the queued writes are committed.
+typedef struct
+{
+	FString		Value;
+	bool		bDeleted;
+
+} PENDINGENTRY_t;
+
+// A namespace whose ranks are kept in memory.
+typedef struct
+{
+	FString			Namespace;
+	RankTree		*pTree;
+
+	// Value of g_uiRankTreeUseCounter when the ranks were queried the last time.
+	unsigned int	uiLastUsed;
+
+} RANKEDNAMESPACE_t;
+
 //*****************************************************************************
 //	VARIABLES
 
 // [BB] Handle to our database.
 sqlite3 *g_db = NULL;
 
+// Prepared statements of g_db that are currently unused, keyed by their SQL text.
+static	TMap<FString, sqlite3_stmt *>	g_StatementCache;
+
+// Entries written since all queued writes were committed the last time. Reads check these first.
+static	TMap<FString, PENDINGENTRY_t>	g_PendingEntries;
+
+// Namespaces whose ranks were queried recently.
+static	TArray<RANKEDNAMESPACE_t>		g_RankedNamespaces;
+static	unsigned int		g_uiRankTreeUseCounter = 0;
+
+// Number of writes the game thread queued since the writer thread was started.
+static	unsigned int		g_uiNumQueuedWrites = 0;
+
+// Number of failed writes that were already reported.
+static	unsigned int		g_uiNumReportedFailedWrites = 0;
+
+#ifdef DATABASE_WRITERTHREAD
+// The writer thread and whether it's running.
+static	pthread_t			g_WriterThread;
+static	bool				g_bWriterThreadRunning = false;
+
+// The writer thread's own connection to the database file and its prepared statements.
+static	sqlite3				*g_WriterDb = NULL;
+static	sqlite3_stmt		*g_apWriterStatements[NUM_DATABASEWRITES];
+
+// Protects everything below. g_WriterCondition is signaled whenever writes were queued or committed.
+static	pthread_mutex_t		g_WriterMutex = PTHREAD_MUTEX_INITIALIZER;
+static	pthread_cond_t		g_WriterCondition = PTHREAD_COND_INITIALIZER;
+static	std::vector<DATABASEWRITE_t>	g_QueuedWrites;
+static	bool				g_bStopWriterThread = false;
+
+// Is the game thread waiting for the queued writes? Then the writer thread doesn't wait for more.
+static	bool				g_bFlushRequested = false;
+static	unsigned int		g_uiNumCommittedWrites = 0;
+static	unsigned int		g_uiNumFailedWrites = 0;
+static	std::string			g_LastWriterError;
+#endif
+
+static	bool	database_IsFileDatabase ( void );
+static	void	database_SetJournalMode ( void );
+static	void	database_StopWritingBehind ( void );
+static	void	database_UpdateWriterThread ( void );
+static	void	database_ClearRankTrees ( void );
+static	void	database_FlushWrites ( void );
+
 // [BB] Filename for the database.
 CUSTOM_CVAR( String, databasefile, ":memory:", CVAR_ARCHIVE|CVAR_NOSETBYACS )
 {
@@ -75,6 +190,32 @@ CUSTOM_CVAR( Int, database_maxpagecount, 32768, CVAR_ARCHIVE|CVAR_NOSETBYACS )
 		DATABASE_SetMaxPageCount ( self );
 }
 
+// Use WAL journaling for a database file, so that reading the database doesn't block writing to it.
+CUSTOM_CVAR( Bool, database_wal, false, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+{
+	if ( DATABASE_IsAvailable() && database_IsFileDatabase() )
+	{
+		database_SetJournalMode ( );
+		database_UpdateWriterThread ( );
+	}
+}
+
+// Keep the ranks of this many namespaces in memory, so that ranks can be determined without counting entries.
+CUSTOM_CVAR( Int, database_rankcache, 0, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+{
+	if ( self < 0 )
+		self = 0;
+	else
+		database_ClearRankTrees ( );
+}
+
+// Commit the writes to a database file on a separate thread, in batched transactions.
+CUSTOM_CVAR( Bool, database_writebehind, false, CVAR_ARCHIVE|CVAR_NOSETBYACS )
+{
+	if ( DATABASE_IsAvailable() )
+		database_UpdateWriterThread ( );
+}
+
 //*****************************************************************************
 //	PROTOTYPES
 
@@ -86,10 +227,20 @@ CUSTOM_CVAR( Int, database_maxpagecount, 32768, CVAR_ARCHIVE|CVAR_NOSETBYACS )
 class DataBaseCommand
 {
 	sqlite3_stmt *_stmt;
+	const FString _command;
 public:
-	DataBaseCommand ( const char *Command ) : _stmt ( NULL )
+	DataBaseCommand ( const char *Command ) : _stmt ( NULL ), _command ( Command )
 	{
-		int error = sqlite3_prepare ( g_db, Command, -1, &_stmt, NULL );
+		// Reuse the statement if it was already prepared before.
+		sqlite3_stmt **cachedStmt = g_StatementCache.CheckKey ( _command );
+		if ( cachedStmt != NULL )
+		{
+			_stmt = *cachedStmt;
+			g_StatementCache.Remove ( _command );
+			return;
+		}
+
+		int error = sqlite3_prepare_v2 ( g_db, Command, -1, &_stmt, NULL );
 		if ( error != SQLITE_OK )
 			Printf ( "Could not prepare statement. Error: %s\n", sqlite3_errmsg ( g_db ) );
 	}
@@ -117,7 +268,13 @@ public:
 	{
 		if ( _stmt != NULL )
 		{
-			sqlite3_finalize ( _stmt );
+			// Put the statement back into the cache, unless a nested command with the same text already did.
+			sqlite3_reset ( _stmt );
+			sqlite3_clear_bindings ( _stmt );
+			if ( ( g_StatementCache.CheckKey ( _command ) == NULL ) && ( g_StatementCache.CountUsed() < MAX_CACHED_STATEMENTS ) )
+				g_StatementCache[_command] = _stmt;
+			else
+				sqlite3_finalize ( _stmt );
 			_stmt = NULL;
 		}
 	}
@@ -134,7 +291,7 @@ public:
 		return ( result == SQLITE_ROW );
 	}
 
-	void exec ( )
+	bool exec ( )
 	{
 		const int result = sqlite3_step ( _stmt );
 		if ( result == SQLITE_ROW )
@@ -143,6 +300,7 @@ public:
 			Printf ( "Could not execute statement. Error: %s\n", sqlite3_errmsg ( g_db ) );
 
 		finalize();
+		return ( result == SQLITE_DONE );
 	}
 
 	const unsigned char *getText ( const int ColumnIndex )
@@ -175,11 +333,425 @@ void database_ClearHandle ( void )
 {
 	if ( g_db != NULL )
 	{
+		// The writer thread commits everything that is still queued before it stops.
+		database_StopWritingBehind ( );
+
+		database_ClearRankTrees ( );
+
+		TMapIterator<FString, sqlite3_stmt *> it ( g_StatementCache );
+		TMap<FString, sqlite3_stmt *>::Pair *pair;
+		while ( it.NextPair ( pair ) )
+			sqlite3_finalize ( pair->Value );
+		g_StatementCache.Clear ( );
+
 		sqlite3_close ( g_db );
 		g_db = NULL;
 	}
 }
 
+//*****************************************************************************
+//
+static bool database_IsFileDatabase ( void )
+{
+	return ( ( g_db != NULL ) && ( strcmp ( databasefile.GetGenericRep( CVAR_String ).String, ":memory:" ) != 0 ) );
+}
+
+//*****************************************************************************
+//
+static bool database_IsWritingBehind ( void )
+{
+#ifdef DATABASE_WRITERTHREAD
+	return g_bWriterThreadRunning;
+#else
+	return false;
+#endif
+}
+
+//*****************************************************************************
+//
+static FString database_GetPendingEntryKey ( const char *Namespace, const char *EntryName )
+{
+	// Prefix the namespace with its length, so that different pairs never end up with the same key.
+	FString key;
+	key.Format ( "%u:%s%s", static_cast<unsigned int> ( strlen ( Namespace ) ), Namespace, EntryName );
+	return key;
+}
+
+//*****************************************************************************
+//
+static const PENDINGENTRY_t *database_FindPendingEntry ( const char *Namespace, const char *EntryName )
+{
+	if ( g_PendingEntries.CountUsed() == 0 )
+		return NULL;
+
+	return g_PendingEntries.CheckKey ( database_GetPendingEntryKey ( Namespace, EntryName ) );
+}
+
+//*****************************************************************************
+//
+static void database_ClearRankTrees ( void )
+{
+	for ( unsigned int i = 0; i < g_RankedNamespaces.Size(); ++i )
+		delete g_RankedNamespaces[i].pTree;
+	g_RankedNamespaces.Clear ( );
+}
+
+//*****************************************************************************
+//
+static RankTree *database_FindRankTree ( const char *Namespace )
+{
+	for ( unsigned int i = 0; i < g_RankedNamespaces.Size(); ++i )
+	{
+		if ( g_RankedNamespaces[i].Namespace.Compare ( Namespace ) == 0 )
+		{
+			g_RankedNamespaces[i].uiLastUsed = ++g_uiRankTreeUseCounter;
+			return g_RankedNamespaces[i].pTree;
+		}
+	}
+
+	return NULL;
+}
+
+//*****************************************************************************
+//
+// Keeps the rank tree of Namespace, if there is one, in sync with a write. EntryValue is NULL if the entry was deleted.
+static void database_UpdateRankTree ( const char *Namespace, const char *EntryName, const char *EntryValue )
+{
+	if ( g_RankedNamespaces.Size() == 0 )
+		return;
+
+	RankTree *tree = database_FindRankTree ( Namespace );
+	if ( tree == NULL )
+		return;
+
+	// atoi parses the same prefix as SQLite's CAST(Value AS INTEGER).
+	if ( EntryValue != NULL )
+		tree->SetValue ( EntryName, atoi ( EntryValue ) );
+	else
+		tree->RemoveKey ( EntryName );
+}
+
+//*****************************************************************************
+//
+static RankTree *database_GetRankTree ( const char *Namespace )
+{
+	RankTree *tree = database_FindRankTree ( Namespace );
+	if ( tree != NULL )
+		return tree;
+
+	// Make room by dropping the namespace that wasn't ranked for the longest time.
+	if ( g_RankedNamespaces.Size() >= static_cast<unsigned int> ( *database_rankcache ) )
+	{
+		unsigned int oldest = 0;
+		for ( unsigned int i = 1; i < g_RankedNamespaces.Size(); ++i )
+		{
+			if ( g_RankedNamespaces[i].uiLastUsed < g_RankedNamespaces[oldest].uiLastUsed )
+				oldest = i;
+		}
+
+		delete g_RankedNamespaces[oldest].pTree;
+		g_RankedNamespaces.Delete ( oldest );
+	}
+
+	// From now on, every write to the namespace also updates the tree.
+	database_FlushWrites ( );
+	tree = new RankTree;
+	DataBaseCommand cmd ( "SELECT KeyName, "INTVALUE" FROM "TABLENAME" WHERE Namespace=?1" );
+	cmd.bindString ( 1, Namespace );
+	while ( cmd.step( ) )
+		tree->SetValue ( reinterpret_cast<const char *> ( cmd.getText(0) ), cmd.getInteger(1) );
+	cmd.finalize();
+
+	RANKEDNAMESPACE_t rankedNamespace;
+	rankedNamespace.Namespace = Namespace;
+	rankedNamespace.pTree = tree;
+	rankedNamespace.uiLastUsed = ++g_uiRankTreeUseCounter;
+	g_RankedNamespaces.Push ( rankedNamespace );
+	return tree;
+}
+
+//*****************************************************************************
+//
+static void database_ReportFailedWrites ( void )
+{
+#ifdef DATABASE_WRITERTHREAD
+	pthread_mutex_lock ( &g_WriterMutex );
+	const unsigned int numFailedWrites = g_uiNumFailedWrites;
+	const FString lastError = g_LastWriterError.c_str();
+	pthread_mutex_unlock ( &g_WriterMutex );
+
+	if ( numFailedWrites != g_uiNumReportedFailedWrites )
+	{
+		Printf ( "%u queued database writes failed. Error: %s\n", numFailedWrites - g_uiNumReportedFailedWrites, lastError.GetChars() );
+		g_uiNumReportedFailedWrites = numFailedWrites;
+	}
+#endif
+}
+
+//*****************************************************************************
+//
+// Queues a write for the writer thread. EntryExists tells whether the entry exists before the write,
+// this determines whether an add or set actually changes the entry.
+static void database_QueueWrite ( const DATABASEWRITE_e Type, const char *Namespace, const char *EntryName, const char *EntryValue, const bool EntryExists )
+{
+#ifdef DATABASE_WRITERTHREAD
+	DATABASEWRITE_t write;
+	write.Type = Type;
+	write.Namespace = Namespace;
+	write.EntryName = EntryName;
+	write.EntryValue = EntryValue;
+
+	pthread_mutex_lock ( &g_WriterMutex );
+	const bool allCommitted = ( g_uiNumCommittedWrites == g_uiNumQueuedWrites );
+	g_QueuedWrites.push_back ( write );
+	pthread_cond_broadcast ( &g_WriterCondition );
+	pthread_mutex_unlock ( &g_WriterMutex );
+	++g_uiNumQueuedWrites;
+
+	// Once everything that was queued is committed, the database itself is up to date again.
+	if ( allCommitted )
+		g_PendingEntries.Clear ( );
+
+	const bool changesEntry = ( Type == DBW_DELETEENTRY ) || ( ( Type == DBW_ADDENTRY ) ? !EntryExists : EntryExists );
+	if ( changesEntry )
+	{
+		PENDINGENTRY_t &entry = g_PendingEntries[database_GetPendingEntryKey ( Namespace, EntryName )];
+		entry.bDeleted = ( Type == DBW_DELETEENTRY );
+		entry.Value = entry.bDeleted ? "" : EntryValue;
+		database_UpdateRankTree ( Namespace, EntryName, entry.bDeleted ? NULL : EntryValue );
+	}
+
+	database_ReportFailedWrites ( );
+#endif
+}
+
+//*****************************************************************************
+//
+// Waits until the writer thread committed all queued writes. Needed before the queries that
+// can't be answered from g_PendingEntries.
+static void database_FlushWrites ( void )
+{
+#ifdef DATABASE_WRITERTHREAD
+	if ( g_bWriterThreadRunning == false )
+		return;
+
+	pthread_mutex_lock ( &g_WriterMutex );
+	while ( g_uiNumCommittedWrites != g_uiNumQueuedWrites )
+	{
+		g_bFlushRequested = true;
+		pthread_cond_broadcast ( &g_WriterCondition );
+		pthread_cond_wait ( &g_WriterCondition, &g_WriterMutex );
+	}
+	pthread_mutex_unlock ( &g_WriterMutex );
+
+	g_PendingEntries.Clear ( );
+	database_ReportFailedWrites ( );
+#endif
+}
+
+#ifdef DATABASE_WRITERTHREAD
+//*****************************************************************************
+//
+// Only called by the writer thread. Returns the number of writes that failed.
+static unsigned int database_CommitWrites ( const std::vector<DATABASEWRITE_t> &Writes, std::string &Error )
+{
+	if ( sqlite3_exec ( g_WriterDb, "BEGIN TRANSACTION", NULL, NULL, NULL ) != SQLITE_OK )
+	{
+		Error = sqlite3_errmsg ( g_WriterDb );
+		return Writes.size();
+	}
+
+	unsigned int numFailed = 0;
+	for ( unsigned int i = 0; i < Writes.size(); ++i )
+	{
+		sqlite3_stmt *stmt = g_apWriterStatements[Writes[i].Type];
+		sqlite3_bind_text ( stmt, 1, Writes[i].Namespace.c_str(), -1, SQLITE_STATIC );
+		sqlite3_bind_text ( stmt, 2, Writes[i].EntryName.c_str(), -1, SQLITE_STATIC );
+		if ( Writes[i].Type != DBW_DELETEENTRY )
+			sqlite3_bind_text ( stmt, 3, Writes[i].EntryValue.c_str(), -1, SQLITE_STATIC );
+
+		if ( sqlite3_step ( stmt ) != SQLITE_DONE )
+		{
+			Error = sqlite3_errmsg ( g_WriterDb );
+			++numFailed;
+		}
+		sqlite3_reset ( stmt );
+		sqlite3_clear_bindings ( stmt );
+	}
+
+	if ( sqlite3_exec ( g_WriterDb, "COMMIT TRANSACTION", NULL, NULL, NULL ) != SQLITE_OK )
+	{
+		Error = sqlite3_errmsg ( g_WriterDb );
+		sqlite3_exec ( g_WriterDb, "ROLLBACK TRANSACTION", NULL, NULL, NULL );
+		return Writes.size();
+	}
+
+	return numFailed;
+}
+
+//*****************************************************************************
+//
+static void *database_WriterThread ( void * )
+{
+	std::vector<DATABASEWRITE_t> writes;
+
+	pthread_mutex_lock ( &g_WriterMutex );
+	for ( ;; )
+	{
+		while ( g_QueuedWrites.empty() && ( g_bStopWriterThread == false ) )
+			pthread_cond_wait ( &g_WriterCondition, &g_WriterMutex );
+
+		// Everything that was queued is committed before the thread stops.
+		if ( g_QueuedWrites.empty() )
+			break;
+
+		// Give the game thread some time to queue more writes, so that they share the transaction.
+		struct timeval now;
+		gettimeofday ( &now, NULL );
+		const long long deadlineUSecs = static_cast<long long> ( now.tv_usec ) + WRITEBEHIND_BATCH_MSECS * 1000;
+		struct timespec deadline;
+		deadline.tv_sec = now.tv_sec + static_cast<time_t> ( deadlineUSecs / 1000000 );
+		deadline.tv_nsec = static_cast<long> ( deadlineUSecs % 1000000 ) * 1000;
+		while ( ( g_bStopWriterThread == false ) && ( g_bFlushRequested == false ) )
+		{
+			if ( pthread_cond_timedwait ( &g_WriterCondition, &g_WriterMutex, &deadline ) == ETIMEDOUT )
+				break;
+		}
+
+		writes.swap ( g_QueuedWrites );
+		g_bFlushRequested = false;
+		pthread_mutex_unlock ( &g_WriterMutex );
+
+		std::string error;
+		const unsigned int numFailed = database_CommitWrites ( writes, error );
+
+		pthread_mutex_lock ( &g_WriterMutex );
+		g_uiNumCommittedWrites += writes.size();
+		g_uiNumFailedWrites += numFailed;
+		if ( numFailed > 0 )
+			g_LastWriterError = error;
+		writes.clear();
+		pthread_cond_broadcast ( &g_WriterCondition );
+	}
+	pthread_mutex_unlock ( &g_WriterMutex );
+
+	return NULL;
+}
+
+//*****************************************************************************
+//
+static void database_CloseWriterConnection ( void )
+{
+	for ( int i = 0; i < NUM_DATABASEWRITES; ++i )
+	{
+		if ( g_apWriterStatements[i] != NULL )
+		{
+			sqlite3_finalize ( g_apWriterStatements[i] );
+			g_apWriterStatements[i] = NULL;
+		}
+	}
+
+	if ( g_WriterDb != NULL )
+	{
+		sqlite3_close ( g_WriterDb );
+		g_WriterDb = NULL;
+	}
+}
+
+//*****************************************************************************
+//
+static bool database_StartWriterThread ( void )
+{
+	const char *dbFileName = databasefile.GetGenericRep( CVAR_String ).String;
+	if ( sqlite3_open ( dbFileName, &g_WriterDb ) != SQLITE_OK )
+	{
+		Printf ( "database_StartWriterThread: Can't open database \"%s\": %s\n", dbFileName, sqlite3_errmsg ( g_WriterDb ) );
+		database_CloseWriterConnection ( );
+		return false;
+	}
+
+	sqlite3_busy_timeout ( g_WriterDb, BUSY_TIMEOUT_MSECS );
+	if ( database_wal )
+		sqlite3_exec ( g_WriterDb, "PRAGMA synchronous=NORMAL", NULL, NULL, NULL );
+
+	static const char *const queries[NUM_DATABASEWRITES] = { ADDENTRYQUERY, SETENTRYQUERY, DELETEENTRYQUERY };
+	for ( int i = 0; i < NUM_DATABASEWRITES; ++i )
+	{
+		if ( sqlite3_prepare_v2 ( g_WriterDb, queries[i], -1, &g_apWriterStatements[i], NULL ) != SQLITE_OK )
+		{
+			Printf ( "database_StartWriterThread: Could not prepare statement. Error: %s\n", sqlite3_errmsg ( g_WriterDb ) );
+			database_CloseWriterConnection ( );
+			return false;
+		}
+	}
+
+	g_uiNumQueuedWrites = 0;
+	g_uiNumCommittedWrites = 0;
+	g_uiNumFailedWrites = 0;
+	g_uiNumReportedFailedWrites = 0;
+	g_bStopWriterThread = false;
+	g_bFlushRequested = false;
+	if ( pthread_create ( &g_WriterThread, NULL, database_WriterThread, NULL ) != 0 )
+	{
+		Printf ( "database_StartWriterThread: Couldn't create the writer thread.\n" );
+		database_CloseWriterConnection ( );
+		return false;
+	}
+
+	return true;
+}
+
+//*****************************************************************************
+//
+static void database_StopWriterThread ( void )
+{
+	pthread_mutex_lock ( &g_WriterMutex );
+	g_bStopWriterThread = true;
+	pthread_cond_broadcast ( &g_WriterCondition );
+	pthread_mutex_unlock ( &g_WriterMutex );
+
+	pthread_join ( g_WriterThread, NULL );
+	database_CloseWriterConnection ( );
+	g_PendingEntries.Clear ( );
+	database_ReportFailedWrites ( );
+}
+#endif
+
+//*****************************************************************************
+//
+static void database_StopWritingBehind ( void )
+{
+#ifdef DATABASE_WRITERTHREAD
+	if ( g_bWriterThreadRunning )
+	{
+		database_StopWriterThread ( );
+		g_bWriterThreadRunning = false;
+	}
+#endif
+}
+
+//*****************************************************************************
+//
+// Starts or stops the writer thread depending on database_writebehind and the database that is open.
+static void database_UpdateWriterThread ( void )
+{
+	const bool useThread = database_writebehind && database_IsFileDatabase();
+
+#ifdef DATABASE_WRITERTHREAD
+	if ( useThread == g_bWriterThreadRunning )
+		return;
+
+	if ( useThread )
+		g_bWriterThreadRunning = database_StartWriterThread ( );
+	else
+		database_StopWritingBehind ( );
+#else
+	if ( useThread )
+		Printf ( "database_writebehind is not supported on this platform, writes are done on the game thread.\n" );
+#endif
+}
+
+
 //*****************************************************************************
 //
 void database_ExecuteCommand ( const char *Command, int (*Callback)(void*,int,char**,char**) = NULL, void *Data = NULL )
@@ -189,6 +761,20 @@ void database_ExecuteCommand ( const char *Command, int (*Callback)(void*,int,ch
 		Printf ( "Error: %s\n", sqlite3_errmsg ( g_db ) );
 }
 
+//*****************************************************************************
+//
+static void database_SetJournalMode ( void )
+{
+	if ( database_IsFileDatabase() == false )
+		return;
+
+	// Leaving WAL mode requires that no other connection to the database is open.
+	database_StopWritingBehind ( );
+
+	database_ExecuteCommand ( database_wal ? "PRAGMA journal_mode=WAL" : "PRAGMA journal_mode=DELETE" );
+	database_ExecuteCommand ( database_wal ? "PRAGMA synchronous=NORMAL" : "PRAGMA synchronous=FULL" );
+}
+
 //*****************************************************************************
 //
 
@@ -236,6 +822,10 @@ void DATABASE_Init ( void )
 
 	// [BB] Now that the database is ready, we can set the max page count.
 	DATABASE_SetMaxPageCount ( database_maxpagecount );
+
+	sqlite3_busy_timeout ( g_db, BUSY_TIMEOUT_MSECS );
+	database_SetJournalMode ( );
+	database_UpdateWriterThread ( );
 }
 
 //*****************************************************************************
@@ -267,6 +857,11 @@ void DATABASE_BeginTransaction ( void )
 	if ( DATABASE_IsAvailable ( "DATABASE_BeginTransaction" ) == false )
 		return;
 
+	// The writer thread already commits the queued writes in transactions. A transaction of
+	// the game thread's connection would only keep it from committing them.
+	if ( database_IsWritingBehind() )
+		return;
+
 	database_ExecuteCommand ( "BEGIN TRANSACTION" );
 }
 
@@ -277,6 +872,9 @@ void DATABASE_EndTransaction ( void )
 	if ( DATABASE_IsAvailable ( "DATABASE_EndTransaction" ) == false )
 		return;
 
+	if ( database_IsWritingBehind() )
+		return;
+
 	database_ExecuteCommand ( "END TRANSACTION" );
 }
 
@@ -288,6 +886,10 @@ void DATABASE_CreateTable ( )
 		return;
 
 	database_ExecuteCommand ( "CREATE TABLE if not exists "TABLENAME"(Namespace text, KeyName text, Value text, Timestamp text, PRIMARY KEY (Namespace, KeyName))" );
+
+	// Rank and top-N queries only need to walk this index. Since it's an index on an expression,
+	// the table stays compatible with older versions.
+	database_ExecuteCommand ( "CREATE INDEX if not exists "TABLENAME"IntValue ON "TABLENAME"(Namespace, "INTVALUE", KeyName)" );
 }
 
 //*****************************************************************************
@@ -297,6 +899,9 @@ void DATABASE_ClearTable ( )
 	if ( DATABASE_IsAvailable ( "DATABASE_ClearTable" ) == false )
 		return;
 
+	database_FlushWrites ( );
+	database_ClearRankTrees ( );
+
 	database_ExecuteCommand ( "DELETE FROM "TABLENAME );
 }
 
@@ -307,6 +912,9 @@ void DATABASE_DeleteTable ( )
 	if ( DATABASE_IsAvailable ( "DATABASE_DeleteTable" ) == false )
 		return;
 
+	database_FlushWrites ( );
+	database_ClearRankTrees ( );
+
 	database_ExecuteCommand ( "DROP TABLE "TABLENAME );
 }
 
@@ -328,6 +936,8 @@ void DATABASE_DumpTable ( )
 	if ( DATABASE_IsAvailable ( "DATABASE_DumpTable" ) == false )
 		return;
 
+	database_FlushWrites ( );
+
 	Printf ( "Dumping table \"%s\"\n", TABLENAME );
 	database_ExecuteCommand ( "SELECT * from "TABLENAME, database_DumpTableCallback );
 }
@@ -339,6 +949,8 @@ void DATABASE_DumpNamespace ( const char *Namespace )
 	if ( DATABASE_IsAvailable ( "DATABASE_DumpNamespace" ) == false )
 		return;
 
+	database_FlushWrites ( );
+
 	Printf ( "Dumping namespace \"%s\"\n", Namespace );
 	DataBaseCommand cmd ( "SELECT * from "TABLENAME" WHERE Namespace=?1" );
 	cmd.bindString ( 1, Namespace );
@@ -354,11 +966,18 @@ void DATABASE_AddEntry ( const char *Namespace, const char *EntryName, const cha
 	if ( DATABASE_IsAvailable ( "DATABASE_AddEntry" ) == false )
 		return;
 
-	DataBaseCommand cmd ( "INSERT INTO "TABLENAME" VALUES(?1,?2,?3,("TIMEQUERY"))" );
+	if ( database_IsWritingBehind() )
+	{
+		database_QueueWrite ( DBW_ADDENTRY, Namespace, EntryName, EntryValue, DATABASE_EntryExists ( Namespace, EntryName ) );
+		return;
+	}
+
+	DataBaseCommand cmd ( ADDENTRYQUERY );
 	cmd.bindString ( 1, Namespace );
 	cmd.bindString ( 2, EntryName );
 	cmd.bindString ( 3, EntryValue );
-	cmd.exec ( );
+	if ( cmd.exec ( ) && ( sqlite3_changes ( g_db ) > 0 ) )
+		database_UpdateRankTree ( Namespace, EntryName, EntryValue );
 }
 
 //*****************************************************************************
@@ -368,11 +987,18 @@ void DATABASE_SetEntry ( const char *Namespace, const char *EntryName, const cha
 	if ( DATABASE_IsAvailable ( "DATABASE_SetEntry" ) == false )
 		return;
 
-	DataBaseCommand cmd ( "UPDATE "TABLENAME" SET Value=?3,Timestamp=("TIMEQUERY") WHERE Namespace=?1 AND KeyName=?2" );
+	if ( database_IsWritingBehind() )
+	{
+		database_QueueWrite ( DBW_SETENTRY, Namespace, EntryName, EntryValue, DATABASE_EntryExists ( Namespace, EntryName ) );
+		return;
+	}
+
+	DataBaseCommand cmd ( SETENTRYQUERY );
 	cmd.bindString ( 1, Namespace );
 	cmd.bindString ( 2, EntryName );
 	cmd.bindString ( 3, EntryValue );
-	cmd.exec ( );
+	if ( cmd.exec ( ) && ( sqlite3_changes ( g_db ) > 0 ) )
+		database_UpdateRankTree ( Namespace, EntryName, EntryValue );
 }
 
 //*****************************************************************************
@@ -382,6 +1008,10 @@ FString DATABASE_GetEntry ( const char *Namespace, const char *EntryName )
 	if ( DATABASE_IsAvailable ( "DATABASE_GetEntry" ) == false )
 		return "";
 
+	const PENDINGENTRY_t *pendingEntry = database_FindPendingEntry ( Namespace, EntryName );
+	if ( pendingEntry != NULL )
+		return pendingEntry->Value;
+
 	DataBaseCommand cmd ( "SELECT * FROM "TABLENAME" WHERE Namespace=?1 AND KeyName=?2" );
 	cmd.bindString ( 1, Namespace );
 	cmd.bindString ( 2, EntryName );
@@ -400,6 +1030,10 @@ bool DATABASE_EntryExists ( const char *Namespace, const char *EntryName )
 	if ( DATABASE_IsAvailable ( "DATABASE_GetEntry" ) == false )
 		return "";
 
+	const PENDINGENTRY_t *pendingEntry = database_FindPendingEntry ( Namespace, EntryName );
+	if ( pendingEntry != NULL )
+		return ( pendingEntry->bDeleted == false );
+
 	DataBaseCommand cmd ( "SELECT * FROM "TABLENAME" WHERE Namespace=?1 AND KeyName=?2" );
 	cmd.bindString ( 1, Namespace );
 	cmd.bindString ( 2, EntryName );
@@ -414,10 +1048,17 @@ void DATABASE_DeleteEntry ( const char *Namespace, const char *EntryName )
 	if ( DATABASE_IsAvailable ( "DATABASE_DeleteEntry" ) == false )
 		return;
 
-	DataBaseCommand cmd ( "DELETE FROM "TABLENAME" WHERE Namespace=?1 AND KeyName=?2" );
+	if ( database_IsWritingBehind() )
+	{
+		database_QueueWrite ( DBW_DELETEENTRY, Namespace, EntryName, "", true );
+		return;
+	}
+
+	DataBaseCommand cmd ( DELETEENTRYQUERY );
 	cmd.bindString ( 1, Namespace );
 	cmd.bindString ( 2, EntryName );
-	cmd.exec ( );
+	if ( cmd.exec ( ) )
+		database_UpdateRankTree ( Namespace, EntryName, NULL );
 }
 
 //*****************************************************************************
@@ -470,14 +1111,26 @@ void DATABASE_SaveIncrementEntryInt ( const char *Namespace, const char *EntryNa
 		return;
 
 	FString newVal;
-	if ( DATABASE_EntryExists ( Namespace, EntryName ) )
+	if ( database_IsWritingBehind() )
+	{
+		// The writer thread may not have committed the old value yet, so the new value is computed here.
+		const bool entryExists = DATABASE_EntryExists ( Namespace, EntryName );
+		newVal.AppendFormat ( "%d", ( entryExists ? atoi ( DATABASE_GetEntry ( Namespace, EntryName ).GetChars() ) : 0 ) + Increment );
+		database_QueueWrite ( entryExists ? DBW_SETENTRY : DBW_ADDENTRY, Namespace, EntryName, newVal.GetChars(), entryExists );
+	}
+	else if ( DATABASE_EntryExists ( Namespace, EntryName ) )
 	{
 		// [BB] Get the old value and set the incremented value in a single query.
-		DataBaseCommand cmd ( "UPDATE "TABLENAME" SET Value=(SELECT CAST(Value AS INTEGER) FROM "TABLENAME" WHERE Namespace=?1 AND KeyName=?2)+?3,Timestamp=("TIMEQUERY") WHERE Namespace=?1 AND KeyName=?2" );
+		DataBaseCommand cmd ( "UPDATE "TABLENAME" SET Value="INTVALUE"+?3,Timestamp=("TIMEQUERY") WHERE Namespace=?1 AND KeyName=?2" );
 		cmd.bindString ( 1, Namespace );
 		cmd.bindString ( 2, EntryName );
 		cmd.bindInt ( 3, Increment );
-		cmd.exec ( );
+
+		// A rank tree of the namespace already knows the old value.
+		RankTree *tree = database_FindRankTree ( Namespace );
+		int oldValue;
+		if ( cmd.exec ( ) && ( tree != NULL ) && tree->GetValue ( EntryName, oldValue ) )
+			tree->SetValue ( EntryName, oldValue + Increment );
 	}
 	else
 	{
@@ -493,19 +1146,31 @@ int DATABASE_GetEntryRank ( const char *Namespace, const char *EntryName, const
 	if ( DATABASE_IsAvailable ( "DATABASE_GetEntryRank" ) == false )
 		return -1;
 
+	// The rank tree already includes the queued writes, so there's no need to wait for them.
+	if ( database_rankcache > 0 )
+	{
+		RankTree *tree = database_GetRankTree ( Namespace );
+		int value;
+		if ( tree->GetValue ( EntryName, value ) == false )
+			return -1;
+
+		return ( Descending ? tree->CountHigher ( value ) : tree->CountLower ( value ) ) + 1;
+	}
+
+	database_FlushWrites ( );
+
 	if ( DATABASE_EntryExists ( Namespace, EntryName ) )
 	{
 		// [BB] To get the rank of a certain entry, we get the value of the entry,
 		// count how many values are lower (or higher) than the value and return
 		// the count + 1.
 		FString commandString;
-		commandString.Format ( "SELECT COUNT(*) from "TABLENAME" WHERE Namespace=?1 AND CAST(Value AS INTEGER)" );
+		commandString.Format ( "SELECT COUNT(*) from "TABLENAME" WHERE Namespace=?1 AND "INTVALUE );
 		commandString += Descending ? ">" : "<";
-		commandString += ( "(SELECT CAST(Value AS INTEGER) FROM "TABLENAME" WHERE Namespace=?2 AND KeyName=?3)" );
+		commandString += ( "(SELECT "INTVALUE" FROM "TABLENAME" WHERE Namespace=?1 AND KeyName=?2)" );
 		DataBaseCommand cmd ( commandString.GetChars() );
 		cmd.bindString ( 1, Namespace );
-		cmd.bindString ( 2, Namespace );
-		cmd.bindString ( 3, EntryName );
+		cmd.bindString ( 2, EntryName );
 		cmd.step( );
 		const int res = cmd.getInteger(0) + 1 ;
 		return res;
@@ -526,8 +1191,10 @@ int DATABASE_GetSortedEntries ( const char *Namespace, const int N, const int Of
 		return 0;
 	}
 
+	database_FlushWrites ( );
+
 	FString commandString;
-	commandString.Format ( "SELECT * from "TABLENAME" WHERE Namespace=?1 ORDER BY CAST(Value AS INTEGER) " );
+	commandString.Format ( "SELECT * from "TABLENAME" WHERE Namespace=?1 ORDER BY "INTVALUE" " );
 	commandString += Descending ? "DESC" : "ASC";
 	commandString += " LIMIT ?2 OFFSET ?3";
 	DataBaseCommand cmd ( commandString.GetChars() );
@@ -548,6 +1215,8 @@ int DATABASE_GetEntries ( const char *Namespace, TArray<std::pair<FString, FStri
 		return 0;
 	}
 
+	database_FlushWrites ( );
+
 	DataBaseCommand cmd ( "SELECT * from "TABLENAME" WHERE Namespace=?1" );
 	cmd.bindString ( 1, Namespace );
 	cmd.iterateAndGetReturnedEntries ( Entries );
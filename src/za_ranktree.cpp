@@ -0,0 +1,292 @@
+//-----------------------------------------------------------------------------
+//
+// Zandronum Source
+// Copyright (C) 2015 Zandronum Development Team
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the Zandronum Development Team nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+// 4. Redistributions in any form must be accompanied by information on how to
+//    obtain complete source code for the software and any accompanying
+//    software that uses the software. The source code must either be included
+//    in the distribution or be available for no more than the cost of
+//    distribution plus a nominal fee, and must be freely redistributable
+//    under reasonable conditions. For an executable file, complete source
+//    code means the source code for all modules it contains. It does not
+//    include source code for modules or files that typically accompany the
+//    major components of the operating system on which the executable file
+//    runs.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//
+//
+// Filename: za_ranktree.cpp
+//
+//-----------------------------------------------------------------------------
+
+#include "za_ranktree.h"
+
+//*****************************************************************************
+//	FUNCTIONS
+
+RankTree::RankTree ( )
+	: _root ( -1 ),
+	  _seed ( 0x9E3779B9 )
+{
+}
+
+//*****************************************************************************
+//
+void RankTree::Clear ( )
+{
+	_nodes.Clear ( );
+	_freeNodes.Clear ( );
+	_keyNodes.Clear ( );
+	_root = -1;
+}
+
+//*****************************************************************************
+//
+void RankTree::SetValue ( const char *Key, const int Value )
+{
+	int nodeIndex;
+	int *existingNode = _keyNodes.CheckKey ( Key );
+
+	if ( existingNode != NULL )
+	{
+		nodeIndex = *existingNode;
+		if ( _nodes[nodeIndex].Value == Value )
+			return;
+
+		_root = remove ( _root, nodeIndex );
+	}
+	else if ( _freeNodes.Pop ( nodeIndex ) == false )
+	{
+		Node newNode;
+		nodeIndex = _nodes.Push ( newNode );
+	}
+
+	// The priorities only need to look random, xorshift is good enough.
+	_seed ^= _seed << 13;
+	_seed ^= _seed >> 17;
+	_seed ^= _seed << 5;
+
+	Node &node = _nodes[nodeIndex];
+	node.Value = Value;
+	node.Priority = _seed;
+	node.Left = -1;
+	node.Right = -1;
+	node.Size = 1;
+	_keyNodes[Key] = nodeIndex;
+	_root = insert ( _root, nodeIndex );
+}
+
+//*****************************************************************************
+//
+bool RankTree::GetValue ( const char *Key, int &Value ) const
+{
+	const int *nodeIndex = _keyNodes.CheckKey ( Key );
+	if ( nodeIndex == NULL )
+		return false;
+
+	Value = _nodes[*nodeIndex].Value;
+	return true;
+}
+
+//*****************************************************************************
+//
+void RankTree::RemoveKey ( const char *Key )
+{
+	const int *nodeIndex = _keyNodes.CheckKey ( Key );
+	if ( nodeIndex == NULL )
+		return;
+
+	_root = remove ( _root, *nodeIndex );
+	_freeNodes.Push ( *nodeIndex );
+	_keyNodes.Remove ( Key );
+}
+
+//*****************************************************************************
+//
+unsigned int RankTree::Size ( ) const
+{
+	return subtreeSize ( _root );
+}
+
+//*****************************************************************************
+//
+unsigned int RankTree::CountLower ( const int Value ) const
+{
+	unsigned int count = 0;
+	int nodeIndex = _root;
+
+	while ( nodeIndex != -1 )
+	{
+		const Node &node = _nodes[nodeIndex];
+		if ( node.Value < Value )
+		{
+			count += subtreeSize ( node.Left ) + 1;
+			nodeIndex = node.Right;
+		}
+		else
+			nodeIndex = node.Left;
+	}
+
+	return count;
+}
+
+//*****************************************************************************
+//
+unsigned int RankTree::CountHigher ( const int Value ) const
+{
+	unsigned int count = 0;
+	int nodeIndex = _root;
+
+	while ( nodeIndex != -1 )
+	{
+		const Node &node = _nodes[nodeIndex];
+		if ( node.Value > Value )
+		{
+			count += subtreeSize ( node.Right ) + 1;
+			nodeIndex = node.Left;
+		}
+		else
+			nodeIndex = node.Right;
+	}
+
+	return count;
+}
+
+//*****************************************************************************
+//
+unsigned int RankTree::subtreeSize ( const int NodeIndex ) const
+{
+	return ( NodeIndex != -1 ) ? _nodes[NodeIndex].Size : 0;
+}
+
+//*****************************************************************************
+//
+bool RankTree::isLess ( const int A, const int B ) const
+{
+	if ( _nodes[A].Value != _nodes[B].Value )
+		return ( _nodes[A].Value < _nodes[B].Value );
+
+	return ( A < B );
+}
+
+//*****************************************************************************
+//
+void RankTree::update ( const int NodeIndex )
+{
+	Node &node = _nodes[NodeIndex];
+	node.Size = subtreeSize ( node.Left ) + subtreeSize ( node.Right ) + 1;
+}
+
+//*****************************************************************************
+//
+// Splits the subtree at Root into the nodes that are less than Pivot and the rest.
+void RankTree::split ( const int Root, const int Pivot, int &Left, int &Right )
+{
+	if ( Root == -1 )
+	{
+		Left = Right = -1;
+		return;
+	}
+
+	if ( isLess ( Root, Pivot ) )
+	{
+		split ( _nodes[Root].Right, Pivot, _nodes[Root].Right, Right );
+		Left = Root;
+	}
+	else
+	{
+		split ( _nodes[Root].Left, Pivot, Left, _nodes[Root].Left );
+		Right = Root;
+	}
+
+	update ( Root );
+}
+
+//*****************************************************************************
+//
+// All nodes of Left have to be less than the nodes of Right.
+int RankTree::merge ( const int Left, const int Right )
+{
+	if ( Left == -1 )
+		return Right;
+	if ( Right == -1 )
+		return Left;
+
+	if ( _nodes[Left].Priority > _nodes[Right].Priority )
+	{
+		_nodes[Left].Right = merge ( _nodes[Left].Right, Right );
+		update ( Left );
+		return Left;
+	}
+	else
+	{
+		_nodes[Right].Left = merge ( Left, _nodes[Right].Left );
+		update ( Right );
+		return Right;
+	}
+}
+
+//*****************************************************************************
+//
+int RankTree::insert ( const int Root, const int NodeIndex )
+{
+	if ( Root == -1 )
+		return NodeIndex;
+
+	if ( _nodes[NodeIndex].Priority > _nodes[Root].Priority )
+	{
+		split ( Root, NodeIndex, _nodes[NodeIndex].Left, _nodes[NodeIndex].Right );
+		update ( NodeIndex );
+		return NodeIndex;
+	}
+
+	if ( isLess ( NodeIndex, Root ) )
+		_nodes[Root].Left = insert ( _nodes[Root].Left, NodeIndex );
+	else
+		_nodes[Root].Right = insert ( _nodes[Root].Right, NodeIndex );
+
+	update ( Root );
+	return Root;
+}
+
+//*****************************************************************************
+//
+int RankTree::remove ( const int Root, const int NodeIndex )
+{
+	if ( Root == NodeIndex )
+		return merge ( _nodes[Root].Left, _nodes[Root].Right );
+
+	if ( isLess ( NodeIndex, Root ) )
+		_nodes[Root].Left = remove ( _nodes[Root].Left, NodeIndex );
+	else
+		_nodes[Root].Right = remove ( _nodes[Root].Right, NodeIndex );
+
+	update ( Root );
+	return Root;
+}
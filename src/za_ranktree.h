@@ -0,0 +1,102 @@
+//-----------------------------------------------------------------------------
+//
+// Zandronum Source
+// Copyright (C) 2015 Zandronum Development Team
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 3. Neither the name of the Zandronum Development Team nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+// 4. Redistributions in any form must be accompanied by information on how to
+//    obtain complete source code for the software and any accompanying
+//    software that uses the software. The source code must either be included
+//    in the distribution or be available for no more than the cost of
+//    distribution plus a nominal fee, and must be freely redistributable
+//    under reasonable conditions. For an executable file, complete source
+//    code means the source code for all modules it contains. It does not
+//    include source code for modules or files that typically accompany the
+//    major components of the operating system on which the executable file
+//    runs.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//
+//
+// Filename: za_ranktree.h
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __ZA_RANKTREE_H__
+#define __ZA_RANKTREE_H__
+
+#include "tarray.h"
+#include "zstring.h"
+
+//*****************************************************************************
+//	CLASSES
+
+/**
+ * \brief Keeps the integer values of a set of keys sorted, so that the rank of a value can be determined in O(log n).
+ *
+ * The nodes form a treap, each node knows the size of its subtree. Nodes with equal values are ordered by their index.
+ */
+class RankTree
+{
+public:
+	RankTree ( );
+
+	void			Clear ( );
+	void			SetValue ( const char *Key, const int Value );
+	bool			GetValue ( const char *Key, int &Value ) const;
+	void			RemoveKey ( const char *Key );
+	unsigned int	Size ( ) const;
+
+	// Number of keys whose value is lower (or higher) than Value.
+	unsigned int	CountLower ( const int Value ) const;
+	unsigned int	CountHigher ( const int Value ) const;
+
+private:
+	struct Node
+	{
+		int				Value;
+		unsigned int	Priority;
+		int				Left;
+		int				Right;
+		unsigned int	Size;
+	};
+
+	TArray<Node>		_nodes;
+	TArray<int>			_freeNodes;
+	TMap<FString, int>	_keyNodes;
+	int					_root;
+	unsigned int		_seed;
+
+	unsigned int	subtreeSize ( const int NodeIndex ) const;
+	bool			isLess ( const int A, const int B ) const;
+	void			update ( const int NodeIndex );
+	void			split ( const int Root, const int Pivot, int &Left, int &Right );
+	int				merge ( const int Left, const int Right );
+	int				insert ( const int Root, const int NodeIndex );
+	int				remove ( const int Root, const int NodeIndex );
+};
+
+#endif	// __ZA_RANKTREE_H__